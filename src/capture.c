@@ -0,0 +1,411 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** capture.c
+**
+** Continuous video and sound capture, written out on a thread of its own
+** $Id$
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <noftypes.h>
+#include <log.h>
+#include <osd.h>
+#include <bitmap.h>
+#include <thread.h>
+#include <wav.h>
+#include <y4m.h>
+#include <nes.h>
+#include <capture.h>
+
+/* Each frame goes into a slot of the queue: its picture, the palette it
+** was drawn in, and the sound made with it.  Emulation fills slots and
+** the writer empties them, so the head and tail are all they share; the
+** monitor only wakes whichever is waiting on the other.
+*/
+typedef struct capslot_s
+{
+   bool drawn;                /* else the last picture again */
+   int dropped;               /* frames before this one with no room */
+   uint32 silence;            /* and the samples of sound they made */
+   int num_samples;
+   uint8 *samples;
+   bitmap_t *bmp;
+   uint8 *pixels;
+   rgb_t palette[256];
+} capslot_t;
+
+static struct
+{
+   bool on;
+   int policy;
+   int num_slots;
+   capslot_t *slots;
+   uint32 head, tail;         /* head is emulation's, tail the writer's */
+   capslot_t *filling;        /* this frame's slot, once it has one */
+   int max_samples;           /* room in a slot */
+   int sample_bytes;
+   int dropped_frames;        /* not yet told to the writer */
+   uint32 dropped_samples;
+   bool stopping;             /* under the monitor */
+   bool failed;               /* the writer's */
+   monitor_t *bell;
+   thread_t *writer;
+   y4m_t *y4m;
+   wav_t *wav;
+   uint8 *silence;            /* max_samples of it */
+   capstats_t stats;
+} cap;
+
+#ifdef __GNUC__
+#define  CAP_LOAD(x)          __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define  CAP_STORE(x, v)      __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#else /* !__GNUC__ */
+#define  CAP_LOAD(x)          (*(volatile uint32 *) &(x))
+#define  CAP_STORE(x, v)      (*(volatile uint32 *) &(x) = (v))
+#endif /* !__GNUC__ */
+
+/* frames left out stand as the last picture again, and their sound as
+** silence, so the two files keep time with each other
+*/
+static int cap_writedropped(int frames, uint32 samples)
+{
+   int count;
+
+   for (; frames; frames--)
+   {
+      if (y4m_repeat(cap.y4m))
+         return -1;
+   }
+
+   for (; samples; samples -= count)
+   {
+      count = (samples > (uint32) cap.max_samples) ? cap.max_samples : (int) samples;
+      if (wav_write(cap.wav, cap.silence, count))
+         return -1;
+   }
+
+   return 0;
+}
+
+/* the writer's side: whatever was left out, then the frame itself */
+static int cap_writeslot(capslot_t *slot)
+{
+   if (cap_writedropped(slot->dropped, slot->silence))
+      return -1;
+
+   if (slot->drawn)
+   {
+      if (y4m_write(cap.y4m, slot->bmp, slot->palette))
+         return -1;
+   }
+   else if (y4m_repeat(cap.y4m))
+   {
+      return -1;
+   }
+
+   return wav_write(cap.wav, slot->samples, slot->num_samples);
+}
+
+/* writes slots out as they come, until stopped with none left; after a
+** failure it carries on emptying them, so emulation is never held up
+*/
+static int cap_writer(void *arg)
+{
+   capslot_t *slot;
+   bool done;
+
+   UNUSED(arg);
+
+   for (;;)
+   {
+      monitor_enter(cap.bell);
+      while (CAP_LOAD(cap.head) == cap.tail && false == cap.stopping)
+         monitor_wait(cap.bell);
+      done = (CAP_LOAD(cap.head) == cap.tail);
+      monitor_leave(cap.bell);
+
+      if (done)
+         break;
+
+      slot = &cap.slots[cap.tail % cap.num_slots];
+      if (false == cap.failed && cap_writeslot(slot))
+      {
+         log_printf("capture: error writing, the rest is lost\n");
+         cap.failed = true;
+      }
+
+      monitor_enter(cap.bell);
+      CAP_STORE(cap.tail, cap.tail + 1);
+      monitor_notify(cap.bell);
+      monitor_leave(cap.bell);
+   }
+
+   return cap.failed ? -1 : 0;
+}
+
+static void cap_free(void)
+{
+   int i;
+
+   if (cap.slots)
+   {
+      for (i = 0; i < cap.num_slots; i++)
+      {
+         bmp_destroy(&cap.slots[i].bmp);
+         if (cap.slots[i].pixels)
+            free(cap.slots[i].pixels);
+         if (cap.slots[i].samples)
+            free(cap.slots[i].samples);
+      }
+
+      free(cap.slots);
+   }
+
+   if (cap.silence)
+      free(cap.silence);
+
+   y4m_close(&cap.y4m);
+   wav_close(&cap.wav);
+   monitor_destroy(&cap.bell);
+}
+
+/* capture to basename.y4m and basename.wav, queueing up to queue_frames
+** for the writer; the sound is as the apu makes it
+*/
+int capture_start(const char *basename, int sample_rate, int sample_bits,
+                  int policy, int queue_frames)
+{
+   char filename[PATH_MAX];
+   capslot_t *slot;
+   int i;
+
+   ASSERT(false == cap.on);
+
+   memset(&cap, 0, sizeof(cap));
+   cap.policy = policy;
+   cap.num_slots = (queue_frames > 1) ? queue_frames : 2;
+   cap.sample_bytes = sample_bits / 8;
+
+   /* the device sink bends the rate a little, so leave room to spare */
+   cap.max_samples = (sample_rate / NES_REFRESH_RATE + 1) * 2;
+
+   cap.slots = malloc(cap.num_slots * sizeof(capslot_t));
+   if (NULL == cap.slots)
+      goto _fail;
+   memset(cap.slots, 0, cap.num_slots * sizeof(capslot_t));
+
+   for (i = 0; i < cap.num_slots; i++)
+   {
+      slot = &cap.slots[i];
+      slot->pixels = malloc(NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT);
+      slot->samples = malloc(cap.max_samples * cap.sample_bytes);
+      if (NULL == slot->pixels || NULL == slot->samples)
+         goto _fail;
+
+      slot->bmp = bmp_createhw(slot->pixels, NES_SCREEN_WIDTH, NES_SCREEN_HEIGHT,
+                               NES_SCREEN_WIDTH);
+      if (NULL == slot->bmp)
+         goto _fail;
+   }
+
+   cap.silence = malloc(cap.max_samples * cap.sample_bytes);
+   if (NULL == cap.silence)
+      goto _fail;
+   memset(cap.silence, (8 == sample_bits) ? 0x80 : 0, cap.max_samples * cap.sample_bytes);
+
+   cap.bell = monitor_create();
+   if (NULL == cap.bell)
+      goto _fail;
+
+   snprintf(filename, sizeof(filename), "%s.y4m", basename);
+   cap.y4m = y4m_open(filename, NES_SCREEN_WIDTH, NES_SCREEN_HEIGHT, NES_REFRESH_RATE);
+   if (NULL == cap.y4m)
+      goto _fail;
+
+   snprintf(filename, sizeof(filename), "%s.wav", basename);
+   cap.wav = wav_open(filename, sample_rate, sample_bits);
+   if (NULL == cap.wav)
+      goto _fail;
+
+   cap.writer = thread_create(cap_writer, NULL);
+   if (NULL == cap.writer)
+      goto _fail;
+
+   cap.on = true;
+   log_printf("capture: to %s.y4m and .wav, %d frames queued at most, %s when full\n",
+              basename, cap.num_slots, (CAPTURE_DROP == policy) ? "dropping" : "blocking");
+
+   return 0;
+
+_fail:
+   log_printf("capture: could not start capturing to %s\n", basename);
+   cap_free();
+   return -1;
+}
+
+/* let the writer finish what's queued, and close up */
+void capture_stop(void)
+{
+   int retval;
+
+   if (false == cap.on)
+      return;
+
+   /* a frame only half made never happened */
+   cap.filling = NULL;
+
+   monitor_enter(cap.bell);
+   cap.stopping = true;
+   monitor_notify(cap.bell);
+   monitor_leave(cap.bell);
+
+   retval = thread_join(&cap.writer);
+
+   /* and any left out since the last one queued */
+   if (0 == retval && cap_writedropped(cap.dropped_frames, cap.dropped_samples))
+      retval = -1;
+
+   if (y4m_close(&cap.y4m) || wav_close(&cap.wav))
+      retval = -1;
+   if (retval)
+      cap.stats.failed = true;
+
+   log_printf("capture: %u frames, %u dropped, %u waits for %u ms, %d queued at most%s\n",
+              cap.stats.frames, cap.stats.dropped, cap.stats.waits,
+              cap.stats.wait_usecs / 1000, cap.stats.max_queued,
+              cap.stats.failed ? ", and failed" : "");
+
+   cap_free();
+   cap.on = false;
+}
+
+bool capture_active(void)
+{
+   return cap.on;
+}
+
+/* the slot this frame goes into, waiting for one or giving up on it as
+** the policy says
+*/
+static capslot_t *cap_getslot(void)
+{
+   capslot_t *slot;
+   uint32 start;
+
+   if (cap.filling)
+      return cap.filling;
+
+   if (cap.head - CAP_LOAD(cap.tail) >= (uint32) cap.num_slots)
+   {
+      if (CAPTURE_DROP == cap.policy)
+         return NULL;
+
+      start = osd_get_usecs();
+
+      monitor_enter(cap.bell);
+      while (cap.head - CAP_LOAD(cap.tail) >= (uint32) cap.num_slots)
+         monitor_wait(cap.bell);
+      monitor_leave(cap.bell);
+
+      cap.stats.waits++;
+      cap.stats.wait_usecs += osd_get_usecs() - start;
+   }
+
+   slot = &cap.slots[cap.head % cap.num_slots];
+   slot->drawn = false;
+   slot->dropped = cap.dropped_frames;
+   slot->silence = cap.dropped_samples;
+   slot->num_samples = 0;
+   cap.dropped_frames = 0;
+   cap.dropped_samples = 0;
+
+   cap.filling = slot;
+   return slot;
+}
+
+/* some of this frame's sound */
+void capture_sound(const void *buffer, int num_samples)
+{
+   capslot_t *slot;
+
+   if (false == cap.on)
+      return;
+
+   slot = cap_getslot();
+   if (NULL == slot)
+   {
+      cap.dropped_samples += num_samples;
+      return;
+   }
+
+   if (num_samples > cap.max_samples - slot->num_samples)
+      num_samples = cap.max_samples - slot->num_samples;
+
+   memcpy(slot->samples + slot->num_samples * cap.sample_bytes, buffer,
+          num_samples * cap.sample_bytes);
+   slot->num_samples += num_samples;
+}
+
+/* the frame is done; bmp is NULL if it wasn't drawn.  only the picture
+** and its palette are copied here, the writer does the converting
+*/
+void capture_frame(const bitmap_t *bmp, const rgb_t *pal)
+{
+   capslot_t *slot;
+   int y, queued;
+
+   if (false == cap.on)
+      return;
+
+   slot = cap_getslot();
+   if (NULL == slot)
+   {
+      cap.dropped_frames++;
+      cap.stats.dropped++;
+      return;
+   }
+
+   if (bmp)
+   {
+      for (y = 0; y < NES_SCREEN_HEIGHT; y++)
+         memcpy(slot->bmp->line[y], bmp->line[y], NES_SCREEN_WIDTH);
+      memcpy(slot->palette, pal, sizeof(slot->palette));
+      slot->drawn = true;
+   }
+
+   cap.filling = NULL;
+   CAP_STORE(cap.head, cap.head + 1);
+   cap.stats.frames++;
+
+   queued = (int) (cap.head - CAP_LOAD(cap.tail));
+   if (queued > cap.stats.max_queued)
+      cap.stats.max_queued = queued;
+
+   monitor_enter(cap.bell);
+   monitor_notify(cap.bell);
+   monitor_leave(cap.bell);
+}
+
+void capture_getstats(capstats_t *stats)
+{
+   *stats = cap.stats;
+}
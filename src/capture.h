@@ -0,0 +1,61 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** capture.h
+**
+** Continuous video and sound capture, written out on a thread of its own
+** $Id$
+*/
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <noftypes.h>
+#include <bitmap.h>
+
+#define  CAPTURE_QUEUE        120   /* frames the writer may fall behind */
+
+/* what to do when the writer has fallen that far behind */
+enum
+{
+   CAPTURE_BLOCK,       /* emulation waits for it, and nothing is lost */
+   CAPTURE_DROP         /* leave frames out, as repeats and silence */
+};
+
+typedef struct capstats_s
+{
+   uint32 frames;       /* queued to be written */
+   uint32 dropped;      /* left out for want of room */
+   uint32 waits;        /* times emulation waited for room */
+   uint32 wait_usecs;
+   int max_queued;
+   bool failed;         /* the writer couldn't write */
+} capstats_t;
+
+extern int capture_start(const char *basename, int sample_rate, int sample_bits,
+                         int policy, int queue_frames);
+extern void capture_stop(void);
+extern bool capture_active(void);
+
+extern void capture_sound(const void *buffer, int num_samples);
+extern void capture_frame(const bitmap_t *bmp, const rgb_t *pal);
+
+extern void capture_getstats(capstats_t *stats);
+
+#endif /* _CAPTURE_H_ */
@@ -28,8 +28,6 @@
 #include "nes6502.h"
 #include "dis6502.h"
 
-#ifdef NES6502_DEBUG
-
 /* addressing modes */
 enum 
 { 
@@ -58,15 +56,28 @@ static uint32 pc_reg;
 */
 static char disasm_buf[256];
 
+/* the bytes of the instruction, if they were handed to us; otherwise
+** they're read from wherever the cpu has them mapped
+*/
+static const uint8 *code_bytes = NULL;
+
+
+static uint8 dis_getbyte(int offset)
+{
+   if (code_bytes)
+      return code_bytes[offset];
+
+   return nes6502_getbyte(pc_reg + offset);
+}
 
 static uint8 dis_op8(void)
 {
-   return (nes6502_getbyte(pc_reg + 1));
+   return (dis_getbyte(1));
 }
 
 static uint16 dis_op16(void)
 {
-   return (nes6502_getbyte(pc_reg + 1) + (nes6502_getbyte(pc_reg + 2) << 8));
+   return (dis_getbyte(1) + (dis_getbyte(2) << 8));
 }
 
 static int dis_show_ind(char *buf)
@@ -135,7 +146,7 @@ static int dis_show_relative(char *buf)
 
 static int dis_show_code(char *buf, int optype)
 {
-   char *dest = buf + sprintf(buf, "%02X ", nes6502_getbyte(pc_reg));
+   char *dest = buf + sprintf(buf, "%02X ", dis_getbyte(0));
 
    switch (optype)
    {
@@ -151,14 +162,14 @@ static int dis_show_code(char *buf, int optype)
    case _zero_y:
    case _ind_y:
    case _ind_x:
-      dest += sprintf(dest, "%02X    ", nes6502_getbyte(pc_reg + 1));
+      dest += sprintf(dest, "%02X    ", dis_getbyte(1));
       break;
 
    case _abs:
    case _abs_x:
    case _abs_y:
    case _ind:
-      dest += sprintf(dest, "%02X %02X ", nes6502_getbyte(pc_reg + 1), nes6502_getbyte(pc_reg + 2));
+      dest += sprintf(dest, "%02X %02X ", dis_getbyte(1), dis_getbyte(2));
       break;
    }
 
@@ -192,17 +203,13 @@ static int dis_show_op(char *buf, char *opstr, int optype)
    return (int) (dest - buf);
 }
 
-char *nes6502_disasm(uint32 PC, uint8 P, uint8 A, uint8 X, uint8 Y, uint8 S)
+/* the mnemonic for an opcode, and its addressing mode */
+static int dis_decode(uint8 opcode, char **opstr)
 {
-   char *buf = disasm_buf;
    char *op;
    int type;
 
-   pc_reg = PC;
-
-   buf += sprintf(buf, "%04X: ", pc_reg);
-
-   switch (nes6502_getbyte(pc_reg))
+   switch (opcode)
    {
    case 0x00: op = "brk"; type = _imp;    break;
    case 0x01: op = "ora"; type = _ind_x;  break;
@@ -477,8 +484,33 @@ char *nes6502_disasm(uint32 PC, uint8 P, uint8 A, uint8 X, uint8 Y, uint8 S)
    case 0xff: op = "isb"; type = _abs_x;  break;
    }
 
+   *opstr = op;
+   return type;
+}
+
+/* the instruction at pc_reg */
+static char *dis_instr(char *buf)
+{
+   char *op;
+   int type;
+
+   buf += sprintf(buf, "%04X: ", pc_reg);
+
+   type = dis_decode(dis_getbyte(0), &op);
    buf += dis_show_op(buf, op, type);
 
+   return buf;
+}
+
+char *nes6502_disasm(uint32 PC, uint8 P, uint8 A, uint8 X, uint8 Y, uint8 S)
+{
+   char *buf;
+
+   pc_reg = PC;
+   code_bytes = NULL;
+
+   buf = dis_instr(disasm_buf);
+
    buf += sprintf(buf, "%c%c1%c%c%c%c%c %02X %02X %02X %02X\n",
       (P & N_FLAG) ? 'N' : '.',
       (P & V_FLAG) ? 'V' : '.',
@@ -492,7 +524,41 @@ char *nes6502_disasm(uint32 PC, uint8 P, uint8 A, uint8 X, uint8 Y, uint8 S)
    return disasm_buf;
 }
 
-#endif /* NES6502_DEBUG */
+/* the instruction in code[], as though it were at PC; for code that
+** isn't mapped in, or has since been banked out
+*/
+char *nes6502_disasm_code(uint32 PC, const uint8 *code)
+{
+   pc_reg = PC;
+   code_bytes = code;
+
+   dis_instr(disasm_buf);
+   code_bytes = NULL;
+
+   return disasm_buf;
+}
+
+/* how many bytes an instruction takes, opcode and all */
+int nes6502_oplength(uint8 opcode)
+{
+   char *op;
+
+   switch (dis_decode(opcode, &op))
+   {
+   case _imp:
+   case _acc:
+      return 1;
+
+   case _abs:
+   case _abs_x:
+   case _abs_y:
+   case _ind:
+      return 3;
+
+   default:
+      return 2;
+   }
+}
 
 /*
 ** $Log: dis6502.c,v $
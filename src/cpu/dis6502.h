@@ -31,6 +31,8 @@ extern "C" {
 #endif /* __cplusplus */
 
 extern char *nes6502_disasm(uint32 PC, uint8 P, uint8 A, uint8 X, uint8 Y, uint8 S);
+extern char *nes6502_disasm_code(uint32 PC, const uint8 *code);
+extern int nes6502_oplength(uint8 opcode);
 
 #ifdef __cplusplus
 }
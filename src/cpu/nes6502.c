@@ -27,13 +27,53 @@
 #include <noftypes.h>
 #include "nes6502.h"
 #include "dis6502.h"
-
-//#define  NES6502_DISASM
+#include "prof6502.h"
+#include "trace6502.h"
 
 #ifdef __GNUC__
 #define  NES6502_JUMPTABLE
 #endif /* __GNUC__ */
 
+/* the profiler's hooks, which are nothing at all unless it's built in */
+#ifdef NES6502_PROFILE
+
+#define  PROFILE_INSN() \
+   prof6502_insn(PC, cpu.mem_page[PC >> NES6502_BANKSHIFT], cpu.total_cycles)
+#define  PROFILE_CALL() \
+   prof6502_call(PC, cpu.mem_page[PC >> NES6502_BANKSHIFT], S, cpu.total_cycles)
+#define  PROFILE_RETURN() \
+   prof6502_return(S, cpu.total_cycles)
+#define  PROFILE_INTERRUPT(kind) \
+   prof6502_interrupt((kind), PC, cpu.mem_page[PC >> NES6502_BANKSHIFT], S, cpu.total_cycles)
+#define  PROFILE_HANDLER(index, write) \
+   prof6502_handler((index), (write))
+
+#else /* !NES6502_PROFILE */
+
+#define  PROFILE_INSN()
+#define  PROFILE_CALL()
+#define  PROFILE_RETURN()
+#define  PROFILE_INTERRUPT(kind)
+#define  PROFILE_HANDLER(index, write)
+
+#endif /* !NES6502_PROFILE */
+
+/* and the tracer's, a record of each instruction as it's fetched */
+#ifdef NES6502_TRACE
+
+#define  TRACE_INSN() \
+{ \
+   if (trace6502.records) \
+      trace6502_insn(PC, trace_code(PC), A, X, Y, S, COMBINE_FLAGS(), \
+                     cpu.total_cycles); \
+}
+
+#else /* !NES6502_TRACE */
+
+#define  TRACE_INSN()
+
+#endif /* !NES6502_TRACE */
+
 
 #define  ADD_CYCLES(x) \
 { \
@@ -307,6 +347,7 @@
    PUSH(COMBINE_FLAGS()); \
    i_flag = 1; \
    JUMP(NMI_VECTOR); \
+   PROFILE_INTERRUPT(PROF6502_NMI); \
 }
 
 #define IRQ_PROC() \
@@ -317,6 +358,7 @@
    PUSH(COMBINE_FLAGS()); \
    i_flag = 1; \
    JUMP(IRQ_VECTOR); \
+   PROFILE_INTERRUPT(PROF6502_IRQ); \
 }
 
 /*
@@ -523,6 +565,7 @@
    PUSH(COMBINE_FLAGS()); \
    i_flag = 1; \
    JUMP(IRQ_VECTOR); \
+   PROFILE_INTERRUPT(PROF6502_BRK); \
    ADD_CYCLES(7); \
 }
 
@@ -714,6 +757,7 @@
    PUSH(PC & 0xFF); \
    JUMP(PC - 1); \
    ADD_CYCLES(6); \
+   PROFILE_CALL(); \
 }
 
 /* undocumented */
@@ -894,6 +938,7 @@
    PC = PULL(); \
    PC |= PULL() << 8; \
    ADD_CYCLES(6); \
+   PROFILE_RETURN(); \
    if (0 == i_flag && cpu.int_pending && remaining_cycles > 0) \
    { \
       cpu.int_pending = 0; \
@@ -907,6 +952,7 @@
    PC = PULL(); \
    PC = (PC | (PULL() << 8)) + 1; \
    ADD_CYCLES(6); \
+   PROFILE_RETURN(); \
 }
 
 /* undocumented */
@@ -1199,6 +1245,22 @@ INLINE void bank_writebyte(register uint32 address, register uint8 value)
    cpu.mem_page[address >> NES6502_BANKSHIFT][address & NES6502_BANKMASK] = value;
 }
 
+#ifdef NES6502_TRACE
+/* an instruction's bytes, in a row even if it runs into the next bank */
+INLINE const uint8 *trace_code(register uint32 address)
+{
+   static uint8 code[3];
+
+   if ((address & NES6502_BANKMASK) < NES6502_BANKMASK - 1)
+      return cpu.mem_page[address >> NES6502_BANKSHIFT] + (address & NES6502_BANKMASK);
+
+   code[0] = bank_readbyte(address);
+   code[1] = bank_readbyte((address + 1) & 0xFFFF);
+   code[2] = bank_readbyte((address + 2) & 0xFFFF);
+   return code;
+}
+#endif /* NES6502_TRACE */
+
 /* read a byte of 6502 memory */
 static uint8 mem_readbyte(uint32 address)
 {
@@ -1221,7 +1283,10 @@ static uint8 mem_readbyte(uint32 address)
       for (mr = cpu.read_handler; mr->min_range != 0xFFFFFFFF; mr++)
       {
          if (address >= mr->min_range && address <= mr->max_range)
+         {
+            PROFILE_HANDLER(mr - cpu.read_handler, false);
             return mr->read_func(address);
+         }
       }
    }
 
@@ -1247,6 +1312,7 @@ static void mem_writebyte(uint32 address, uint8 value)
       {
          if (address >= mw->min_range && address <= mw->max_range)
          {
+            PROFILE_HANDLER(mw - cpu.write_handler, true);
             mw->write_func(address, value);
             return;
          }
@@ -1331,28 +1397,16 @@ uint32 nes6502_getcycles(bool reset_flag)
    cpu.s_reg = S; \
 }
 
-#define  MIN(a,b)    (((a) < (b)) ? (a) : (b))
-
 #ifdef NES6502_JUMPTABLE
 
 #define  OPCODE_BEGIN(xx)  op##xx:
-#ifdef NES6502_DISASM
-
 #define  OPCODE_END \
    if (remaining_cycles <= 0) \
       goto end_execute; \
-   log_printf(nes6502_disasm(PC, COMBINE_FLAGS(), A, X, Y, S)); \
+   TRACE_INSN(); \
+   PROFILE_INSN(); \
    goto *opcode_table[bank_readbyte(PC++)];
 
-#else /* !NES6520_DISASM */
-
-#define  OPCODE_END \
-   if (remaining_cycles <= 0) \
-      goto end_execute; \
-   goto *opcode_table[bank_readbyte(PC++)];
-
-#endif /* !NES6502_DISASM */
-
 #else /* !NES6502_JUMPTABLE */
 #define  OPCODE_BEGIN(xx)  case 0x##xx:
 #define  OPCODE_END        break;
@@ -1450,9 +1504,8 @@ int nes6502_execute(int timeslice_cycles)
    /* Continue until we run out of cycles */
    while (remaining_cycles > 0)
    {
-#ifdef NES6502_DISASM
-      log_printf(nes6502_disasm(PC, COMBINE_FLAGS(), A, X, Y, S));
-#endif /* NES6502_DISASM */
+      TRACE_INSN();
+      PROFILE_INSN();
 
       /* Fetch and execute instruction */
       switch (bank_readbyte(PC++))
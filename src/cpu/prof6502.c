@@ -0,0 +1,830 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** prof6502.c
+**
+** Cycle profiler for the 6502 core
+** $Id$
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <noftypes.h>
+#include <log.h>
+#include <osd.h>
+#include "nes6502.h"
+#include "dis6502.h"
+#include "prof6502.h"
+
+/* Cycles are counted against locations: a byte of PRG-ROM, so the same
+** address in two banks is two places, or else a cpu address for code
+** run from RAM.  Past those come places that aren't code at all: the
+** entry to each kind of interrupt, and each memory handler.
+**
+** Functions are wherever a JSR or an interrupt lands.  A shadow of the
+** cpu stack says which one is running, and what called it; each
+** location belongs to the function it was first run in.
+*/
+enum
+{
+   PSEUDO_MAIN,         /* whatever runs with nothing called */
+   PSEUDO_NMI,
+   PSEUDO_IRQ,
+   PSEUDO_BRK,
+   PSEUDO_READ,
+   PSEUDO_WRITE = PSEUDO_READ + PROF6502_HANDLERS,
+   PSEUDO_COUNT = PSEUDO_WRITE + PROF6502_HANDLERS
+};
+
+/* functions are numbered from 1, and pseudo locations have the first few */
+#define  PSEUDO_FUNC(pseudo)  ((pseudo) + 1)
+#define  MAIN_FUNC            PSEUDO_FUNC(PSEUDO_MAIN)
+
+/* a caller, a call site and what it called */
+typedef struct profarc_s
+{
+   uint64_t key;        /* 0 if free */
+   uint64_t calls;
+   uint64_t cycles;
+} profarc_t;
+
+typedef struct profframe_s
+{
+   int arc;             /* -1 if there was no room for it */
+   uint16 func;
+   uint8 s;             /* cpu stack pointer, return address pushed */
+   bool interrupt;
+   uint64_t entry;      /* the clock, and interrupt time, when called */
+   uint64_t stolen;
+} profframe_t;
+
+static struct
+{
+   bool on;
+   const uint8 *rom;
+   uint32 rom_length;
+   uint32 pseudo;       /* first pseudo location */
+   uint32 num_locs;
+
+   /* per location */
+   uint64_t *cycles;
+   uint32 *insns;
+   uint16 *owner;       /* function first run in */
+   uint16 *func_at;     /* function starting here */
+   uint8 *page;         /* where in the cpu's map it was run */
+
+   uint32 func_entry[PROF6502_MAXFUNCS];
+   int num_funcs;
+   uint32 lost_funcs;
+
+   profarc_t *arcs;
+   int num_arcs;
+   uint32 lost_arcs;
+
+   profframe_t stack[PROF6502_DEPTH];
+   int depth;
+
+   uint32 current;      /* location of the instruction running */
+   int32 last;          /* the core's cycle count, when last looked at */
+   uint64_t clock;
+   uint64_t stolen;     /* cycles spent taking and handling interrupts */
+} prof;
+
+static struct
+{
+   const void *func;
+   const char *name;
+} handler_names[PROF6502_HANDLERS];
+
+static const char *pseudo_names[] = { "<main>", "<nmi>", "<irq>", "<brk>" };
+
+/* name a memory handler, as the profile should show it */
+void prof6502_namehandler(const void *func, const char *name)
+{
+   int i;
+
+   for (i = 0; i < PROF6502_HANDLERS; i++)
+   {
+      if (NULL == handler_names[i].func || func == handler_names[i].func)
+      {
+         handler_names[i].func = func;
+         handler_names[i].name = name;
+         return;
+      }
+   }
+}
+
+INLINE uint32 prof_locate(uint32 pc, const uint8 *page)
+{
+   if (page >= prof.rom && page < prof.rom + prof.rom_length)
+      return (uint32) (page - prof.rom) + (pc & NES6502_BANKMASK);
+
+   return prof.rom_length + (pc & 0xFFFF);
+}
+
+INLINE int prof_top(void)
+{
+   return prof.depth ? prof.stack[prof.depth - 1].func : MAIN_FUNC;
+}
+
+/* count the cycles since we last looked against the running instruction */
+INLINE void prof_tick(int32 cycles)
+{
+   int32 delta = cycles - prof.last;
+
+   /* the count goes backwards when a snapshot is loaded */
+   prof.last = cycles;
+   if (delta > 0)
+   {
+      prof.cycles[prof.current] += delta;
+      prof.clock += delta;
+   }
+}
+
+/* the function that starts at loc, made up if it's new */
+static int prof_func(uint32 loc, uint32 pc)
+{
+   int func = prof.func_at[loc];
+
+   if (func)
+      return func;
+
+   if (prof.num_funcs == PROF6502_MAXFUNCS)
+   {
+      prof.lost_funcs++;
+      return MAIN_FUNC;
+   }
+
+   func = prof.num_funcs++;
+   prof.func_entry[func] = loc;
+   prof.func_at[loc] = (uint16) func;
+   prof.page[loc] = (uint8) (pc >> NES6502_BANKSHIFT);
+
+   return func;
+}
+
+static int prof_arc(int caller, uint32 site, int callee)
+{
+   uint64_t key;
+   uint32 i;
+
+   key = ((uint64_t) caller << 48) | ((uint64_t) callee << 32) | site;
+
+   for (i = (uint32) ((key * 0x9E3779B97F4A7C15ULL) >> 48); ; i++)
+   {
+      i &= PROF6502_MAXARCS - 1;
+
+      if (key == prof.arcs[i].key)
+         return (int) i;
+
+      if (0 == prof.arcs[i].key)
+         break;
+   }
+
+   /* keep the table from filling, or lookups would never end */
+   if (prof.num_arcs >= PROF6502_MAXARCS - PROF6502_MAXARCS / 8)
+   {
+      prof.lost_arcs++;
+      return -1;
+   }
+
+   prof.arcs[i].key = key;
+   prof.num_arcs++;
+
+   return (int) i;
+}
+
+/* the function on top has returned, or been abandoned */
+static void prof_pop(void)
+{
+   profframe_t *frame = &prof.stack[--prof.depth];
+   int64_t cycles;
+
+   /* interrupts taken while it ran were none of its doing */
+   cycles = (int64_t) (prof.clock - frame->entry) - (int64_t) (prof.stolen - frame->stolen);
+   if (cycles < 0)
+      cycles = 0;
+
+   if (frame->arc >= 0)
+      prof.arcs[frame->arc].cycles += cycles;
+
+   if (frame->interrupt)
+      prof.stolen += cycles + INT_CYCLES;
+}
+
+/* caller is 0 for whatever function is running */
+static void prof_push(int caller, uint32 site, int func, uint8 s, bool interrupt,
+                      uint64_t entry)
+{
+   profframe_t *frame;
+
+   /* anything at or below the new stack pointer is gone, whether it
+   ** returned or not (games pull return addresses, and reset S)
+   */
+   while (prof.depth && prof.stack[prof.depth - 1].s <= s)
+      prof_pop();
+
+   if (PROF6502_DEPTH == prof.depth)
+      return;
+
+   if (0 == caller)
+      caller = prof_top();
+
+   frame = &prof.stack[prof.depth++];
+   frame->arc = prof_arc(caller, site, func);
+   frame->func = (uint16) func;
+   frame->s = s;
+   frame->interrupt = interrupt;
+   frame->entry = entry;
+   frame->stolen = prof.stolen;
+
+   if (frame->arc >= 0)
+      prof.arcs[frame->arc].calls++;
+}
+
+/* an instruction is about to run */
+void prof6502_insn(uint32 pc, const uint8 *page, int32 cycles)
+{
+   uint32 loc;
+
+   if (false == prof.on)
+      return;
+
+   prof_tick(cycles);
+
+   loc = prof_locate(pc, page);
+   prof.current = loc;
+   prof.insns[loc]++;
+
+   if (0 == prof.owner[loc])
+   {
+      prof.owner[loc] = (uint16) prof_top();
+      prof.page[loc] = (uint8) (pc >> NES6502_BANKSHIFT);
+   }
+}
+
+/* the running instruction, a JSR, has called pc */
+void prof6502_call(uint32 pc, const uint8 *page, uint8 s, int32 cycles)
+{
+   if (false == prof.on)
+      return;
+
+   prof_tick(cycles);
+   prof_push(0, prof.current, prof_func(prof_locate(pc, page), pc), s, false, prof.clock);
+}
+
+/* an RTS or RTI has left the stack pointer at s */
+void prof6502_return(uint8 s, int32 cycles)
+{
+   if (false == prof.on)
+      return;
+
+   prof_tick(cycles);
+
+   while (prof.depth && prof.stack[prof.depth - 1].s < s)
+      prof_pop();
+}
+
+/* an interrupt is being taken, to its handler at pc; its cycles are yet
+** to be counted, and go to the interrupt rather than what it interrupted
+*/
+void prof6502_interrupt(int kind, uint32 pc, const uint8 *page, uint8 s, int32 cycles)
+{
+   uint32 pseudo = prof.pseudo + PSEUDO_NMI + kind;
+
+   if (false == prof.on)
+      return;
+
+   prof_tick(cycles);
+   prof.current = pseudo;
+   prof.insns[pseudo]++;
+
+   prof_push(PSEUDO_FUNC(PSEUDO_NMI + kind), pseudo, prof_func(prof_locate(pc, page), pc),
+             s, true, prof.clock + INT_CYCLES);
+}
+
+/* the running instruction has gone through a memory handler */
+void prof6502_handler(int index, bool write)
+{
+   int pseudo, arc;
+
+   if (false == prof.on || index >= PROF6502_HANDLERS)
+      return;
+
+   pseudo = (write ? PSEUDO_WRITE : PSEUDO_READ) + index;
+   prof.insns[prof.pseudo + pseudo]++;
+
+   arc = prof_arc(prof_top(), prof.current, PSEUDO_FUNC(pseudo));
+   if (arc >= 0)
+      prof.arcs[arc].calls++;
+}
+
+void prof6502_free(void)
+{
+   if (prof.cycles)
+      free(prof.cycles);
+   if (prof.insns)
+      free(prof.insns);
+   if (prof.owner)
+      free(prof.owner);
+   if (prof.func_at)
+      free(prof.func_at);
+   if (prof.page)
+      free(prof.page);
+   if (prof.arcs)
+      free(prof.arcs);
+
+   memset(&prof, 0, sizeof(prof));
+}
+
+/* start counting afresh, for code in a rom_length byte PRG-ROM at rom */
+int prof6502_start(const uint8 *rom, int rom_length)
+{
+   nes6502_context context;
+   int i;
+
+#ifndef NES6502_PROFILE
+   log_printf("prof6502: the cpu core wasn't built with NES6502_PROFILE\n");
+   return -1;
+#endif /* !NES6502_PROFILE */
+
+   prof6502_free();
+
+   prof.rom = rom;
+   prof.rom_length = rom_length;
+   prof.pseudo = rom_length + 0x10000;
+   prof.num_locs = prof.pseudo + PSEUDO_COUNT;
+
+   prof.cycles = malloc(prof.num_locs * sizeof(uint64_t));
+   prof.insns = malloc(prof.num_locs * sizeof(uint32));
+   prof.owner = malloc(prof.num_locs * sizeof(uint16));
+   prof.func_at = malloc(prof.num_locs * sizeof(uint16));
+   prof.page = malloc(prof.num_locs);
+   prof.arcs = malloc(PROF6502_MAXARCS * sizeof(profarc_t));
+   if (NULL == prof.cycles || NULL == prof.insns || NULL == prof.owner
+       || NULL == prof.func_at || NULL == prof.page || NULL == prof.arcs)
+   {
+      prof6502_free();
+      return -1;
+   }
+
+   memset(prof.cycles, 0, prof.num_locs * sizeof(uint64_t));
+   memset(prof.insns, 0, prof.num_locs * sizeof(uint32));
+   memset(prof.owner, 0, prof.num_locs * sizeof(uint16));
+   memset(prof.func_at, 0, prof.num_locs * sizeof(uint16));
+   memset(prof.page, 0, prof.num_locs);
+   memset(prof.arcs, 0, PROF6502_MAXARCS * sizeof(profarc_t));
+
+   for (i = 0; i < PSEUDO_COUNT; i++)
+   {
+      prof.func_entry[PSEUDO_FUNC(i)] = prof.pseudo + i;
+      prof.func_at[prof.pseudo + i] = (uint16) PSEUDO_FUNC(i);
+      prof.owner[prof.pseudo + i] = (uint16) PSEUDO_FUNC(i);
+   }
+   prof.num_funcs = PSEUDO_FUNC(PSEUDO_COUNT);
+
+   /* whatever ran before now isn't ours */
+   nes6502_getcontext(&context);
+   prof.last = context.total_cycles;
+   prof.current = prof.pseudo + PSEUDO_MAIN;
+
+   prof.on = true;
+   return 0;
+}
+
+/* stop counting, and close up whatever calls are still open */
+void prof6502_stop(void)
+{
+   if (false == prof.on)
+      return;
+
+   while (prof.depth)
+      prof_pop();
+
+   prof.on = false;
+}
+
+static void prof_name(int func, char *buf)
+{
+   uint32 loc = prof.func_entry[func];
+   nes6502_context context;
+   uint32 index;
+   const void *handler = NULL;
+   int i;
+
+   if (loc < prof.rom_length)
+   {
+      sprintf(buf, "%02X:%04X", loc >> 14,
+              (prof.page[loc] << NES6502_BANKSHIFT) | (loc & NES6502_BANKMASK));
+      return;
+   }
+
+   if (loc < prof.pseudo)
+   {
+      sprintf(buf, "--:%04X", loc - prof.rom_length);
+      return;
+   }
+
+   index = loc - prof.pseudo;
+   if (index < PSEUDO_READ)
+   {
+      strcpy(buf, pseudo_names[index]);
+      return;
+   }
+
+   /* a memory handler, by name if it has one and its range if not */
+   nes6502_getcontext(&context);
+   if (index < PSEUDO_WRITE)
+   {
+      index -= PSEUDO_READ;
+      handler = (const void *) context.read_handler[index].read_func;
+      sprintf(buf, "read $%04X-$%04X", context.read_handler[index].min_range,
+              context.read_handler[index].max_range);
+   }
+   else
+   {
+      index -= PSEUDO_WRITE;
+      handler = (const void *) context.write_handler[index].write_func;
+      sprintf(buf, "write $%04X-$%04X", context.write_handler[index].min_range,
+              context.write_handler[index].max_range);
+   }
+
+   for (i = 0; i < PROF6502_HANDLERS && handler_names[i].func; i++)
+   {
+      if (handler == handler_names[i].func)
+      {
+         sprintf(buf + strlen(buf), " %s", handler_names[i].name);
+         break;
+      }
+   }
+}
+
+/* the disassembly of a location, for the listing */
+static char *prof_disasm(uint32 loc)
+{
+   uint8 code[3];
+   uint32 pc;
+   int i;
+
+   if (loc < prof.rom_length)
+   {
+      pc = (prof.page[loc] << NES6502_BANKSHIFT) | (loc & NES6502_BANKMASK);
+      for (i = 0; i < 3; i++)
+         code[i] = (loc + i < prof.rom_length) ? prof.rom[loc + i] : 0;
+   }
+   else
+   {
+      /* as it is now, which may not be what ran */
+      pc = loc - prof.rom_length;
+      for (i = 0; i < 3; i++)
+         code[i] = nes6502_getbyte((pc + i) & 0xFFFF);
+   }
+
+   return nes6502_disasm_code(pc, code);
+}
+
+/* the listing callgrind points at: each location that ran, disassembled,
+** with its line number put in lines[]
+*/
+static int prof_writelisting(const char *filename, uint32 *lines)
+{
+   char name[64];
+   FILE *fp;
+   uint32 loc, line, next;
+   const char *text;
+
+   fp = fopen(filename, "w");
+   if (NULL == fp)
+      return -1;
+
+   fprintf(fp, "; cycle profile listing, by location run\n");
+   line = 1;
+
+   /* the handlers are only named if they were used, as only then are
+   ** they sure to be in the cpu's tables
+   */
+   for (loc = prof.pseudo; loc < prof.num_locs; loc++)
+   {
+      if (loc >= prof.pseudo + PSEUDO_READ && 0 == prof.insns[loc])
+         continue;
+
+      prof_name(prof.func_at[loc], name);
+      fprintf(fp, "%s\n", name);
+      lines[loc] = ++line;
+   }
+
+   next = 0;
+   for (loc = 0; loc < prof.pseudo; loc++)
+   {
+      if (0 == prof.insns[loc] && 0 == prof.func_at[loc])
+         continue;
+
+      if (loc != next || prof.func_at[loc])
+      {
+         fprintf(fp, "\n");
+         line++;
+      }
+
+      if (prof.func_at[loc])
+      {
+         prof_name(prof.func_at[loc], name);
+         fprintf(fp, "%s:\n", name);
+         line++;
+      }
+
+      text = prof_disasm(loc);
+      if (loc < prof.rom_length)
+         fprintf(fp, "%02X:%s\n", loc >> 14, text);
+      else
+         fprintf(fp, "--:%s\n", text);
+      lines[loc] = ++line;
+
+      next = loc + nes6502_oplength(prof.rom_length > loc ? prof.rom[loc]
+                                    : nes6502_getbyte(loc - prof.rom_length));
+   }
+
+   if (ferror(fp))
+   {
+      fclose(fp);
+      return -1;
+   }
+
+   return fclose(fp) ? -1 : 0;
+}
+
+INLINE int prof_caller(const profarc_t *arc)
+{
+   return (int) (arc->key >> 48);
+}
+
+INLINE int prof_callee(const profarc_t *arc)
+{
+   return (int) ((arc->key >> 32) & 0xFFFF);
+}
+
+INLINE uint32 prof_site(const profarc_t *arc)
+{
+   return (uint32) arc->key;
+}
+
+/* callgrind names a function in full once, by number after that */
+static void prof_writefunc(FILE *fp, const char *label, int func, bool *named)
+{
+   char name[64];
+
+   if (named[func])
+   {
+      fprintf(fp, "%s=(%d)\n", label, func);
+   }
+   else
+   {
+      prof_name(func, name);
+      fprintf(fp, "%s=(%d) %s\n", label, func, name);
+      named[func] = true;
+   }
+}
+
+/* write the profile for callgrind_annotate or kcachegrind, and beside it
+** filename.asm, the disassembly it refers to by line
+*/
+int prof6502_write(const char *filename)
+{
+   char listing[PATH_MAX];
+   const char *base;
+   uint32 *lines = NULL, *next_loc = NULL;
+   uint32 *first_loc = NULL;
+   int *next_arc = NULL, *first_arc = NULL;
+   bool *named = NULL;
+   FILE *fp = NULL;
+   uint32 loc;
+   int func, i;
+   profarc_t *arc;
+
+   ASSERT(false == prof.on);
+
+   if (NULL == prof.cycles)
+      return -1;
+
+   lines = malloc(prof.num_locs * sizeof(uint32));
+   next_loc = malloc(prof.num_locs * sizeof(uint32));
+   first_loc = malloc(PROF6502_MAXFUNCS * sizeof(uint32));
+   next_arc = malloc(PROF6502_MAXARCS * sizeof(int));
+   first_arc = malloc(PROF6502_MAXFUNCS * sizeof(int));
+   named = malloc(PROF6502_MAXFUNCS * sizeof(bool));
+   if (NULL == lines || NULL == next_loc || NULL == first_loc
+       || NULL == next_arc || NULL == first_arc || NULL == named)
+      goto _fail;
+
+   snprintf(listing, sizeof(listing), "%s.asm", filename);
+   if (prof_writelisting(listing, lines))
+      goto _fail;
+
+   /* each function's locations and calls, in order */
+   for (func = 0; func < PROF6502_MAXFUNCS; func++)
+   {
+      first_loc[func] = prof.num_locs;
+      first_arc[func] = -1;
+      named[func] = false;
+   }
+
+   for (loc = prof.num_locs; loc-- > 0; )
+   {
+      if (prof.cycles[loc])
+      {
+         next_loc[loc] = first_loc[prof.owner[loc]];
+         first_loc[prof.owner[loc]] = loc;
+      }
+   }
+
+   for (i = PROF6502_MAXARCS; i-- > 0; )
+   {
+      if (prof.arcs[i].key)
+      {
+         next_arc[i] = first_arc[prof_caller(&prof.arcs[i])];
+         first_arc[prof_caller(&prof.arcs[i])] = i;
+      }
+   }
+
+   fp = fopen(filename, "w");
+   if (NULL == fp)
+      goto _fail;
+
+   /* the listing goes beside the profile, so name it from there */
+   base = strrchr(listing, '/');
+   if (NULL == base)
+      base = strrchr(listing, '\\');
+   base = base ? base + 1 : listing;
+
+   fprintf(fp, "# callgrind format\n");
+   fprintf(fp, "version: 1\n");
+   fprintf(fp, "creator: nofrendo\n");
+   fprintf(fp, "positions: line\n");
+   fprintf(fp, "events: Cycles\n");
+   fprintf(fp, "summary: %llu\n", (unsigned long long) prof.clock);
+   fprintf(fp, "\nfl=(1) %s\n", base);
+
+   for (func = 1; func < prof.num_funcs; func++)
+   {
+      if (prof.num_locs == first_loc[func] && first_arc[func] < 0)
+         continue;
+
+      fprintf(fp, "\n");
+      prof_writefunc(fp, "fn", func, named);
+
+      for (loc = first_loc[func]; loc != prof.num_locs; loc = next_loc[loc])
+         fprintf(fp, "%u %llu\n", lines[loc], (unsigned long long) prof.cycles[loc]);
+
+      for (i = first_arc[func]; i >= 0; i = next_arc[i])
+      {
+         arc = &prof.arcs[i];
+         prof_writefunc(fp, "cfn", prof_callee(arc), named);
+         fprintf(fp, "calls=%llu %u\n", (unsigned long long) arc->calls,
+                 lines[prof.func_entry[prof_callee(arc)]]);
+         fprintf(fp, "%u %llu\n", lines[prof_site(arc)], (unsigned long long) arc->cycles);
+      }
+   }
+
+   if (ferror(fp))
+      goto _fail;
+
+   i = fclose(fp);
+   fp = NULL;
+   if (i)
+      goto _fail;
+
+   free(lines);
+   free(next_loc);
+   free(first_loc);
+   free(next_arc);
+   free(first_arc);
+   free(named);
+
+   return 0;
+
+_fail:
+   log_printf("prof6502: could not write %s\n", filename);
+
+   if (fp)
+      fclose(fp);
+   if (lines)
+      free(lines);
+   if (next_loc)
+      free(next_loc);
+   if (first_loc)
+      free(first_loc);
+   if (next_arc)
+      free(next_arc);
+   if (first_arc)
+      free(first_arc);
+   if (named)
+      free(named);
+
+   return -1;
+}
+
+/* list the functions that took the most cycles of their own, and how
+** often each memory handler was gone through
+*/
+void prof6502_report(FILE *fp, int count)
+{
+   uint64_t *self = NULL, *incl = NULL, *calls = NULL;
+   uint64_t total = prof.clock ? prof.clock : 1;
+   char name[64];
+   uint32 loc;
+   int func, best, i;
+   profarc_t *arc;
+
+   if (NULL == prof.cycles)
+      return;
+
+   self = malloc(PROF6502_MAXFUNCS * sizeof(uint64_t));
+   incl = malloc(PROF6502_MAXFUNCS * sizeof(uint64_t));
+   calls = malloc(PROF6502_MAXFUNCS * sizeof(uint64_t));
+   if (NULL == self || NULL == incl || NULL == calls)
+      goto _out;
+
+   memset(self, 0, PROF6502_MAXFUNCS * sizeof(uint64_t));
+   memset(calls, 0, PROF6502_MAXFUNCS * sizeof(uint64_t));
+
+   for (loc = 0; loc < prof.num_locs; loc++)
+      self[prof.owner[loc]] += prof.cycles[loc];
+
+   memcpy(incl, self, PROF6502_MAXFUNCS * sizeof(uint64_t));
+
+   for (i = 0; i < PROF6502_MAXARCS; i++)
+   {
+      arc = &prof.arcs[i];
+      if (arc->key)
+      {
+         incl[prof_caller(arc)] += arc->cycles;
+         calls[prof_callee(arc)] += arc->calls;
+      }
+   }
+
+   fprintf(fp, "%llu cycles, %d functions, %d call sites\n",
+              (unsigned long long) prof.clock, prof.num_funcs - PSEUDO_FUNC(PSEUDO_COUNT),
+              prof.num_arcs);
+   if (prof.lost_funcs || prof.lost_arcs)
+      fprintf(fp, "no room for %u functions and %u calls\n",
+                 prof.lost_funcs, prof.lost_arcs);
+
+   fprintf(fp, "   self%%   incl%%        calls  function\n");
+   for (; count > 0; count--)
+   {
+      best = 0;
+      for (func = 1; func < prof.num_funcs; func++)
+      {
+         if (func >= PSEUDO_FUNC(PSEUDO_READ) && func < PSEUDO_FUNC(PSEUDO_COUNT))
+            continue;
+
+         if (self[func] > self[best])
+            best = func;
+      }
+
+      if (0 == best)
+         break;
+
+      prof_name(best, name);
+      fprintf(fp, "  %5.1f%%  %5.1f%%  %11llu  %s\n",
+                 100.0 * self[best] / total, 100.0 * incl[best] / total,
+                 (unsigned long long) calls[best], name);
+      self[best] = 0;
+   }
+
+   fprintf(fp, "     accesses  handler\n");
+   for (func = PSEUDO_FUNC(PSEUDO_READ); func < PSEUDO_FUNC(PSEUDO_COUNT); func++)
+   {
+      loc = prof.func_entry[func];
+      if (prof.insns[loc])
+      {
+         prof_name(func, name);
+         fprintf(fp, "  %11u  %s\n", prof.insns[loc], name);
+      }
+   }
+
+_out:
+   if (self)
+      free(self);
+   if (incl)
+      free(incl);
+   if (calls)
+      free(calls);
+}
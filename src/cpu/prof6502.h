@@ -0,0 +1,73 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** prof6502.h
+**
+** Cycle profiler for the 6502 core
+** $Id$
+*/
+
+#ifndef _PROF6502_H_
+#define _PROF6502_H_
+
+#include <stdio.h>
+#include <noftypes.h>
+
+/* The core only calls the hooks below when it's built with this defined;
+** without it, profiling costs nothing and prof6502_start fails.
+*/
+/*#define  NES6502_PROFILE*/
+
+#define  PROF6502_MAXFUNCS    8192
+#define  PROF6502_MAXARCS     65536    /* power of 2 */
+#define  PROF6502_DEPTH       256
+#define  PROF6502_HANDLERS    32
+
+/* how the cpu got into a handler */
+enum
+{
+   PROF6502_NMI,
+   PROF6502_IRQ,
+   PROF6502_BRK
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern int prof6502_start(const uint8 *rom, int rom_length);
+extern void prof6502_stop(void);
+extern void prof6502_free(void);
+extern int prof6502_write(const char *filename);
+extern void prof6502_report(FILE *fp, int count);
+extern void prof6502_namehandler(const void *func, const char *name);
+
+/* hooks for the core */
+extern void prof6502_insn(uint32 pc, const uint8 *page, int32 cycles);
+extern void prof6502_call(uint32 pc, const uint8 *page, uint8 s, int32 cycles);
+extern void prof6502_return(uint8 s, int32 cycles);
+extern void prof6502_interrupt(int kind, uint32 pc, const uint8 *page, uint8 s,
+                               int32 cycles);
+extern void prof6502_handler(int index, bool write);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _PROF6502_H_ */
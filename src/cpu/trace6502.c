@@ -0,0 +1,173 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** trace6502.c
+**
+** Binary execution trace of the 6502 core, into a file mapped ring
+** $Id$
+*/
+
+#include <string.h>
+#include <stdint.h>
+#ifdef WIN32
+#include <windows.h>
+#else /* !WIN32 */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif /* !WIN32 */
+#include <noftypes.h>
+#include <log.h>
+#include "trace6502.h"
+
+/* The records go straight into a shared mapping of the file, so nothing
+** is ever written out as such: whatever the core recorded is in the file
+** even if the process dies, and the decoding is left to tracedump.
+*/
+trace6502_t trace6502;
+
+static struct
+{
+   void *base;
+   size_t length;
+#ifdef WIN32
+   HANDLE file, mapping;
+#else /* !WIN32 */
+   int fd;
+#endif /* !WIN32 */
+} ring;
+
+static void trace_unmap(void)
+{
+#ifdef WIN32
+   if (ring.base)
+      UnmapViewOfFile(ring.base);
+   if (ring.mapping)
+      CloseHandle(ring.mapping);
+   if (ring.file && INVALID_HANDLE_VALUE != ring.file)
+      CloseHandle(ring.file);
+#else /* !WIN32 */
+   if (ring.base)
+      munmap(ring.base, ring.length);
+   if (ring.fd >= 0)
+      close(ring.fd);
+#endif /* !WIN32 */
+
+   memset(&ring, 0, sizeof(ring));
+#ifndef WIN32
+   ring.fd = -1;
+#endif /* !WIN32 */
+}
+
+/* the file, the size it will stay, mapped in */
+static int trace_map(const char *filename, size_t length)
+{
+   ring.length = length;
+
+#ifdef WIN32
+   ring.file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                           CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+   if (INVALID_HANDLE_VALUE == ring.file)
+      goto _fail;
+
+   ring.mapping = CreateFileMappingA(ring.file, NULL, PAGE_READWRITE,
+                                     (DWORD) ((uint64_t) length >> 32), (DWORD) length, NULL);
+   if (NULL == ring.mapping)
+      goto _fail;
+
+   ring.base = MapViewOfFile(ring.mapping, FILE_MAP_WRITE, 0, 0, length);
+   if (NULL == ring.base)
+      goto _fail;
+#else /* !WIN32 */
+   ring.fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if (ring.fd < 0)
+      goto _fail;
+
+   if (ftruncate(ring.fd, (off_t) length))
+      goto _fail;
+
+   ring.base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, ring.fd, 0);
+   if (MAP_FAILED == ring.base)
+   {
+      ring.base = NULL;
+      goto _fail;
+   }
+#endif /* !WIN32 */
+
+   return 0;
+
+_fail:
+   trace_unmap();
+   return -1;
+}
+
+/* trace into the last num_records (rounded up to a power of 2) of
+** filename; scanline, if not NULL, is read with each one
+*/
+int trace6502_start(const char *filename, int num_records, const int *scanline)
+{
+   tracehdr_t *header;
+   uint32 count;
+
+#ifndef NES6502_TRACE
+   log_printf("trace6502: the cpu core wasn't built with NES6502_TRACE\n");
+   return -1;
+#endif /* !NES6502_TRACE */
+
+   trace6502_stop();
+
+   if (num_records <= 0 || num_records > TRACE6502_MAXRECORDS)
+      num_records = TRACE6502_RECORDS;
+
+   for (count = 1; count < (uint32) num_records; count <<= 1)
+      ;
+
+   if (trace_map(filename, TRACE6502_OFFSET + (size_t) count * sizeof(tracerec_t)))
+   {
+      log_printf("trace6502: could not map %s\n", filename);
+      return -1;
+   }
+
+   header = (tracehdr_t *) ring.base;
+   memcpy(header->magic, TRACE6502_MAGIC, sizeof(header->magic));
+   header->record_size = sizeof(tracerec_t);
+   header->num_records = count;
+   header->reserved = 0;
+   header->written = 0;
+
+   trace6502.header = header;
+   trace6502.mask = count - 1;
+   trace6502.scanline = scanline;
+   trace6502.records = (tracerec_t *) ((uint8 *) ring.base + TRACE6502_OFFSET);
+
+   log_printf("trace6502: tracing the last %u instructions to %s\n", count, filename);
+   return 0;
+}
+
+void trace6502_stop(void)
+{
+   if (NULL == trace6502.records)
+      return;
+
+   log_printf("trace6502: %llu instructions traced\n",
+              (unsigned long long) trace6502.header->written);
+
+   memset(&trace6502, 0, sizeof(trace6502));
+   trace_unmap();
+}
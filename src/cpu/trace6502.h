@@ -0,0 +1,106 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** trace6502.h
+**
+** Binary execution trace of the 6502 core, into a file mapped ring
+** $Id$
+*/
+
+#ifndef _TRACE6502_H_
+#define _TRACE6502_H_
+
+#include <stdint.h>
+#include <noftypes.h>
+
+/* The core only records when it's built with this defined; without it,
+** tracing costs nothing and trace6502_start fails.
+*/
+/*#define  NES6502_TRACE*/
+
+#define  TRACE6502_MAGIC      "NTR1"
+#define  TRACE6502_RECORDS    (1 << 20)   /* the default, 16MB of them */
+#define  TRACE6502_MAXRECORDS (1 << 26)
+#define  TRACE6502_OFFSET     32          /* of the first record in the file */
+
+/* an instruction, as it was about to run */
+typedef struct tracerec_s
+{
+   uint32 cycles;       /* the core's count, before the instruction */
+   uint16 pc;
+   uint16 scanline;     /* 0xFFFF if nobody said */
+   uint8 code[3];       /* opcode, and whatever operand bytes follow */
+   uint8 a, x, y, s, p;
+} tracerec_t;
+
+/* the file is this, then num_records records, oldest overwritten first */
+typedef struct tracehdr_s
+{
+   char magic[4];
+   uint32 record_size;
+   uint32 num_records;  /* a power of 2 */
+   uint32 reserved;
+   uint64_t written;    /* ever; the next goes at written % num_records */
+} tracehdr_t;
+
+typedef struct trace6502_s
+{
+   tracerec_t *records; /* NULL if not tracing */
+   tracehdr_t *header;
+   uint32 mask;
+   const int *scanline;
+} trace6502_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern trace6502_t trace6502;
+
+extern int trace6502_start(const char *filename, int num_records, const int *scanline);
+extern void trace6502_stop(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+/* the core's hook, with code the instruction's bytes in a row.  the file
+** is mapped, so a record is just a few stores, and whatever was
+** written survives the process dying
+*/
+ALWAYS_INLINE void trace6502_insn(uint32 pc, const uint8 *code, uint8 a, uint8 x,
+                                  uint8 y, uint8 s, uint8 p, int32 cycles)
+{
+   tracerec_t *rec;
+
+   rec = &trace6502.records[(uint32) trace6502.header->written++ & trace6502.mask];
+   rec->cycles = (uint32) cycles;
+   rec->pc = (uint16) pc;
+   rec->scanline = trace6502.scanline ? (uint16) *trace6502.scanline : 0xFFFF;
+   rec->code[0] = code[0];
+   rec->code[1] = code[1];
+   rec->code[2] = code[2];
+   rec->a = a;
+   rec->x = x;
+   rec->y = y;
+   rec->s = s;
+   rec->p = p;
+}
+
+#endif /* _TRACE6502_H_ */
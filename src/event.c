@@ -85,6 +85,12 @@ static void func_event_snapshot(int code)
       gui_savesnap();
 }
 
+static void func_event_capture(int code)
+{
+   if (INP_STATE_MAKE == code)
+      gui_togglecapture();
+}
+
 static void func_event_toggle_frameskip(int code)
 {
    if (INP_STATE_MAKE == code)
@@ -446,10 +452,11 @@ static event_t nes_events[] =
    func_event_soft_reset,
    func_event_hard_reset,
    func_event_snapshot,
+   func_event_capture,
    func_event_toggle_frameskip,
    /* saves */
-   func_event_state_save,
-   func_event_state_load, /* 10 */
+   func_event_state_save, /* 10 */
+   func_event_state_load,
    func_event_state_slot_0,
    func_event_state_slot_1,
    func_event_state_slot_2,
@@ -458,8 +465,8 @@ static event_t nes_events[] =
    func_event_state_slot_5,
    func_event_state_slot_6,
    func_event_state_slot_7,
-   func_event_state_slot_8,
-   func_event_state_slot_9, /* 20 */
+   func_event_state_slot_8, /* 20 */
+   func_event_state_slot_9,
    /* GUI */
    func_event_gui_toggle_oam,
    func_event_gui_toggle_wave,
@@ -470,8 +477,8 @@ static event_t nes_events[] =
    func_event_gui_display_info,
    func_event_gui_toggle,
    /* sound */
-   func_event_toggle_channel_0,
-   func_event_toggle_channel_1, /* 30 */
+   func_event_toggle_channel_0, /* 30 */
+   func_event_toggle_channel_1,
    func_event_toggle_channel_2,
    func_event_toggle_channel_3,
    func_event_toggle_channel_4,
@@ -482,8 +489,8 @@ static event_t nes_events[] =
    /* picture */
    func_event_toggle_sprites,
    func_event_palette_hue_up,
-   func_event_palette_hue_down,
-   func_event_palette_tint_up, /* 40 */
+   func_event_palette_hue_down, /* 40 */
+   func_event_palette_tint_up,
    func_event_palette_tint_down,
    func_event_palette_set_default,
    func_event_palette_set_shady,
@@ -493,8 +500,8 @@ static event_t nes_events[] =
    func_event_joypad1_start,
    func_event_joypad1_select,
    func_event_joypad1_up,
-   func_event_joypad1_down,
-   func_event_joypad1_left, /* 50 */
+   func_event_joypad1_down, /* 50 */
+   func_event_joypad1_left,
    func_event_joypad1_right,
    /* joypad 2 */
    func_event_joypad2_a,
@@ -504,13 +511,12 @@ static event_t nes_events[] =
    func_event_joypad2_up,
    func_event_joypad2_down,
    func_event_joypad2_left,
-   func_event_joypad2_right,
+   func_event_joypad2_right, /* 60 */
    /* NSF control */
-   NULL, /* 60 */
    NULL,
    NULL,
-   /* OS-specific */
    NULL,
+   /* OS-specific */
    NULL,
    NULL,
    NULL,
@@ -519,6 +525,7 @@ static event_t nes_events[] =
    NULL,
    NULL, /* 70 */
    NULL,
+   NULL,
    /* last */
    NULL
 };
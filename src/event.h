@@ -39,6 +39,7 @@ enum
    event_soft_reset,
    event_hard_reset,
    event_snapshot,
+   event_capture,
    event_toggle_frameskip,
    /* saves */
    event_state_save,
@@ -63,6 +63,8 @@ rgb_t gui_pal[GUI_TOTALCOLORS] =
 /**************************************************************/
 #include <pcx.h>
 #include <nesstate.h>
+#include <nofconfig.h>
+#include <capture.h>
 static bool option_drawsprites = true;
 
 /* save a PCX snapshot */
@@ -80,6 +82,44 @@ void gui_savesnap(void)
    gui_sendmsg(GUI_GREEN, "Screen saved to %s", filename);
 }
 
+/* start capturing video and sound, or stop */
+void gui_togglecapture(void)
+{
+   char filename[PATH_MAX];
+   nes_t *nes = nes_getcontextptr();
+   capstats_t stats;
+   int policy;
+
+   if (capture_active())
+   {
+      capture_stop();
+      capture_getstats(&stats);
+
+      if (stats.failed)
+         gui_sendmsg(GUI_RED, "Capture failed");
+      else if (stats.dropped)
+         gui_sendmsg(GUI_YELLOW, "Captured %u frames, %u dropped", stats.frames, stats.dropped);
+      else
+         gui_sendmsg(GUI_GREEN, "Captured %u frames", stats.frames);
+      return;
+   }
+
+   if (osd_makecapname(filename, PATH_MAX) < 0)
+      return;
+
+   policy = strcmp(config.read_string("capture", "policy", "block"), "drop")
+            ? CAPTURE_BLOCK : CAPTURE_DROP;
+
+   if (capture_start(filename, nes->apu->sample_rate, nes->apu->sample_bits, policy,
+                     config.read_int("capture", "queue", CAPTURE_QUEUE)))
+   {
+      gui_sendmsg(GUI_RED, "Could not capture to %s", filename);
+      return;
+   }
+
+   gui_sendmsg(GUI_GREEN, "Capturing to %s", filename);
+}
+
 /* Show/hide sprites (hiding sprites useful for making maps) */
 void gui_togglesprites(void)
 {
@@ -167,6 +207,8 @@ static int pattern_col = 0;
 static bool gui_fpsupdate = false;
 static int gui_ticks = 0;
 static int gui_fps = 0;
+static int gui_static = 0;
+static bool gui_fpsshown = false;
 static int gui_refresh = 60; /* default to 60Hz */
 
 static int mouse_x, mouse_y, mouse_button;
@@ -376,17 +418,26 @@ static void gui_tickdec(void)
 /* Update the FPS display */
 static void gui_updatefps(void)
 {
-   static char fpsbuf[20];
+   static char fpsbuf[20], staticbuf[20], soundbuf[20], dropbuf[20];
+   sndstats_t sound;
 
    /* Check to see if we need to do an sprintf or not */
    if (true == gui_fpsupdate)
    {
+      osd_getsoundstats(&sound);
       sprintf(fpsbuf, "%4d FPS /%4d%%", gui_fps, (gui_fps * 100) / gui_refresh);
+      sprintf(staticbuf, "%4d static", gui_static);
+      sprintf(soundbuf, "%4d ms sound", (int) sound.latency);
+      sprintf(dropbuf, "%4d dropouts", sound.underruns + sound.overruns + sound.stalls);
       gui_fps = 0;
+      gui_static = 0;
       gui_fpsupdate = false;
    }
 
    gui_textout(fpsbuf, gui_surface->width - 1 - 90, 1, &small, GUI_GREEN);
+   gui_textout(staticbuf, gui_surface->width - 1 - 90, 3 + small.height, &small, GUI_GREEN);
+   gui_textout(soundbuf, gui_surface->width - 1 - 90, 5 + 2 * small.height, &small, GUI_GREEN);
+   gui_textout(dropbuf, gui_surface->width - 1 - 90, 7 + 3 * small.height, &small, GUI_GREEN);
 }
 
 /* Turn FPS on/off */
@@ -580,6 +631,28 @@ void gui_frame(bool draw)
       osd_getmouse(&mouse_x, &mouse_y, &mouse_button);
       gui_drawmouse();
    }
+
+   gui_fpsshown = option_showfps;
+}
+
+/* the emulator left a frame on screen as it was */
+void gui_staticframe(void)
+{
+   gui_static++;
+}
+
+/* would the overlay look the same as on the last frame drawn? */
+bool gui_isstatic(void)
+{
+   if (option_showgui || option_showpattern || option_showoam
+       || option_wavetype != GUI_WAVENONE || msg.ttl)
+      return false;
+
+   /* the fps counter only changes once a second */
+   if (option_showfps != gui_fpsshown || (option_showfps && gui_fpsupdate))
+      return false;
+
+   return true;
 }
 
 void gui_sendmsg(int color, char *format, ...)
@@ -73,6 +73,8 @@ extern int gui_init(void);
 extern void gui_shutdown(void);
 
 extern void gui_frame(bool draw);
+extern void gui_staticframe(void);
+extern bool gui_isstatic(void);
 
 extern void gui_togglefps(void);
 extern void gui_togglegui(void);
@@ -84,6 +86,7 @@ extern void gui_decpatterncol(void);
 extern void gui_incpatterncol(void);
 
 extern void gui_savesnap(void);
+extern void gui_togglecapture(void);
 extern void gui_togglesprites(void);
 extern void gui_togglefs(void);
 extern void gui_displayinfo();
@@ -53,6 +53,10 @@ typedef struct memblock_s
 /* debugging flag */
 bool mem_debug = true;
 
+/* heap allocations since startup, and where the current frame began */
+static int mem_allocs = 0;
+static int mem_framestart = 0;
+
 
 #ifdef NOFRENDO_DEBUG
 
@@ -76,7 +80,8 @@ static int mem_checkguardblock(void *data, int guard_size)
    block = ((char *) data) - guard_size;
 
    /* get the size */
-   alloc_size = *((uint32 *) block)++;
+   alloc_size = *((uint32 *) block);
+   block += sizeof(uint32);
 
    /* check leading guard string */
    check = GUARD_STRING;
@@ -141,7 +146,8 @@ static void *mem_guardalloc(int alloc_size, int guard_size)
       *ptr++ = 0xDEADBEEF;
    
    /* store the size of the newly allocated block*/
-   *((uint32 *) block)++ = alloc_size;
+   *((uint32 *) block) = alloc_size;
+   block += sizeof(uint32);
 
    /* put guard string at beginning of block */
    check = GUARD_STRING;
@@ -226,8 +232,8 @@ static void mem_deleteblock(void *data, char *file, int line)
       {
          if (mem_checkguardblock(mem_record[i].block_addr, GUARD_LENGTH))
          {
-            sprintf(fail, "mem_deleteblock 0x%08X at line %d of %s -- block corrupt",
-                    (uint32) data, line, file);
+            sprintf(fail, "mem_deleteblock %p at line %d of %s -- block corrupt",
+                    data, line, file);
             ASSERT_MSG(fail);
          }
 
@@ -236,8 +242,8 @@ static void mem_deleteblock(void *data, char *file, int line)
       }
    }
 
-   sprintf(fail, "mem_deleteblock 0x%08X at line %d of %s -- block not found",
-           (uint32) data, line, file);
+   sprintf(fail, "mem_deleteblock %p at line %d of %s -- block not found",
+           data, line, file);
    ASSERT_MSG(fail);
 }
 #endif /* NOFRENDO_DEBUG */
@@ -270,6 +276,7 @@ void *_my_malloc(int size, char *file, int line)
       mem_addblock(temp, size, file, line);
 
    mem_blockcount++;
+   mem_allocs++;
 
    return temp;
 }
@@ -339,6 +346,8 @@ void *_my_malloc(int size)
       ASSERT_MSG(fail);
    }
 
+   mem_allocs++;
+
    return temp;
 }
 
@@ -376,6 +385,23 @@ char *_my_strdup(const char *string)
 
 #endif /* !NOFRENDO_DEBUG */
 
+/* number of heap allocations made so far */
+int mem_getallocs(void)
+{
+   return mem_allocs;
+}
+
+/* call at the end of each frame: returns how many allocations were made
+** since the last call.  once running, this should always be zero
+*/
+int mem_endframe(void)
+{
+   int count = mem_allocs - mem_framestart;
+
+   mem_framestart = mem_allocs;
+   return count;
+}
+
 /* check for orphaned memory handles */
 void mem_checkleaks(void)
 {
@@ -394,8 +420,8 @@ void mem_checkleaks(void)
       {
          if (mem_record[i].block_addr)
          {
-            log_printf("addr: 0x%08X, size: %d, line %d of %s%s\n",
-                    (uint32) mem_record[i].block_addr,
+            log_printf("addr: %p, size: %d, line %d of %s%s\n",
+                    mem_record[i].block_addr,
                     mem_record[i].block_size,
                     mem_record[i].line_num,
                     mem_record[i].file_name,
@@ -423,8 +449,8 @@ void mem_checkblocks(void)
       {
          if (mem_checkguardblock(mem_record[i].block_addr, GUARD_LENGTH))
          {
-            log_printf("addr: 0x%08X, size: %d, line %d of %s -- block corrupt\n",
-                    (uint32) mem_record[i].block_addr,
+            log_printf("addr: %p, size: %d, line %d of %s -- block corrupt\n",
+                    mem_record[i].block_addr,
                     mem_record[i].block_size,
                     mem_record[i].line_num,
                     mem_record[i].file_name);
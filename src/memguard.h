@@ -30,6 +30,38 @@
 #undef strdup
 #endif
 
+/* route heap traffic through the wrappers in memguard.c.  system headers
+** have to come before this one, since free() becomes a macro that NULLs
+** the pointer it was handed
+*/
+#ifdef NOFRENDO_DEBUG
+
+#define  malloc(s)   _my_malloc((s), __FILE__, __LINE__)
+#define  free(d)     _my_free((void **) &(d), __FILE__, __LINE__)
+#define  strdup(s)   _my_strdup((s), __FILE__, __LINE__)
+
+extern void *_my_malloc(int size, char *file, int line);
+extern void _my_free(void **data, char *file, int line);
+extern char *_my_strdup(const char *string, char *file, int line);
+
+#else /* !NOFRENDO_DEBUG */
+
+#define  malloc(s)   _my_malloc((s))
+#define  free(d)     _my_free((void **) &(d))
+#define  strdup(s)   _my_strdup((s))
+
+extern void *_my_malloc(int size);
+extern void _my_free(void **data);
+extern char *_my_strdup(const char *string);
+
+#endif /* !NOFRENDO_DEBUG */
+
+/* allocations are counted in every build; with mem_debug off this is
+** all memguard does, so it is cheap enough to leave running
+*/
+extern int mem_getallocs(void);
+extern int mem_endframe(void);
+
 extern void mem_cleanup(void);
 extern void mem_checkblocks(void);
 extern void mem_checkleaks(void);
@@ -36,6 +36,12 @@
 #include <nes_ppu.h>
 #include <nes_rom.h>
 #include <nes_mmc.h>
+#include <nesinput.h>
+#include <netplay.h>
+#include <replay.h>
+#include <capture.h>
+#include <nofconfig.h>
+#include <trace6502.h>
 #include <vid_drv.h>
 #include <nofrendo.h>
 
@@ -293,7 +299,36 @@ void nes_nmi(void)
    nes6502_nmi();
 }
 
-static void nes_renderframe(bool draw_flag)
+/* run the cpu, breaking off whenever the dmc needs it, so sample fetches
+** and dmc irqs land on the cycles they should
+*/
+static int nes_execute(int cycles)
+{
+   int slice, ran, elapsed = 0;
+
+   while (elapsed < cycles)
+   {
+      slice = apu_dmcnext();
+      if (slice > cycles - elapsed)
+         slice = cycles - elapsed;
+
+      ran = nes6502_execute(slice);
+      apu_dmcclock();
+
+      /* a jammed cpu gets nowhere */
+      if (0 == ran)
+         break;
+
+      elapsed += ran;
+   }
+
+   return elapsed;
+}
+
+/* run the machine through one frame; sound_flag is whether anyone is
+** going to hear it.  the apu is run through the frame either way
+*/
+void nes_runframe(bool draw_flag, bool sound_flag)
 {
    int elapsed_cycles;
    mapintf_t *mapintf = nes.mmc->intf;
@@ -306,7 +341,7 @@ static void nes_renderframe(bool draw_flag)
       if (241 == nes.scanline)
       {
          /* 7-9 cycle delay between when VINT flag goes up and NMI is taken */
-         elapsed_cycles = nes6502_execute(7);
+         elapsed_cycles = nes_execute(7);
          nes.scanline_cycles -= elapsed_cycles;
          nes_checkfiq(elapsed_cycles);
 
@@ -321,7 +356,7 @@ static void nes_renderframe(bool draw_flag)
          mapintf->hblank(in_vblank);
 
       nes.scanline_cycles += (float) NES_SCANLINE_CYCLES;
-      elapsed_cycles = nes6502_execute((int) nes.scanline_cycles);
+      elapsed_cycles = nes_execute((int) nes.scanline_cycles);
       nes.scanline_cycles -= (float) elapsed_cycles;
       nes_checkfiq(elapsed_cycles);
 
@@ -330,6 +365,13 @@ static void nes_renderframe(bool draw_flag)
    }
 
    nes.scanline = 0;
+
+   /* the sound for this frame */
+   apu_endframe();
+   if (sound_flag)
+      osd_soundframe();
+
+   input_endframe();
 }
 
 static void system_video(bool draw)
@@ -338,14 +380,20 @@ static void system_video(bool draw)
    if (false == draw)
    {
       gui_frame(false);
+      osd_getinput();
       return;
    }
 
-   /* blit the NES screen to our video surface */
-   vid_blit(nes.vidbuf, 0, (NES_SCREEN_HEIGHT - NES_VISIBLE_HEIGHT) / 2,
-            0, 0, NES_SCREEN_WIDTH, NES_VISIBLE_HEIGHT);
+   /* nothing changed on screen - leave the last frame up */
+   if (ppu_framestatic() && gui_isstatic())
+   {
+      gui_frame(false);
+      gui_staticframe();
+      osd_getinput();
+      return;
+   }
 
-   /* overlay our GUI on top of it */
+   /* overlay our GUI on top of the frame the PPU drew */
    gui_frame(true);
 
    /* blit to screen */
@@ -355,12 +403,63 @@ static void system_video(bool draw)
    osd_getinput();
 }
 
+/* a frame of our own, or of a netplay session or replay if there is one */
+static void nes_frame(bool draw_flag)
+{
+   if (netplay_active())
+   {
+      netplay_frame(draw_flag);
+      return;
+   }
+
+   if (replay_active())
+   {
+      if (replay_frame(draw_flag))
+         return;
+
+      /* the replay has run out; carry on from where it left us */
+      replay_stop();
+   }
+
+   nes_runframe(draw_flag, true);
+}
+
+/* once running, a frame shouldn't touch the heap at all */
+static void nes_checkallocs(void)
+{
+   int allocs = mem_endframe();
+
+   if (allocs)
+      log_printf("nes: %d heap allocation%s during a frame\n", allocs,
+                 1 == allocs ? "" : "s");
+}
+
+/* sound goes to the sink and, when capturing, to the capture too */
+static void nes_sound(void *buffer, int num_samples)
+{
+   nes.apu->process(buffer, num_samples);
+   capture_sound(buffer, num_samples);
+}
+
+/* trace the cpu as [trace] in the config says; only a core built with
+** NES6502_TRACE can
+*/
+static void nes_traceinit(void)
+{
+   const char *filename;
+
+   filename = config.read_string("trace", "file", "");
+   if (*filename)
+      trace6502_start(filename, config.read_int("trace", "records", TRACE6502_RECORDS),
+                      &nes.scanline);
+}
+
 /* main emulation loop */
 void nes_emulate(void)
 {
    int last_ticks, frames_to_render;
 
-   osd_setsound(nes.apu->process);
+   osd_setsound(nes_sound);
 
    last_ticks = nofrendo_ticks;
    frames_to_render = 0;
@@ -370,6 +469,16 @@ void nes_emulate(void)
    uint32 frame_time = 1000 / NES_REFRESH_RATE;
    uint32 frame_start_time = 0;
 
+   /* one or the other; a replay of a netplay session isn't a thing */
+   netplay_init();
+   if (false == netplay_active())
+      replay_init();
+
+   nes_traceinit();
+
+   /* startup allocations don't count against the first frame */
+   mem_endframe();
+
    while (false == nes.poweroff)
    {
       if (nofrendo_ticks != last_ticks)
@@ -390,8 +499,10 @@ void nes_emulate(void)
       else if (frames_to_render > 1)
       {
          frames_to_render--;
-         nes_renderframe(false);
+         nes_frame(false);
+         capture_frame(NULL, NULL);
          system_video(false);
+         nes_checkallocs();
       }
       else if ((1 == frames_to_render && true == nes.autoframeskip)
                || false == nes.autoframeskip)
@@ -399,8 +510,10 @@ void nes_emulate(void)
          frames_to_render = 0;
          frame_start_time = osd_get_ticks();
 
-         nes_renderframe(true);
+         nes_frame(true);
+         capture_frame(nes.vidbuf, nes.ppu->curpal);
          system_video(true);
+         nes_checkallocs();
 
          int remaining_time = (int)frame_time - (int)(osd_get_ticks() - frame_start_time);
          if (remaining_time > 0)
@@ -411,6 +524,11 @@ void nes_emulate(void)
 
       osd_delay(1); // reduce CPU usage
    }
+
+   capture_stop();
+   netplay_close();
+   replay_stop();
+   trace6502_stop();
 }
 
 static void mem_trash(uint8 *buffer, int length)
@@ -428,7 +546,10 @@ void nes_reset(int reset_type)
    {
       memset(nes.cpu->mem_page[0], 0, NES_RAMSIZE);
       if (nes.rominfo->vram)
+      {
          mem_trash(nes.rominfo->vram, 0x2000 * nes.rominfo->vram_banks);
+         ppu_refreshchr();
+      }
    }
 
    apu_reset();
@@ -450,7 +571,6 @@ void nes_destroy(nes_t **machine)
       mmc_destroy(&(*machine)->mmc);
       ppu_destroy(&(*machine)->ppu);
       apu_destroy(&(*machine)->apu);
-      bmp_destroy(&(*machine)->vidbuf);
       if ((*machine)->cpu)
       {
          if ((*machine)->cpu->mem_page[0])
@@ -498,6 +618,12 @@ int nes_insertcart(const char *filename, nes_t *machine)
    /* if there's VRAM, let the PPU know */
    if (NULL != machine->rominfo->vram)
       machine->ppu->vram_present = true;
+
+   /* decode the cart's CHR for the renderer */
+   if (ppu_setchr(machine->ppu, machine->rominfo->vrom,
+                  machine->rominfo->vrom_banks * 0x2000, machine->rominfo->vram,
+                  machine->rominfo->vram_banks * 0x2000))
+      goto _fail;
    
    apu_setext(machine->apu, machine->mmc->intf->sound_ext);
    
@@ -527,11 +653,11 @@ nes_t *nes_create(void)
 
    memset(machine, 0, sizeof(nes_t));
 
-   /* bitmap */
+   /* bitmap - the ppu renders straight into the video frame */
    /* 8 pixel overdraw */
-   machine->vidbuf = bmp_create(NES_SCREEN_WIDTH, NES_SCREEN_HEIGHT, 8);
-   if (NULL == machine->vidbuf)
+   if (vid_setmode(NES_SCREEN_WIDTH, NES_SCREEN_HEIGHT, 8))
       goto _fail;
+   machine->vidbuf = vid_getframe();
 
    machine->autoframeskip = true;
 
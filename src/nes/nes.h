@@ -106,6 +106,7 @@ extern void nes_setfiq(uint8 state);
 extern void nes_nmi(void);
 extern void nes_irq(void);
 extern void nes_emulate(void);
+extern void nes_runframe(bool draw_flag, bool sound_flag);
 
 extern void nes_reset(int reset_type);
 
@@ -36,12 +36,19 @@
 #include <bitmap.h>
 #include <vid_drv.h>
 #include <nes_pal.h>
+#include <nes_tile.h>
 #include <nesinput.h>
 
 
 /* PPU access */
 #define  PPU_MEM(x)           ppu.page[(x) >> 10][(x)]
 
+/* Pattern cache row for the tile row whose low bitplane is at x.  The
+** horizontally flipped row is 64 bytes on, which is also OAMF_HFLIP
+*/
+#define  PAT_TILESIZE         128
+#define  PAT_ROW(x)           (ppu.patpage[(x) >> 10] + (((x) & 0x3F7) << 3))
+
 /* Background (color 0) and solid sprite pixel flags */
 #define  BG_TRANS             0x80
 #define  SP_PIXEL             0x40
@@ -55,15 +62,205 @@
 /* the NES PPU */
 static ppu_t ppu;
 
+static void ppu_setrenderer(void);
+
+/* pattern pages that aren't backed by VROM or VRAM draw as transparent */
+static uint8 pat_blank[0x400 << 3];
+
+/* Background layer cache: the four logical nametables pre-rendered as
+** palette indices into one 512x480 image.  Tiles are redrawn a row at a
+** time when their dirty bit is set, and a background scanline is then a
+** scrolled copy out of the image through the palette.
+*/
+#define  LAYER_WIDTH          512
+#define  LAYER_HEIGHT         480
+
+static struct
+{
+   uint8 pixels[LAYER_HEIGHT][LAYER_WIDTH];
+   uint32 dirty[60][2];    /* a bit per tile, for left and right tables */
+   uint8 *nametab[4];      /* nametable pages the layer was drawn from */
+   uint8 *chr[4];          /* ...and background pattern pages */
+   uint32 bg_base;
+   bool chr_dirty;         /* pattern pages under the layer changed */
+   uint32 chr_tiles[8];    /* a bit per background tile written since */
+   bool tiles_dirty;       /* any of those set */
+   bool resync;            /* start of a frame, pattern pages may change */
+} bglayer;
+
+/* Static frame detection.  Each line of the last drawn frame records
+** the registers and pages it was drawn from, and ppu_changes counts
+** writes that changed VRAM, CHR-RAM or the palette (or OAM mid-frame).
+** A frame whose lines all match leaves the bitmap untouched - only the
+** sprite 0 strike and sprite overflow are replayed.
+*/
+typedef struct lineinfo_s
+{
+   uint32 vaddr;
+   int tile_xofs;
+   uint8 ctrl0, ctrl1;
+   bool drawsprites;
+   uint8 *patpage[8];
+   uint8 *nametab[4];
+} lineinfo_t;
+
+static uint32 ppu_changes = 0;
+
+static struct
+{
+   lineinfo_t line[240];
+   uint8 oam[256];
+   uint32 changes;      /* ppu_changes when the frame was drawn */
+   int strike_line, strike_x;
+   bool valid;          /* no changes while the frame was drawn */
+   bool skipping;       /* this frame matches, so far */
+   bool skipped;        /* ...and it matched all the way down */
+} ppu_frame;
+
+static void ppu_layerdirty(int table)
+{
+   int row;
+
+   for (row = (table >> 1) * 30; row < ((table >> 1) + 1) * 30; row++)
+      bglayer.dirty[row][table & 1] = 0xFFFFFFFF;
+}
+
+/* background tiles were written - dirty wherever the nametables use them */
+static void ppu_layertiles(void)
+{
+   const uint8 *names;
+   int table, row, x_tile, first_row;
+   uint32 bits;
+
+   for (table = 0; table < 4; table++)
+   {
+      names = &PPU_MEM(0x2000 + (table << 10));
+      first_row = (table >> 1) * 30;
+
+      for (row = 0; row < 30; row++, names += 32)
+      {
+         bits = 0;
+         for (x_tile = 0; x_tile < 32; x_tile++)
+         {
+            if (bglayer.chr_tiles[names[x_tile] >> 5] & ((uint32) 1 << (names[x_tile] & 31)))
+               bits |= (uint32) 1 << x_tile;
+         }
+
+         bglayer.dirty[first_row + row][table & 1] |= bits;
+      }
+   }
+
+   memset(bglayer.chr_tiles, 0, sizeof(bglayer.chr_tiles));
+   bglayer.tiles_dirty = false;
+}
+
+/* a nametable or attribute byte changed - dirty the tiles showing it */
+static void ppu_layerwrite(uint32 address)
+{
+   uint8 *location = &PPU_MEM(address);
+   int table, offset, row, first_row;
+   uint32 bits;
+
+   /* with mirroring, the byte can show up in more than one table */
+   for (table = 0; table < 4; table++)
+   {
+      offset = location - (ppu.page[8 + table] + 0x2000 + (table << 10));
+      if (offset < 0 || offset >= 0x400)
+         continue;
+
+      first_row = (table >> 1) * 30;
+
+      if (offset < 0x3C0)
+      {
+         bglayer.dirty[first_row + (offset >> 5)][table & 1] |= (uint32) 1 << (offset & 31);
+      }
+      else
+      {
+         /* an attribute byte covers a 4x4 block of tiles */
+         offset -= 0x3C0;
+         bits = (uint32) 0xF << ((offset & 7) << 2);
+         for (row = (offset >> 3) << 2; row < ((offset >> 3) << 2) + 4 && row < 30; row++)
+            bglayer.dirty[first_row + row][table & 1] |= bits;
+      }
+   }
+}
+
 
 void ppu_displaysprites(bool display)
 {
    ppu.drawsprites = display;
 }
 
+/* expand one tile row into its pattern cache slot, as-is and flipped */
+static void ppu_decoderow(uint8 *cache, uint8 pat1, uint8 pat2)
+{
+   int i;
+   uint8 pixel;
+
+   for (i = 0; i < 8; i++)
+   {
+      pixel = ((pat1 >> (7 - i)) & 1) | (((pat2 >> (7 - i)) & 1) << 1);
+      cache[i] = pixel;
+      cache[64 + 7 - i] = pixel;
+   }
+}
+
+static void ppu_decodechr(uint8 *cache, const uint8 *chr, int size)
+{
+   int tile, row;
+
+   for (tile = 0; tile < size; tile += 16, cache += PAT_TILESIZE)
+   {
+      for (row = 0; row < 8; row++)
+         ppu_decoderow(cache + (row << 3), chr[tile + row], chr[tile + row + 8]);
+   }
+}
+
+/* bank switches only need to find the cached copy of a 1kB page */
+static void ppu_setpatpage(ppu_t *src_ppu, int page)
+{
+   uint8 *location = src_ppu->page[page] + (page << 10);
+   int i;
+
+   for (i = 0; i < 2; i++)
+   {
+      if (src_ppu->patsrc[i] && location >= src_ppu->patsrc[i]
+          && location < src_ppu->patsrc[i] + src_ppu->patsize[i])
+      {
+         src_ppu->patpage[page] = src_ppu->patcache[i] + ((location - src_ppu->patsrc[i]) << 3);
+         return;
+      }
+   }
+
+   src_ppu->patpage[page] = pat_blank;
+}
+
+/* a write landed in CHR memory - re-expand the row it touched */
+INLINE void ppu_patwrite(uint32 address)
+{
+   int i, tile;
+
+   if (pat_blank == ppu.patpage[address >> 10])
+      return;
+
+   address &= ~8;
+   ppu_decoderow(PAT_ROW(address), PPU_MEM(address), PPU_MEM(address + 8));
+
+   /* the page may be under the layer more than once */
+   for (i = 0; i < 4; i++)
+   {
+      if (ppu.patpage[address >> 10] == bglayer.chr[i])
+      {
+         tile = (i << 6) + ((address & 0x3FF) >> 4);
+         bglayer.chr_tiles[tile >> 5] |= (uint32) 1 << (tile & 31);
+         bglayer.tiles_dirty = true;
+      }
+   }
+}
+
 void ppu_setcontext(ppu_t *src_ppu)
 {
-   int nametab[4];
+   int nametab[4], i;
    ASSERT(src_ppu);
    ppu = *src_ppu;
 
@@ -88,6 +285,18 @@ void ppu_setcontext(ppu_t *src_ppu)
    ppu.page[13] = ppu.page[9] - 0x1000;
    ppu.page[14] = ppu.page[10] - 0x1000;
    ppu.page[15] = ppu.page[11] - 0x1000;
+
+   for (i = 0; i < 8; i++)
+      ppu_setpatpage(&ppu, i);
+
+   ppu.obj_dirty = true;
+
+   /* anything could have changed under the layer cache */
+   bglayer.chr_dirty = true;
+   bglayer.resync = true;
+   ppu_frame.valid = false;
+
+   ppu_setrenderer();
 }
 
 void ppu_getcontext(ppu_t *dest_ppu)
@@ -124,6 +333,7 @@ ppu_t *ppu_create(void)
 {
    static bool pal_generated = false;
    ppu_t *temp;
+   int i;
 
    temp = malloc(sizeof(ppu_t));
    if (NULL == temp)
@@ -135,11 +345,16 @@ ppu_t *ppu_create(void)
    temp->vromswitch = NULL;
    temp->vram_present = false;
    temp->drawsprites = true;
+   temp->obj_dirty = true;
+
+   for (i = 0; i < 8; i++)
+      temp->patpage[i] = pat_blank;
 
    /* TODO: probably a better way to do this... */
    if (false == pal_generated)
    {
       pal_generate();
+      tile_setkernel(TILE_KERNEL_AUTO);
       pal_generated = true;
    }
 
@@ -152,6 +367,10 @@ void ppu_destroy(ppu_t **src_ppu)
 {
    if (*src_ppu)
    {
+      if ((*src_ppu)->patcache[0])
+         free((*src_ppu)->patcache[0]);
+      if ((*src_ppu)->patcache[1])
+         free((*src_ppu)->patcache[1]);
       free(*src_ppu);
       *src_ppu = NULL;
    }
@@ -159,6 +378,8 @@ void ppu_destroy(ppu_t **src_ppu)
 
 void ppu_setpage(int size, int page_num, uint8 *location)
 {
+   int first = page_num;
+
    /* deliberately fall through */
    switch (size)
    {
@@ -176,6 +397,59 @@ void ppu_setpage(int size, int page_num, uint8 *location)
       ppu.page[page_num++] = location;
       break;
    }
+
+   for (; first < page_num && first < 8; first++)
+      ppu_setpatpage(&ppu, first);
+}
+
+/* build the pattern cache for a cart's CHR memory */
+int ppu_setchr(ppu_t *src_ppu, uint8 *vrom, int vrom_size,
+               uint8 *vram, int vram_size)
+{
+   int i;
+
+   src_ppu->patsrc[0] = vrom;
+   src_ppu->patsize[0] = vrom ? vrom_size : 0;
+   src_ppu->patsrc[1] = vram;
+   src_ppu->patsize[1] = vram ? vram_size : 0;
+
+   for (i = 0; i < 2; i++)
+   {
+      if (src_ppu->patcache[i])
+      {
+         free(src_ppu->patcache[i]);
+         src_ppu->patcache[i] = NULL;
+      }
+
+      if (0 == src_ppu->patsize[i])
+         continue;
+
+      src_ppu->patcache[i] = malloc(src_ppu->patsize[i] << 3);
+      if (NULL == src_ppu->patcache[i])
+         return -1;
+
+      ppu_decodechr(src_ppu->patcache[i], src_ppu->patsrc[i], src_ppu->patsize[i]);
+   }
+
+   for (i = 0; i < 8; i++)
+      ppu_setpatpage(src_ppu, i);
+
+   return 0;
+}
+
+/* CHR memory was changed behind our back (reset, state load) */
+void ppu_refreshchr(void)
+{
+   int i;
+
+   for (i = 0; i < 2; i++)
+   {
+      if (ppu.patcache[i])
+         ppu_decodechr(ppu.patcache[i], ppu.patsrc[i], ppu.patsize[i]);
+   }
+
+   bglayer.chr_dirty = true;
+   ppu_changes++;
 }
 
 /* make sure $3000-$3F00 mirrors $2000-$2F00 */
@@ -229,6 +503,8 @@ void ppu_reset(int reset_type)
 
    ppu.latch = 0;
    ppu.vram_accessible = true;
+   ppu.obj_dirty = true;
+   ppu_frame.valid = false;
 }
 
 /* we render a scanline of graphics first so we know exactly
@@ -279,6 +555,10 @@ static void ppu_oamdma(uint8 value)
          ppu.oam[oam_loc] = nes6502_getbyte(cpu_address++);
    }
 
+   ppu.obj_dirty = true;
+   if (false == ppu.vram_accessible)
+      ppu_changes++;
+
    /* make the CPU spin for DMA cycles */
    nes6502_burn(513);
    nes6502_release();
@@ -412,7 +692,11 @@ void ppu_write(uint32 address, uint8 value)
    case PPU_CTRL0:
       ppu.ctrl0 = value;
 
-      ppu.obj_height = (value & PPU_CTRL0F_OBJ16) ? 16 : 8;
+      if (ppu.obj_height != ((value & PPU_CTRL0F_OBJ16) ? 16 : 8))
+      {
+         ppu.obj_height = (value & PPU_CTRL0F_OBJ16) ? 16 : 8;
+         ppu.obj_dirty = true;
+      }
       ppu.bg_base = (value & PPU_CTRL0F_BGADDR) ? 0x1000 : 0;
       ppu.obj_base = (value & PPU_CTRL0F_OBJADDR) ? 0x1000 : 0;
       ppu.vaddr_inc = (value & PPU_CTRL0F_ADDRINC) ? 32 : 1;
@@ -421,6 +705,8 @@ void ppu_write(uint32 address, uint8 value)
       /* Mask out bits 10 & 11 in the ppu latch */
       ppu.vaddr_latch &= ~0x0C00;
       ppu.vaddr_latch |= ((value & 3) << 10);
+
+      ppu_setrenderer();
       break;
 
    case PPU_CTRL1:
@@ -430,6 +716,8 @@ void ppu_write(uint32 address, uint8 value)
       ppu.bg_on = (value & PPU_CTRL1F_BGON) ? true : false;
       ppu.obj_mask = (value & PPU_CTRL1F_OBJMASK) ? false : true;
       ppu.bg_mask = (value & PPU_CTRL1F_BGMASK) ? false : true;
+
+      ppu_setrenderer();
       break;
 
    case PPU_OAMADDR:
@@ -437,7 +725,11 @@ void ppu_write(uint32 address, uint8 value)
       break;
 
    case PPU_OAMDATA:
+      /* OAM is only compared at the top of a frame */
+      if (false == ppu.vram_accessible)
+         ppu_changes++;
       ppu.oam[ppu.oam_addr++] = value;
+      ppu.obj_dirty = true;
       break;
 
    case PPU_SCROLL:
@@ -487,7 +779,13 @@ void ppu_write(uint32 address, uint8 value)
          {
             log_printf("VRAM write to $%04X, scanline %d\n", 
                        ppu.vaddr, nes_getcontextptr()->scanline);
+            if (0xFF != PPU_MEM(ppu.vaddr))
+               ppu_changes++;
             PPU_MEM(ppu.vaddr) = 0xFF; /* corrupt */
+            if (ppu.vaddr < 0x2000)
+               ppu_patwrite(ppu.vaddr);
+            else
+               ppu_layerwrite(ppu.vaddr);
          }
          else 
          {
@@ -496,7 +794,13 @@ void ppu_write(uint32 address, uint8 value)
             if (false == ppu.vram_present && addr >= 0x3000)
                ppu.vaddr -= 0x1000;
 
+            if (value != PPU_MEM(addr))
+               ppu_changes++;
             PPU_MEM(addr) = value;
+            if (addr < 0x2000)
+               ppu_patwrite(addr);
+            else
+               ppu_layerwrite(addr);
          }
       }
       else
@@ -505,11 +809,16 @@ void ppu_write(uint32 address, uint8 value)
          {
             int i;
 
+            if (((value & 0x3F) | BG_TRANS) != ppu.palette[0])
+               ppu_changes++;
+
             for (i = 0; i < 8; i ++)
                ppu.palette[i << 2] = (value & 0x3F) | BG_TRANS;
          }
          else if (ppu.vaddr & 3)
          {
+            if ((value & 0x3F) != ppu.palette[ppu.vaddr & 0x1F])
+               ppu_changes++;
             ppu.palette[ppu.vaddr & 0x1F] = value & 0x3F;
          }
       }
@@ -568,6 +877,7 @@ void ppu_setdefaultpal(ppu_t *src_ppu)
 void ppu_setlatchfunc(ppulatchfunc_t func)
 {
    ppu.latchfunc = func;
+   ppu_setrenderer();
 }
 
 void ppu_setvromswitch(ppuvromswitch_t func)
@@ -592,123 +902,220 @@ INLINE void draw_bgtile(uint8 *surface, uint8 pat1, uint8 pat2,
    *surface = colors[pattern & 3];
 }
 
-INLINE int draw_oamtile(uint8 *surface, uint8 attrib, uint8 pat1, 
-                        uint8 pat2, const uint8 *col_tbl, bool check_strike)
+/* colors is the tile row from the pattern cache, already flipped if need
+** be.  returns the first solid sprite pixel over a solid bg pixel, or -1
+*/
+INLINE int draw_oamstrike(const uint8 *surface, const uint8 *colors)
+{
+   if (colors[0] && BG_SOLID(surface[0]))
+      return 0;
+   else if (colors[1] && BG_SOLID(surface[1]))
+      return 1;
+   else if (colors[2] && BG_SOLID(surface[2]))
+      return 2;
+   else if (colors[3] && BG_SOLID(surface[3]))
+      return 3;
+   else if (colors[4] && BG_SOLID(surface[4]))
+      return 4;
+   else if (colors[5] && BG_SOLID(surface[5]))
+      return 5;
+   else if (colors[6] && BG_SOLID(surface[6]))
+      return 6;
+   else if (colors[7] && BG_SOLID(surface[7]))
+      return 7;
+
+   return -1;
+}
+
+/* sprite in front of the background */
+INLINE void draw_oamfront(uint8 *surface, const uint8 *colors, const uint8 *col_tbl)
 {
-   int strike_pixel = -1;
-   uint32 color = ((pat2 & 0xAA) << 8) | ((pat2 & 0x55) << 1)
-                  | ((pat1 & 0xAA) << 7) | (pat1 & 0x55);
+   if (colors[0] && SP_CLEAR(surface[0]))
+      surface[0] = SP_PIXEL | col_tbl[colors[0]];
+   if (colors[1] && SP_CLEAR(surface[1]))
+      surface[1] = SP_PIXEL | col_tbl[colors[1]];
+   if (colors[2] && SP_CLEAR(surface[2]))
+      surface[2] = SP_PIXEL | col_tbl[colors[2]];
+   if (colors[3] && SP_CLEAR(surface[3]))
+      surface[3] = SP_PIXEL | col_tbl[colors[3]];
+   if (colors[4] && SP_CLEAR(surface[4]))
+      surface[4] = SP_PIXEL | col_tbl[colors[4]];
+   if (colors[5] && SP_CLEAR(surface[5]))
+      surface[5] = SP_PIXEL | col_tbl[colors[5]];
+   if (colors[6] && SP_CLEAR(surface[6]))
+      surface[6] = SP_PIXEL | col_tbl[colors[6]];
+   if (colors[7] && SP_CLEAR(surface[7]))
+      surface[7] = SP_PIXEL | col_tbl[colors[7]];
+}
+
+/* sprite behind the background */
+INLINE void draw_oambehind(uint8 *surface, const uint8 *colors, const uint8 *col_tbl)
+{
+   if (colors[0])
+      surface[0] = SP_PIXEL | (BG_CLEAR(surface[0]) ? col_tbl[colors[0]] : surface[0]);
+   if (colors[1])
+      surface[1] = SP_PIXEL | (BG_CLEAR(surface[1]) ? col_tbl[colors[1]] : surface[1]);
+   if (colors[2])
+      surface[2] = SP_PIXEL | (BG_CLEAR(surface[2]) ? col_tbl[colors[2]] : surface[2]);
+   if (colors[3])
+      surface[3] = SP_PIXEL | (BG_CLEAR(surface[3]) ? col_tbl[colors[3]] : surface[3]);
+   if (colors[4])
+      surface[4] = SP_PIXEL | (BG_CLEAR(surface[4]) ? col_tbl[colors[4]] : surface[4]);
+   if (colors[5])
+      surface[5] = SP_PIXEL | (BG_CLEAR(surface[5]) ? col_tbl[colors[5]] : surface[5]);
+   if (colors[6])
+      surface[6] = SP_PIXEL | (BG_CLEAR(surface[6]) ? col_tbl[colors[6]] : surface[6]);
+   if (colors[7])
+      surface[7] = SP_PIXEL | (BG_CLEAR(surface[7]) ? col_tbl[colors[7]] : surface[7]);
+}
+
+/* Scanline renderers.  The *_tmpl routines below take the PPU mode as
+** constant arguments, and the PPU_RENDERBG/PPU_RENDEROAM macros stamp out
+** one copy per mode, so those tests are compiled out of the tile and
+** sprite loops.  ppu_setrenderer() picks the copies for the current mode
+** whenever $2000/$2001 or the mapper's latch function change.
+*/
+static void (*ppu_renderbg)(uint8 *vidbuf);
+static void (*ppu_renderoam)(uint8 *vidbuf, int scanline);
 
-   /* sprite is not 100% transparent */
-   if (color)
+/* draw a line of transparent background color if bg is disabled */
+static void ppu_renderbg_off(uint8 *vidbuf)
+{
+   memset(vidbuf, FULLBG, NES_SCREEN_WIDTH);
+}
+
+/* draw the dirty tiles of one row of the layer cache */
+static void ppu_layerrow(int row)
+{
+   int half, table, x_tile, y_tile, line, i;
+   uint32 dirty, nt_base;
+   uint8 tile_index, attrib, col_high;
+   const uint8 *data_ptr;
+   uint8 *dest;
+
+   y_tile = row % 30;
+
+   for (half = 0; half < 2; half++)
    {
-      uint8 colors[8];
+      dirty = bglayer.dirty[row][half];
+      if (0 == dirty)
+         continue;
 
-      /* swap pixels around if our tile is flipped */
-      if (0 == (attrib & OAMF_HFLIP))
-      {
-         colors[0] = (color >> 14) & 3;
-         colors[1] = (color >> 6) & 3;
-         colors[2] = (color >> 12) & 3;
-         colors[3] = (color >> 4) & 3;
-         colors[4] = (color >> 10) & 3;
-         colors[5] = (color >> 2) & 3;
-         colors[6] = (color >> 8) & 3;
-         colors[7] = color & 3;
-      }
-      else
-      {
-         colors[7] = (color >> 14) & 3;
-         colors[6] = (color >> 6) & 3;
-         colors[5] = (color >> 12) & 3;
-         colors[4] = (color >> 4) & 3;
-         colors[3] = (color >> 10) & 3;
-         colors[2] = (color >> 2) & 3;
-         colors[1] = (color >> 8) & 3;
-         colors[0] = color & 3;
-      }
+      table = ((row / 30) << 1) + half;
+      nt_base = 0x2000 + (table << 10);
 
-      /* check for solid sprite pixel overlapping solid bg pixel */
-      if (check_strike)
+      for (x_tile = 0; x_tile < 32; x_tile++)
       {
-         if (colors[0] && BG_SOLID(surface[0]))
-            strike_pixel = 0;
-         else if (colors[1] && BG_SOLID(surface[1]))
-            strike_pixel = 1;
-         else if (colors[2] && BG_SOLID(surface[2]))
-            strike_pixel = 2;
-         else if (colors[3] && BG_SOLID(surface[3]))
-            strike_pixel = 3;
-         else if (colors[4] && BG_SOLID(surface[4]))
-            strike_pixel = 4;
-         else if (colors[5] && BG_SOLID(surface[5]))
-            strike_pixel = 5;
-         else if (colors[6] && BG_SOLID(surface[6]))
-            strike_pixel = 6;
-         else if (colors[7] && BG_SOLID(surface[7]))
-            strike_pixel = 7;
-      }
+         if (0 == (dirty & ((uint32) 1 << x_tile)))
+            continue;
 
-      /* draw the character */
-      if (attrib & OAMF_BEHIND)
-      {
-         if (colors[0])
-            surface[0] = SP_PIXEL | (BG_CLEAR(surface[0]) ? col_tbl[colors[0]] : surface[0]);
-         if (colors[1])
-            surface[1] = SP_PIXEL | (BG_CLEAR(surface[1]) ? col_tbl[colors[1]] : surface[1]);
-         if (colors[2])
-            surface[2] = SP_PIXEL | (BG_CLEAR(surface[2]) ? col_tbl[colors[2]] : surface[2]);
-         if (colors[3])
-            surface[3] = SP_PIXEL | (BG_CLEAR(surface[3]) ? col_tbl[colors[3]] : surface[3]);
-         if (colors[4])
-            surface[4] = SP_PIXEL | (BG_CLEAR(surface[4]) ? col_tbl[colors[4]] : surface[4]);
-         if (colors[5])
-            surface[5] = SP_PIXEL | (BG_CLEAR(surface[5]) ? col_tbl[colors[5]] : surface[5]);
-         if (colors[6])
-            surface[6] = SP_PIXEL | (BG_CLEAR(surface[6]) ? col_tbl[colors[6]] : surface[6]);
-         if (colors[7])
-            surface[7] = SP_PIXEL | (BG_CLEAR(surface[7]) ? col_tbl[colors[7]] : surface[7]);
+         tile_index = PPU_MEM(nt_base + (y_tile << 5) + x_tile);
+         attrib = PPU_MEM(nt_base + 0x3C0 + ((y_tile & 0x1C) << 1) + (x_tile >> 2));
+         col_high = ((attrib >> ((x_tile & 2) + ((y_tile & 2) << 1))) & 3) << 2;
+
+         data_ptr = PAT_ROW(ppu.bg_base + (tile_index << 4));
+         dest = &bglayer.pixels[row << 3][(half << 8) + (x_tile << 3)];
+
+         for (line = 0; line < 8; line++, data_ptr += 8, dest += LAYER_WIDTH)
+         {
+            for (i = 0; i < 8; i++)
+               dest[i] = data_ptr[i] | col_high;
+         }
       }
-      else
+
+      bglayer.dirty[row][half] = 0;
+   }
+}
+
+/* draw a scanline as a scrolled copy out of the layer cache.  returns
+** false if the cache can't be used for this line
+*/
+static bool ppu_layerline(uint8 *vidbuf)
+{
+   uint8 **chr = &ppu.patpage[ppu.bg_base >> 10];
+   int table, y_tile, row, x, length;
+   const uint8 *src;
+   uint8 *dest;
+
+   /* rows 30 and 31 are attributes, only the tile path fetches those */
+   y_tile = (ppu.vaddr >> 5) & 0x1F;
+   if (y_tile >= 30)
+      return false;
+
+   /* background CHR may only change under the layer between frames - if
+   ** a split screen switches banks mid-frame, the tile path draws the
+   ** rest of the frame
+   */
+   if (bglayer.bg_base != ppu.bg_base
+       || memcmp(bglayer.chr, chr, sizeof(bglayer.chr)))
+   {
+      if (false == bglayer.resync)
+         return false;
+
+      bglayer.bg_base = ppu.bg_base;
+      memcpy(bglayer.chr, chr, sizeof(bglayer.chr));
+      bglayer.chr_dirty = true;
+   }
+
+   bglayer.resync = false;
+
+   if (bglayer.chr_dirty)
+   {
+      memset(bglayer.dirty, 0xFF, sizeof(bglayer.dirty));
+      memset(bglayer.chr_tiles, 0, sizeof(bglayer.chr_tiles));
+      bglayer.tiles_dirty = false;
+      bglayer.chr_dirty = false;
+   }
+   else if (bglayer.tiles_dirty)
+   {
+      ppu_layertiles();
+   }
+
+   /* mirroring changed */
+   for (table = 0; table < 4; table++)
+   {
+      if (bglayer.nametab[table] != ppu.page[8 + table])
       {
-         if (colors[0] && SP_CLEAR(surface[0]))
-            surface[0] = SP_PIXEL | col_tbl[colors[0]];
-         if (colors[1] && SP_CLEAR(surface[1]))
-            surface[1] = SP_PIXEL | col_tbl[colors[1]];
-         if (colors[2] && SP_CLEAR(surface[2]))
-            surface[2] = SP_PIXEL | col_tbl[colors[2]];
-         if (colors[3] && SP_CLEAR(surface[3]))
-            surface[3] = SP_PIXEL | col_tbl[colors[3]];
-         if (colors[4] && SP_CLEAR(surface[4]))
-            surface[4] = SP_PIXEL | col_tbl[colors[4]];
-         if (colors[5] && SP_CLEAR(surface[5]))
-            surface[5] = SP_PIXEL | col_tbl[colors[5]];
-         if (colors[6] && SP_CLEAR(surface[6]))
-            surface[6] = SP_PIXEL | col_tbl[colors[6]];
-         if (colors[7] && SP_CLEAR(surface[7]))
-            surface[7] = SP_PIXEL | col_tbl[colors[7]];
+         bglayer.nametab[table] = ppu.page[8 + table];
+         ppu_layerdirty(table);
       }
    }
 
-   return strike_pixel;
+   table = (ppu.vaddr >> 10) & 3;
+   row = (table >> 1) * 30 + y_tile;
+   if (bglayer.dirty[row][0] | bglayer.dirty[row][1])
+      ppu_layerrow(row);
+
+   src = bglayer.pixels[(row << 3) + ((ppu.vaddr >> 12) & 7)];
+   x = ((table & 1) << 8) + ((ppu.vaddr & 0x1F) << 3);
+   dest = vidbuf - ppu.tile_xofs;
+   length = 33 * 8;
+
+   /* wrap around from the right hand tables to the left */
+   if (x + length > LAYER_WIDTH)
+   {
+      tile_lookup(dest, src + x, ppu.palette, LAYER_WIDTH - x);
+      dest += LAYER_WIDTH - x;
+      length -= LAYER_WIDTH - x;
+      x = 0;
+   }
+
+   tile_lookup(dest, src + x, ppu.palette, length);
+
+   return true;
 }
 
-static void ppu_renderbg(uint8 *vidbuf)
+/* fetch and draw the 33 tiles of a scanline */
+ALWAYS_INLINE void ppu_rendertiles(uint8 *vidbuf, bool latch)
 {
-   uint8 *bmp_ptr, *data_ptr, *tile_ptr, *attrib_ptr;
+   uint8 *tile_ptr, *attrib_ptr;
    uint32 refresh_vaddr, bg_offset, attrib_base;
-   int tile_count;
+   int tile_num;
    uint8 tile_index, x_tile, y_tile;
    uint8 col_high, attrib, attrib_shift;
+   const uint8 *rows[TILE_MAXFETCH];
+   uint8 tile_col[TILE_MAXFETCH];
 
-   /* draw a line of transparent background color if bg is disabled */
-   if (false == ppu.bg_on)
-   {
-      memset(vidbuf, FULLBG, NES_SCREEN_WIDTH);
-      return;
-   }
-
-   bmp_ptr = vidbuf - ppu.tile_xofs; /* scroll x */
    refresh_vaddr = 0x2000 + (ppu.vaddr & 0x0FE0); /* mask out x tile */
    x_tile = ppu.vaddr & 0x1F;
    y_tile = (ppu.vaddr >> 5) & 0x1F; /* to simplify calculations */
@@ -722,21 +1129,18 @@ static void ppu_renderbg(uint8 *vidbuf)
    attrib_shift = (x_tile & 2) + ((y_tile & 2) << 1);
    col_high = ((attrib >> attrib_shift) & 3) << 2;
 
-   /* ppu fetches 33 tiles */
-   tile_count = 33;
-   while (tile_count--)
+   /* ppu fetches 33 tiles - gather them all, then decode the line at once */
+   for (tile_num = 0; tile_num < 33; tile_num++)
    {
       /* Tile number from nametable */
       tile_index = *tile_ptr++;
-      data_ptr = &PPU_MEM(bg_offset + (tile_index << 4));
+      rows[tile_num] = PAT_ROW(bg_offset + (tile_index << 4));
+      tile_col[tile_num] = col_high;
 
       /* Handle $FD/$FE tile VROM switching (PunchOut) */
-      if (ppu.latchfunc)
+      if (latch)
          ppu.latchfunc(ppu.bg_base, tile_index);
 
-      draw_bgtile(bmp_ptr, data_ptr[0], data_ptr[8], ppu.palette + col_high);
-      bmp_ptr += 8;
-
       x_tile++;
 
       if (0 == (x_tile & 1))     /* check every 2 tiles */
@@ -763,8 +1167,18 @@ static void ppu_renderbg(uint8 *vidbuf)
       }
    }
 
+   /* scroll x */
+   tile_drawbg(vidbuf - ppu.tile_xofs, rows, tile_col, ppu.palette, 33);
+}
+
+ALWAYS_INLINE void ppu_renderbg_tmpl(uint8 *vidbuf, bool latch, bool mask)
+{
+   /* latch mappers have to see every tile fetch */
+   if (latch || false == ppu_layerline(vidbuf))
+      ppu_rendertiles(vidbuf, latch);
+
    /* Blank left hand column if need be */
-   if (ppu.bg_mask)
+   if (mask)
    {
       uint32 *buf_ptr = (uint32 *) vidbuf;
       uint32 bg_clear = FULLBG | FULLBG << 8 | FULLBG << 16 | FULLBG << 24;
@@ -774,6 +1188,17 @@ static void ppu_renderbg(uint8 *vidbuf)
    }
 }
 
+#define  PPU_RENDERBG(name, latch, mask) \
+static void name(uint8 *vidbuf) \
+{ \
+   ppu_renderbg_tmpl(vidbuf, latch, mask); \
+}
+
+PPU_RENDERBG(ppu_renderbg_plain, false, false)
+PPU_RENDERBG(ppu_renderbg_mask, false, true)
+PPU_RENDERBG(ppu_renderbg_latch, true, false)
+PPU_RENDERBG(ppu_renderbg_latchmask, true, true)
+
 /* OAM entry */
 typedef struct obj_s
 {
@@ -783,51 +1208,85 @@ typedef struct obj_s
    uint8 x_loc;
 } obj_t;
 
+/* bucket sprites by the scanlines they cover, so rendering a line only
+** has to look at the sprites that are actually on it
+*/
+static void ppu_evaloam(void)
+{
+   obj_t *sprite_ptr;
+   int sprite_num, scanline, last_line;
+   uint8 sprite_y;
+
+   memset(ppu.obj_count, 0, sizeof(ppu.obj_count));
+
+   sprite_ptr = (obj_t *) ppu.oam;
+
+   for (sprite_num = 0; sprite_num < 64; sprite_num++, sprite_ptr++)
+   {
+      sprite_y = sprite_ptr->y_loc + 1;
+      if ((0 == sprite_y) || (sprite_y >= 240))
+         continue;
+
+      last_line = sprite_y + ppu.obj_height;
+      if (last_line > 240)
+         last_line = 240;
+
+      /* later sprites on a full line are dropped */
+      for (scanline = sprite_y; scanline < last_line; scanline++)
+      {
+         if (ppu.obj_count[scanline] < PPU_MAXSPRITE)
+            ppu.obj_list[scanline][ppu.obj_count[scanline]++] = sprite_num;
+      }
+   }
+
+   ppu.obj_dirty = false;
+}
+
+static void ppu_renderoam_off(uint8 *vidbuf, int scanline)
+{
+   UNUSED(vidbuf);
+   UNUSED(scanline);
+}
+
 /* TODO: fetch valid OAM a scanline before, like the Real Thing */
-static void ppu_renderoam(uint8 *vidbuf, int scanline)
+ALWAYS_INLINE void ppu_renderoam_tmpl(uint8 *vidbuf, int scanline, bool obj16,
+                                      bool latch, bool mask)
 {
    uint8 *buf_ptr;
    uint32 vram_offset, savecol[2];
-   int sprite_num, spritecount;
+   int list_num, sprite_num;
    obj_t *sprite_ptr;
-   uint8 sprite_height;
 
-   if (false == ppu.obj_on)
-      return;
+   if (ppu.obj_dirty)
+      ppu_evaloam();
 
    /* Get our buffer pointer */
    buf_ptr = vidbuf;
 
    /* Save left hand column? */
-   if (ppu.obj_mask)
+   if (mask)
    {
       savecol[0] = ((uint32 *) buf_ptr)[0];
       savecol[1] = ((uint32 *) buf_ptr)[1];
    }
 
-   sprite_height = ppu.obj_height;
    vram_offset = ppu.obj_base;
-   spritecount = 0;
 
-   sprite_ptr = (obj_t *) ppu.oam;
-
-   for (sprite_num = 0; sprite_num < 64; sprite_num++, sprite_ptr++)
+   for (list_num = 0; list_num < ppu.obj_count[scanline]; list_num++)
    {
-      uint8 *data_ptr, *bmp_ptr;
+      const uint8 *data_ptr;
+      uint8 *bmp_ptr;
       uint32 vram_adr;
       int y_offset;
       uint8 tile_index, attrib, col_high;
       uint8 sprite_y, sprite_x;
-      bool check_strike;
+      uint32 solid[2];
       int strike_pixel;
 
+      sprite_num = ppu.obj_list[scanline][list_num];
+      sprite_ptr = (obj_t *) ppu.oam + sprite_num;
       sprite_y = sprite_ptr->y_loc + 1;
 
-      /* Check to see if sprite is out of range */
-      if ((sprite_y > scanline) || (sprite_y <= (scanline - sprite_height))
-          || (0 == sprite_y) || (sprite_y >= 240))
-         continue;
-
       sprite_x = sprite_ptr->x_loc;
       tile_index = sprite_ptr->tile;
       attrib = sprite_ptr->atr;
@@ -835,21 +1294,18 @@ static void ppu_renderoam(uint8 *vidbuf, int scanline)
       bmp_ptr = buf_ptr + sprite_x;
 
       /* Handle $FD/$FE tile VROM switching (PunchOut) */
-      if (ppu.latchfunc)
+      if (latch)
          ppu.latchfunc(vram_offset, tile_index);
 
       /* Get upper two bits of color */
       col_high = ((attrib & 3) << 2);
 
       /* 8x16 even sprites use $0000, odd use $1000 */
-      if (16 == ppu.obj_height)
+      if (obj16)
          vram_adr = ((tile_index & 1) << 12) | ((tile_index & 0xFE) << 4);
       else
          vram_adr = vram_offset + (tile_index << 4);
 
-      /* Get the address of the tile */
-      data_ptr = &PPU_MEM(vram_adr);
-
       /* Calculate offset (line within the sprite) */
       y_offset = scanline - sprite_y;
       if (y_offset > 7)
@@ -858,68 +1314,134 @@ static void ppu_renderoam(uint8 *vidbuf, int scanline)
       /* Account for vertical flippage */
       if (attrib & OAMF_VFLIP)
       {
-         if (16 == ppu.obj_height)
+         if (obj16)
             y_offset -= 23;
          else
             y_offset -= 7;
 
-         data_ptr -= y_offset;
+         vram_adr -= y_offset;
       }
       else
       {
-         data_ptr += y_offset;
+         vram_adr += y_offset;
       }
 
+      /* Get the tile row - the flipped copy sits OAMF_HFLIP bytes on */
+      data_ptr = PAT_ROW(vram_adr) + (attrib & OAMF_HFLIP);
+
+      /* sprite is 100% transparent */
+      memcpy(solid, data_ptr, sizeof(solid));
+      if (0 == (solid[0] | solid[1]))
+         continue;
+
       /* if we're on sprite 0 and sprite 0 strike flag isn't set,
       ** check for a strike 
       */
-      check_strike = (0 == sprite_num) && (false == ppu.strikeflag);
-      strike_pixel = draw_oamtile(bmp_ptr, attrib, data_ptr[0], data_ptr[8], ppu.palette + 16 + col_high, check_strike);
-      if (strike_pixel >= 0)
-         ppu_setstrike(strike_pixel);
-
-      /* maximum of 8 sprites per scanline */
-      if (++spritecount == PPU_MAXSPRITE)
+      if (0 == sprite_num && false == ppu.strikeflag)
       {
-         ppu.stat |= PPU_STATF_MAXSPRITE;
-         break;
+         strike_pixel = draw_oamstrike(bmp_ptr, data_ptr);
+         if (strike_pixel >= 0)
+         {
+            ppu_setstrike(strike_pixel);
+            ppu_frame.strike_line = scanline;
+            ppu_frame.strike_x = strike_pixel;
+         }
       }
+
+      if (attrib & OAMF_BEHIND)
+         draw_oambehind(bmp_ptr, data_ptr, ppu.palette + 16 + col_high);
+      else
+         draw_oamfront(bmp_ptr, data_ptr, ppu.palette + 16 + col_high);
    }
 
+   /* maximum of 8 sprites per scanline */
+   if (PPU_MAXSPRITE == ppu.obj_count[scanline])
+      ppu.stat |= PPU_STATF_MAXSPRITE;
+
    /* Restore lefthand column */
-   if (ppu.obj_mask)
+   if (mask)
    {
       ((uint32 *) buf_ptr)[0] = savecol[0];
       ((uint32 *) buf_ptr)[1] = savecol[1];
    }
 }
 
+#define  PPU_RENDEROAM(name, obj16, latch, mask) \
+static void name(uint8 *vidbuf, int scanline) \
+{ \
+   ppu_renderoam_tmpl(vidbuf, scanline, obj16, latch, mask); \
+}
+
+PPU_RENDEROAM(ppu_renderoam_8, false, false, false)
+PPU_RENDEROAM(ppu_renderoam_8mask, false, false, true)
+PPU_RENDEROAM(ppu_renderoam_8latch, false, true, false)
+PPU_RENDEROAM(ppu_renderoam_8latchmask, false, true, true)
+PPU_RENDEROAM(ppu_renderoam_16, true, false, false)
+PPU_RENDEROAM(ppu_renderoam_16mask, true, false, true)
+PPU_RENDEROAM(ppu_renderoam_16latch, true, true, false)
+PPU_RENDEROAM(ppu_renderoam_16latchmask, true, true, true)
+
+/* indexed by [latch][mask] and [obj16][latch][mask] */
+static void (*const ppu_bgrenderers[2][2])(uint8 *vidbuf) =
+{
+   { ppu_renderbg_plain, ppu_renderbg_mask },
+   { ppu_renderbg_latch, ppu_renderbg_latchmask }
+};
+
+static void (*const ppu_oamrenderers[2][2][2])(uint8 *vidbuf, int scanline) =
+{
+   {
+      { ppu_renderoam_8, ppu_renderoam_8mask },
+      { ppu_renderoam_8latch, ppu_renderoam_8latchmask }
+   },
+   {
+      { ppu_renderoam_16, ppu_renderoam_16mask },
+      { ppu_renderoam_16latch, ppu_renderoam_16latchmask }
+   }
+};
+
+/* pick the scanline renderers for the current mode */
+static void ppu_setrenderer(void)
+{
+   int latch = (NULL != ppu.latchfunc);
+
+   if (ppu.bg_on)
+      ppu_renderbg = ppu_bgrenderers[latch][ppu.bg_mask];
+   else
+      ppu_renderbg = ppu_renderbg_off;
+
+   if (ppu.obj_on)
+      ppu_renderoam = ppu_oamrenderers[16 == ppu.obj_height][latch][ppu.obj_mask];
+   else
+      ppu_renderoam = ppu_renderoam_off;
+}
+
 /* Fake rendering a line */
 /* This is needed for sprite 0 hits when we're skipping drawing a frame */
 static void ppu_fakeoam(int scanline)
 {
-   uint8 *data_ptr;
+   const uint8 *colors;
    obj_t *sprite_ptr;
-   uint32 vram_adr, color;
+   uint32 vram_adr;
    int y_offset;
-   uint8 pat1, pat2;
    uint8 tile_index, attrib;
-   uint8 sprite_height, sprite_y, sprite_x;
+   uint8 sprite_y, sprite_x;
 
    /* we don't need to be here if strike flag is set */
 
    if (false == ppu.obj_on || ppu.strikeflag)
       return;
 
-   sprite_height = ppu.obj_height;
-   sprite_ptr = (obj_t *) ppu.oam;
-   sprite_y = sprite_ptr->y_loc + 1;
+   if (ppu.obj_dirty)
+      ppu_evaloam();
 
-   /* Check to see if sprite is out of range */
-   if ((sprite_y > scanline) || (sprite_y <= (scanline - sprite_height)) 
-       || (0 == sprite_y) || (sprite_y > 240))
+   /* sprite 0 always heads the list of a line it's on */
+   if (0 == ppu.obj_count[scanline] || 0 != ppu.obj_list[scanline][0])
       return;
 
+   sprite_ptr = (obj_t *) ppu.oam;
+   sprite_y = sprite_ptr->y_loc + 1;
+
    sprite_x = sprite_ptr->x_loc;
    tile_index = sprite_ptr->tile;
    attrib = sprite_ptr->atr;
@@ -930,8 +1452,6 @@ static void ppu_fakeoam(int scanline)
    else
       vram_adr = ppu.obj_base + (tile_index << 4);
 
-   data_ptr = &PPU_MEM(vram_adr);
-
    /* Calculate offset (line within the sprite) */
    y_offset = scanline - sprite_y;
    if (y_offset > 7)
@@ -944,69 +1464,116 @@ static void ppu_fakeoam(int scanline)
          y_offset -= 23;
       else
          y_offset -= 7;
-      data_ptr -= y_offset;
+      vram_adr -= y_offset;
    }
    else
    {
-      data_ptr += y_offset;
+      vram_adr += y_offset;
    }
 
    /* check for a solid sprite 0 pixel */
-   pat1 = data_ptr[0];
-   pat2 = data_ptr[8];
-   color = ((pat2 & 0xAA) << 8) | ((pat2 & 0x55) << 1)
-                  | ((pat1 & 0xAA) << 7) | (pat1 & 0x55);
+   colors = PAT_ROW(vram_adr) + (attrib & OAMF_HFLIP);
+
+   if (colors[0])
+      ppu_setstrike(sprite_x + 0);
+   else if (colors[1])
+      ppu_setstrike(sprite_x + 1);
+   else if (colors[2])
+      ppu_setstrike(sprite_x + 2);
+   else if (colors[3])
+      ppu_setstrike(sprite_x + 3);
+   else if (colors[4])
+      ppu_setstrike(sprite_x + 4);
+   else if (colors[5])
+      ppu_setstrike(sprite_x + 5);
+   else if (colors[6])
+      ppu_setstrike(sprite_x + 6);
+   else if (colors[7])
+      ppu_setstrike(sprite_x + 7);
+}
 
-   if (color)
-   {
-      uint8 colors[8];
+bool ppu_enabled(void)
+{
+   return (ppu.bg_on || ppu.obj_on);
+}
 
-      /* buckle up, it's going to get ugly... */
-      if (0 == (attrib & OAMF_HFLIP))
-      {
-         colors[0] = (color >> 14) & 3;
-         colors[1] = (color >> 6) & 3;
-         colors[2] = (color >> 12) & 3;
-         colors[3] = (color >> 4) & 3;
-         colors[4] = (color >> 10) & 3;
-         colors[5] = (color >> 2) & 3;
-         colors[6] = (color >> 8) & 3;
-         colors[7] = color & 3;
-      }
-      else
+/* true if this line would come out the same as last drawn */
+static bool ppu_staticline(int scanline)
+{
+   lineinfo_t info;
+
+   if (0 == scanline)
+   {
+      ppu_frame.skipping = ppu_frame.valid && NULL == ppu.latchfunc
+                           && ppu_changes == ppu_frame.changes
+                           && 0 == memcmp(ppu_frame.oam, ppu.oam, sizeof(ppu.oam));
+      if (false == ppu_frame.skipping)
       {
-         colors[7] = (color >> 14) & 3;
-         colors[6] = (color >> 6) & 3;
-         colors[5] = (color >> 12) & 3;
-         colors[4] = (color >> 4) & 3;
-         colors[3] = (color >> 10) & 3;
-         colors[2] = (color >> 2) & 3;
-         colors[1] = (color >> 8) & 3;
-         colors[0] = color & 3;
+         memcpy(ppu_frame.oam, ppu.oam, sizeof(ppu.oam));
+         ppu_frame.changes = ppu_changes;
+         ppu_frame.strike_line = -1;
       }
+   }
+
+   memset(&info, 0, sizeof(info));
+   info.vaddr = ppu.vaddr;
+   info.tile_xofs = ppu.tile_xofs;
+   info.ctrl0 = ppu.ctrl0;
+   info.ctrl1 = ppu.ctrl1;
+   info.drawsprites = ppu.drawsprites;
+   memcpy(info.patpage, ppu.patpage, sizeof(info.patpage));
+   memcpy(info.nametab, &ppu.page[8], sizeof(info.nametab));
+
+   if (ppu_frame.skipping
+       && (ppu_changes != ppu_frame.changes
+           || memcmp(&info, &ppu_frame.line[scanline], sizeof(info))))
+   {
+      /* lines above still match, the strike may be further down */
+      ppu_frame.skipping = false;
+      if (ppu_frame.strike_line >= scanline)
+         ppu_frame.strike_line = -1;
+   }
+
+   if (false == ppu_frame.skipping)
+      ppu_frame.line[scanline] = info;
 
-      if (colors[0])
-         ppu_setstrike(sprite_x + 0);
-      else if (colors[1])
-         ppu_setstrike(sprite_x + 1);
-      else if (colors[2])
-         ppu_setstrike(sprite_x + 2);
-      else if (colors[3])
-         ppu_setstrike(sprite_x + 3);
-      else if (colors[4])
-         ppu_setstrike(sprite_x + 4);
-      else if (colors[5])
-         ppu_setstrike(sprite_x + 5);
-      else if (colors[6])
-         ppu_setstrike(sprite_x + 6);
-      else if (colors[7])
-         ppu_setstrike(sprite_x + 7);
+   if (239 == scanline)
+   {
+      ppu_frame.valid = (ppu_changes == ppu_frame.changes);
+      ppu_frame.skipped = ppu_frame.skipping;
    }
+
+   return ppu_frame.skipping;
 }
 
-bool ppu_enabled(void)
+/* the bitmap already holds this line - just do what rendering it would
+** have done to the PPU status
+*/
+static void ppu_replayline(int scanline)
 {
-   return (ppu.bg_on || ppu.obj_on);
+   if (false == ppu.drawsprites)
+   {
+      ppu_fakeoam(scanline);
+      return;
+   }
+
+   if (false == ppu.obj_on)
+      return;
+
+   if (ppu.obj_dirty)
+      ppu_evaloam();
+
+   if (scanline == ppu_frame.strike_line)
+      ppu_setstrike(ppu_frame.strike_x);
+
+   if (PPU_MAXSPRITE == ppu.obj_count[scanline])
+      ppu.stat |= PPU_STATF_MAXSPRITE;
+}
+
+/* was the last drawn frame identical to the one before it? */
+bool ppu_framestatic(void)
+{
+   return ppu_frame.skipped;
 }
 
 static void ppu_renderscanline(bitmap_t *bmp, int scanline, bool draw_flag)
@@ -1027,6 +1594,12 @@ static void ppu_renderscanline(bitmap_t *bmp, int scanline, bool draw_flag)
       }
    }
 
+   if (draw_flag && ppu_staticline(scanline))
+   {
+      ppu_replayline(scanline);
+      return;
+   }
+
    if (draw_flag)
       ppu_renderbg(buf);
 
@@ -1093,6 +1666,8 @@ void ppu_scanline(bitmap_t *bmp, int scanline, bool draw_flag)
    }
    else if (261 == scanline)
    {
+      bglayer.resync = true;
+
       ppu.stat &= ~PPU_STATF_VBLANK;
       ppu.strikeflag = false;
       ppu.strike_cycle = (uint32) -1;
@@ -81,6 +81,20 @@ typedef struct ppu_s
    uint8 palette[32];
    uint8 *page[16];
 
+   /* pattern cache: CHR rows expanded to one pixel per byte, each tile
+   ** is 8 rows as-is followed by 8 rows horizontally flipped
+   */
+   uint8 *patpage[8];
+   uint8 *patsrc[2], *patcache[2];
+   int patsize[2];
+
+   /* sprites in range of each visible scanline, rebuilt when OAM or
+   ** sprite size changes
+   */
+   uint8 obj_list[240][PPU_MAXSPRITE];
+   uint8 obj_count[240];
+   bool obj_dirty;
+
    /* hardware registers */
    uint8 ctrl0, ctrl1, stat, oam_addr;
    uint32 vaddr, vaddr_latch;
@@ -130,6 +144,14 @@ extern void ppu_mirror(int nt1, int nt2, int nt3, int nt4);
 extern void ppu_setpage(int size, int page_num, uint8 *location);
 extern uint8 *ppu_getpage(int page);
 
+/* pattern cache */
+extern int ppu_setchr(ppu_t *src_ppu, uint8 *vrom, int vrom_size,
+                      uint8 *vram, int vram_size);
+extern void ppu_refreshchr(void);
+
+/* static frame detection */
+extern bool ppu_framestatic(void);
+
 
 /* control */
 extern void ppu_reset(int reset_type);
@@ -0,0 +1,292 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** nes_tile.c
+**
+** Background tile drawing kernels
+** $Id$
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <noftypes.h>
+#include <log.h>
+#include <nes_tile.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define  TILE_X86
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#define  TILE_TARGET(isa)  __attribute__ ((target(isa)))
+#endif /* __GNUC__ && x86 */
+
+/* generic vectors need a variable byte shuffle, which clang lacks */
+#if defined(__GNUC__) && !defined(__clang__)
+#define  TILE_VECTOR
+typedef uint8 v16u8 __attribute__ ((vector_size(16)));
+#endif /* __GNUC__ && !__clang__ */
+
+INLINE void tile_drawone(uint8 *surface, const uint8 *row, const uint8 *colors)
+{
+   surface[0] = colors[row[0]];
+   surface[1] = colors[row[1]];
+   surface[2] = colors[row[2]];
+   surface[3] = colors[row[3]];
+   surface[4] = colors[row[4]];
+   surface[5] = colors[row[5]];
+   surface[6] = colors[row[6]];
+   surface[7] = colors[row[7]];
+}
+
+static void tile_scalar(uint8 *dest, const uint8 **rows, const uint8 *col_high,
+                        const uint8 *palette, int num_tiles)
+{
+   while (num_tiles--)
+   {
+      tile_drawone(dest, *rows++, palette + *col_high++);
+      dest += 8;
+   }
+}
+
+static void lookup_scalar(uint8 *dest, const uint8 *src, const uint8 *palette,
+                          int length)
+{
+   for (; length; length -= 8, dest += 8, src += 8)
+      tile_drawone(dest, src, palette);
+}
+
+#ifdef TILE_X86
+
+/* spread byte 0 of v across the low 8 lanes, and byte 1 across the high 8 */
+TILE_TARGET("sse2") INLINE __m128i tile_spread_sse2(__m128i v)
+{
+   v = _mm_unpacklo_epi8(v, v);
+   v = _mm_unpacklo_epi16(v, v);
+   return _mm_unpacklo_epi32(v, v);
+}
+
+/* two tiles per pass.  sse2 has no byte shuffle, so the four colors each
+** tile can use are spread out, and every pixel selects one with masks
+*/
+TILE_TARGET("sse2")
+static void tile_sse2(uint8 *dest, const uint8 **rows, const uint8 *col_high,
+                      const uint8 *palette, int num_tiles)
+{
+   const __m128i one = _mm_set1_epi8(1);
+   const __m128i two = _mm_set1_epi8(2);
+
+   for (; num_tiles >= 2; num_tiles -= 2)
+   {
+      const uint8 *col0 = palette + col_high[0];
+      const uint8 *col1 = palette + col_high[1];
+      __m128i pix, lo, hi, c0, c1, c2, c3, out;
+
+      pix = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) rows[0]),
+                               _mm_loadl_epi64((const __m128i *) rows[1]));
+      lo = _mm_cmpeq_epi8(_mm_and_si128(pix, one), one);
+      hi = _mm_cmpeq_epi8(_mm_and_si128(pix, two), two);
+
+      c0 = tile_spread_sse2(_mm_cvtsi32_si128(col0[0] | (col1[0] << 8)));
+      c1 = tile_spread_sse2(_mm_cvtsi32_si128(col0[1] | (col1[1] << 8)));
+      c2 = tile_spread_sse2(_mm_cvtsi32_si128(col0[2] | (col1[2] << 8)));
+      c3 = tile_spread_sse2(_mm_cvtsi32_si128(col0[3] | (col1[3] << 8)));
+
+      /* pick between 0/1 and 2/3 on the low bit, then on the high bit */
+      c0 = _mm_or_si128(_mm_andnot_si128(lo, c0), _mm_and_si128(lo, c1));
+      c2 = _mm_or_si128(_mm_andnot_si128(lo, c2), _mm_and_si128(lo, c3));
+      out = _mm_or_si128(_mm_andnot_si128(hi, c0), _mm_and_si128(hi, c2));
+
+      _mm_storeu_si128((__m128i *) dest, out);
+
+      dest += 16;
+      rows += 2;
+      col_high += 2;
+   }
+
+   if (num_tiles)
+      tile_scalar(dest, rows, col_high, palette, num_tiles);
+}
+
+/* as above, but the palette lookup is a single byte shuffle */
+TILE_TARGET("ssse3")
+static void tile_ssse3(uint8 *dest, const uint8 **rows, const uint8 *col_high,
+                       const uint8 *palette, int num_tiles)
+{
+   const __m128i spread = _mm_set_epi8(1, 1, 1, 1, 1, 1, 1, 1,
+                                       0, 0, 0, 0, 0, 0, 0, 0);
+   const __m128i colors = _mm_loadu_si128((const __m128i *) palette);
+
+   for (; num_tiles >= 2; num_tiles -= 2)
+   {
+      __m128i pix, col;
+
+      pix = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) rows[0]),
+                               _mm_loadl_epi64((const __m128i *) rows[1]));
+      col = _mm_shuffle_epi8(_mm_cvtsi32_si128(col_high[0] | (col_high[1] << 8)), spread);
+
+      _mm_storeu_si128((__m128i *) dest,
+                       _mm_shuffle_epi8(colors, _mm_or_si128(pix, col)));
+
+      dest += 16;
+      rows += 2;
+      col_high += 2;
+   }
+
+   if (num_tiles)
+      tile_scalar(dest, rows, col_high, palette, num_tiles);
+}
+
+TILE_TARGET("ssse3")
+static void lookup_ssse3(uint8 *dest, const uint8 *src, const uint8 *palette,
+                         int length)
+{
+   const __m128i colors = _mm_loadu_si128((const __m128i *) palette);
+
+   for (; length >= 16; length -= 16, dest += 16, src += 16)
+   {
+      _mm_storeu_si128((__m128i *) dest,
+                       _mm_shuffle_epi8(colors, _mm_loadu_si128((const __m128i *) src)));
+   }
+
+   if (length)
+   {
+      _mm_storel_epi64((__m128i *) dest,
+                       _mm_shuffle_epi8(colors, _mm_loadl_epi64((const __m128i *) src)));
+   }
+}
+
+#endif /* TILE_X86 */
+
+#ifdef TILE_VECTOR
+
+/* portable version of the ssse3 kernel, for non-x86 gcc targets */
+static void tile_vector(uint8 *dest, const uint8 **rows, const uint8 *col_high,
+                        const uint8 *palette, int num_tiles)
+{
+   v16u8 colors;
+
+   memcpy(&colors, palette, sizeof(colors));
+
+   for (; num_tiles >= 2; num_tiles -= 2)
+   {
+      uint8 c0 = col_high[0], c1 = col_high[1];
+      v16u8 col = { c0, c0, c0, c0, c0, c0, c0, c0, c1, c1, c1, c1, c1, c1, c1, c1 };
+      v16u8 pix;
+
+      memcpy(&pix, rows[0], 8);
+      memcpy((uint8 *) &pix + 8, rows[1], 8);
+      pix = __builtin_shuffle(colors, pix | col);
+      memcpy(dest, &pix, sizeof(pix));
+
+      dest += 16;
+      rows += 2;
+      col_high += 2;
+   }
+
+   if (num_tiles)
+      tile_scalar(dest, rows, col_high, palette, num_tiles);
+}
+
+static void lookup_vector(uint8 *dest, const uint8 *src, const uint8 *palette,
+                          int length)
+{
+   v16u8 colors, pix;
+
+   memcpy(&colors, palette, sizeof(colors));
+
+   for (; length >= 16; length -= 16, dest += 16, src += 16)
+   {
+      memcpy(&pix, src, sizeof(pix));
+      pix = __builtin_shuffle(colors, pix);
+      memcpy(dest, &pix, sizeof(pix));
+   }
+
+   if (length)
+      lookup_scalar(dest, src, palette, length);
+}
+
+#endif /* TILE_VECTOR */
+
+
+static int tile_kernel = TILE_KERNEL_SCALAR;
+tilekernel_t tile_drawbg = tile_scalar;
+tilelookup_t tile_lookup = lookup_scalar;
+
+static const char *tile_names[] =
+{
+   "scalar", "sse2", "ssse3", "vector"
+};
+
+/* pick a background kernel, or the best one this cpu can run */
+int tile_setkernel(int kernel)
+{
+   if (TILE_KERNEL_AUTO == kernel)
+   {
+      if (0 == tile_setkernel(TILE_KERNEL_SSSE3)
+          || 0 == tile_setkernel(TILE_KERNEL_SSE2)
+          || 0 == tile_setkernel(TILE_KERNEL_VECTOR))
+         return 0;
+
+      return tile_setkernel(TILE_KERNEL_SCALAR);
+   }
+
+   switch (kernel)
+   {
+   case TILE_KERNEL_SCALAR:
+      tile_drawbg = tile_scalar;
+      tile_lookup = lookup_scalar;
+      break;
+
+#ifdef TILE_X86
+   case TILE_KERNEL_SSE2:
+      if (0 == __builtin_cpu_supports("sse2"))
+         return -1;
+      tile_drawbg = tile_sse2;
+      tile_lookup = lookup_scalar;
+      break;
+
+   case TILE_KERNEL_SSSE3:
+      if (0 == __builtin_cpu_supports("ssse3"))
+         return -1;
+      tile_drawbg = tile_ssse3;
+      tile_lookup = lookup_ssse3;
+      break;
+#endif /* TILE_X86 */
+
+#ifdef TILE_VECTOR
+   case TILE_KERNEL_VECTOR:
+      tile_drawbg = tile_vector;
+      tile_lookup = lookup_vector;
+      break;
+#endif /* TILE_VECTOR */
+
+   default:
+      return -1;
+   }
+
+   tile_kernel = kernel;
+   log_printf("background tile kernel: %s\n", tile_names[tile_kernel]);
+
+   return 0;
+}
+
+const char *tile_kernelname(void)
+{
+   return tile_names[tile_kernel];
+}
@@ -0,0 +1,62 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** nes_tile.h
+**
+** Background tile drawing kernels
+** $Id$
+*/
+
+#ifndef _NES_TILE_H_
+#define _NES_TILE_H_
+
+#include <noftypes.h>
+
+/* tiles fetched by the ppu per scanline, plus one for pairwise kernels */
+#define  TILE_MAXFETCH        34
+
+enum
+{
+   TILE_KERNEL_SCALAR,
+   TILE_KERNEL_SSE2,
+   TILE_KERNEL_SSSE3,
+   TILE_KERNEL_VECTOR,
+   TILE_KERNEL_AUTO
+};
+
+/* draw num_tiles rows of 8 pixels into dest.  rows points at each tile's
+** row of 2-bit pixels (from the ppu pattern cache), col_high holds the
+** attribute bits (0, 4, 8 or 12) of each tile, and palette the 16
+** background palette entries
+*/
+typedef void (*tilekernel_t)(uint8 *dest, const uint8 **rows,
+                             const uint8 *col_high, const uint8 *palette,
+                             int num_tiles);
+
+/* translate length (a multiple of 8) palette indices from src into dest */
+typedef void (*tilelookup_t)(uint8 *dest, const uint8 *src,
+                             const uint8 *palette, int length);
+
+extern tilekernel_t tile_drawbg;
+extern tilelookup_t tile_lookup;
+
+extern int tile_setkernel(int kernel);
+extern const char *tile_kernelname(void);
+
+#endif /* _NES_TILE_H_ */
@@ -37,6 +37,38 @@ static int active_entries = 0;
 /* read counters */
 static int pad0_readcount, pad1_readcount, ppad_readcount, ark_readcount;
 
+/* pad states put in from elsewhere (netplay), in place of our own */
+static bool pads_forced = false;
+static uint8 forced_pads[2];
+
+/* Presses and releases wait here, in order, until the game strobes the
+** pads.  Events are only pumped between frames, so a strobe sees whatever
+** came in before the frame started.  One thread queues and one resolves,
+** so the head and tail are all they share.
+*/
+typedef struct inputevent_s
+{
+   nesinput_t *input;
+   int state;
+   int value;
+} inputevent_t;
+
+static struct
+{
+   inputevent_t events[INPUT_QUEUE_SIZE];
+   int head, tail;            /* head is the queuer's, tail the resolver's */
+   bool strobed;              /* resolved since the last frame ended */
+   uint32 dropped;
+} queue;
+
+#ifdef __GNUC__
+#define  QUEUE_LOAD(x)        __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define  QUEUE_STORE(x, v)    __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#else /* !__GNUC__ */
+#define  QUEUE_LOAD(x)        (*(volatile int *) &(x))
+#define  QUEUE_STORE(x, v)    (*(volatile int *) &(x) = (v))
+#endif /* !__GNUC__ */
+
 
 static int retrieve_type(int type)
 {
@@ -53,11 +85,12 @@ static int retrieve_type(int type)
    return value;
 }
 
-static uint8 get_pad0(void)
+/* all eight buttons of a joypad, as our own input sources have it */
+uint8 input_getpad(int type)
 {
    uint8 value;
 
-   value = (uint8) retrieve_type(INP_JOYPAD0);
+   value = (uint8) retrieve_type(type);
 
    /* mask out left/right simultaneous keypresses */
    if ((value & INP_PAD_UP) && (value & INP_PAD_DOWN))
@@ -66,6 +99,29 @@ static uint8 get_pad0(void)
    if ((value & INP_PAD_LEFT) && (value & INP_PAD_RIGHT))
       value &= ~(INP_PAD_LEFT | INP_PAD_RIGHT);
 
+   return value;
+}
+
+/* have the game see these two pads instead of ours, until NULL */
+void input_setpads(const uint8 *pads)
+{
+   if (NULL == pads)
+   {
+      pads_forced = false;
+      return;
+   }
+
+   forced_pads[0] = pads[0];
+   forced_pads[1] = pads[1];
+   pads_forced = true;
+}
+
+static uint8 get_pad0(void)
+{
+   uint8 value;
+
+   value = pads_forced ? forced_pads[0] : input_getpad(INP_JOYPAD0);
+
    /* return (0x40 | value) due to bus conflicts */
    return (0x40 | ((value >> pad0_readcount++) & 1));
 }
@@ -74,14 +130,7 @@ static uint8 get_pad1(void)
 {
    uint8 value;
 
-   value = (uint8) retrieve_type(INP_JOYPAD1);
-
-   /* mask out left/right simultaneous keypresses */
-   if ((value & INP_PAD_UP) && (value & INP_PAD_DOWN))
-      value &= ~(INP_PAD_UP | INP_PAD_DOWN);
-
-   if ((value & INP_PAD_LEFT) && (value & INP_PAD_RIGHT))
-      value &= ~(INP_PAD_LEFT | INP_PAD_RIGHT);
+   value = pads_forced ? forced_pads[1] : input_getpad(INP_JOYPAD1);
 
    /* return (0x40 | value) due to bus conflicts */
    return (0x40 | ((value >> pad1_readcount++) & 1));
@@ -162,18 +211,69 @@ void input_register(nesinput_t *input)
    active_entries++;
 }
 
+/* queue a press or release, to be seen at the next strobe */
 void input_event(nesinput_t *input, int state, int value)
 {
+   inputevent_t *event;
+   int head;
+
    ASSERT(input);
 
-   if (state == INP_STATE_MAKE)
-      input->data |= value;   /* OR it in */
-   else /* break state */
-      input->data &= ~value;  /* mask it out */
+   head = queue.head;
+   if (((head + 1) & (INPUT_QUEUE_SIZE - 1)) == QUEUE_LOAD(queue.tail))
+   {
+      queue.dropped++;
+      log_printf("nesinput: event queue full, %u dropped\n", queue.dropped);
+      return;
+   }
+
+   event = &queue.events[head];
+   event->input = input;
+   event->state = state;
+   event->value = value;
+
+   QUEUE_STORE(queue.head, (head + 1) & (INPUT_QUEUE_SIZE - 1));
 }
 
+/* bring the pads up to date with everything queued so far */
+void input_resolve(void)
+{
+   inputevent_t *event;
+   int tail, head;
+
+   tail = queue.tail;
+   head = QUEUE_LOAD(queue.head);
+
+   for (; tail != head; tail = (tail + 1) & (INPUT_QUEUE_SIZE - 1))
+   {
+      event = &queue.events[tail];
+
+      if (event->state == INP_STATE_MAKE)
+         event->input->data |= event->value;   /* OR it in */
+      else /* break state */
+         event->input->data &= ~event->value;  /* mask it out */
+   }
+
+   QUEUE_STORE(queue.tail, tail);
+   queue.strobed = true;
+}
+
+/* a game that isn't reading the pads still has its state kept current,
+** so nothing backs up and no release goes missing
+*/
+void input_endframe(void)
+{
+   if (false == queue.strobed)
+      input_resolve();
+
+   queue.strobed = false;
+}
+
+/* the pads latch their state as the strobe goes low */
 void input_strobe(void)
 {
+   input_resolve();
+
    pad0_readcount = 0;
    pad1_readcount = 0;
    ppad_readcount = 0;
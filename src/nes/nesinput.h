@@ -77,10 +77,17 @@ typedef struct nesinput_s
 
 #define  MAX_CONTROLLERS   32
 
+/* presses and releases waiting for the game to strobe; a power of two */
+#define  INPUT_QUEUE_SIZE  256
+
 extern uint8 input_get(int type);
 extern void input_register(nesinput_t *input);
 extern void input_event(nesinput_t *input, int state, int value);
+extern void input_resolve(void);
+extern void input_endframe(void);
 extern void input_strobe(void);
+extern uint8 input_getpad(int type);
+extern void input_setpads(const uint8 *pads);
 
 #endif /* _NESINPUT_H_ */
 
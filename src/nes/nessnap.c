@@ -0,0 +1,404 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** nessnap.c
+**
+** In-memory machine snapshots
+** $Id$
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <noftypes.h>
+#include <log.h>
+#include <nes.h>
+#include <nessnap.h>
+
+#define  SNAP_RAMSIZE         0x800
+
+/* what a page pointer can point into; anything else is the mapper's own
+** memory, which stays as it is on load
+*/
+enum
+{
+   SNAP_NULL,
+   SNAP_RAM,
+   SNAP_ROM,
+   SNAP_SRAM,
+   SNAP_VROM,
+   SNAP_VRAM,
+   SNAP_REGIONS,
+   SNAP_FOREIGN = 0xFF
+};
+
+typedef struct snapregion_s
+{
+   const uint8 *base;
+   uint32 length;
+} snapregion_t;
+
+static snapregion_t regions[SNAP_REGIONS];
+
+/* scratch for ppu contexts, which are too big for the stack */
+static ppu_t snap_ppu;
+
+static uint8 *snap_cartmem(const snap_t *snap)
+{
+   return (uint8 *) snap + sizeof(snap_t);
+}
+
+static void snap_getregions(nes_t *machine, uint8 *ram)
+{
+   rominfo_t *cart = machine->rominfo;
+
+   regions[SNAP_RAM].base = ram;
+   regions[SNAP_RAM].length = SNAP_RAMSIZE;
+   regions[SNAP_ROM].base = cart->rom;
+   regions[SNAP_ROM].length = cart->rom_banks * 0x4000;
+   regions[SNAP_SRAM].base = cart->sram;
+   regions[SNAP_SRAM].length = cart->sram_banks * 0x400;
+   regions[SNAP_VROM].base = cart->vrom;
+   regions[SNAP_VROM].length = cart->vrom_banks * 0x2000;
+   regions[SNAP_VRAM].base = cart->vram;
+   regions[SNAP_VRAM].length = cart->vram_banks * 0x2000;
+}
+
+static uint32 snap_encode(const uint8 *ptr)
+{
+   int i;
+
+   if (NULL == ptr)
+      return SNAP_NULL;
+
+   for (i = SNAP_RAM; i < SNAP_REGIONS; i++)
+   {
+      if (NULL != regions[i].base && ptr >= regions[i].base
+          && ptr < regions[i].base + regions[i].length)
+         return (i << 24) | (uint32) (ptr - regions[i].base);
+   }
+
+   return SNAP_FOREIGN << 24;
+}
+
+/* live is what to keep if the page wasn't ours to describe */
+static uint8 *snap_decode(uint32 page, uint8 *live)
+{
+   int region = page >> 24;
+
+   if (SNAP_NULL == region)
+      return NULL;
+
+   if (region >= SNAP_REGIONS || NULL == regions[region].base)
+      return live;
+
+   return (uint8 *) regions[region].base + (page & 0xFFFFFF);
+}
+
+/* a snapshot sized for the cart in the machine now */
+snap_t *snap_create(void)
+{
+   nes_t *machine = nes_getcontextptr();
+   snap_t *snap;
+   uint32 sram_length, vram_length;
+
+   ASSERT(machine->rominfo);
+
+   sram_length = machine->rominfo->sram ? machine->rominfo->sram_banks * 0x400 : 0;
+   vram_length = machine->rominfo->vram ? machine->rominfo->vram_banks * 0x2000 : 0;
+
+   snap = malloc(sizeof(snap_t) + sram_length + vram_length);
+   if (NULL == snap)
+      return NULL;
+
+   memset(snap, 0, sizeof(snap_t) + sram_length + vram_length);
+   snap->length = sizeof(snap_t) + sram_length + vram_length;
+   snap->version = SNAP_VERSION;
+   snap->sram_length = sram_length;
+   snap->vram_length = vram_length;
+
+   return snap;
+}
+
+void snap_destroy(snap_t **snap)
+{
+   if (*snap)
+      free(*snap);
+}
+
+/* take a snapshot; only between frames */
+void snap_save(snap_t *snap)
+{
+   nes_t *machine = nes_getcontextptr();
+   apu_t apu;
+   int i;
+
+   ASSERT(snap);
+
+   /* cpu */
+   nes6502_getcontext(&snap->cpu);
+   memcpy(snap->ram, snap->cpu.mem_page[0], SNAP_RAMSIZE);
+   snap_getregions(machine, snap->cpu.mem_page[0]);
+
+   for (i = 0; i < NES6502_NUMBANKS; i++)
+   {
+      snap->cpu_pages[i] = snap_encode(snap->cpu.mem_page[i]);
+      snap->cpu.mem_page[i] = NULL;
+   }
+
+   snap->cpu.read_handler = NULL;
+   snap->cpu.write_handler = NULL;
+
+   /* ppu; its pattern pages are numbered from the start of the window */
+   ppu_getcontext(&snap->ppu);
+
+   for (i = 0; i < 8; i++)
+      snap->ppu_pages[i] = snap_encode(snap->ppu.page[i] + (i << 10));
+
+   for (i = 0; i < 4; i++)
+      snap->nametabs[i] = (uint8) ((snap->ppu.page[i + 8] + 0x2000 + (i << 10) - snap->ppu.nametab) >> 10);
+
+   memset(snap->ppu.page, 0, sizeof(snap->ppu.page));
+   memset(snap->ppu.patpage, 0, sizeof(snap->ppu.patpage));
+   memset(snap->ppu.patsrc, 0, sizeof(snap->ppu.patsrc));
+   memset(snap->ppu.patcache, 0, sizeof(snap->ppu.patcache));
+   snap->ppu.latchfunc = NULL;
+   snap->ppu.vromswitch = NULL;
+
+   /* apu */
+   apu_getcontext(&apu);
+   snap->rectangle[0] = apu.rectangle[0];
+   snap->rectangle[1] = apu.rectangle[1];
+   snap->triangle = apu.triangle;
+   snap->noise = apu.noise;
+   snap->dmc = apu.dmc;
+   snap->enable_reg = apu.enable_reg;
+
+   /* mapper */
+   memset(&snap->mapper, 0, sizeof(snap->mapper));
+   if (machine->mmc->intf->get_state)
+      machine->mmc->intf->get_state(&snap->mapper);
+
+   snap->fiq_occurred = machine->fiq_occurred;
+   snap->fiq_state = machine->fiq_state;
+   snap->fiq_cycles = machine->fiq_cycles;
+   snap->scanline = machine->scanline;
+   snap->scanline_cycles = machine->scanline_cycles;
+
+   if (snap->sram_length)
+      memcpy(snap_cartmem(snap), machine->rominfo->sram, snap->sram_length);
+   if (snap->vram_length)
+      memcpy(snap_cartmem(snap) + snap->sram_length, machine->rominfo->vram, snap->vram_length);
+}
+
+/* put the machine back as it was; the snapshot must be of this cart */
+int snap_load(const snap_t *snap)
+{
+   nes_t *machine = nes_getcontextptr();
+   nes6502_context cpu;
+   apu_t apu;
+   uint8 *vram;
+   int i;
+
+   ASSERT(snap);
+
+   if (SNAP_VERSION != snap->version
+       || snap->length != sizeof(snap_t) + snap->sram_length + snap->vram_length
+       || snap->sram_length != (uint32) (machine->rominfo->sram ? machine->rominfo->sram_banks * 0x400 : 0)
+       || snap->vram_length != (uint32) (machine->rominfo->vram ? machine->rominfo->vram_banks * 0x2000 : 0))
+   {
+      log_printf("snap: snapshot doesn't fit this cart\n");
+      return -1;
+   }
+
+   /* the mapper first, as it may well bank things the snapshot then
+   ** puts back where they were
+   */
+   if (machine->mmc->intf->set_state)
+      machine->mmc->intf->set_state((SnssMapperBlock *) &snap->mapper);
+
+   /* cpu */
+   nes6502_getcontext(&cpu);
+   snap_getregions(machine, cpu.mem_page[0]);
+
+   for (i = 0; i < NES6502_NUMBANKS; i++)
+      cpu.mem_page[i] = snap_decode(snap->cpu_pages[i], cpu.mem_page[i]);
+
+   cpu.pc_reg = snap->cpu.pc_reg;
+   cpu.a_reg = snap->cpu.a_reg;
+   cpu.p_reg = snap->cpu.p_reg;
+   cpu.x_reg = snap->cpu.x_reg;
+   cpu.y_reg = snap->cpu.y_reg;
+   cpu.s_reg = snap->cpu.s_reg;
+   cpu.jammed = snap->cpu.jammed;
+   cpu.int_pending = snap->cpu.int_pending;
+   cpu.int_latency = snap->cpu.int_latency;
+   cpu.total_cycles = snap->cpu.total_cycles;
+   cpu.burn_cycles = snap->cpu.burn_cycles;
+
+   memcpy((uint8 *) regions[SNAP_RAM].base, snap->ram, SNAP_RAMSIZE);
+   nes6502_setcontext(&cpu);
+
+   /* ppu, keeping what belongs to the cart and the renderer */
+   ppu_getcontext(&snap_ppu);
+
+   for (i = 0; i < 8; i++)
+      snap_ppu.page[i] = snap_decode(snap->ppu_pages[i], snap_ppu.page[i] + (i << 10)) - (i << 10);
+
+   memcpy(snap_ppu.nametab, snap->ppu.nametab, sizeof(snap_ppu.nametab));
+   memcpy(snap_ppu.oam, snap->ppu.oam, sizeof(snap_ppu.oam));
+   memcpy(snap_ppu.palette, snap->ppu.palette, sizeof(snap_ppu.palette));
+
+   for (i = 0; i < 4; i++)
+      snap_ppu.page[i + 8] = snap_ppu.nametab + (snap->nametabs[i] << 10) - 0x2000 - (i << 10);
+
+   snap_ppu.ctrl0 = snap->ppu.ctrl0;
+   snap_ppu.ctrl1 = snap->ppu.ctrl1;
+   snap_ppu.stat = snap->ppu.stat;
+   snap_ppu.oam_addr = snap->ppu.oam_addr;
+   snap_ppu.vaddr = snap->ppu.vaddr;
+   snap_ppu.vaddr_latch = snap->ppu.vaddr_latch;
+   snap_ppu.tile_xofs = snap->ppu.tile_xofs;
+   snap_ppu.flipflop = snap->ppu.flipflop;
+   snap_ppu.vaddr_inc = snap->ppu.vaddr_inc;
+   snap_ppu.tile_nametab = snap->ppu.tile_nametab;
+   snap_ppu.obj_height = snap->ppu.obj_height;
+   snap_ppu.obj_base = snap->ppu.obj_base;
+   snap_ppu.bg_base = snap->ppu.bg_base;
+   snap_ppu.bg_on = snap->ppu.bg_on;
+   snap_ppu.obj_on = snap->ppu.obj_on;
+   snap_ppu.obj_mask = snap->ppu.obj_mask;
+   snap_ppu.bg_mask = snap->ppu.bg_mask;
+   snap_ppu.latch = snap->ppu.latch;
+   snap_ppu.vdata_latch = snap->ppu.vdata_latch;
+   snap_ppu.strobe = snap->ppu.strobe;
+   snap_ppu.strikeflag = snap->ppu.strikeflag;
+   snap_ppu.strike_cycle = snap->ppu.strike_cycle;
+   snap_ppu.vram_accessible = snap->ppu.vram_accessible;
+
+   ppu_setcontext(&snap_ppu);
+
+   /* chr ram is only decoded again if it changed */
+   if (snap->vram_length)
+   {
+      vram = snap_cartmem(snap) + snap->sram_length;
+      if (memcmp(machine->rominfo->vram, vram, snap->vram_length))
+      {
+         memcpy(machine->rominfo->vram, vram, snap->vram_length);
+         ppu_refreshchr();
+      }
+   }
+
+   if (snap->sram_length)
+      memcpy(machine->rominfo->sram, snap_cartmem(snap), snap->sram_length);
+
+   /* apu */
+   apu_getcontext(&apu);
+   apu.rectangle[0] = snap->rectangle[0];
+   apu.rectangle[1] = snap->rectangle[1];
+   apu.triangle = snap->triangle;
+   apu.noise = snap->noise;
+   apu.dmc = snap->dmc;
+   apu.enable_reg = snap->enable_reg;
+   apu_setcontext(&apu);
+   apu_resync();
+
+   machine->fiq_occurred = snap->fiq_occurred;
+   machine->fiq_state = snap->fiq_state;
+   machine->fiq_cycles = snap->fiq_cycles;
+   machine->scanline = snap->scanline;
+   machine->scanline_cycles = snap->scanline_cycles;
+
+   return 0;
+}
+
+static uint32 snap_fnv(uint32 hash, const void *data, int length)
+{
+   const uint8 *p = data;
+
+   while (length--)
+   {
+      hash ^= *p++;
+      hash *= 16777619;
+   }
+
+   return hash;
+}
+
+/* the apu's length counters, envelopes and sweeps, which carry on from
+** frame to frame without the game writing them
+*/
+static uint32 snap_apuhash(uint32 hash, const snap_t *snap)
+{
+   const rectangle_t *rect;
+   int32 counters[10];
+   int i;
+
+   for (i = 0; i < 2; i++)
+   {
+      rect = &snap->rectangle[i];
+      counters[0] = rect->vbl_length;
+      counters[1] = rect->env_phase;
+      counters[2] = rect->env_vol;
+      counters[3] = rect->sweep_phase;
+      counters[4] = rect->freq;
+      hash = snap_fnv(hash, counters, 5 * sizeof(int32));
+   }
+
+   counters[0] = snap->triangle.vbl_length;
+   counters[1] = snap->triangle.linear_length;
+   counters[2] = snap->triangle.counter_started;
+   counters[3] = snap->triangle.write_latency;
+   counters[4] = snap->noise.vbl_length;
+   counters[5] = snap->noise.env_phase;
+   counters[6] = snap->noise.env_vol;
+   counters[7] = snap->dmc.dma_length;
+   counters[8] = snap->dmc.address;
+   counters[9] = snap->dmc.irq_occurred;
+
+   return snap_fnv(hash, counters, sizeof(counters));
+}
+
+/* a hash of what the game sees, for telling whether two machines have
+** gone different ways; padding and host pointers are left out
+*/
+uint32 snap_hash(const snap_t *snap)
+{
+   uint32 hash = 2166136261u;
+   uint8 regs[8];
+
+   regs[0] = snap->cpu.a_reg;
+   regs[1] = snap->cpu.x_reg;
+   regs[2] = snap->cpu.y_reg;
+   regs[3] = snap->cpu.s_reg;
+   regs[4] = snap->cpu.p_reg;
+   regs[5] = (uint8) snap->cpu.pc_reg;
+   regs[6] = (uint8) (snap->cpu.pc_reg >> 8);
+   regs[7] = snap->enable_reg;
+
+   hash = snap_fnv(hash, regs, sizeof(regs));
+   hash = snap_fnv(hash, snap->ram, sizeof(snap->ram));
+   hash = snap_fnv(hash, snap->ppu.nametab, sizeof(snap->ppu.nametab));
+   hash = snap_fnv(hash, snap->ppu.oam, sizeof(snap->ppu.oam));
+   hash = snap_fnv(hash, snap->ppu.palette, sizeof(snap->ppu.palette));
+   hash = snap_fnv(hash, snap->nametabs, sizeof(snap->nametabs));
+   hash = snap_fnv(hash, snap_cartmem(snap), snap->sram_length + snap->vram_length);
+   hash = snap_apuhash(hash, snap);
+
+   return hash;
+}
@@ -0,0 +1,85 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** nessnap.h
+**
+** In-memory machine snapshots
+** $Id$
+*/
+
+#ifndef _NESSNAP_H_
+#define _NESSNAP_H_
+
+#include <noftypes.h>
+#include <libsnss.h>
+#include <nes.h>
+
+#define  SNAP_VERSION         1
+
+/* A snapshot is the whole machine as the game sees it, taken between
+** frames.  Where the live machine has pointers into RAM, ROM and the
+** like, the snapshot has (region << 24 | offset), so a snapshot is one
+** flat block that can be copied, sent or stored as it is, and loaded
+** back into any run of the same cart.  Sound output and the renderer's
+** caches aren't in it; they follow along on their own.
+*/
+typedef struct snap_s
+{
+   uint32 length;             /* of the whole block, cart memory included */
+   uint32 version;
+
+   /* cpu */
+   nes6502_context cpu;
+   uint32 cpu_pages[NES6502_NUMBANKS];
+   uint8 ram[0x800];
+
+   /* ppu */
+   ppu_t ppu;
+   uint32 ppu_pages[8];
+   uint8 nametabs[4];
+
+   /* the apu's channels, but not how it's set up to make sound */
+   rectangle_t rectangle[2];
+   triangle_t triangle;
+   noise_t noise;
+   dmc_t dmc;
+   uint8 enable_reg;
+
+   /* mapper registers, as far as the mapper tells */
+   SnssMapperBlock mapper;
+
+   /* the rest of the machine */
+   bool fiq_occurred;
+   uint8 fiq_state;
+   int fiq_cycles;
+   int scanline;
+   float scanline_cycles;
+
+   /* the cart's SRAM and then its VRAM follow on */
+   uint32 sram_length, vram_length;
+} snap_t;
+
+extern snap_t *snap_create(void);
+extern void snap_destroy(snap_t **snap);
+
+extern void snap_save(snap_t *snap);
+extern int snap_load(const snap_t *snap);
+extern uint32 snap_hash(const snap_t *snap);
+
+#endif /* _NESSNAP_H_ */
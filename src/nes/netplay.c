@@ -0,0 +1,848 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** netplay.c
+**
+** Peer to peer rollback netplay
+** $Id$
+*/
+
+/* Two machines run the same cart in lockstep, each with one pad of its
+** own and the other's coming over UDP.  A local press is held back a
+** couple of frames before the game sees it, which gives it time to get
+** across; when the peer's input for a frame isn't in yet, we guess it's
+** the same as the last we had and run on.  A snapshot is kept of the
+** start of every recent frame, so when a guess turns out wrong, the
+** machine goes back to the frame it was wrong on and runs forward again,
+** without drawing or making sound, with what the peer really pressed.
+**
+** Every so often both sides hash the state at a frame whose input is
+** settled on both, and send the hash along.  Should they disagree, the
+** host (the first player) is right: the other side asks for its state at
+** that checkpoint, loads it and runs forward from there.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN32
+#include <winsock2.h>
+#else /* !WIN32 */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif /* !WIN32 */
+#include <noftypes.h>
+#include <log.h>
+#include <osd.h>
+#include <nofconfig.h>
+#include <nes.h>
+#include <nesinput.h>
+#include <nessnap.h>
+#include <netplay.h>
+
+#ifdef WIN32
+typedef SOCKET netsock_t;
+#define  NET_BADSOCK          INVALID_SOCKET
+#define  net_closesocket      closesocket
+#else /* !WIN32 */
+typedef int netsock_t;
+#define  NET_BADSOCK          (-1)
+#define  net_closesocket      close
+#endif /* !WIN32 */
+
+#define  NET_HISTORY          512   /* frames of input kept; a power of two */
+#define  NET_MAXSEND          128   /* inputs in one packet, at most */
+#define  NET_HASHINTERVAL     60    /* frames between checkpoints */
+#define  NET_HASHES           8
+#define  NET_RESENDFRAMES     10    /* between sends of the host's state */
+#define  NET_NOFRAME          0xFFFFFFFF
+
+#define  NET_MAXPACKET        1200
+#define  NET_CHUNKSIZE        1024
+#define  NET_MAXCHUNKS        256
+#define  NET_DELAYQUEUE       512   /* packets held by the link conditioner */
+
+/* packets start 'N' 'F' type, and everything in them is little endian */
+enum
+{
+   NET_INPUT = 1,
+   NET_STATE
+};
+
+typedef struct nethash_s
+{
+   uint32 frame;
+   uint32 hash;
+} nethash_t;
+
+typedef struct netdelayed_s
+{
+   uint32 due;                /* osd_get_usecs() */
+   int length;
+   uint8 data[NET_MAXPACKET];
+} netdelayed_t;
+
+static struct
+{
+   bool active;
+   int player;                /* 0 is the host */
+   int delay, rollback;
+
+   netsock_t sock;
+   struct sockaddr_in peer;
+   bool peer_known;
+
+   /* frame is the next to be run; inputs for frames before local_count
+   ** and remote_count are known for certain
+   */
+   uint32 frame;
+   uint32 local_count, remote_count;
+   uint32 remote_ack;         /* of our inputs, how many the peer has */
+   uint8 local_input[NET_HISTORY];
+   uint8 remote_input[NET_HISTORY];
+   uint8 used_input[NET_HISTORY];   /* the peer's, as we ran the frame */
+   uint32 wrong_frame;        /* earliest frame run on a bad guess */
+
+   /* the start of each of the last few frames */
+   snap_t *snaps[NETPLAY_MAXROLLBACK + 2];
+   int num_snaps;
+
+   /* checkpoints */
+   nethash_t hashes[NET_HASHES];
+   uint32 next_check;
+   nethash_t peer_hash;
+   uint32 compared_frame;     /* the last checkpoint we held up to the peer's */
+   snap_t *checkpoint;        /* the host's last, to hand over */
+   uint32 checkpoint_frame;
+
+   /* the other side of a resync */
+   uint32 resync_frame;       /* the checkpoint we asked for */
+   uint32 peer_resync;        /* the checkpoint the peer asked for */
+   uint32 last_statesend;
+   snap_t *incoming;
+   uint32 incoming_frame;
+   uint32 incoming_have[NET_MAXCHUNKS / 32];
+   int incoming_count;
+
+   /* link conditioner, for trying it out */
+   int latency, loss;
+   uint32 seed;
+   netdelayed_t *delayed;
+   int delayed_head, delayed_tail;
+
+   netstats_t stats;
+} net;
+
+
+static void net_put32(uint8 *p, uint32 value)
+{
+   p[0] = (uint8) value;
+   p[1] = (uint8) (value >> 8);
+   p[2] = (uint8) (value >> 16);
+   p[3] = (uint8) (value >> 24);
+}
+
+static uint32 net_get32(const uint8 *p)
+{
+   return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32) p[3] << 24);
+}
+
+static void net_put16(uint8 *p, uint16 value)
+{
+   p[0] = (uint8) value;
+   p[1] = (uint8) (value >> 8);
+}
+
+static uint16 net_get16(const uint8 *p)
+{
+   return (uint16) (p[0] | (p[1] << 8));
+}
+
+static void net_rawsend(const uint8 *data, int length)
+{
+   if (false == net.peer_known)
+      return;
+
+   sendto(net.sock, (const char *) data, length, 0,
+          (struct sockaddr *) &net.peer, sizeof(net.peer));
+}
+
+/* packets to send back out that have sat in the conditioner long enough */
+static void net_flushdelayed(void)
+{
+   uint32 now = osd_get_usecs();
+   netdelayed_t *packet;
+
+   while (net.delayed_tail != net.delayed_head)
+   {
+      packet = &net.delayed[net.delayed_tail];
+      if ((int32) (packet->due - now) > 0)
+         break;
+
+      net_rawsend(packet->data, packet->length);
+      net.delayed_tail = (net.delayed_tail + 1) & (NET_DELAYQUEUE - 1);
+   }
+}
+
+static void net_send(const uint8 *data, int length)
+{
+   netdelayed_t *packet;
+
+   net.stats.packets_sent++;
+
+   if (net.loss)
+   {
+      net.seed = net.seed * 1103515245 + 12345;
+      if ((int) ((net.seed >> 16) % 100) < net.loss)
+      {
+         net.stats.packets_lost++;
+         return;
+      }
+   }
+
+   if (0 == net.latency)
+   {
+      net_rawsend(data, length);
+      return;
+   }
+
+   /* a full conditioner loses the packet, like a full router would */
+   if (((net.delayed_head + 1) & (NET_DELAYQUEUE - 1)) == net.delayed_tail)
+   {
+      net.stats.packets_lost++;
+      return;
+   }
+
+   packet = &net.delayed[net.delayed_head];
+   packet->due = osd_get_usecs() + net.latency * 1000;
+   packet->length = length;
+   memcpy(packet->data, data, length);
+   net.delayed_head = (net.delayed_head + 1) & (NET_DELAYQUEUE - 1);
+}
+
+/* our inputs the peer hasn't acknowledged, our latest checkpoint, and
+** whether we want the host's state
+*/
+static void net_sendinput(void)
+{
+   uint8 packet[NET_MAXPACKET];
+   uint32 start, count, i;
+   int length;
+   nethash_t *hash;
+
+   start = net.remote_ack;
+   count = net.local_count - start;
+   if (count > NET_MAXSEND)
+      count = NET_MAXSEND;
+
+   packet[0] = 'N';
+   packet[1] = 'F';
+   packet[2] = NET_INPUT;
+   net_put32(packet + 3, net.remote_count);
+   net_put32(packet + 7, start);
+   packet[11] = (uint8) count;
+   length = 12;
+
+   for (i = 0; i < count; i++)
+      packet[length++] = net.local_input[(start + i) & (NET_HISTORY - 1)];
+
+   hash = &net.hashes[((net.next_check / NET_HASHINTERVAL) + NET_HASHES - 1) % NET_HASHES];
+   net_put32(packet + length, hash->frame);
+   net_put32(packet + length + 4, hash->hash);
+   net_put32(packet + length + 8, net.resync_frame);
+   length += 12;
+
+   net_send(packet, length);
+}
+
+/* the host's checkpoint, in pieces */
+static void net_sendstate(void)
+{
+   uint8 packet[NET_MAXPACKET];
+   const uint8 *data = (const uint8 *) net.checkpoint;
+   int chunk, chunks, length;
+
+   chunks = (net.checkpoint->length + NET_CHUNKSIZE - 1) / NET_CHUNKSIZE;
+
+   for (chunk = 0; chunk < chunks; chunk++)
+   {
+      length = net.checkpoint->length - chunk * NET_CHUNKSIZE;
+      if (length > NET_CHUNKSIZE)
+         length = NET_CHUNKSIZE;
+
+      packet[0] = 'N';
+      packet[1] = 'F';
+      packet[2] = NET_STATE;
+      net_put32(packet + 3, net.checkpoint_frame);
+      net_put16(packet + 7, (uint16) chunk);
+      net_put16(packet + 9, (uint16) chunks);
+      net_put16(packet + 11, (uint16) length);
+      memcpy(packet + 13, data + chunk * NET_CHUNKSIZE, length);
+
+      net_send(packet, length + 13);
+   }
+}
+
+static nethash_t *net_findhash(uint32 frame)
+{
+   nethash_t *hash = &net.hashes[(frame / NET_HASHINTERVAL) % NET_HASHES];
+
+   return (hash->frame == frame) ? hash : NULL;
+}
+
+/* compare our checkpoint against the peer's, if we have it yet */
+static void net_checkhash(void)
+{
+   nethash_t *ours;
+
+   if (NET_NOFRAME == net.peer_hash.frame || net.compared_frame == net.peer_hash.frame)
+      return;
+
+   ours = net_findhash(net.peer_hash.frame);
+   if (NULL == ours)
+      return;
+
+   net.compared_frame = ours->frame;
+
+   if (ours->hash == net.peer_hash.hash)
+   {
+      if (NET_NOFRAME == net.stats.checked_frame || ours->frame > net.stats.checked_frame)
+         net.stats.checked_frame = ours->frame;
+   }
+   else
+   {
+      net.stats.desyncs++;
+      log_printf("netplay: out of sync at frame %u\n", ours->frame);
+
+      /* the host's word is final */
+      if (0 != net.player && NET_NOFRAME == net.resync_frame)
+         net.resync_frame = ours->frame;
+   }
+}
+
+static void net_readinput(const uint8 *packet, int length)
+{
+   uint32 ack, start, count, frame, i;
+   uint8 input;
+
+   if (length < 12)
+      return;
+
+   ack = net_get32(packet + 3);
+   start = net_get32(packet + 7);
+   count = packet[11];
+   if (length < (int) (12 + count + 12))
+      return;
+
+   if ((int32) (ack - net.remote_ack) > 0 && (int32) (ack - net.local_count) <= 0)
+      net.remote_ack = ack;
+
+   for (i = 0; i < count; i++)
+   {
+      frame = start + i;
+      if (frame != net.remote_count)
+         continue;
+
+      input = packet[12 + i];
+      net.remote_input[frame & (NET_HISTORY - 1)] = input;
+      net.remote_count++;
+
+      /* we've already run this frame, on a guess that was wrong */
+      if ((int32) (frame - net.frame) < 0 && input != net.used_input[frame & (NET_HISTORY - 1)])
+      {
+         if (NET_NOFRAME == net.wrong_frame || (int32) (frame - net.wrong_frame) < 0)
+            net.wrong_frame = frame;
+      }
+   }
+
+   packet += 12 + count;
+   net.peer_hash.frame = net_get32(packet);
+   net.peer_hash.hash = net_get32(packet + 4);
+   net.peer_resync = net_get32(packet + 8);
+
+   net_checkhash();
+}
+
+static void net_readstate(const uint8 *packet, int length)
+{
+   uint32 frame;
+   int chunk, chunks, size;
+
+   if (length < 13 || NET_NOFRAME == net.resync_frame)
+      return;
+
+   frame = net_get32(packet + 3);
+   chunk = net_get16(packet + 7);
+   chunks = net_get16(packet + 9);
+   size = net_get16(packet + 11);
+
+   if (chunks > NET_MAXCHUNKS || chunk >= chunks || size > NET_CHUNKSIZE || length < size + 13
+       || (uint32) chunks != (net.incoming->length + NET_CHUNKSIZE - 1) / NET_CHUNKSIZE
+       || chunk * NET_CHUNKSIZE + size > (int) net.incoming->length
+       || (int32) (frame - net.resync_frame) < 0)
+      return;
+
+   /* a newer checkpoint than the one we were putting together */
+   if (frame != net.incoming_frame)
+   {
+      net.incoming_frame = frame;
+      memset(net.incoming_have, 0, sizeof(net.incoming_have));
+      net.incoming_count = 0;
+   }
+
+   if (net.incoming_have[chunk >> 5] & (1 << (chunk & 31)))
+      return;
+
+   /* the length and version are in the first chunk; keep our own */
+   if (0 == chunk)
+   {
+      if (net_get32(packet + 13) != net.incoming->length
+          || net_get32(packet + 17) != SNAP_VERSION)
+         return;
+   }
+
+   memcpy((uint8 *) net.incoming + chunk * NET_CHUNKSIZE, packet + 13, size);
+   net.incoming_have[chunk >> 5] |= 1 << (chunk & 31);
+   net.incoming_count++;
+}
+
+static void net_poll(void)
+{
+   uint8 packet[NET_MAXPACKET];
+   struct sockaddr_in from;
+   int length;
+#ifdef WIN32
+   int fromlen;
+#else /* !WIN32 */
+   socklen_t fromlen;
+#endif /* !WIN32 */
+
+   for (;;)
+   {
+      fromlen = sizeof(from);
+      length = recvfrom(net.sock, (char *) packet, sizeof(packet), 0,
+                        (struct sockaddr *) &from, &fromlen);
+      if (length < 0)
+         break;
+
+      if (length < 3 || 'N' != packet[0] || 'F' != packet[1])
+         continue;
+
+      /* whoever speaks first is our peer, if we weren't told */
+      if (false == net.peer_known)
+      {
+         net.peer = from;
+         net.peer_known = true;
+      }
+      else if (from.sin_addr.s_addr != net.peer.sin_addr.s_addr
+               || from.sin_port != net.peer.sin_port)
+      {
+         continue;
+      }
+
+      net.stats.packets_received++;
+
+      if (NET_INPUT == packet[2])
+         net_readinput(packet, length);
+      else if (NET_STATE == packet[2])
+         net_readstate(packet, length);
+   }
+
+   net_flushdelayed();
+}
+
+static snap_t *net_snap(uint32 frame)
+{
+   return net.snaps[frame % net.num_snaps];
+}
+
+/* run one frame with both pads as we know or guess them */
+static void net_runframe(bool draw_flag, bool sound_flag)
+{
+   uint32 index = net.frame & (NET_HISTORY - 1);
+   uint8 pads[2], remote;
+
+   if ((int32) (net.frame - net.remote_count) < 0)
+      remote = net.remote_input[index];
+   else
+      remote = net.remote_input[(net.remote_count - 1) & (NET_HISTORY - 1)];
+
+   net.used_input[index] = remote;
+
+   pads[net.player] = net.local_input[index];
+   pads[net.player ^ 1] = remote;
+   input_setpads(pads);
+
+   snap_save(net_snap(net.frame));
+   nes_runframe(draw_flag, sound_flag);
+   net.frame++;
+}
+
+/* run from a frame we have the start of back up to where we were; the
+** frames aren't heard, but apu_endframe still steps the sound channels,
+** so their length counters come out as they would have live
+*/
+static void net_resimulate(uint32 from)
+{
+   uint32 to = net.frame, start;
+
+   start = osd_get_usecs();
+
+   net.frame = from;
+   while (net.frame != to)
+   {
+      net_runframe(false, false);
+      net.stats.resim_frames++;
+   }
+
+   net.stats.resim_usecs += osd_get_usecs() - start;
+
+   /* the checkpoints from here on have to be taken again */
+   if ((int32) (net.next_check - from) > 0)
+      net.next_check = ((from + NET_HASHINTERVAL - 1) / NET_HASHINTERVAL) * NET_HASHINTERVAL;
+}
+
+static void net_rollback(void)
+{
+   uint32 from = net.wrong_frame;
+
+   net.wrong_frame = NET_NOFRAME;
+
+   /* further back than we have; only the host's state will help */
+   if ((int32) (net.frame - from) >= net.num_snaps)
+   {
+      log_printf("netplay: can't roll back %u frames\n", net.frame - from);
+      if (0 != net.player && NET_NOFRAME == net.resync_frame)
+         net.resync_frame = from;
+      return;
+   }
+
+   if (snap_load(net_snap(from)))
+      return;
+
+   net.stats.rollbacks++;
+   net_resimulate(from);
+}
+
+/* the host's state has all come in; take it up and run forward */
+static void net_resync(void)
+{
+   uint32 from = net.incoming_frame;
+
+   /* we haven't got there yet; hang on to it until we have */
+   if ((int32) (net.frame - from) < 0)
+      return;
+
+   net.incoming_count = 0;
+   memset(net.incoming_have, 0, sizeof(net.incoming_have));
+
+   /* too far past it to run back up; wait for a later one */
+   if ((int32) (net.frame - from) >= NET_HISTORY || snap_load(net.incoming))
+      return;
+
+   log_printf("netplay: took up the host's state at frame %u\n", from);
+   net.stats.resyncs++;
+   net.resync_frame = NET_NOFRAME;
+   net.wrong_frame = NET_NOFRAME;
+   net_resimulate(from);
+}
+
+/* hash each checkpoint as its input becomes settled on both sides */
+static void net_takecheckpoints(void)
+{
+   nethash_t *hash;
+
+   while ((int32) (net.next_check - net.frame) < 0
+          && (int32) (net.next_check - net.remote_count) <= 0)
+   {
+      /* long gone from the ring; leave it */
+      if ((int32) (net.frame - net.next_check) >= net.num_snaps)
+      {
+         net.next_check += NET_HASHINTERVAL;
+         continue;
+      }
+
+      hash = &net.hashes[(net.next_check / NET_HASHINTERVAL) % NET_HASHES];
+      hash->frame = net.next_check;
+      hash->hash = snap_hash(net_snap(net.next_check));
+
+      if (0 == net.player)
+      {
+         memcpy(net.checkpoint, net_snap(net.next_check), net.checkpoint->length);
+         net.checkpoint_frame = net.next_check;
+      }
+
+      net.next_check += NET_HASHINTERVAL;
+      net_checkhash();
+   }
+}
+
+/* one frame of netplay in place of nes_runframe(); false if we had to
+** hold back and wait for the peer
+*/
+bool netplay_frame(bool draw_flag)
+{
+   uint32 start = osd_get_usecs();
+   bool ran = false;
+
+   ASSERT(net.active);
+
+   net_poll();
+
+   if (NET_NOFRAME != net.resync_frame
+       && net.incoming_count == (int) ((net.incoming->length + NET_CHUNKSIZE - 1) / NET_CHUNKSIZE))
+      net_resync();
+
+   if (NET_NOFRAME != net.wrong_frame)
+      net_rollback();
+
+   /* no more running on guesses than we can take back */
+   if ((int32) (net.frame + 1 - net.remote_count) > net.rollback)
+   {
+      net.stats.stalls++;
+   }
+   else
+   {
+      /* what we press now, the game sees a few frames on */
+      input_resolve();
+      net.local_input[net.local_count & (NET_HISTORY - 1)] = input_getpad(INP_JOYPAD0);
+      net.local_count++;
+
+      net_runframe(draw_flag, true);
+      net.stats.frames++;
+      ran = true;
+   }
+
+   net_takecheckpoints();
+
+   if (0 == net.player && NET_NOFRAME != net.peer_resync
+       && NET_NOFRAME != net.checkpoint_frame
+       && net.frame - net.last_statesend >= NET_RESENDFRAMES)
+   {
+      net.last_statesend = net.frame;
+      net_sendstate();
+   }
+
+   net_sendinput();
+   net_flushdelayed();
+
+   net.stats.frame_usecs += osd_get_usecs() - start;
+
+   return ran;
+}
+
+bool netplay_active(void)
+{
+   return net.active;
+}
+
+void netplay_getstats(netstats_t *stats)
+{
+   *stats = net.stats;
+}
+
+/* pretend the link is slow, lossy, or both */
+void netplay_setlink(int latency_ms, int loss_percent)
+{
+   net.latency = (latency_ms > 0) ? latency_ms : 0;
+   net.loss = (loss_percent > 0) ? loss_percent : 0;
+}
+
+static int net_resolve(const char *host, int port, struct sockaddr_in *addr)
+{
+   struct hostent *entry;
+
+   memset(addr, 0, sizeof(*addr));
+   addr->sin_family = AF_INET;
+   addr->sin_port = htons((uint16) port);
+   addr->sin_addr.s_addr = inet_addr(host);
+
+   if (INADDR_NONE == addr->sin_addr.s_addr)
+   {
+      entry = gethostbyname(host);
+      if (NULL == entry || AF_INET != entry->h_addrtype)
+         return -1;
+
+      memcpy(&addr->sin_addr, entry->h_addr_list[0], sizeof(addr->sin_addr));
+   }
+
+   return 0;
+}
+
+/* everything netplay_open() got hold of */
+static void net_free(void)
+{
+   int i;
+
+   if (NET_BADSOCK != net.sock)
+      net_closesocket(net.sock);
+   net.sock = NET_BADSOCK;
+
+#ifdef WIN32
+   WSACleanup();
+#endif /* WIN32 */
+
+   for (i = 0; i < NETPLAY_MAXROLLBACK + 2; i++)
+      snap_destroy(&net.snaps[i]);
+
+   snap_destroy(&net.checkpoint);
+   snap_destroy(&net.incoming);
+   if (net.delayed)
+      free(net.delayed);
+}
+
+/* start playing against a peer; a NULL peer_host waits to be found */
+int netplay_open(int player, int local_port, const char *peer_host, int peer_port,
+                 int delay, int rollback)
+{
+   struct sockaddr_in addr;
+   int i;
+#ifdef WIN32
+   WSADATA wsa;
+   u_long nonblock = 1;
+#endif /* WIN32 */
+
+   ASSERT(false == net.active);
+
+   memset(&net, 0, sizeof(net));
+   net.sock = NET_BADSOCK;
+   net.player = player ? 1 : 0;
+   net.delay = (delay < 0) ? 0 : delay;
+   net.rollback = rollback;
+   if (net.rollback < 1)
+      net.rollback = 1;
+   if (net.rollback > NETPLAY_MAXROLLBACK)
+      net.rollback = NETPLAY_MAXROLLBACK;
+
+#ifdef WIN32
+   if (WSAStartup(MAKEWORD(2, 2), &wsa))
+      goto _fail;
+#endif /* WIN32 */
+
+   if (peer_host)
+   {
+      if (net_resolve(peer_host, peer_port, &net.peer))
+      {
+         log_printf("netplay: can't find %s\n", peer_host);
+         goto _fail;
+      }
+      net.peer_known = true;
+   }
+
+   net.sock = socket(AF_INET, SOCK_DGRAM, 0);
+   if (NET_BADSOCK == net.sock)
+      goto _fail;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons((uint16) local_port);
+   addr.sin_addr.s_addr = htonl(INADDR_ANY);
+   if (bind(net.sock, (struct sockaddr *) &addr, sizeof(addr)))
+   {
+      log_printf("netplay: can't listen on port %d\n", local_port);
+      goto _fail;
+   }
+
+#ifdef WIN32
+   ioctlsocket(net.sock, FIONBIO, &nonblock);
+#else /* !WIN32 */
+   fcntl(net.sock, F_SETFL, fcntl(net.sock, F_GETFL) | O_NONBLOCK);
+#endif /* !WIN32 */
+
+   /* one more than we can roll back, for the frame about to run */
+   net.num_snaps = net.rollback + 2;
+   for (i = 0; i < net.num_snaps; i++)
+   {
+      net.snaps[i] = snap_create();
+      if (NULL == net.snaps[i])
+         goto _fail;
+   }
+
+   net.checkpoint = snap_create();
+   net.incoming = snap_create();
+   net.delayed = malloc(NET_DELAYQUEUE * sizeof(netdelayed_t));
+   if (NULL == net.checkpoint || NULL == net.incoming || NULL == net.delayed)
+      goto _fail;
+
+   /* the first few frames are nobody's input */
+   net.local_count = net.remote_count = net.remote_ack = net.delay;
+   net.wrong_frame = NET_NOFRAME;
+   net.resync_frame = net.peer_resync = NET_NOFRAME;
+   net.peer_hash.frame = net.compared_frame = NET_NOFRAME;
+   net.incoming_frame = NET_NOFRAME;
+   net.checkpoint_frame = NET_NOFRAME;
+   net.stats.checked_frame = NET_NOFRAME;
+   for (i = 0; i < NET_HASHES; i++)
+      net.hashes[i].frame = NET_NOFRAME;
+
+   net.seed = (uint32) (player + 1) * 2654435761u;
+   net.active = true;
+
+   log_printf("netplay: player %d on port %d, %d frame delay, %d frame rollback\n",
+              net.player + 1, local_port, net.delay, net.rollback);
+
+   return 0;
+
+_fail:
+   net_free();
+   return -1;
+}
+
+void netplay_close(void)
+{
+   if (false == net.active)
+      return;
+
+   net_free();
+   input_setpads(NULL);
+   net.active = false;
+}
+
+/* start up as [netplay] in the config says: player 1 hosts, player 2
+** joins the peer, and 0 is no netplay at all
+*/
+int netplay_init(void)
+{
+   const char *peer;
+   int player;
+
+   player = config.read_int("netplay", "player", 0);
+   if (player < 1 || player > 2)
+      return 0;
+
+   /* the host may find out who its peer is as it's called */
+   peer = config.read_string("netplay", "peer", "");
+   if (0 == *peer && 2 == player)
+   {
+      log_printf("netplay: player 2 needs a peer to join\n");
+      return -1;
+   }
+
+   return netplay_open(player - 1,
+                       config.read_int("netplay", "port", NETPLAY_PORT),
+                       *peer ? peer : NULL,
+                       config.read_int("netplay", "peer_port", NETPLAY_PORT),
+                       config.read_int("netplay", "delay", NETPLAY_DELAY),
+                       config.read_int("netplay", "rollback", NETPLAY_ROLLBACK));
+}
@@ -0,0 +1,60 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** netplay.h
+**
+** Peer to peer rollback netplay
+** $Id$
+*/
+
+#ifndef _NETPLAY_H_
+#define _NETPLAY_H_
+
+#include <noftypes.h>
+
+#define  NETPLAY_PORT         5400
+#define  NETPLAY_DELAY        2     /* frames local input is held back */
+#define  NETPLAY_ROLLBACK     8     /* frames that may run on a guess */
+#define  NETPLAY_MAXROLLBACK  30
+
+typedef struct netstats_s
+{
+   uint32 frames;             /* run for real */
+   uint32 rollbacks;
+   uint32 resim_frames;       /* run again after a wrong guess */
+   uint32 resim_usecs;
+   uint32 frame_usecs;        /* everything, resimulation included */
+   uint32 stalls;             /* frames held up waiting on the peer */
+   uint32 desyncs;            /* checkpoints whose hashes didn't agree */
+   uint32 resyncs;            /* host states loaded to put that right */
+   uint32 packets_sent, packets_received, packets_lost;
+   uint32 checked_frame;      /* last checkpoint both sides agree on */
+} netstats_t;
+
+extern int netplay_init(void);
+extern int netplay_open(int player, int local_port, const char *peer_host, int peer_port,
+                        int delay, int rollback);
+extern void netplay_close(void);
+extern void netplay_setlink(int latency_ms, int loss_percent);
+
+extern bool netplay_active(void);
+extern bool netplay_frame(bool draw_flag);
+extern void netplay_getstats(netstats_t *stats);
+
+#endif /* _NETPLAY_H_ */
@@ -0,0 +1,454 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** nsf.c
+**
+** NSF loading and playback
+** $Id$
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <noftypes.h>
+#include <log.h>
+#include <nes6502.h>
+#include <nes_apu.h>
+#include <vrcvisnd.h>
+#include <mmc5_snd.h>
+#include <fds_snd.h>
+#include <nsf.h>
+
+#define  NSF_RAMSIZE          0x800
+#define  NSF_BANKSIZE         0x1000
+
+/* the tune's init and play routines are called from a little 6502 routine
+** of our own, in the ppu's otherwise unused address space.  it calls init,
+** then waits for the flag to go up, clears it, calls play, and waits again;
+** raising the flag is the nsf's stand-in for nmi
+*/
+#define  NSF_PLAYER_ADDR      0x2800
+#define  NSF_PLAYER_FLAG      0x2F00
+
+static const uint8 nsf_player[] =
+{
+   0x20, 0x00, 0x00,       /*       JSR init */
+   0x2C, 0x00, 0x2F,       /* wait: BIT flag */
+   0x10, 0xFB,             /*       BPL wait */
+   0x4E, 0x00, 0x2F,       /*       LSR flag */
+   0x20, 0x00, 0x00,       /*       JSR play */
+   0x4C, 0x03, 0x28        /*       JMP wait */
+};
+
+#define  NSF_PLAYER_INIT      1
+#define  NSF_PLAYER_PLAY      12
+
+/* tune being played, for the memory handlers */
+static nsf_t *cur_nsf = NULL;
+
+
+static uint16 nsf_get16(const uint8 *src)
+{
+   return (uint16) (src[0] | (src[1] << 8));
+}
+
+static uint8 nsf_ramread(uint32 address)
+{
+   return cur_nsf->ram[address & (NSF_RAMSIZE - 1)];
+}
+
+static void nsf_ramwrite(uint32 address, uint8 value)
+{
+   cur_nsf->ram[address & (NSF_RAMSIZE - 1)] = value;
+}
+
+/* ppu registers, $4016/7, and rom */
+static void nsf_nullwrite(uint32 address, uint8 value)
+{
+   UNUSED(address);
+   UNUSED(value);
+}
+
+/* $5FF8-$5FFF each pick the 4kB bank seen at $8000-$FFFF */
+static void nsf_setbank(nes6502_context *cpu, int page, int bank)
+{
+   cpu->mem_page[8 + page] = cur_nsf->data + (bank % cur_nsf->num_banks) * NSF_BANKSIZE;
+}
+
+static void nsf_bankswitch(uint32 address, uint8 value)
+{
+   nes6502_context cpu;
+
+   nes6502_getcontext(&cpu);
+   nsf_setbank(&cpu, address & 7, value);
+   nes6502_setcontext(&cpu);
+}
+
+/* fill in the cpu's memory handlers, sound chip's first */
+static void nsf_buildhandlers(nsf_t *nsf, apuext_t *ext)
+{
+   nes6502_memread *mr = nsf->readhandler;
+   nes6502_memwrite *mw = nsf->writehandler;
+   int i;
+
+   mr->min_range = 0x0800; mr->max_range = 0x1FFF; mr->read_func = nsf_ramread; mr++;
+   mr->min_range = 0x4015; mr->max_range = 0x4015; mr->read_func = apu_read; mr++;
+
+   mw->min_range = 0x0800; mw->max_range = 0x1FFF; mw->write_func = nsf_ramwrite; mw++;
+   mw->min_range = 0x2000; mw->max_range = NSF_PLAYER_ADDR - 1; mw->write_func = nsf_nullwrite; mw++;
+   mw->min_range = 0x4000; mw->max_range = 0x4013; mw->write_func = apu_write; mw++;
+   mw->min_range = 0x4015; mw->max_range = 0x4015; mw->write_func = apu_write; mw++;
+   mw->min_range = 0x4016; mw->max_range = 0x4017; mw->write_func = nsf_nullwrite; mw++;
+   mw->min_range = 0x5FF8; mw->max_range = 0x5FFF; mw->write_func = nsf_bankswitch; mw++;
+
+   if (ext)
+   {
+      for (i = 0; ext->mem_read && ext->mem_read[i].read_func; i++, mr++)
+      {
+         mr->min_range = ext->mem_read[i].min_range;
+         mr->max_range = ext->mem_read[i].max_range;
+         mr->read_func = ext->mem_read[i].read_func;
+      }
+
+      for (i = 0; ext->mem_write && ext->mem_write[i].write_func; i++, mw++)
+      {
+         mw->min_range = ext->mem_write[i].min_range;
+         mw->max_range = ext->mem_write[i].max_range;
+         mw->write_func = ext->mem_write[i].write_func;
+      }
+   }
+
+   /* anything the sound chip didn't claim up there is rom */
+   mw->min_range = 0x8000; mw->max_range = 0xFFFF; mw->write_func = nsf_nullwrite; mw++;
+
+   mr->min_range = mr->max_range = -1; mr->read_func = NULL; mr++;
+   mw->min_range = mw->max_range = -1; mw->write_func = NULL; mw++;
+
+   ASSERT(mr - nsf->readhandler <= NSF_MAX_HANDLERS);
+   ASSERT(mw - nsf->writehandler <= NSF_MAX_HANDLERS);
+}
+
+/* one sound chip can be hooked to the apu; pick the first we do */
+static apuext_t *nsf_getext(nsf_t *nsf)
+{
+   apuext_t *ext = NULL;
+
+   if (nsf->ext_sound_type & NSF_EXT_VRC6)
+      ext = &vrcvi_ext;
+   else if (nsf->ext_sound_type & NSF_EXT_MMC5)
+      ext = &mmc5_ext;
+   else if (nsf->ext_sound_type & NSF_EXT_FDS)
+      ext = &fds_ext;
+
+   if (nsf->ext_sound_type & (NSF_EXT_VRC7 | NSF_EXT_N163 | NSF_EXT_S5B))
+      log_printf("nsf: some of this tune's sound chips are not emulated\n");
+
+   return ext;
+}
+
+static int nsf_getheader(nsf_t *nsf, const uint8 *head)
+{
+   int i;
+
+   if (memcmp(head, NSF_MAGIC, 5))
+      return -1;
+
+   nsf->version = head[0x05];
+   nsf->num_songs = head[0x06];
+   nsf->start_song = head[0x07];
+   nsf->load_addr = nsf_get16(head + 0x08);
+   nsf->init_addr = nsf_get16(head + 0x0A);
+   nsf->play_addr = nsf_get16(head + 0x0C);
+
+   /* the strings needn't be terminated */
+   memcpy(nsf->song_name, head + 0x0E, 32);
+   memcpy(nsf->artist_name, head + 0x2E, 32);
+   memcpy(nsf->copyright, head + 0x4E, 32);
+   nsf->song_name[32] = nsf->artist_name[32] = nsf->copyright[32] = 0;
+
+   nsf->ntsc_speed = nsf_get16(head + 0x6E);
+   memcpy(nsf->bankswitch_info, head + 0x70, 8);
+   nsf->ext_sound_type = head[0x7B];
+
+   nsf->bankswitched = false;
+   for (i = 0; i < 8; i++)
+   {
+      if (nsf->bankswitch_info[i])
+         nsf->bankswitched = true;
+   }
+
+   if (0 == nsf->num_songs)
+      return -1;
+
+   if (0 == nsf->start_song || nsf->start_song > nsf->num_songs)
+      nsf->start_song = 1;
+
+   /* everything but fds tunes loads into rom */
+   if (nsf->load_addr < 0x8000)
+   {
+      log_printf("nsf: load address $%04X is not in rom space\n", nsf->load_addr);
+      return -1;
+   }
+
+   return 0;
+}
+
+/* Load an NSF into memory */
+nsf_t *nsf_load(const char *filename)
+{
+   FILE *fp;
+   nsf_t *nsf;
+   uint8 head[NSF_HEADER_LENGTH];
+   long length, offset;
+
+   nsf = malloc(sizeof(nsf_t));
+   if (NULL == nsf)
+      return NULL;
+
+   memset(nsf, 0, sizeof(nsf_t));
+
+   fp = fopen(filename, "rb");
+   if (NULL == fp)
+   {
+      log_printf("nsf: could not open %s\n", filename);
+      goto _fail;
+   }
+
+   if (1 != fread(head, NSF_HEADER_LENGTH, 1, fp) || nsf_getheader(nsf, head))
+   {
+      log_printf("nsf: %s is not a valid NSF\n", filename);
+      goto _fail;
+   }
+
+   fseek(fp, 0, SEEK_END);
+   length = ftell(fp) - NSF_HEADER_LENGTH;
+   fseek(fp, NSF_HEADER_LENGTH, SEEK_SET);
+
+   /* with no code there'd be no banks to switch between */
+   if (length <= 0)
+   {
+      log_printf("nsf: %s has no data after its header\n", filename);
+      goto _fail;
+   }
+
+   /* banked tunes load at their address within the first bank; the
+   ** rest load at their address in a flat 32kB
+   */
+   if (nsf->bankswitched)
+      offset = nsf->load_addr & (NSF_BANKSIZE - 1);
+   else
+      offset = nsf->load_addr - 0x8000;
+
+   nsf->num_banks = (int) ((offset + length + NSF_BANKSIZE - 1) / NSF_BANKSIZE);
+   if (false == nsf->bankswitched)
+   {
+      if (nsf->num_banks > 8)
+         length = 8 * NSF_BANKSIZE - offset;
+      nsf->num_banks = 8;
+   }
+
+   nsf->data = malloc(nsf->num_banks * NSF_BANKSIZE);
+   if (NULL == nsf->data)
+      goto _fail;
+
+   memset(nsf->data, 0, nsf->num_banks * NSF_BANKSIZE);
+   if (length != (long) fread(nsf->data + offset, 1, length, fp))
+      goto _fail;
+
+   fclose(fp);
+   fp = NULL;
+
+   nsf->ram = malloc(NSF_RAMSIZE);
+   nsf->player = malloc(NSF_BANKSIZE);
+   nsf->exram = malloc(NSF_BANKSIZE);
+   nsf->wram = malloc(2 * NSF_BANKSIZE);
+   if (NULL == nsf->ram || NULL == nsf->player || NULL == nsf->exram || NULL == nsf->wram)
+      goto _fail;
+
+   log_printf("nsf: %s - %s, %d songs\n", nsf->artist_name, nsf->song_name, nsf->num_songs);
+
+   return nsf;
+
+_fail:
+   if (NULL != fp)
+      fclose(fp);
+   nsf_free(&nsf);
+   return NULL;
+}
+
+/* Free an NSF */
+void nsf_free(nsf_t **nsf)
+{
+   if (NULL == *nsf)
+      return;
+
+   if (cur_nsf == *nsf)
+      cur_nsf = NULL;
+
+   if ((*nsf)->apu)
+      apu_destroy(&(*nsf)->apu);
+   if ((*nsf)->data)
+      free((*nsf)->data);
+   if ((*nsf)->ram)
+      free((*nsf)->ram);
+   if ((*nsf)->player)
+      free((*nsf)->player);
+   if ((*nsf)->exram)
+      free((*nsf)->exram);
+   if ((*nsf)->wram)
+      free((*nsf)->wram);
+
+   free(*nsf);
+}
+
+/* set the machine up fresh and call init for track (1-based) */
+int nsf_playtrack(nsf_t *nsf, int track, int sample_rate, int sample_bits)
+{
+   apuext_t *ext;
+   int i;
+
+   ASSERT(nsf);
+
+   if (track < 1 || track > nsf->num_songs)
+      return -1;
+
+   cur_nsf = nsf;
+   nsf->current_song = track;
+
+   ext = nsf_getext(nsf);
+
+   /* a new rate needs a new apu */
+   if (nsf->apu && (sample_rate != nsf->sample_rate || sample_bits != nsf->sample_bits))
+      apu_destroy(&nsf->apu);
+
+   if (NULL == nsf->apu)
+   {
+      nsf->apu = apu_create(0, sample_rate, NSF_REFRESH_RATE, sample_bits);
+      if (NULL == nsf->apu)
+         return -1;
+
+      /* no irq line to drive; tunes poll the frame counter, if anything */
+      apu_setext(nsf->apu, ext);
+   }
+
+   nsf->sample_rate = sample_rate;
+   nsf->sample_bits = sample_bits;
+
+   memset(nsf->ram, 0, NSF_RAMSIZE);
+   memset(nsf->exram, 0, NSF_BANKSIZE);
+   memset(nsf->wram, 0, 2 * NSF_BANKSIZE);
+
+   memset(nsf->player, 0, NSF_BANKSIZE);
+   memcpy(nsf->player + (NSF_PLAYER_ADDR & (NSF_BANKSIZE - 1)), nsf_player, sizeof(nsf_player));
+   nsf->player[(NSF_PLAYER_ADDR & (NSF_BANKSIZE - 1)) + NSF_PLAYER_INIT] = (uint8) nsf->init_addr;
+   nsf->player[(NSF_PLAYER_ADDR & (NSF_BANKSIZE - 1)) + NSF_PLAYER_INIT + 1] = (uint8) (nsf->init_addr >> 8);
+   nsf->player[(NSF_PLAYER_ADDR & (NSF_BANKSIZE - 1)) + NSF_PLAYER_PLAY] = (uint8) nsf->play_addr;
+   nsf->player[(NSF_PLAYER_ADDR & (NSF_BANKSIZE - 1)) + NSF_PLAYER_PLAY + 1] = (uint8) (nsf->play_addr >> 8);
+
+   nsf_buildhandlers(nsf, ext);
+
+   /* only the cpu, apu and memory; no ppu */
+   memset(&nsf->cpu, 0, sizeof(nes6502_context));
+   nsf->cpu.mem_page[0] = nsf->ram;
+   nsf->cpu.mem_page[2] = nsf->player;
+   nsf->cpu.mem_page[5] = nsf->exram;
+   nsf->cpu.mem_page[6] = nsf->wram;
+   nsf->cpu.mem_page[7] = nsf->wram + NSF_BANKSIZE;
+   for (i = 0; i < 8; i++)
+      nsf_setbank(&nsf->cpu, i, nsf->bankswitched ? nsf->bankswitch_info[i] : i);
+
+   nsf->cpu.read_handler = nsf->readhandler;
+   nsf->cpu.write_handler = nsf->writehandler;
+
+   /* init gets the song in A, and NTSC (0) in X */
+   nsf->cpu.pc_reg = NSF_PLAYER_ADDR;
+   nsf->cpu.a_reg = track - 1;
+   nsf->cpu.x_reg = 0;
+   nsf->cpu.s_reg = 0xFF;
+   nsf->cpu.p_reg = R_FLAG | I_FLAG | Z_FLAG;
+
+   nes6502_setcontext(&nsf->cpu);
+
+   apu_setcontext(nsf->apu);
+   apu_reset();
+   apu_write(APU_SMASK, 0x0F);
+
+   /* a tune that doesn't say gets the usual NTSC rate */
+   if (0 == nsf->ntsc_speed)
+      nsf->play_cycles = APU_BASEFREQ / 60.0988;
+   else
+      nsf->play_cycles = APU_BASEFREQ * nsf->ntsc_speed / 1000000;
+
+   nsf->play_timer = nsf->play_cycles;
+   nsf->frame_cycles = 0;
+   nsf->frame_samples = 0;
+
+   return 0;
+}
+
+/* run the tune for a 60th of a second, raising the play flag whenever
+** the play timer runs out, and make the sound for it.  buffer needs room
+** for sample_rate / NSF_REFRESH_RATE + 1 samples; returns how many there
+** are
+*/
+int nsf_frame(nsf_t *nsf, void *buffer)
+{
+   int slice, ran, num_samples;
+
+   ASSERT(nsf == cur_nsf);
+
+   nsf->frame_cycles += APU_BASEFREQ / NSF_REFRESH_RATE;
+
+   while (nsf->frame_cycles > 0)
+   {
+      slice = apu_dmcnext();
+      if (slice > nsf->frame_cycles)
+         slice = (int) nsf->frame_cycles + 1;
+      if (slice > nsf->play_timer)
+         slice = (int) nsf->play_timer + 1;
+
+      ran = nes6502_execute(slice);
+      apu_dmcclock();
+
+      /* a jammed cpu gets nowhere */
+      if (0 == ran)
+      {
+         nsf->frame_cycles = 0;
+         break;
+      }
+
+      nsf->frame_cycles -= ran;
+      nsf->play_timer -= ran;
+      if (nsf->play_timer <= 0)
+      {
+         nsf->play_timer += nsf->play_cycles;
+         nsf->player[NSF_PLAYER_FLAG & (NSF_BANKSIZE - 1)] = 0x80;
+      }
+   }
+
+   apu_endframe();
+
+   nsf->frame_samples += (double) nsf->sample_rate / NSF_REFRESH_RATE;
+   num_samples = (int) nsf->frame_samples;
+   nsf->frame_samples -= num_samples;
+
+   apu_process(buffer, num_samples);
+
+   return num_samples;
+}
@@ -0,0 +1,96 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** nsf.h
+**
+** NSF loading and playback
+** $Id$
+*/
+
+#ifndef _NSF_H_
+#define _NSF_H_
+
+#include <noftypes.h>
+#include <nes6502.h>
+#include <nes_apu.h>
+
+#define  NSF_MAGIC            "NESM\x1A"
+#define  NSF_HEADER_LENGTH    0x80
+
+/* expansion sound chips the tune wants, from the header */
+#define  NSF_EXT_VRC6         0x01
+#define  NSF_EXT_VRC7         0x02
+#define  NSF_EXT_FDS          0x04
+#define  NSF_EXT_MMC5         0x08
+#define  NSF_EXT_N163         0x10
+#define  NSF_EXT_S5B          0x20
+
+/* play calls are made on the cpu's clock, but sound comes out a 60Hz
+** frame at a time
+*/
+#define  NSF_REFRESH_RATE     60
+
+#define  NSF_MAX_HANDLERS     16
+
+typedef struct nsf_s
+{
+   /* from the header */
+   uint8 version;
+   uint8 num_songs;
+   uint8 start_song;
+   uint32 load_addr, init_addr, play_addr;
+   char song_name[33];
+   char artist_name[33];
+   char copyright[33];
+   uint32 ntsc_speed; /* microseconds between play calls */
+   uint8 bankswitch_info[8];
+   uint8 ext_sound_type;
+
+   /* the tune's code and data, padded out to whole 4kB banks */
+   uint8 *data;
+   int num_banks;
+   bool bankswitched;
+
+   /* memory the tune runs in */
+   uint8 *ram;       /* $0000-$07FF */
+   uint8 *player;    /* $2000-$2FFF, our init/play caller */
+   uint8 *exram;     /* $5000-$5FFF */
+   uint8 *wram;      /* $6000-$7FFF */
+
+   nes6502_context cpu;
+   nes6502_memread readhandler[NSF_MAX_HANDLERS];
+   nes6502_memwrite writehandler[NSF_MAX_HANDLERS];
+   apu_t *apu;
+
+   /* playback */
+   int current_song;
+   int sample_rate;
+   int sample_bits;
+   double play_cycles, play_timer;
+   double frame_cycles;
+   double frame_samples;
+} nsf_t;
+
+extern nsf_t *nsf_load(const char *filename);
+extern void nsf_free(nsf_t **nsf);
+
+extern int nsf_playtrack(nsf_t *nsf, int track, int sample_rate, int sample_bits);
+extern int nsf_frame(nsf_t *nsf, void *buffer);
+
+#endif /* _NSF_H_ */
@@ -0,0 +1,956 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** replay.c
+**
+** Input recording and playback, with keyframes to seek by
+** $Id$
+*/
+
+/* A replay is the pads, frame by frame, cut into segments of a few
+** seconds.  Each segment starts with a keyframe, a snapshot of the whole
+** machine (run length packed), so playback can start at any segment
+** without running everything before it:
+**
+**    header      "NFRP", version, flags, keyframe interval in frames,
+**                snapshot length, cart hash, frames, keyframes, and
+**                where the index is
+**    segments    "KF" 0 0, frame, packed length, the packed snapshot
+**                "IN" 0 0, frames, then two pad bytes a frame
+**    index       frame and file offset of each keyframe
+**
+** All of it little endian.  The index and header are filled in when
+** recording stops; a replay that never got that far can still be played,
+** by walking the segments instead.
+**
+** Recording hands each finished segment to a writer thread, which packs
+** and writes it, so the emulation thread never waits on the disk unless
+** the writer is a whole RP_SEGMENTS behind.  Playback maps the file.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef WIN32
+#include <windows.h>
+#else /* !WIN32 */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif /* !WIN32 */
+#include <noftypes.h>
+#include <log.h>
+#include <gui.h>
+#include <nofconfig.h>
+#include <thread.h>
+#include <nes.h>
+#include <nesinput.h>
+#include <nessnap.h>
+#include <replay.h>
+
+#define  RP_HEADER_LENGTH     48
+#define  RP_KEYFRAME_LENGTH   12
+#define  RP_INPUT_LENGTH      8
+#define  RP_INDEX_LENGTH      8
+
+#define  RP_COMPLETE          0x0001   /* header and index are good */
+
+#define  RP_SEGMENTS          4        /* handed to the writer, at most */
+#define  RP_INDEX_KEYFRAMES   8192     /* to start with; 22 hours at 10s */
+
+typedef struct rpsegment_s
+{
+   snap_t *snap;              /* the machine as the segment starts */
+   uint8 *inputs;
+   uint32 frame;
+   int count;                 /* frames of input so far */
+   int number;                /* which keyframe this is */
+} rpsegment_t;
+
+static struct
+{
+   bool on;
+   FILE *fp;
+   int interval;
+   uint32 cart_hash;
+   uint32 frame;
+
+   rpsegment_t segments[RP_SEGMENTS];
+   bool open;                 /* the current one is being filled */
+   uint8 *pack;               /* the writer's */
+
+   /* between us and the writer */
+   thread_t *writer;
+   monitor_t *monitor;
+   int submitted, written;
+   bool quit, failed;
+
+   uint32 offset;             /* where the writer is in the file */
+   uint32 *index;             /* keyframe offsets */
+   int index_size;
+   int keyframes;
+} rec;
+
+static struct
+{
+   bool on;
+   const uint8 *data;
+   uint32 length;
+#ifdef WIN32
+   HANDLE file, mapping;
+#endif /* WIN32 */
+
+   uint32 frames;
+   int keyframes;
+   uint32 *key_frames, *key_offsets;
+   snap_t *snap;
+
+   uint32 frame;              /* next to play */
+   int segment;
+   const uint8 *inputs;
+   uint32 seg_start, seg_count;
+} play;
+
+
+static void rp_put32(uint8 *dest, uint32 value)
+{
+   dest[0] = (uint8) value;
+   dest[1] = (uint8) (value >> 8);
+   dest[2] = (uint8) (value >> 16);
+   dest[3] = (uint8) (value >> 24);
+}
+
+static uint32 rp_get32(const uint8 *src)
+{
+   return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32) src[3] << 24);
+}
+
+/* a replay only goes with the cart it was made on */
+static uint32 rp_carthash(void)
+{
+   rominfo_t *cart = nes_getcontextptr()->rominfo;
+   uint32 hash = 2166136261u;
+   const uint8 *p;
+   int length;
+
+   p = cart->rom;
+   for (length = cart->rom_banks * 0x4000; length; length--)
+   {
+      hash ^= *p++;
+      hash *= 16777619;
+   }
+
+   p = cart->vrom;
+   for (length = cart->vrom ? cart->vrom_banks * 0x2000 : 0; length; length--)
+   {
+      hash ^= *p++;
+      hash *= 16777619;
+   }
+
+   return hash;
+}
+
+/* Snapshots are mostly runs of zeros or some other byte.  A control
+** byte below 0x80 is followed by that many plus one bytes as they are;
+** from 0x80 up, by one byte to repeat (control & 0x7F) + 3 times
+*/
+static uint32 rp_pack(uint8 *dest, const uint8 *src, uint32 length)
+{
+   uint8 *out = dest;
+   uint32 i = 0, literal = 0, run;
+
+   while (i < length)
+   {
+      for (run = 1; i + run < length && run < 130 && src[i + run] == src[i]; run++)
+         ;
+
+      if (run >= 3)
+      {
+         *out++ = (uint8) (0x80 | (run - 3));
+         *out++ = src[i];
+         i += run;
+         continue;
+      }
+
+      /* gather literals up to the next run */
+      literal = 0;
+      while (i + literal < length && literal < 128)
+      {
+         if (i + literal + 2 < length && src[i + literal] == src[i + literal + 1]
+             && src[i + literal] == src[i + literal + 2])
+            break;
+         literal++;
+      }
+
+      *out++ = (uint8) (literal - 1);
+      memcpy(out, src + i, literal);
+      out += literal;
+      i += literal;
+   }
+
+   return (uint32) (out - dest);
+}
+
+static int rp_unpack(uint8 *dest, uint32 dest_length, const uint8 *src, uint32 src_length)
+{
+   const uint8 *end = src + src_length;
+   uint32 done = 0, count;
+
+   while (src < end)
+   {
+      if (*src & 0x80)
+      {
+         count = (*src & 0x7F) + 3;
+         if (src + 1 >= end || done + count > dest_length)
+            return -1;
+
+         memset(dest + done, src[1], count);
+         src += 2;
+      }
+      else
+      {
+         count = *src + 1;
+         if (src + 1 + count > end || done + count > dest_length)
+            return -1;
+
+         memcpy(dest + done, src + 1, count);
+         src += 1 + count;
+      }
+
+      done += count;
+   }
+
+   return (done == dest_length) ? 0 : -1;
+}
+
+static int rp_putheader(FILE *fp, uint32 flags, uint32 index_offset)
+{
+   uint8 header[RP_HEADER_LENGTH];
+
+   memset(header, 0, sizeof(header));
+   memcpy(header, "NFRP", 4);
+   rp_put32(header + 4, REPLAY_VERSION);
+   rp_put32(header + 8, flags);
+   rp_put32(header + 12, rec.interval);
+   rp_put32(header + 16, rec.segments[0].snap->length);
+   rp_put32(header + 20, rec.cart_hash);
+   rp_put32(header + 24, rec.frame);
+   rp_put32(header + 28, rec.keyframes);
+   rp_put32(header + 32, index_offset);
+
+   if (fseek(fp, 0, SEEK_SET) || 1 != fwrite(header, RP_HEADER_LENGTH, 1, fp))
+      return -1;
+
+   return 0;
+}
+
+/* pack a segment and put it out at the end of the file */
+static int rp_writesegment(rpsegment_t *seg)
+{
+   uint8 chunk[RP_KEYFRAME_LENGTH];
+   uint32 packed;
+
+   packed = rp_pack(rec.pack, (const uint8 *) seg->snap, seg->snap->length);
+
+   memcpy(chunk, "KF\0\0", 4);
+   rp_put32(chunk + 4, seg->frame);
+   rp_put32(chunk + 8, packed);
+   if (1 != fwrite(chunk, RP_KEYFRAME_LENGTH, 1, rec.fp)
+       || 1 != fwrite(rec.pack, packed, 1, rec.fp))
+      return -1;
+
+   memcpy(chunk, "IN\0\0", 4);
+   rp_put32(chunk + 4, seg->count);
+   if (1 != fwrite(chunk, RP_INPUT_LENGTH, 1, rec.fp)
+       || (seg->count && 1 != fwrite(seg->inputs, seg->count * 2, 1, rec.fp)))
+      return -1;
+
+   return 0;
+}
+
+/* note where a keyframe went.  the index is made big enough up front
+** that this hardly ever has to grow it, and when it does, only the
+** writer touches it, so it's done here rather than on the emulation thread
+*/
+static int rp_putindex(int number, uint32 offset)
+{
+   uint32 *index;
+
+   if (number >= rec.index_size)
+   {
+      index = malloc(rec.index_size * 2 * sizeof(uint32));
+      if (NULL == index)
+         return -1;
+
+      memcpy(index, rec.index, rec.index_size * sizeof(uint32));
+      free(rec.index);
+      rec.index = index;
+      rec.index_size *= 2;
+   }
+
+   rec.index[number] = offset;
+   return 0;
+}
+
+/* the writer thread: segments out to disk as they come */
+static int rp_writer(void *arg)
+{
+   rpsegment_t *seg;
+   uint32 offset;
+
+   UNUSED(arg);
+
+   monitor_enter(rec.monitor);
+
+   for (;;)
+   {
+      while (rec.written == rec.submitted && false == rec.quit)
+         monitor_wait(rec.monitor);
+
+      if (rec.written == rec.submitted)
+         break;
+
+      seg = &rec.segments[rec.written % RP_SEGMENTS];
+      offset = rec.offset;
+      monitor_leave(rec.monitor);
+
+      if (false == rec.failed && rp_writesegment(seg))
+      {
+         log_printf("replay: error writing, recording no more\n");
+         rec.failed = true;
+      }
+
+      if (false == rec.failed && rp_putindex(seg->number, offset))
+      {
+         log_printf("replay: out of memory for the index, recording no more\n");
+         rec.failed = true;
+      }
+
+      monitor_enter(rec.monitor);
+      rec.offset = (uint32) ftell(rec.fp);
+      rec.written++;
+      monitor_notify(rec.monitor);
+   }
+
+   monitor_leave(rec.monitor);
+
+   return rec.failed ? -1 : 0;
+}
+
+/* the writer is this segment's now */
+static void rp_submit(void)
+{
+   monitor_enter(rec.monitor);
+   rec.submitted++;
+   monitor_notify(rec.monitor);
+   monitor_leave(rec.monitor);
+
+   rec.open = false;
+}
+
+/* start a segment here, with a snapshot of how things stand */
+static void rp_opensegment(void)
+{
+   rpsegment_t *seg;
+
+   monitor_enter(rec.monitor);
+
+   /* the writer is that far behind; nothing to do but wait on it */
+   while (rec.submitted - rec.written >= RP_SEGMENTS)
+      monitor_wait(rec.monitor);
+
+   monitor_leave(rec.monitor);
+
+   seg = &rec.segments[rec.submitted % RP_SEGMENTS];
+   seg->frame = rec.frame;
+   seg->count = 0;
+   seg->number = rec.keyframes++;
+   snap_save(seg->snap);
+   rec.open = true;
+}
+
+static void rp_freerecord(void)
+{
+   int i;
+
+   if (rec.fp)
+   {
+      fclose(rec.fp);
+      rec.fp = NULL;
+   }
+
+   for (i = 0; i < RP_SEGMENTS; i++)
+   {
+      snap_destroy(&rec.segments[i].snap);
+      if (rec.segments[i].inputs)
+         free(rec.segments[i].inputs);
+   }
+
+   if (rec.pack)
+      free(rec.pack);
+   if (rec.index)
+      free(rec.index);
+   monitor_destroy(&rec.monitor);
+}
+
+/* record from here on; interval is frames between keyframes */
+int replay_record(const char *filename, int interval)
+{
+   int i;
+
+   ASSERT(false == replay_active());
+
+   memset(&rec, 0, sizeof(rec));
+   rec.interval = (interval > 0) ? interval : REPLAY_INTERVAL * NES_REFRESH_RATE;
+   rec.cart_hash = rp_carthash();
+
+   for (i = 0; i < RP_SEGMENTS; i++)
+   {
+      rec.segments[i].snap = snap_create();
+      rec.segments[i].inputs = malloc(rec.interval * 2);
+      if (NULL == rec.segments[i].snap || NULL == rec.segments[i].inputs)
+         goto _fail;
+   }
+
+   /* packing never grows a run by more than a byte in 128 */
+   rec.pack = malloc(rec.segments[0].snap->length + rec.segments[0].snap->length / 128 + 1);
+   rec.monitor = monitor_create();
+   rec.index = malloc(RP_INDEX_KEYFRAMES * sizeof(uint32));
+   rec.index_size = RP_INDEX_KEYFRAMES;
+   if (NULL == rec.pack || NULL == rec.monitor || NULL == rec.index)
+      goto _fail;
+
+   rec.fp = fopen(filename, "wb");
+   if (NULL == rec.fp)
+   {
+      log_printf("replay: could not create %s\n", filename);
+      goto _fail;
+   }
+
+   /* a header saying it isn't finished, until it is */
+   if (rp_putheader(rec.fp, 0, 0))
+      goto _fail;
+   rec.offset = RP_HEADER_LENGTH;
+
+   rec.writer = thread_create(rp_writer, NULL);
+   if (NULL == rec.writer)
+      goto _fail;
+
+   rec.on = true;
+   gui_sendmsg(GUI_GREEN, "Recording to %s", filename);
+
+   return 0;
+
+_fail:
+   rp_freerecord();
+   return -1;
+}
+
+static void rp_stoprecord(void)
+{
+   uint8 entry[RP_INDEX_LENGTH];
+   int i, retval;
+
+   if (rec.open)
+   {
+      if (rec.segments[rec.submitted % RP_SEGMENTS].count)
+         rp_submit();
+      else
+         rec.keyframes--;
+   }
+
+   monitor_enter(rec.monitor);
+   rec.quit = true;
+   monitor_notify(rec.monitor);
+   monitor_leave(rec.monitor);
+
+   retval = thread_join(&rec.writer);
+
+   /* the index, and a header that points at it */
+   if (0 == retval)
+   {
+      if (fseek(rec.fp, rec.offset, SEEK_SET))
+         retval = -1;
+
+      for (i = 0; i < rec.keyframes && 0 == retval; i++)
+      {
+         rp_put32(entry, (uint32) i * rec.interval);
+         rp_put32(entry + 4, rec.index[i]);
+         if (1 != fwrite(entry, RP_INDEX_LENGTH, 1, rec.fp))
+            retval = -1;
+      }
+
+      if (0 == retval)
+         retval = rp_putheader(rec.fp, RP_COMPLETE, rec.offset);
+   }
+
+   if (retval)
+      log_printf("replay: recording didn't finish properly\n");
+
+   gui_sendmsg(GUI_GREEN, "Recorded %u frames", rec.frame);
+
+   rp_freerecord();
+   rec.on = false;
+}
+
+static bool rp_recordframe(bool draw_flag)
+{
+   rpsegment_t *seg;
+   uint8 pads[2];
+
+   if (false == rec.open)
+      rp_opensegment();
+
+   /* the pads go in as they stand as the frame starts, and the game
+   ** sees just that, so it plays back the same
+   */
+   input_resolve();
+   pads[0] = input_getpad(INP_JOYPAD0);
+   pads[1] = input_getpad(INP_JOYPAD1);
+   input_setpads(pads);
+
+   seg = &rec.segments[rec.submitted % RP_SEGMENTS];
+   seg->inputs[seg->count * 2] = pads[0];
+   seg->inputs[seg->count * 2 + 1] = pads[1];
+   seg->count++;
+
+   nes_runframe(draw_flag, true);
+   rec.frame++;
+
+   if (seg->count == rec.interval)
+      rp_submit();
+
+   return true;
+}
+
+/* whether length bytes at offset are all in the file.  both come from
+** the file, so this is careful not to let the sum wrap round
+*/
+static bool rp_fits(uint32 offset, uint64_t length)
+{
+   return offset <= play.length && length <= play.length - offset;
+}
+
+/* where a keyframe's segment is, and its inputs */
+static const uint8 *rp_segment(int index, uint32 *packed, const uint8 **inputs, uint32 *count)
+{
+   const uint8 *chunk;
+   uint32 offset = play.key_offsets[index];
+
+   if (false == rp_fits(offset, RP_KEYFRAME_LENGTH))
+      return NULL;
+
+   chunk = play.data + offset;
+   if (memcmp(chunk, "KF", 2))
+      return NULL;
+
+   *packed = rp_get32(chunk + 8);
+   offset += RP_KEYFRAME_LENGTH;
+   if (false == rp_fits(offset, (uint64_t) *packed + RP_INPUT_LENGTH))
+      return NULL;
+
+   offset += *packed;
+   if (memcmp(play.data + offset, "IN", 2))
+      return NULL;
+
+   *count = rp_get32(play.data + offset + 4);
+   offset += RP_INPUT_LENGTH;
+   if (false == rp_fits(offset, (uint64_t) *count * 2))
+      return NULL;
+
+   *inputs = play.data + offset;
+   return chunk + RP_KEYFRAME_LENGTH;
+}
+
+/* keyframes from the index, or from walking the segments if there's no
+** index (the recording was cut short)
+*/
+static int rp_readindex(void)
+{
+   const uint8 *entry;
+   uint32 flags, offset, packed, count, next;
+   int i;
+
+   flags = rp_get32(play.data + 8);
+   play.keyframes = rp_get32(play.data + 28);
+   play.frames = rp_get32(play.data + 24);
+   offset = rp_get32(play.data + 32);
+
+   if (0 == (flags & RP_COMPLETE) || play.keyframes < 0
+       || false == rp_fits(offset, (uint64_t) play.keyframes * RP_INDEX_LENGTH))
+   {
+      play.keyframes = 0;
+      for (offset = RP_HEADER_LENGTH; rp_fits(offset, RP_KEYFRAME_LENGTH); play.keyframes++)
+      {
+         if (memcmp(play.data + offset, "KF", 2))
+            break;
+         packed = rp_get32(play.data + offset + 8);
+         if (false == rp_fits(offset + RP_KEYFRAME_LENGTH, (uint64_t) packed + RP_INPUT_LENGTH))
+            break;
+         next = offset + RP_KEYFRAME_LENGTH + packed;
+         count = rp_get32(play.data + next + 4);
+
+         /* a segment only partly written doesn't count */
+         if (false == rp_fits(next + RP_INPUT_LENGTH, (uint64_t) count * 2))
+            break;
+         next += RP_INPUT_LENGTH + count * 2;
+
+         /* and a walk that doesn't go forward never ends */
+         if (next <= offset)
+            break;
+         offset = next;
+      }
+
+      offset = 0;
+   }
+
+   if (0 == play.keyframes)
+      return -1;
+
+   play.key_frames = malloc(play.keyframes * sizeof(uint32));
+   play.key_offsets = malloc(play.keyframes * sizeof(uint32));
+   if (NULL == play.key_frames || NULL == play.key_offsets)
+      return -1;
+
+   if (offset)
+   {
+      entry = play.data + offset;
+      for (i = 0; i < play.keyframes; i++, entry += RP_INDEX_LENGTH)
+      {
+         play.key_frames[i] = rp_get32(entry);
+         play.key_offsets[i] = rp_get32(entry + 4);
+      }
+   }
+   else
+   {
+      offset = RP_HEADER_LENGTH;
+      play.frames = 0;
+      for (i = 0; i < play.keyframes; i++)
+      {
+         play.key_offsets[i] = offset;
+         play.key_frames[i] = rp_get32(play.data + offset + 4);
+         offset += RP_KEYFRAME_LENGTH + rp_get32(play.data + offset + 8);
+         count = rp_get32(play.data + offset + 4);
+         offset += RP_INPUT_LENGTH + count * 2;
+         play.frames = play.key_frames[i] + count;
+      }
+
+      log_printf("replay: no index, found %d keyframes\n", play.keyframes);
+   }
+
+   /* and check they all hang together */
+   for (i = 0; i < play.keyframes; i++)
+   {
+      const uint8 *inputs;
+
+      if (NULL == rp_segment(i, &packed, &inputs, &count)
+          || packed > play.length)
+         return -1;
+
+      next = (i + 1 < play.keyframes) ? play.key_frames[i + 1] : play.frames;
+      if (next != (uint64_t) play.key_frames[i] + count)
+         return -1;
+   }
+
+   return 0;
+}
+
+static int rp_map(const char *filename)
+{
+#ifdef WIN32
+   LARGE_INTEGER size;
+
+   play.file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+   if (INVALID_HANDLE_VALUE == play.file)
+      return -1;
+
+   if (FALSE == GetFileSizeEx(play.file, &size) || size.QuadPart < RP_HEADER_LENGTH)
+      return -1;
+   play.length = (uint32) size.QuadPart;
+
+   play.mapping = CreateFileMapping(play.file, NULL, PAGE_READONLY, 0, 0, NULL);
+   if (NULL == play.mapping)
+      return -1;
+
+   play.data = MapViewOfFile(play.mapping, FILE_MAP_READ, 0, 0, 0);
+   if (NULL == play.data)
+      return -1;
+#else /* !WIN32 */
+   struct stat info;
+   void *data;
+   int fd;
+
+   fd = open(filename, O_RDONLY);
+   if (fd < 0)
+      return -1;
+
+   if (fstat(fd, &info) || info.st_size < RP_HEADER_LENGTH)
+   {
+      close(fd);
+      return -1;
+   }
+
+   data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (MAP_FAILED == data)
+      return -1;
+
+   play.data = data;
+   play.length = (uint32) info.st_size;
+#endif /* !WIN32 */
+
+   return 0;
+}
+
+static void rp_freeplay(void)
+{
+#ifdef WIN32
+   if (play.data)
+      UnmapViewOfFile(play.data);
+   if (play.mapping)
+      CloseHandle(play.mapping);
+   if (play.file && INVALID_HANDLE_VALUE != play.file)
+      CloseHandle(play.file);
+   play.mapping = play.file = NULL;
+#else /* !WIN32 */
+   if (play.data)
+      munmap((void *) play.data, play.length);
+#endif /* !WIN32 */
+   play.data = NULL;
+
+   if (play.key_frames)
+      free(play.key_frames);
+   if (play.key_offsets)
+      free(play.key_offsets);
+   snap_destroy(&play.snap);
+}
+
+/* play back a replay of the cart that's in */
+int replay_play(const char *filename)
+{
+   ASSERT(false == replay_active());
+
+   memset(&play, 0, sizeof(play));
+
+   if (rp_map(filename))
+   {
+      log_printf("replay: could not open %s\n", filename);
+      goto _fail;
+   }
+
+   if (memcmp(play.data, "NFRP", 4) || REPLAY_VERSION != rp_get32(play.data + 4))
+   {
+      log_printf("replay: %s isn't a replay this version can play\n", filename);
+      goto _fail;
+   }
+
+   play.snap = snap_create();
+   if (NULL == play.snap)
+      goto _fail;
+
+   if (rp_get32(play.data + 20) != rp_carthash()
+       || rp_get32(play.data + 16) != play.snap->length)
+   {
+      log_printf("replay: %s was recorded on another cart\n", filename);
+      goto _fail;
+   }
+
+   if (rp_readindex())
+   {
+      log_printf("replay: %s is damaged\n", filename);
+      goto _fail;
+   }
+
+   play.on = true;
+   if (replay_seek(play.key_frames[0]))
+   {
+      replay_stop();
+      return -1;
+   }
+
+   gui_sendmsg(GUI_GREEN, "Playing %s", filename);
+
+   return 0;
+
+_fail:
+   rp_freeplay();
+   return -1;
+}
+
+static void rp_runframe(bool draw_flag, bool sound_flag)
+{
+   const uint8 *pads = play.inputs + (play.frame - play.seg_start) * 2;
+
+   input_setpads(pads);
+   nes_runframe(draw_flag, sound_flag);
+   play.frame++;
+}
+
+/* the next segment's inputs carry on from here; its keyframe isn't
+** needed, as we're already where it starts
+*/
+static bool rp_nextsegment(void)
+{
+   uint32 packed;
+
+   if (play.frame - play.seg_start < play.seg_count)
+      return true;
+
+   if (play.segment + 1 >= play.keyframes)
+      return false;
+
+   play.segment++;
+   rp_segment(play.segment, &packed, &play.inputs, &play.seg_count);
+   play.seg_start = play.key_frames[play.segment];
+
+   return true;
+}
+
+/* go to any frame, from the keyframe before it */
+int replay_seek(uint32 frame)
+{
+   const uint8 *packed_data;
+   uint32 packed;
+   int low, high, mid;
+
+   if (false == play.on || frame >= play.frames || frame < play.key_frames[0])
+      return -1;
+
+   low = 0;
+   high = play.keyframes - 1;
+   while (low < high)
+   {
+      mid = (low + high + 1) / 2;
+      if (play.key_frames[mid] <= frame)
+         low = mid;
+      else
+         high = mid - 1;
+   }
+
+   packed_data = rp_segment(low, &packed, &play.inputs, &play.seg_count);
+   if (NULL == packed_data
+       || rp_unpack((uint8 *) play.snap, play.snap->length, packed_data, packed)
+       || snap_load(play.snap))
+   {
+      log_printf("replay: keyframe %d is damaged\n", low);
+      return -1;
+   }
+
+   /* the sound starts over from here, the same whichever way we came */
+   apu_resetmixer();
+
+   play.segment = low;
+   play.seg_start = play.frame = play.key_frames[low];
+
+   /* nobody hears these, but apu_endframe steps the sound channels all
+   ** the same, so the machine ends up just as playing through would
+   ** leave it
+   */
+   while (play.frame < frame)
+   {
+      rp_nextsegment();
+      rp_runframe(false, false);
+   }
+
+   return 0;
+}
+
+static bool rp_playframe(bool draw_flag)
+{
+   if (play.frame >= play.frames || false == rp_nextsegment())
+      return false;
+
+   rp_runframe(draw_flag, true);
+   return true;
+}
+
+void replay_stop(void)
+{
+   if (rec.on)
+      rp_stoprecord();
+
+   if (play.on)
+   {
+      rp_freeplay();
+      play.on = false;
+   }
+
+   input_setpads(NULL);
+}
+
+bool replay_active(void)
+{
+   return rec.on || play.on;
+}
+
+/* a frame of recording or playback in place of nes_runframe(); false
+** once a replay has run out
+*/
+bool replay_frame(bool draw_flag)
+{
+   if (rec.on)
+      return rp_recordframe(draw_flag);
+
+   if (play.on)
+      return rp_playframe(draw_flag);
+
+   return false;
+}
+
+uint32 replay_numframes(void)
+{
+   return play.on ? play.frames : rec.frame;
+}
+
+int replay_numkeyframes(void)
+{
+   return play.on ? play.keyframes : rec.keyframes;
+}
+
+uint32 replay_keyframe(int index)
+{
+   if (play.on)
+      return play.key_frames[index];
+
+   return (uint32) index * rec.interval;
+}
+
+/* start recording or playing as [replay] in the config says */
+int replay_init(void)
+{
+   const char *filename;
+   int seconds;
+
+   filename = config.read_string("replay", "play", "");
+   if (*filename)
+      return replay_play(filename);
+
+   filename = config.read_string("replay", "record", "");
+   if (*filename)
+   {
+      seconds = config.read_int("replay", "interval", REPLAY_INTERVAL);
+      return replay_record(filename, seconds * NES_REFRESH_RATE);
+   }
+
+   return 0;
+}
@@ -0,0 +1,47 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** replay.h
+**
+** Input recording and playback, with keyframes to seek by
+** $Id$
+*/
+
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include <noftypes.h>
+
+#define  REPLAY_VERSION       1
+#define  REPLAY_INTERVAL      10    /* seconds between keyframes */
+
+extern int replay_init(void);
+extern int replay_record(const char *filename, int interval);
+extern int replay_play(const char *filename);
+extern void replay_stop(void);
+
+extern bool replay_active(void);
+extern bool replay_frame(bool draw_flag);
+extern int replay_seek(uint32 frame);
+
+extern uint32 replay_numframes(void);
+extern int replay_numkeyframes(void);
+extern uint32 replay_keyframe(int index);
+
+#endif /* _REPLAY_H_ */
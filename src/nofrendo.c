@@ -170,8 +170,6 @@ static int internal_insert(const char *filename, system_t type)
       if (nes_insertcart(console.filename, console.machine.nes))
          return -1;
 
-      vid_setmode(NES_SCREEN_WIDTH, NES_VISIBLE_HEIGHT);
-
       if (install_timer(NES_REFRESH_RATE))
          return -1;
 
@@ -191,6 +189,20 @@ static int internal_insert(const char *filename, system_t type)
    return 0;
 }
 
+/* load images, one after another, until the user quits */
+static int run_machine(void *arg)
+{
+   UNUSED(arg);
+
+   while (false == console.quit)
+   {
+      if (internal_insert(console.nextfilename, console.nexttype))
+         return 1;
+   }
+
+   return 0;
+}
+
 /* This tells main_loop to load this next image */
 void main_insert(const char *filename, system_t type)
 {
@@ -242,13 +254,7 @@ int main_loop(const char *filename, system_t type)
    console.nextfilename = strdup(filename);
    console.nexttype = type;
 
-   while (false == console.quit)
-   {
-      if (internal_insert(console.nextfilename, console.nexttype))
-         return 1;
-   }
-
-   return 0;
+   return osd_run(run_machine, NULL);
 }
 
 /*
@@ -31,18 +31,35 @@
 
 #ifdef __GNUC__
 #define  INLINE      static inline
+#define  ALWAYS_INLINE static inline __attribute__ ((always_inline))
 #define  ZERO_LENGTH 0
 #elif defined(WIN32)
 #define  INLINE      static __inline
+#define  ALWAYS_INLINE static __forceinline
 #define  ZERO_LENGTH 0
 #else /* crapintosh? */
 #define  INLINE      static
+#define  ALWAYS_INLINE static
 #define  ZERO_LENGTH 1
 #endif
 
 /* quell stupid compiler warnings */
 #define  UNUSED(x)   ((x) = (x))
 
+#ifndef  MIN
+#define  MIN(a,b)    (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef  MAX
+#define  MAX(a,b)    (((a) > (b)) ? (a) : (b))
+#endif
+
+/* a switch case that runs on into the next on purpose */
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define  FALLTHROUGH __attribute__ ((fallthrough))
+#else
+#define  FALLTHROUGH
+#endif
+
 typedef  signed char    int8;
 typedef  signed short   int16;
 typedef  signed int     int32;
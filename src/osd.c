@@ -187,6 +187,30 @@ int osd_makesnapname(char *filename, int len)
    return -1;
 }
 
+/* build a name for a capture, to have .y4m and .wav put on the end */
+int osd_makecapname(char *filename, int len)
+{
+   char fullpath[PATH_MAX + 1];
+   struct stat stat_data;
+   int cap_num = -1;
+
+   strncpy(fullpath, dataDirectory(), PATH_MAX);
+   strncat(fullpath, "cap%04d.y4m", PATH_MAX - strlen(fullpath));
+
+   while (++cap_num < 10000)
+   {
+      snprintf(filename, len, fullpath, cap_num);
+
+      if (stat(filename, &stat_data))
+      {
+         filename[strlen(filename) - 4] = 0;
+         return cap_num;
+      }
+   }
+
+   return -1;
+}
+
 /*
 ** $Log: osd.c,v $
 ** Revision 1.2  2001/04/27 14:37:11  neil
@@ -72,15 +72,33 @@ typedef struct sndinfo_s
    int bps;
 } sndinfo_t;
 
+typedef struct sndstats_s
+{
+   float latency;       /* ms of sound queued, on average */
+   float target;        /* ms the queue is being steered toward */
+   float speed;         /* rate correction currently applied */
+   int underruns, overruns;
+   int stalls;          /* frames a file sink held emulation up */
+} sndstats_t;
+
 /* get info */
 extern void osd_getvideoinfo(vidinfo_t *info);
 extern void osd_getsoundinfo(sndinfo_t *info);
+extern void osd_getsoundstats(sndstats_t *stats);
+
+/* sound */
+extern void osd_soundframe(void);
 
 /* init / shutdown */
 extern int osd_init(void);
 extern void osd_shutdown(void);
 extern int osd_main(int argc, char *argv[]);
 
+/* runs func, the emulator, until it returns; a port whose windowing has
+** to stay on the main thread gives it another
+*/
+extern int osd_run(int (*func)(void *arg), void *arg);
+
 extern int osd_installtimer(int frequency, void *func, int funcsize,
                             void *counter, int countersize);
 
@@ -94,10 +112,14 @@ extern void osd_getmouse(int *x, int *y, int *button);
 
 /* build a filename for a snapshot, return -ve for error */
 extern int osd_makesnapname(char *filename, int len);
+extern int osd_makecapname(char *filename, int len);
 
 extern uint32 osd_get_ticks();
 extern void osd_delay(uint32 ms);
 
+/* a microsecond clock; wraps, so compare differences */
+extern uint32 osd_get_usecs(void);
+
 #endif /* !NSF_PLAYER */
 
 #endif /* _OSD_H_ */
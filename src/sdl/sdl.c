@@ -37,10 +37,23 @@
 #include <nes_pal.h>
 #include <nesinput.h>
 #include <osd.h>
+#include <wav.h>
 
 #define  DEFAULT_SAMPLERATE   44100
 #define  DEFAULT_BPS          16
 #define  DEFAULT_FRAGSIZE     1024
+#define  DEFAULT_LATENCY      30
+#define  DEFAULT_SINK         "device"
+#define  DEFAULT_WAVFILE      "nofrendo.wav"
+
+/* the wav sink queues this much sound for its writer, and wakes it up
+** once a chunk has built up
+*/
+#define  WAVSINK_SECONDS      2
+#define  WAVSINK_CHUNKS       8
+
+/* most the sound rate is ever bent to keep the queue at its target */
+#define  MAX_RATE_ADJUST      0.005
 
 #define  DEFAULT_WIDTH        256
 #define  DEFAULT_HEIGHT       NES_VISIBLE_HEIGHT
@@ -102,21 +115,86 @@ int osd_installtimer(int frequency, void *func, int funcsize, void *counter, int
 static int sound_bps = DEFAULT_BPS;
 static int sound_samplerate = DEFAULT_SAMPLERATE;
 static int sound_fragsize = DEFAULT_FRAGSIZE;
+static int sound_latency = DEFAULT_LATENCY;
 static unsigned char *audioBuffer = NULL;
 static void (*audio_callback)(void *buffer, int length) = NULL;
 static SDL_AudioDeviceID myAudio;
 
+/* Emulation makes a frame's sound at a time and queues it here for the
+** card to pull from.  How full the queue runs tells whether the card is
+** a little faster or slower than emulation, and the rate is bent by up
+** to MAX_RATE_ADJUST to match, keeping the queue at sound_latency.
+** Positions count bytes and wrap with the mask; the audio device lock
+** guards them.
+*/
+static struct
+{
+   uint8 *data;
+   int mask;
+   int read, write;
+   bool starved;              /* ran dry; top up with silence */
+   bool running;
+   double frame_samples;      /* samples per frame at the nominal rate */
+   double carry;              /* fraction of a sample left from last frame */
+   double target;             /* samples to keep queued */
+} ring;
+
+static struct
+{
+   double fill;               /* samples queued, smoothed */
+   double drift;              /* long-run rate difference, integrated */
+   double speed;              /* current rate correction */
+   double min_speed, max_speed;
+   double latency;            /* ms, summed per frame */
+   uint32 frames;
+   uint32 underruns, overruns;
+   uint32 stalls;
+} audio_stats;
+
+/* Where each frame's sound goes.  The device sink feeds the card; the
+** others need no audio device at all, so have no card clock to follow
+** and take sound at exactly the configured rate.
+*/
+typedef struct sndsink_s
+{
+   const char *name;
+   /* set up, settling sound_samplerate and sound_bps - 0 on success */
+   int  (*init)(void);
+   void (*shutdown)(void);
+   /* make a frame's sound and take it */
+   void (*frame)(void);
+} sndsink_t;
+
+static sndsink_t *sound_sink = NULL;
+
 /* this is the callback that SDL calls to obtain more audio data */
 static void sdl_audio_player(void *udata, unsigned char *stream, int len)
 {
-   memset(stream, 0, len);
+   int count, first;
+
+   UNUSED(udata);
+
+   count = ring.write - ring.read;
+   if (count > len)
+      count = len;
+
+   first = ring.mask + 1 - (ring.read & ring.mask);
+   if (first > count)
+      first = count;
+
+   memcpy(stream, ring.data + (ring.read & ring.mask), first);
+   memcpy(stream + first, ring.data, count - first);
+   ring.read += count;
 
-   /* SDL requests buffer fills in terms of bytes, not samples */
-   if (16 == sound_bps)
-      len /= 2;
+   /* short: pad with silence, and have the queue built back up */
+   if (count < len)
+   {
+      memset(stream + count, (8 == sound_bps) ? 0x80 : 0, len - count);
 
-   if (audio_callback)
-      audio_callback(stream, len);
+      if (ring.running && false == ring.starved)
+         audio_stats.underruns++;
+      ring.starved = true;
+   }
 }
 
 void osd_setsound(void (*playfunc)(void *buffer, int length))
@@ -124,38 +202,216 @@ void osd_setsound(void (*playfunc)(void *buffer, int length))
    audio_callback = playfunc;
 }
 
-static void osd_stopsound(void)
+/* queue bytes of sound, dropping what doesn't fit */
+static void sound_queue(const uint8 *data, int length)
 {
-   audio_callback = NULL;
+   int room, first;
 
-   SDL_CloseAudioDevice(myAudio);
-   if (NULL != audioBuffer)
-      free(audioBuffer);
+   room = ring.mask + 1 - (ring.write - ring.read);
+   if (length > room)
+   {
+      audio_stats.overruns++;
+      length = room;
+   }
+
+   first = ring.mask + 1 - (ring.write & ring.mask);
+   if (first > length)
+      first = length;
+
+   memcpy(ring.data + (ring.write & ring.mask), data, first);
+   memcpy(ring.data, data + first, length - first);
+   ring.write += length;
 }
 
-static int osd_init_sound(void)
+/* queue length bytes of silence */
+static void sound_pad(int length)
 {
-   SDL_AudioSpec wanted, obtained;
-   unsigned int bufferSize;
+   int first;
 
-   sound_bps = config.read_int("sdlaudio", "sound_bps", DEFAULT_BPS);
-   sound_samplerate = config.read_int("sdlaudio", "sound_samplerate", DEFAULT_SAMPLERATE);
-   sound_fragsize = config.read_int("sdlaudio", "sound_fragsize", DEFAULT_FRAGSIZE);
+   first = ring.mask + 1 - (ring.write & ring.mask);
+   if (first > length)
+      first = length;
 
-   if (sound_bps != 8 && sound_bps != 16)
-      sound_bps = 8;
+   memset(ring.data + (ring.write & ring.mask), (8 == sound_bps) ? 0x80 : 0, first);
+   memset(ring.data, (8 == sound_bps) ? 0x80 : 0, length - first);
+   ring.write += length;
+}
 
-   if (sound_samplerate < 5000)
-      sound_samplerate = 5000;
-   else if (sound_samplerate > 48000)
-      sound_samplerate = 48000;
+/* room for a frame's sound, with some to spare for rate correction */
+static int sound_allocframe(void)
+{
+   ring.frame_samples = (double) sound_samplerate / NES_REFRESH_RATE;
+   ring.carry = 0;
+
+   audioBuffer = malloc((sound_bps / 8) * ((int) ring.frame_samples + 1) * 2);
+   if (NULL == audioBuffer)
+   {
+      log_printf("error allocating audio buffer\n");
+      return -1;
+   }
+
+   return 0;
+}
+
+/* make a frame's sound at the nominal rate, returning how many samples */
+static int sound_makeframe(void)
+{
+   double want;
+   int count;
+
+   want = ring.frame_samples + ring.carry;
+   count = (int) want;
+   ring.carry = want - count;
+
+   audio_callback(audioBuffer, count);
+
+   return count;
+}
+
+/* make a frame's sound and queue it for the card */
+static void device_frame(void)
+{
+   int sample_size, count;
+   double error, want;
+
+   sample_size = sound_bps / 8;
+
+   SDL_LockAudioDevice(myAudio);
+
+   /* after running dry, start again from the target */
+   if (ring.starved)
+   {
+      count = (int) ring.target * sample_size - (ring.write - ring.read);
+      if (count > 0)
+         sound_pad(count);
+
+      audio_stats.fill = ring.target;
+      ring.starved = false;
+   }
+
+   count = (ring.write - ring.read) / sample_size;
+
+   SDL_UnlockAudioDevice(myAudio);
+
+   /* the card pulls in bursts of sound_fragsize, so smooth the fill */
+   audio_stats.fill += (count - audio_stats.fill) / 32;
+
+   error = (audio_stats.fill - ring.target) / ring.target;
+   if (error > 1)
+      error = 1;
+   else if (error < -1)
+      error = -1;
+
+   /* the card's clock is off from ours by some steady amount, which the
+   ** integral term learns over ten seconds or so; the rest corrects the
+   ** queue toward the target
+   */
+   audio_stats.drift += error * MAX_RATE_ADJUST / 600;
+   if (audio_stats.drift > MAX_RATE_ADJUST)
+      audio_stats.drift = MAX_RATE_ADJUST;
+   else if (audio_stats.drift < -MAX_RATE_ADJUST)
+      audio_stats.drift = -MAX_RATE_ADJUST;
+
+   /* running ahead, make a little less sound per frame; behind, more */
+   audio_stats.speed = 1.0 - audio_stats.drift - MAX_RATE_ADJUST * error;
+   if (audio_stats.speed > 1.0 + MAX_RATE_ADJUST)
+      audio_stats.speed = 1.0 + MAX_RATE_ADJUST;
+   else if (audio_stats.speed < 1.0 - MAX_RATE_ADJUST)
+      audio_stats.speed = 1.0 - MAX_RATE_ADJUST;
+   if (audio_stats.speed < audio_stats.min_speed)
+      audio_stats.min_speed = audio_stats.speed;
+   if (audio_stats.speed > audio_stats.max_speed)
+      audio_stats.max_speed = audio_stats.speed;
+
+   /* the apu always covers exactly one frame; the resampler stretches it */
+   want = ring.frame_samples * audio_stats.speed + ring.carry;
+   count = (int) want;
+   ring.carry = want - count;
+   apu_setratio(1.0 / audio_stats.speed);
+
+   audio_callback(audioBuffer, count);
+
+   SDL_LockAudioDevice(myAudio);
+   sound_queue(audioBuffer, count * sample_size);
+   ring.running = true;
+   SDL_UnlockAudioDevice(myAudio);
+
+   audio_stats.latency += (audio_stats.fill + sound_fragsize) * 1000.0 / sound_samplerate;
+   audio_stats.frames++;
+}
+
+/* emulation has finished a frame */
+void osd_soundframe(void)
+{
+   if (NULL == audio_callback || NULL == sound_sink)
+      return;
+
+   sound_sink->frame();
+}
+
+void osd_getsoundstats(sndstats_t *stats)
+{
+   /* only the card has a queue to report on */
+   if (NULL == ring.data)
+   {
+      stats->latency = stats->target = 0;
+      stats->speed = 1;
+      stats->underruns = stats->overruns = 0;
+      stats->stalls = audio_stats.stalls;
+      return;
+   }
+
+   stats->latency = (float) ((audio_stats.fill + sound_fragsize) * 1000.0 / sound_samplerate);
+   stats->target = (float) sound_latency;
+   stats->speed = (float) audio_stats.speed;
+   stats->underruns = audio_stats.underruns;
+   stats->overruns = audio_stats.overruns;
+   stats->stalls = 0;
+}
+
+static void device_shutdown(void)
+{
+   SDL_CloseAudioDevice(myAudio);
+   if (NULL != ring.data)
+   {
+      free(ring.data);
+      ring.data = NULL;
+   }
+
+   if (audio_stats.frames)
+   {
+      log_printf("sdl: sound latency %.1f ms average (target %d ms), rate %.4f-%.4f, %d underruns, %d overruns\n",
+                 audio_stats.latency / audio_stats.frames, sound_latency,
+                 audio_stats.min_speed, audio_stats.max_speed,
+                 audio_stats.underruns, audio_stats.overruns);
+   }
+}
+
+static int device_init(void)
+{
+   SDL_AudioSpec wanted, obtained;
+   int size;
+
+   if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+   {
+      log_printf("Couldn't initialize SDL audio: %s\n", SDL_GetError());
+      return -1;
+   }
 
    if (sound_fragsize < 128)
       sound_fragsize = 128;
    else if (sound_fragsize > 32768)
       sound_fragsize = 32768;
 
-   audio_callback = NULL;
+   if (sound_latency < 5)
+      sound_latency = 5;
+   else if (sound_latency > 500)
+      sound_latency = 500;
+
+   /* the card's burst counts against the latency, keep it to a third */
+   while (sound_fragsize > 128
+          && sound_fragsize * 3 > sound_samplerate * sound_latency / 1000)
+      sound_fragsize >>= 1;
 
    /* set the audio format */
    wanted.freq = sound_samplerate;
@@ -181,20 +437,331 @@ static int osd_init_sound(void)
 
    sound_bps = (obtained.format == AUDIO_U8) ? 8 : 16;
    sound_samplerate = obtained.freq;
-   /* twice as big, to be on the safe side */
-   bufferSize = (sound_bps / 8) * obtained.samples * 2;
+   sound_fragsize = obtained.samples;
 
-   audioBuffer = malloc(bufferSize);
-   if (NULL == audioBuffer)
+   if (sound_allocframe())
+      return -1;
+
+   /* the card holds a burst of its own, so the queue makes up the rest
+   ** of the target, and has room for a few frames of slack on top
+   */
+   ring.target = (double) sound_samplerate * sound_latency / 1000 - sound_fragsize;
+   if (ring.target < ring.frame_samples)
+      ring.target = ring.frame_samples;
+
+   size = (sound_bps / 8) * ((int) ring.target * 2 + sound_fragsize * 2 + (int) ring.frame_samples * 4);
+   for (ring.mask = 1; ring.mask < size; ring.mask <<= 1)
+      ;
+
+   ring.data = malloc(ring.mask);
+   if (NULL == ring.data)
    {
-      log_printf("error allocating audio buffer\n");
+      log_printf("error allocating audio queue\n");
       return -1;
    }
 
+   ring.mask--;
+   ring.read = ring.write = 0;
+   ring.starved = true;
+   ring.running = false;
+
+   audio_stats.fill = ring.target;
+   audio_stats.drift = 0;
+   audio_stats.speed = audio_stats.min_speed = audio_stats.max_speed = 1.0;
+
    SDL_PauseAudioDevice(myAudio, 0);
    return 0;
 }
 
+static sndsink_t device_sink = { "device", device_init, device_shutdown, device_frame };
+
+/* The null sink makes every frame's sound and throws it away, so the
+** apu costs what it would with a card, but nothing waits on one.
+*/
+static struct
+{
+   uint32 frames;
+   double samples;
+} null_stats;
+
+static int null_init(void)
+{
+   null_stats.frames = 0;
+   null_stats.samples = 0;
+
+   return sound_allocframe();
+}
+
+static void null_shutdown(void)
+{
+   log_printf("sdl: null sink took %u frames, %.0f samples at %d Hz\n",
+              null_stats.frames, null_stats.samples, sound_samplerate);
+}
+
+static void null_frame(void)
+{
+   null_stats.samples += sound_makeframe();
+   null_stats.frames++;
+}
+
+static sndsink_t null_sink = { "null", null_init, null_shutdown, null_frame };
+
+/* The wav sink queues each frame's sound for a writer thread, so disk
+** waits stay off the emulation thread.  Nothing is ever dropped; if the
+** writer falls a whole queue behind, emulation waits for it.  Positions
+** count bytes and wrap with the mask, guarded by the lock.
+*/
+static struct
+{
+   SDL_Thread *thread;
+   SDL_mutex *lock;
+   SDL_cond *cond;
+   wav_t *wav;
+   uint8 *data;
+   int mask;
+   int read, write;
+   int chunk;                 /* bytes worth waking the writer for */
+   bool quit;
+   bool failed;
+   uint32 stalls;             /* times emulation waited on the writer */
+} wavsink;
+
+static int wavsink_thread(void *data)
+{
+   int count;
+
+   UNUSED(data);
+
+   SDL_LockMutex(wavsink.lock);
+
+   for (;;)
+   {
+      while (false == wavsink.quit && wavsink.write - wavsink.read < wavsink.chunk)
+         SDL_CondWait(wavsink.cond, wavsink.lock);
+
+      count = wavsink.write - wavsink.read;
+      if (0 == count)
+         break;
+
+      /* up to the end of the queue, the rest next time round */
+      if (count > wavsink.mask + 1 - (wavsink.read & wavsink.mask))
+         count = wavsink.mask + 1 - (wavsink.read & wavsink.mask);
+
+      SDL_UnlockMutex(wavsink.lock);
+
+      if (false == wavsink.failed
+          && wav_write(wavsink.wav, wavsink.data + (wavsink.read & wavsink.mask),
+                       count / (sound_bps / 8)))
+      {
+         log_printf("sdl: error writing sound, the rest is lost\n");
+         wavsink.failed = true;
+      }
+
+      SDL_LockMutex(wavsink.lock);
+      wavsink.read += count;
+      SDL_CondBroadcast(wavsink.cond);
+   }
+
+   SDL_UnlockMutex(wavsink.lock);
+
+   return 0;
+}
+
+static void wav_shutdown(void)
+{
+   if (NULL != wavsink.thread)
+   {
+      SDL_LockMutex(wavsink.lock);
+      wavsink.quit = true;
+      SDL_CondBroadcast(wavsink.cond);
+      SDL_UnlockMutex(wavsink.lock);
+
+      SDL_WaitThread(wavsink.thread, NULL);
+      wavsink.thread = NULL;
+   }
+
+   if (NULL != wavsink.wav)
+   {
+      log_printf("sdl: wrote %u samples at %d Hz, waited on the disk %u times\n",
+                 wavsink.wav->num_samples, sound_samplerate, wavsink.stalls);
+
+      if (wav_close(&wavsink.wav))
+         log_printf("sdl: error finishing sound file\n");
+   }
+
+   if (NULL != wavsink.cond)
+   {
+      SDL_DestroyCond(wavsink.cond);
+      wavsink.cond = NULL;
+   }
+
+   if (NULL != wavsink.lock)
+   {
+      SDL_DestroyMutex(wavsink.lock);
+      wavsink.lock = NULL;
+   }
+
+   if (NULL != wavsink.data)
+   {
+      free(wavsink.data);
+      wavsink.data = NULL;
+   }
+}
+
+static int wav_init(void)
+{
+   const char *filename;
+   int size;
+
+   if (sound_allocframe())
+      return -1;
+
+   filename = config.read_string("sdlaudio", "wav_file", DEFAULT_WAVFILE);
+   wavsink.wav = wav_open(filename, sound_samplerate, sound_bps);
+   if (NULL == wavsink.wav)
+   {
+      log_printf("sdl: could not create %s\n", filename);
+      return -1;
+   }
+
+   size = (sound_bps / 8) * sound_samplerate * WAVSINK_SECONDS;
+   for (wavsink.mask = 1; wavsink.mask < size; wavsink.mask <<= 1)
+      ;
+
+   wavsink.data = malloc(wavsink.mask);
+   if (NULL == wavsink.data)
+   {
+      log_printf("error allocating audio queue\n");
+      return -1;
+   }
+
+   wavsink.chunk = wavsink.mask / WAVSINK_CHUNKS;
+   wavsink.mask--;
+   wavsink.read = wavsink.write = 0;
+   wavsink.quit = wavsink.failed = false;
+   wavsink.stalls = 0;
+
+   wavsink.lock = SDL_CreateMutex();
+   wavsink.cond = SDL_CreateCond();
+   if (NULL == wavsink.lock || NULL == wavsink.cond)
+      return -1;
+
+   wavsink.thread = SDL_CreateThread(wavsink_thread, "wavsink", NULL);
+   if (NULL == wavsink.thread)
+   {
+      log_printf("SDL_CreateThread failed: %s\n", SDL_GetError());
+      return -1;
+   }
+
+   log_printf("sdl: writing sound to %s\n", filename);
+   return 0;
+}
+
+static void wav_frame(void)
+{
+   int length, first;
+
+   length = sound_makeframe() * (sound_bps / 8);
+
+   SDL_LockMutex(wavsink.lock);
+
+   while (wavsink.mask + 1 - (wavsink.write - wavsink.read) < length)
+   {
+      wavsink.stalls++;
+      SDL_CondBroadcast(wavsink.cond);
+      SDL_CondWait(wavsink.cond, wavsink.lock);
+   }
+
+   first = wavsink.mask + 1 - (wavsink.write & wavsink.mask);
+   if (first > length)
+      first = length;
+
+   memcpy(wavsink.data + (wavsink.write & wavsink.mask), audioBuffer, first);
+   memcpy(wavsink.data, audioBuffer + first, length - first);
+   wavsink.write += length;
+
+   if (wavsink.write - wavsink.read >= wavsink.chunk)
+      SDL_CondBroadcast(wavsink.cond);
+
+   SDL_UnlockMutex(wavsink.lock);
+
+   audio_stats.stalls = wavsink.stalls;
+}
+
+static sndsink_t wav_sink = { "wav", wav_init, wav_shutdown, wav_frame };
+
+static sndsink_t *sound_sinks[] = { &device_sink, &null_sink, &wav_sink, NULL };
+
+static void osd_stopsound(void)
+{
+   audio_callback = NULL;
+
+   if (NULL != sound_sink)
+   {
+      sound_sink->shutdown();
+      sound_sink = NULL;
+   }
+
+   if (NULL != audioBuffer)
+      free(audioBuffer);
+}
+
+static int osd_init_sound(void)
+{
+   const char *name;
+   int i;
+
+   sound_bps = config.read_int("sdlaudio", "sound_bps", DEFAULT_BPS);
+   sound_samplerate = config.read_int("sdlaudio", "sound_samplerate", DEFAULT_SAMPLERATE);
+   sound_fragsize = config.read_int("sdlaudio", "sound_fragsize", DEFAULT_FRAGSIZE);
+   sound_latency = config.read_int("sdlaudio", "latency", DEFAULT_LATENCY);
+   name = config.read_string("sdlaudio", "sink", DEFAULT_SINK);
+
+   if (sound_bps != 8 && sound_bps != 16)
+      sound_bps = 8;
+
+   if (sound_samplerate < 5000)
+      sound_samplerate = 5000;
+   else if (sound_samplerate > 48000)
+      sound_samplerate = 48000;
+
+   audio_callback = NULL;
+   memset(&audio_stats, 0, sizeof(audio_stats));
+
+   for (i = 0; NULL != sound_sinks[i]; i++)
+   {
+      if (0 == strcmp(name, sound_sinks[i]->name))
+         break;
+   }
+
+   if (NULL == sound_sinks[i])
+   {
+      log_printf("sdl: no sound sink called %s\n", name);
+      return -1;
+   }
+
+   sound_sink = sound_sinks[i];
+   if (sound_sink->init())
+   {
+      /* a machine without a card can still run, just quietly */
+      if (&device_sink != sound_sink)
+         return -1;
+
+      log_printf("sdl: no sound device, carrying on with the null sink\n");
+      device_shutdown();
+      if (NULL != audioBuffer)
+         free(audioBuffer);
+
+      sound_sink = &null_sink;
+      if (sound_sink->init())
+         return -1;
+   }
+
+   log_printf("sdl: sound to the %s sink, %d Hz %d-bit\n",
+              sound_sink->name, sound_samplerate, sound_bps);
+   return 0;
+}
+
 void osd_getsoundinfo(sndinfo_t *info)
 {
    info->sample_rate = sound_samplerate;
@@ -212,6 +779,8 @@ static void set_palette(rgb_t *pal);
 static void clear(uint8 color);
 static bitmap_t *lock_write(void);
 static void free_write(int num_dirties, rect_t *dirty_rects);
+static void custom_blit(bitmap_t *primary, bitmap_t *overlay, int num_dirties,
+                        rect_t *dirty_rects);
 
 viddriver_t sdlDriver =
 {
@@ -223,7 +792,7 @@ viddriver_t sdlDriver =
    clear,         /* clear */
    lock_write,    /* lock_write */
    free_write,    /* free_write */
-   NULL,          /* custom_blit */
+   custom_blit,   /* custom_blit */
    false          /* invalidate flag */
 };
 
@@ -236,34 +805,128 @@ void osd_getvideoinfo(vidinfo_t *info)
 
 /* Now that the driver declaration is out of the way, on to the SDL stuff */
 static SDL_Window *myWindow = NULL;
-static SDL_Surface *mySurface = NULL;
 static SDL_Renderer *myRenderer = NULL;
-static SDL_Color myPalette[256];
+static SDL_Texture *myTexture = NULL;
+static uint32 myColors[256];
 static bitmap_t *myBitmap = NULL;
 static bool fullscreen = false;
 
-/* flip between full screen and windowed */
-void osd_togglefullscreen(int code)
+/* SDL keeps the window, the renderer and the event pump on the thread that
+** started video, and a present on vsync holds that thread up until the
+** display comes round.  So the emulator gets a thread of its own (see
+** osd_run), and this one only shows what it hands over, through three
+** slots: the emulator fills one, one holds the newest complete frame, and
+** the window's thread shows from the last.
+*/
+#define  MAILBOX_RECTS     64
+#define  PRESENT_IDLE_MS   5     /* longest the event pump waits on a frame */
+
+enum
 {
-   bool pause;
-   nes_t *nes = nes_getcontextptr();
+   PRESENT_VSYNC,       /* emulator waits until its last frame is taken */
+   PRESENT_MAILBOX,     /* vsync, but newer frames replace unshown ones */
+   PRESENT_IMMEDIATE    /* no vsync, frames go up as they come in */
+};
 
-   if (INP_STATE_MAKE != code)
-      return;
+static const char *present_names[] = { "vsync", "mailbox", "immediate" };
 
-   ASSERT(nes);
+typedef struct frameslot_s
+{
+   bitmap_t *bmp;                /* the whole screen, overlay and all */
+   uint32 frame;                 /* sequence number */
+   int num_dirties;              /* areas changed since the frame before */
+   rect_t dirty_rects[MAILBOX_RECTS];
+   Uint64 published;             /* when the emulator handed it over */
+} frameslot_t;
+
+static struct
+{
+   SDL_mutex *lock;
+   SDL_cond *cond;
+   frameslot_t slots[3];
+   frameslot_t *write, *ready, *read;
+   bool fresh;                   /* ready holds a frame not taken yet */
+   bool running;                 /* the window's thread is taking frames */
+   bool done;                    /* the emulator has returned */
+   bool fullscreen;              /* as the emulator last asked for it */
+   int mode;
+   uint32 frame;
+   uint32 palette;               /* bumped whenever myColors changes */
+} mailbox;
+
+/* what osd_run starts on the emulator's thread */
+static struct
+{
+   int (*func)(void *arg);
+   void *arg;
+} emulator;
+
+/* the window needs drawing again, new frame or not */
+static bool exposed = false;
+
+/* texture upload and present accounting */
+static struct
+{
+   uint32 frames, rects, dropped;
+   double bytes;
+   double latency, max_latency;  /* milliseconds */
+} upload_stats;
+
+/* tear down everything set_mode builds */
+static void destroy_mode(void)
+{
+   int i;
 
-   pause = nes->pause;
-   nes->pause = true;
+   for (i = 0; i < 3; i++)
+   {
+      if (NULL != mailbox.slots[i].bmp)
+         bmp_destroy(&mailbox.slots[i].bmp);
+   }
 
-   fullscreen ^= true;
+   if (NULL != mailbox.cond)
+   {
+      SDL_DestroyCond(mailbox.cond);
+      mailbox.cond = NULL;
+   }
 
-   if (set_mode(mySurface->w, mySurface->h))
-      ASSERT(0);
+   if (NULL != mailbox.lock)
+   {
+      SDL_DestroyMutex(mailbox.lock);
+      mailbox.lock = NULL;
+   }
+
+   if (NULL != myTexture)
+   {
+      SDL_DestroyTexture(myTexture);
+      myTexture = NULL;
+   }
+
+   if (NULL != myRenderer)
+   {
+      SDL_DestroyRenderer(myRenderer);
+      myRenderer = NULL;
+   }
+
+   if (NULL != myBitmap)
+      bmp_destroy(&myBitmap);
+
+   if (NULL != myWindow)
+   {
+      SDL_DestroyWindow(myWindow);
+      myWindow = NULL;
+   }
+}
 
-   sdlDriver.invalidate = true;
+/* flip between full screen and windowed; the window's thread does it */
+void osd_togglefullscreen(int code)
+{
+   if (INP_STATE_MAKE != code)
+      return;
 
-   nes->pause = pause;
+   SDL_LockMutex(mailbox.lock);
+   mailbox.fullscreen ^= true;
+   SDL_CondBroadcast(mailbox.cond);
+   SDL_UnlockMutex(mailbox.lock);
 }
 
 /* initialise SDL video */
@@ -275,18 +938,80 @@ static int init(int width, int height)
 /* squash memory leaks */
 static void shutdown(void)
 {
-   if (NULL != mySurface)
+   if (upload_stats.frames)
    {
-      SDL_FreeSurface(mySurface);
-      mySurface = NULL;
+      log_printf("sdl: %d frames presented, %d dropped, %.1f rects and %.0f texture bytes per frame\n",
+                 upload_stats.frames, upload_stats.dropped,
+                 (double) upload_stats.rects / upload_stats.frames,
+                 upload_stats.bytes / upload_stats.frames);
+      log_printf("sdl: present latency %.2f ms average, %.2f ms worst\n",
+                 upload_stats.latency / upload_stats.frames, upload_stats.max_latency);
    }
 
-   if (NULL != myBitmap)
-      bmp_destroy(&myBitmap);
+   destroy_mode();
+}
 
-   if (NULL != myWindow)
+/* [sdlvideo] present_mode */
+static void select_present_mode(void)
+{
+   const char *mode;
+
+   mode = config.read_string("sdlvideo", "present_mode", "mailbox");
+
+   if (0 == strcmp(mode, present_names[PRESENT_VSYNC]))
+      mailbox.mode = PRESENT_VSYNC;
+   else if (0 == strcmp(mode, present_names[PRESENT_MAILBOX]))
+      mailbox.mode = PRESENT_MAILBOX;
+   else if (0 == strcmp(mode, present_names[PRESENT_IMMEDIATE]))
+      mailbox.mode = PRESENT_IMMEDIATE;
+   else
    {
-      SDL_DestroyWindow(myWindow);
+      log_printf("sdl: unknown present_mode %s, using mailbox\n", mode);
+      mailbox.mode = PRESENT_MAILBOX;
+   }
+
+   log_printf("sdl: presenting in %s mode\n", present_names[mailbox.mode]);
+}
+
+/* the slots frames come over in, each the size of the screen */
+static int create_mailbox(int width, int height)
+{
+   int i;
+
+   for (i = 0; i < 3; i++)
+   {
+      mailbox.slots[i].bmp = bmp_create(width, height, 0);
+      if (NULL == mailbox.slots[i].bmp)
+         return -1;
+
+      bmp_clear(mailbox.slots[i].bmp, GUI_BLACK);
+      mailbox.slots[i].frame = 0;
+   }
+
+   mailbox.write = &mailbox.slots[0];
+   mailbox.ready = &mailbox.slots[1];
+   mailbox.read = &mailbox.slots[2];
+   mailbox.fresh = false;
+   mailbox.frame = 0;
+   mailbox.palette++;
+
+   mailbox.lock = SDL_CreateMutex();
+   mailbox.cond = SDL_CreateCond();
+   if (NULL == mailbox.lock || NULL == mailbox.cond)
+      return -1;
+
+   return 0;
+}
+
+/* on the window's thread only */
+static void set_fullscreen(bool full)
+{
+   fullscreen = full;
+
+   if (SDL_SetWindowFullscreen(myWindow, fullscreen ? SDL_WINDOW_FULLSCREEN : 0) != 0)
+   {
+      fullscreen = false;
+      log_printf("SDL_SetWindowFullscreen failed: %s\n", SDL_GetError());
    }
 }
 
@@ -294,14 +1019,10 @@ static void shutdown(void)
 static int set_mode(int width, int height)
 {
    int flags;
-   bool restorePalette;
 
-   if (NULL != myWindow)
-   {
-      SDL_DestroyWindow(myWindow);
-      myWindow = NULL;
-      restorePalette = true;
-   }
+   /* the window, and the texture with it, only go away if the size changes */
+   if (NULL != myBitmap && (myBitmap->width != width || myBitmap->height != height))
+      destroy_mode();
 
    if (NULL == myWindow)
    {
@@ -314,7 +1035,14 @@ static int set_mode(int width, int height)
          return -1;
       }
 
-      myRenderer = SDL_CreateRenderer(myWindow, -1, SDL_RENDERER_ACCELERATED);
+      select_present_mode();
+
+      /* waiting on vsync only ever holds up the window's thread */
+      flags = SDL_RENDERER_ACCELERATED;
+      if (PRESENT_IMMEDIATE != mailbox.mode)
+         flags |= SDL_RENDERER_PRESENTVSYNC;
+
+      myRenderer = SDL_CreateRenderer(myWindow, -1, flags);
 
       if (NULL == myRenderer)
       {
@@ -322,28 +1050,32 @@ static int set_mode(int width, int height)
          return -1;
       }
 
-      mySurface = SDL_CreateRGBSurface(0, width, height, 8, 0, 0, 0, 0);
+      /* frames are converted into this as they're taken, and only the
+      ** parts that changed get touched
+      */
+      myTexture = SDL_CreateTexture(myRenderer, SDL_PIXELFORMAT_ARGB8888,
+                                    SDL_TEXTUREACCESS_STREAMING, width, height);
 
-      if (NULL == mySurface)
+      if (NULL == myTexture)
       {
-         log_printf("SDL_CreateRGBSurface failed: %s\n", SDL_GetError());
+         log_printf("SDL_CreateTexture failed: %s\n", SDL_GetError());
          return -1;
       }
-   }
 
-   if (fullscreen)
-   {
-      if (SDL_SetWindowFullscreen(myWindow, SDL_WINDOW_FULLSCREEN) != 0)
+      SDL_SetTextureScaleMode(myTexture, SDL_ScaleModeLinear);
+
+      /* 8-bit surface for the generic lock_write path */
+      myBitmap = bmp_create(width, height, 0);
+
+      if (NULL == myBitmap || create_mailbox(width, height))
       {
-         fullscreen = false;
-         log_printf("SDL_SetWindowFullscreen failed: %s\n", SDL_GetError());
+         log_printf("unable to allocate %dx%d surfaces\n", width, height);
+         return -1;
       }
    }
 
-   if (restorePalette)
-   {
-      SDL_SetPaletteColors(mySurface->format->palette, myPalette, 0, 256);
-   }
+   set_fullscreen(fullscreen);
+   mailbox.fullscreen = fullscreen;
 
    SDL_ShowCursor(0);
    return 0;
@@ -354,42 +1086,304 @@ static void set_palette(rgb_t *pal)
 {
    int i;
 
+   SDL_LockMutex(mailbox.lock);
+
    for (i = 0; i < 256; i++)
-   {
-      myPalette[i].r = pal[i].r;
-      myPalette[i].g = pal[i].g;
-      myPalette[i].b = pal[i].b;
-   }
+      myColors[i] = 0xFF000000 | (pal[i].r << 16) | (pal[i].g << 8) | pal[i].b;
+
+   /* every pixel on the texture needs new colors */
+   mailbox.palette++;
 
-   SDL_SetPaletteColors(mySurface->format->palette, myPalette, 0, 256);
+   SDL_UnlockMutex(mailbox.lock);
 }
 
 /* clear all frames to a particular color */
 static void clear(uint8 color)
 {
-   SDL_FillRect(mySurface, 0, color);
+   bmp_clear(myBitmap, color);
 }
 
 /* acquire the directbuffer for writing */
 static bitmap_t *lock_write(void)
 {
-   SDL_LockSurface(mySurface);
-   myBitmap = bmp_createhw(mySurface->pixels, mySurface->w, 
-                           mySurface->h, mySurface->pitch);
    return myBitmap;
 }
 
+/* hand a frame over to the window's thread.  the free slot is two frames
+** behind, so it gets all of primary, with any overlay laid on top, at
+** dest_x, dest_y; the dirty areas say what to upload from it
+*/
+static void publish(bitmap_t *primary, bitmap_t *overlay, int dest_x, int dest_y,
+                    int num_dirties, rect_t *dirty_rects)
+{
+   frameslot_t *slot = mailbox.write;
+   const uint8 *src, *over;
+   uint8 *dest;
+   int i, x;
+
+   for (i = 0; i < primary->height; i++)
+   {
+      dest = slot->bmp->line[i + dest_y] + dest_x;
+      src = primary->line[i];
+
+      if (NULL == overlay)
+      {
+         memcpy(dest, src, primary->width);
+         continue;
+      }
+
+      over = overlay->line[i];
+      for (x = 0; x < primary->width; x++)
+         dest[x] = (VID_TRANSPARENT == over[x]) ? src[x] : over[x];
+   }
+
+   if (num_dirties > MAILBOX_RECTS)
+      num_dirties = -1;
+
+   slot->num_dirties = num_dirties;
+   for (i = 0; i < num_dirties; i++)
+   {
+      slot->dirty_rects[i] = dirty_rects[i];
+      slot->dirty_rects[i].x += dest_x;
+      slot->dirty_rects[i].y += dest_y;
+   }
+
+   SDL_LockMutex(mailbox.lock);
+
+   /* in vsync mode, wait for the window's thread to take the last frame */
+   while (PRESENT_VSYNC == mailbox.mode && mailbox.fresh && mailbox.running)
+      SDL_CondWait(mailbox.cond, mailbox.lock);
+
+   slot->frame = ++mailbox.frame;
+   slot->published = SDL_GetPerformanceCounter();
+
+   mailbox.write = mailbox.ready;
+   mailbox.ready = slot;
+   mailbox.fresh = true;
+
+   SDL_CondBroadcast(mailbox.cond);
+   SDL_UnlockMutex(mailbox.lock);
+}
+
 /* release the resource */
 static void free_write(int num_dirties, rect_t *dirty_rects)
 {
-   bmp_destroy(&myBitmap);
-   SDL_UnlockSurface(mySurface);
+   publish(myBitmap, NULL, 0, 0, num_dirties, dirty_rects);
+}
 
-   SDL_Texture *tex = SDL_CreateTextureFromSurface(myRenderer, mySurface);
-   SDL_SetTextureScaleMode(tex, SDL_ScaleModeLinear);
-   SDL_RenderCopy(myRenderer, tex, NULL, NULL);
-   SDL_RenderPresent(myRenderer);
-   SDL_DestroyTexture(tex);
+/* frames go from the emulator's buffer straight into a slot */
+static void custom_blit(bitmap_t *primary, bitmap_t *overlay, int num_dirties,
+                        rect_t *dirty_rects)
+{
+   /* center it, as vid_drv would */
+   publish(primary, overlay, (myBitmap->width - primary->width) >> 1,
+           (myBitmap->height - primary->height) >> 1, num_dirties, dirty_rects);
+}
+
+/* convert an area of a slot into the texture */
+static void upload_rect(bitmap_t *bmp, const uint32 *colors, int x, int y,
+                        int width, int height)
+{
+   SDL_Rect rect;
+   uint8 *pixels;
+   int pitch;
+
+   rect.x = x;
+   rect.y = y;
+   rect.w = width;
+   rect.h = height;
+
+   /* streaming textures keep their own buffer, so this doesn't allocate */
+   if (SDL_LockTexture(myTexture, &rect, (void **) &pixels, &pitch))
+      return;
+
+   for (; height; height--, y++, pixels += pitch)
+      vid_convert32((uint32 *) pixels, bmp->line[y] + x, NULL, colors, width);
+
+   SDL_UnlockTexture(myTexture);
+
+   upload_stats.rects++;
+   upload_stats.bytes += rect.w * rect.h * sizeof(uint32);
+}
+
+/* called as events are pumped in, on the window's thread */
+static int watch_window(void *data, SDL_Event *event)
+{
+   UNUSED(data);
+
+   if (SDL_WINDOWEVENT == event->type
+       && (SDL_WINDOWEVENT_EXPOSED == event->window.event
+           || SDL_WINDOWEVENT_SIZE_CHANGED == event->window.event))
+      exposed = true;
+
+   return 1;
+}
+
+/* the window's thread, until the emulator returns: pump events for
+** osd_getinput to pick up, and show each newest frame as it comes in
+*/
+static void present_loop(void)
+{
+   uint32 colors[256], palette = 0, last_frame = 0;
+   frameslot_t *slot;
+   bool full = false, toggle, want;
+   double latency;
+   int i;
+
+   for (;;)
+   {
+      SDL_PumpEvents();
+
+      SDL_LockMutex(mailbox.lock);
+
+      if (false == mailbox.fresh && false == mailbox.done
+          && mailbox.fullscreen == fullscreen)
+         SDL_CondWaitTimeout(mailbox.cond, mailbox.lock, PRESENT_IDLE_MS);
+
+      if (mailbox.done)
+      {
+         SDL_UnlockMutex(mailbox.lock);
+         break;
+      }
+
+      want = mailbox.fullscreen;
+      toggle = (want != fullscreen);
+
+      slot = NULL;
+      if (mailbox.fresh)
+      {
+         /* take the newest frame */
+         slot = mailbox.ready;
+         mailbox.ready = mailbox.read;
+         mailbox.read = slot;
+         mailbox.fresh = false;
+
+         full = (palette != mailbox.palette);
+         if (full)
+         {
+            memcpy(colors, myColors, sizeof(colors));
+            palette = mailbox.palette;
+         }
+
+         /* a vsync-locked emulator can go on now */
+         SDL_CondBroadcast(mailbox.cond);
+      }
+
+      SDL_UnlockMutex(mailbox.lock);
+
+      if (toggle)
+      {
+         set_fullscreen(want);
+
+         /* tell the emulator if it didn't take */
+         if (fullscreen != want)
+         {
+            SDL_LockMutex(mailbox.lock);
+            mailbox.fullscreen = fullscreen;
+            SDL_UnlockMutex(mailbox.lock);
+         }
+
+         exposed = true;
+      }
+
+      if (NULL == slot)
+      {
+         /* nothing new; the texture still holds the last frame shown */
+         if (false == exposed)
+            continue;
+      }
+      else
+      {
+         /* dirty areas only add up to the texture if no frame was skipped */
+         if (slot->frame != last_frame + 1)
+         {
+            upload_stats.dropped += slot->frame - last_frame - 1;
+            full = true;
+         }
+
+         if (full || -1 == slot->num_dirties)
+         {
+            upload_rect(slot->bmp, colors, 0, 0, slot->bmp->width, slot->bmp->height);
+         }
+         else
+         {
+            for (i = 0; i < slot->num_dirties; i++)
+            {
+               upload_rect(slot->bmp, colors, slot->dirty_rects[i].x, slot->dirty_rects[i].y,
+                           slot->dirty_rects[i].w, slot->dirty_rects[i].h);
+            }
+         }
+
+         last_frame = slot->frame;
+      }
+
+      exposed = false;
+
+      SDL_RenderCopy(myRenderer, myTexture, NULL, NULL);
+      SDL_RenderPresent(myRenderer);
+
+      if (NULL != slot)
+      {
+         latency = (SDL_GetPerformanceCounter() - slot->published) * 1000.0
+                   / SDL_GetPerformanceFrequency();
+         upload_stats.frames++;
+         upload_stats.latency += latency;
+         if (latency > upload_stats.max_latency)
+            upload_stats.max_latency = latency;
+      }
+   }
+}
+
+static int emulator_thread(void *data)
+{
+   int retval;
+
+   UNUSED(data);
+
+   retval = emulator.func(emulator.arg);
+
+   SDL_LockMutex(mailbox.lock);
+   mailbox.done = true;
+   SDL_CondBroadcast(mailbox.cond);
+   SDL_UnlockMutex(mailbox.lock);
+
+   return retval;
+}
+
+/* func is the emulator; it gets a thread of its own, and this one, which
+** started video, stays behind to keep the window going until it returns
+*/
+int osd_run(int (*func)(void *arg), void *arg)
+{
+   SDL_Thread *thread;
+   int retval = -1;
+
+   emulator.func = func;
+   emulator.arg = arg;
+
+   SDL_LockMutex(mailbox.lock);
+   mailbox.running = true;
+   mailbox.done = false;
+   SDL_UnlockMutex(mailbox.lock);
+
+   thread = SDL_CreateThread(emulator_thread, "emulator", NULL);
+   if (NULL == thread)
+   {
+      log_printf("SDL_CreateThread failed: %s\n", SDL_GetError());
+      mailbox.running = false;
+      return -1;
+   }
+
+   SDL_AddEventWatch(watch_window, NULL);
+   present_loop();
+   SDL_DelEventWatch(watch_window, NULL);
+
+   SDL_LockMutex(mailbox.lock);
+   mailbox.running = false;
+   SDL_UnlockMutex(mailbox.lock);
+
+   SDL_WaitThread(thread, &retval);
+   return retval;
 }
 
 /*
@@ -485,6 +1479,7 @@ static int key_to_event(SDL_KeyCode key)
       case SDLK_F5: return event_state_save;
       case SDLK_F6: return event_toggle_sprites;
       case SDLK_F7: return event_state_load;
+      case SDLK_F8: return event_capture;
       case SDLK_F10: return event_osd_1;
 
       case SDLK_1: return event_state_slot_1;
@@ -583,7 +1578,8 @@ void osd_getinput(void)
    SDL_Event myEvent;
    event_t func_event;
 
-   while (SDL_PollEvent(&myEvent))
+   /* the window's thread pumps these in, see present_loop */
+   while (SDL_PeepEvents(&myEvent, 1, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT) > 0)
    {
       switch(myEvent.type)
       {
@@ -656,6 +1652,16 @@ uint32 osd_get_ticks()
    return SDL_GetTicks();
 }
 
+uint32 osd_get_usecs(void)
+{
+   Uint64 count, freq;
+
+   count = SDL_GetPerformanceCounter();
+   freq = SDL_GetPerformanceFrequency();
+
+   return (uint32) ((count / freq) * 1000000 + (count % freq) * 1000000 / freq);
+}
+
 void osd_delay(uint32 ms)
 {
    SDL_Delay(ms);
@@ -687,8 +1693,8 @@ int osd_init()
    log_chain_logfunc(logprint);
 
    /* Initialize the SDL library */
-   if (SDL_Init (SDL_INIT_AUDIO | SDL_INIT_TIMER | SDL_INIT_VIDEO
-                 | SDL_INIT_JOYSTICK) < 0)
+   /* audio is only started if sound goes to the card */
+   if (SDL_Init (SDL_INIT_TIMER | SDL_INIT_VIDEO | SDL_INIT_JOYSTICK) < 0)
    {
       printf("Couldn't initialize SDL: %s\n", SDL_GetError());
       return -1;
@@ -29,13 +29,12 @@
 
 static int32 fds_incsize = 0;
 
-/* mix sound channels together */
-static int32 fds_process(void)
+/* mix sound channels into a block */
+static void fds_process(int32 *buffer, int num_samples)
 {
-   int32 output;
-   output = 0;
-
-   return output;
+   /* no wavetable channel yet, so nothing to add */
+   UNUSED(buffer);
+   UNUSED(num_samples);
 }
 
 /* write to registers */
@@ -51,8 +50,7 @@ static void fds_reset(void)
    apu_t apu;
 
    apu_getcontext(&apu);
-//   fds_incsize = apu.cycle_rate;
-   fds_incsize = (int32) (APU_BASEFREQ * 65536.0 / (float) apu.sample_rate);
+   fds_incsize = apu.cycle_rate;
 }
 
 static apu_memwrite fds_memwrite[] =
@@ -71,7 +71,7 @@ typedef struct mmc5rectangle_s
 
    bool enabled;
    
-   float accum;
+   int32 accum;
    int32 freq;
    int32 output_vol;
    bool fixed_envelope;
@@ -96,7 +96,7 @@ typedef struct mmc5dac_s
 
 static struct
 {
-   float incsize;
+   int32 incsize; /* cpu cycles per sample, fixed point */
    uint8 mul[2];
    mmc5rectangle_t rect[2];
    mmc5dac_t dac;
@@ -104,7 +104,7 @@ static struct
 
 
 #define  MMC5_RECTANGLE_OUTPUT   chan->output_vol
-static int32 mmc5_rectangle(mmc5rectangle_t *chan)
+ALWAYS_INLINE int32 mmc5_rectangle(mmc5rectangle_t *chan)
 {
    int32 output;
 
@@ -140,7 +140,7 @@ static int32 mmc5_rectangle(mmc5rectangle_t *chan)
          chan->env_vol++;
    }
 
-   if (chan->freq < 4)
+   if (chan->freq < (4 << APU_FIX_SHIFT))
       return MMC5_RECTANGLE_OUTPUT;
 
    chan->accum -= mmc5.incsize; /* # of cycles per sample */
@@ -207,17 +207,22 @@ static uint8 mmc5_read(uint32 address)
    }
 }
 
-/* mix vrcvi sound channels together */
-static int32 mmc5_process(void)
+/* mix mmc5 sound channels into a block, one channel at a time */
+static void mmc5_process(int32 *buffer, int num_samples)
 {
-   int32 accum;
+   int i;
 
-   accum = mmc5_rectangle(&mmc5.rect[0]);
-   accum += mmc5_rectangle(&mmc5.rect[1]);
-   if (mmc5.dac.enabled)
-      accum += mmc5.dac.output;
+   for (i = 0; i < num_samples; i++)
+      buffer[i] += mmc5_rectangle(&mmc5.rect[0]);
 
-   return accum;
+   for (i = 0; i < num_samples; i++)
+      buffer[i] += mmc5_rectangle(&mmc5.rect[1]);
+
+   if (mmc5.dac.enabled)
+   {
+      for (i = 0; i < num_samples; i++)
+         buffer[i] += mmc5.dac.output;
+   }
 }
 
 /* write to registers */
@@ -249,7 +254,7 @@ static void mmc5_write(uint32 address, uint8 value)
       chan = (address & 4) ? 1 : 0;
       mmc5.rect[chan].regs[2] = value;
       if (mmc5.rect[chan].enabled)
-         mmc5.rect[chan].freq = (((mmc5.rect[chan].regs[3] & 7) << 8) + value) + 1;
+         mmc5.rect[chan].freq = ((((mmc5.rect[chan].regs[3] & 7) << 8) + value) + 1) << APU_FIX_SHIFT;
       break;
 
    case MMC5_WRA3:
@@ -261,7 +266,7 @@ static void mmc5_write(uint32 address, uint8 value)
       {
          mmc5.rect[chan].vbl_length = vbl_lut[value >> 3];
          mmc5.rect[chan].env_vol = 0;
-         mmc5.rect[chan].freq = (((value & 7) << 8) + mmc5.rect[chan].regs[2]) + 1;
+         mmc5.rect[chan].freq = ((((value & 7) << 8) + mmc5.rect[chan].regs[2]) + 1) << APU_FIX_SHIFT;
          mmc5.rect[chan].adder = 0;
       }
       break;
@@ -342,7 +347,7 @@ static int mmc5_init(void)
    apu_t apu;
 
    apu_getcontext(&apu);
-   num_samples = apu.num_samples;
+   num_samples = apu.mix_samples;
 
    /* lut used for enveloping and frequency sweeps */
    for (i = 0; i < 16; i++)
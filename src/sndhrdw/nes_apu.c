@@ -23,24 +23,63 @@
 ** $Id: nes_apu.c,v 1.2 2001/04/27 14:37:11 neil Exp $
 */
 
-#include <stdlib.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
 #include <noftypes.h>
 #include <log.h>
 #include <nes_apu.h>
 #include "nes6502.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
  
 
-#define  APU_OVERSAMPLE
-#define  APU_VOLUME_DECAY(x)  ((x) -= ((x) >> 7))
+/* channels hand the mixer their DAC levels with this many fraction bits,
+** from averaging all the timer steps that fell within a sample
+*/
+#define  APU_LEVEL_SHIFT      4
+#define  APU_LEVEL(x)         ((x) << APU_LEVEL_SHIFT)
+
+/* samples mixed per pass; a frame at the mix rate takes a couple */
+#define  APU_MIXBLOCK         1024
+
+/* pulse mixer input is p1 + p2, tnd input is 3 * t + 2 * n + d */
+#define  APU_PULSE_LUTSIZE    (APU_LEVEL(15 + 15) + 1)
+#define  APU_TND_LUTSIZE      (APU_LEVEL(3 * 15 + 2 * 15 + 127) + 1)
+
+/* dc blocker pole, about 60Hz at the mix rate */
+#define  APU_DC_SHIFT         8
+
+/* the resampler's filter has this many zero crossings either side of
+** center, at phases of 1/256th of a mix sample
+*/
+#define  APU_RS_ZEROS         8
+#define  APU_RS_PHASEBITS     8
+#define  APU_RS_PHASES        (1 << APU_RS_PHASEBITS)
+#define  APU_RS_MAXTAPS       ((APU_MIXRATE / 5000 + 1) * 2 * APU_RS_ZEROS + 8)
+
+/* mixed samples kept past the filter's taps, for the stretching to wander
+** into; the queue holds those and one frame (at 50Hz, the longest)
+*/
+#define  APU_RS_SLACK         16
+#define  APU_RS_QUEUE         (APU_RS_MAXTAPS + 2 * APU_RS_SLACK + APU_MIXRATE / 50)
 
-/* the following seem to be the correct (empirically determined)
-** relative volumes between the sound channels
+/* dmc output changes queued for the mixer; enough for a couple of frames
+** of $4011 writes flat out.  the mixer keeps its place in a frame with
+** this many fraction bits
 */
-#define  APU_RECTANGLE_OUTPUT(channel) (apu.rectangle[channel].output_vol)
-#define  APU_TRIANGLE_OUTPUT           (apu.triangle.output_vol + (apu.triangle.output_vol >> 2))
-#define  APU_NOISE_OUTPUT              ((apu.noise.output_vol + apu.noise.output_vol + apu.noise.output_vol) >> 2)
-#define  APU_DMC_OUTPUT                ((apu.dmc.output_vol + apu.dmc.output_vol + apu.dmc.output_vol) >> 2)
+#define  APU_DMC_DELTAS       16384
+#define  APU_DMC_SHIFT        8
+
+/* how long the cpu may run when the dmc has nothing to fetch */
+#define  APU_DMC_IDLE         0x10000
 
 /* active APU */
 static apu_t apu;
@@ -50,11 +89,49 @@ static int32 decay_lut[16];
 static int vbl_lut[32];
 static int trilength_lut[128];
 
-/* noise lookups for both modes */
-#ifndef REALTIME_NOISE
-static int8 noise_long_lut[APU_NOISE_32K];
-static int8 noise_short_lut[APU_NOISE_93];
-#endif /* !REALTIME_NOISE */
+/* the 2A03 mixes nonlinearly: pulses share one resistor network, and
+** triangle/noise/dmc another
+*/
+static int32 pulse_lut[APU_PULSE_LUTSIZE];
+static int32 tnd_lut[APU_TND_LUTSIZE];
+
+/* per-channel levels for one pass of the mixer */
+static int32 mix_pulse[APU_MIXBLOCK];
+static int32 mix_tnd[APU_MIXBLOCK];
+static int32 mix_ext[APU_MIXBLOCK];
+
+/* the filters' memory, carried from one block to the next */
+static int32 prev_sample;
+static int32 dc_in, dc_out;
+
+/* polyphase resampler from APU_MIXRATE down to the device rate.  input
+** holds mixed samples not yet consumed; pos is where the next output's
+** taps start in it, in 32.32 fixed point.  hold is the last output, for
+** when the stretching runs a sample or so ahead of the mixing
+*/
+static int16 rs_coefs[APU_RS_PHASES * APU_RS_MAXTAPS];
+static int16 rs_input[APU_RS_QUEUE];
+static int rs_taps, rs_count;
+static uint64_t rs_pos, rs_step, rs_nominal;
+static int32 rs_hold;
+
+/* the dmc's dac, as the cpu's timeline left it: each change stamped in
+** cycles from the start of its frame.  a negative level marks the end of
+** a frame, with the frame's length as its stamp
+*/
+typedef struct dmcdelta_s
+{
+   int32 time;
+   int32 level;
+} dmcdelta_t;
+
+static dmcdelta_t dmc_deltas[APU_DMC_DELTAS];
+static uint32 dmc_read, dmc_write;
+static int dmc_frames;           /* frame ends queued */
+static uint32 dmc_now;           /* cpu cycle the dmc has been run up to */
+static uint32 dmc_start;         /* cpu cycle the current frame began on */
+static int32 dmc_clock, dmc_step; /* mixer's place in its frame, 24.8 */
+static int32 dmc_level;          /* dac level the mixer is playing */
 
 
 /* vblank length table used for rectangles, triangle, noise */
@@ -124,7 +201,6 @@ void apu_setchan(int chan, bool enabled)
 ** NES uses to generate pseudo-random series
 ** for the white noise channel
 */
-#ifdef REALTIME_NOISE
 INLINE int8 shift_register15(uint8 xor_tap)
 {
    static int sreg = 0x4000;
@@ -137,38 +213,13 @@ INLINE int8 shift_register15(uint8 xor_tap)
    sreg |= (bit14 << 14);
    return (bit0 ^ 1);
 }
-#else /* !REALTIME_NOISE */
-static void shift_register15(int8 *buf, int count)
-{
-   static int sreg = 0x4000;
-   int bit0, bit1, bit6, bit14;
 
-   if (count == APU_NOISE_93)
-   {
-      while (count--)
-      {
-         bit0 = sreg & 1;
-         bit6 = (sreg & 0x40) >> 6;
-         bit14 = (bit0 ^ bit6);
-         sreg >>= 1;
-         sreg |= (bit14 << 14);
-         *buf++ = bit0 ^ 1;
-      }
-   }
-   else /* 32K noise */
-   {
-      while (count--)
-      {
-         bit0 = sreg & 1;
-         bit1 = (sreg & 2) >> 1;
-         bit14 = (bit0 ^ bit1);
-         sreg >>= 1;
-         sreg |= (bit14 << 14);
-         *buf++ = bit0 ^ 1;
-      }
-   }
-}
-#endif /* !REALTIME_NOISE */
+/* Channels are stepped one sample at a time by the routines below, which
+** get inlined into a loop per channel, so each one runs a whole block
+** with its state in registers.  Timers are 16.16 fixed point cpu cycles;
+** what comes out is the channel's DAC level (0-15, or 0-127 for the dmc)
+** averaged over the timer steps taken during the sample.
+*/
 
 /* RECTANGLE WAVE
 ** ==============
@@ -177,172 +228,81 @@ static void shift_register15(int8 *buf, int count)
 ** reg2: 8 bits of freq
 ** reg3: 0-2=high freq, 7-4=vbl length counter
 */
-#ifdef APU_OVERSAMPLE
+ALWAYS_INLINE int32 apu_rectangle(rectangle_t *chan, int ch)
+{
+   int32 volume, total;
+   int num_times;
 
-#define  APU_MAKE_RECTANGLE(ch) \
-static int32 apu_rectangle_##ch(void) \
-{ \
-   int32 output, total; \
-   int num_times; \
-\
-   APU_VOLUME_DECAY(apu.rectangle[ch].output_vol); \
-\
-   if (false == apu.rectangle[ch].enabled || 0 == apu.rectangle[ch].vbl_length) \
-      return APU_RECTANGLE_OUTPUT(ch); \
-\
-   /* vbl length counter */ \
-   if (false == apu.rectangle[ch].holdnote) \
-      apu.rectangle[ch].vbl_length--; \
-\
-   /* envelope decay at a rate of (env_delay + 1) / 240 secs */ \
-   apu.rectangle[ch].env_phase -= 4; /* 240/60 */ \
-   while (apu.rectangle[ch].env_phase < 0) \
-   { \
-      apu.rectangle[ch].env_phase += apu.rectangle[ch].env_delay; \
-\
-      if (apu.rectangle[ch].holdnote) \
-         apu.rectangle[ch].env_vol = (apu.rectangle[ch].env_vol + 1) & 0x0F; \
-      else if (apu.rectangle[ch].env_vol < 0x0F) \
-         apu.rectangle[ch].env_vol++; \
-   } \
-\
-   /* TODO: find true relation of freq_limit to register values */ \
-   if (apu.rectangle[ch].freq < 8 \
-       || (false == apu.rectangle[ch].sweep_inc \
-           && apu.rectangle[ch].freq > apu.rectangle[ch].freq_limit)) \
-      return APU_RECTANGLE_OUTPUT(ch); \
-\
-   /* frequency sweeping at a rate of (sweep_delay + 1) / 120 secs */ \
-   if (apu.rectangle[ch].sweep_on && apu.rectangle[ch].sweep_shifts) \
-   { \
-      apu.rectangle[ch].sweep_phase -= 2; /* 120/60 */ \
-      while (apu.rectangle[ch].sweep_phase < 0) \
-      { \
-         apu.rectangle[ch].sweep_phase += apu.rectangle[ch].sweep_delay; \
-\
-         if (apu.rectangle[ch].sweep_inc) /* ramp up */ \
-         { \
-            if (0 == ch) \
-               apu.rectangle[ch].freq += ~(apu.rectangle[ch].freq >> apu.rectangle[ch].sweep_shifts); \
-            else \
-               apu.rectangle[ch].freq -= (apu.rectangle[ch].freq >> apu.rectangle[ch].sweep_shifts); \
-         } \
-         else /* ramp down */ \
-         { \
-            apu.rectangle[ch].freq += (apu.rectangle[ch].freq >> apu.rectangle[ch].sweep_shifts); \
-         } \
-      } \
-   } \
-\
-   apu.rectangle[ch].accum -= apu.cycle_rate; \
-   if (apu.rectangle[ch].accum >= 0) \
-      return APU_RECTANGLE_OUTPUT(ch); \
-\
-   if (apu.rectangle[ch].fixed_envelope) \
-      output = apu.rectangle[ch].volume << 8; /* fixed volume */ \
-   else \
-      output = (apu.rectangle[ch].env_vol ^ 0x0F) << 8; \
-\
-   num_times = total = 0; \
-\
-   while (apu.rectangle[ch].accum < 0) \
-   { \
-      apu.rectangle[ch].accum += apu.rectangle[ch].freq + 1; \
-      apu.rectangle[ch].adder = (apu.rectangle[ch].adder + 1) & 0x0F; \
-\
-      if (apu.rectangle[ch].adder < apu.rectangle[ch].duty_flip) \
-         total += output; \
-      else \
-         total -= output; \
-\
-      num_times++; \
-   } \
-\
-   apu.rectangle[ch].output_vol = total / num_times; \
-   return APU_RECTANGLE_OUTPUT(ch); \
-} 
-
-#else /* !APU_OVERSAMPLE */
-#define  APU_MAKE_RECTANGLE(ch) \
-static int32 apu_rectangle_##ch(void) \
-{ \
-   int32 output; \
-\
-   APU_VOLUME_DECAY(apu.rectangle[ch].output_vol); \
-\
-   if (false == apu.rectangle[ch].enabled || 0 == apu.rectangle[ch].vbl_length) \
-      return APU_RECTANGLE_OUTPUT(ch); \
-\
-   /* vbl length counter */ \
-   if (false == apu.rectangle[ch].holdnote) \
-      apu.rectangle[ch].vbl_length--; \
-\
-   /* envelope decay at a rate of (env_delay + 1) / 240 secs */ \
-   apu.rectangle[ch].env_phase -= 4; /* 240/60 */ \
-   while (apu.rectangle[ch].env_phase < 0) \
-   { \
-      apu.rectangle[ch].env_phase += apu.rectangle[ch].env_delay; \
-\
-      if (apu.rectangle[ch].holdnote) \
-         apu.rectangle[ch].env_vol = (apu.rectangle[ch].env_vol + 1) & 0x0F; \
-      else if (apu.rectangle[ch].env_vol < 0x0F) \
-         apu.rectangle[ch].env_vol++; \
-   } \
-\
-   /* TODO: find true relation of freq_limit to register values */ \
-   if (apu.rectangle[ch].freq < 8 || (false == apu.rectangle[ch].sweep_inc && apu.rectangle[ch].freq > apu.rectangle[ch].freq_limit)) \
-      return APU_RECTANGLE_OUTPUT(ch); \
-\
-   /* frequency sweeping at a rate of (sweep_delay + 1) / 120 secs */ \
-   if (apu.rectangle[ch].sweep_on && apu.rectangle[ch].sweep_shifts) \
-   { \
-      apu.rectangle[ch].sweep_phase -= 2; /* 120/60 */ \
-      while (apu.rectangle[ch].sweep_phase < 0) \
-      { \
-         apu.rectangle[ch].sweep_phase += apu.rectangle[ch].sweep_delay; \
-\
-         if (apu.rectangle[ch].sweep_inc) /* ramp up */ \
-         { \
-            if (0 == ch) \
-               apu.rectangle[ch].freq += ~(apu.rectangle[ch].freq >> apu.rectangle[ch].sweep_shifts); \
-            else \
-               apu.rectangle[ch].freq -= (apu.rectangle[ch].freq >> apu.rectangle[ch].sweep_shifts); \
-         } \
-         else /* ramp down */ \
-         { \
-            apu.rectangle[ch].freq += (apu.rectangle[ch].freq >> apu.rectangle[ch].sweep_shifts); \
-         } \
-      } \
-   } \
-\
-   apu.rectangle[ch].accum -= apu.cycle_rate; \
-   if (apu.rectangle[ch].accum >= 0) \
-      return APU_RECTANGLE_OUTPUT(ch); \
-\
-   while (apu.rectangle[ch].accum < 0) \
-   { \
-      apu.rectangle[ch].accum += (apu.rectangle[ch].freq + 1); \
-      apu.rectangle[ch].adder = (apu.rectangle[ch].adder + 1) & 0x0F; \
-   } \
-\
-   if (apu.rectangle[ch].fixed_envelope) \
-      output = apu.rectangle[ch].volume << 8; /* fixed volume */ \
-   else \
-      output = (apu.rectangle[ch].env_vol ^ 0x0F) << 8; \
-\
-   if (0 == apu.rectangle[ch].adder) \
-      apu.rectangle[ch].output_vol = output; \
-   else if (apu.rectangle[ch].adder == apu.rectangle[ch].duty_flip) \
-      apu.rectangle[ch].output_vol = -output; \
-\
-   return APU_RECTANGLE_OUTPUT(ch); \
-}
+   if (false == chan->enabled || 0 == chan->vbl_length)
+      return (chan->output_vol = 0);
 
-#endif /* !APU_OVERSAMPLE */
+   /* vbl length counter */
+   if (false == chan->holdnote)
+      chan->vbl_length--;
 
-/* generate the functions */
-APU_MAKE_RECTANGLE(0)
-APU_MAKE_RECTANGLE(1)
+   /* envelope decay at a rate of (env_delay + 1) / 240 secs */
+   chan->env_phase -= 4; /* 240/60 */
+   while (chan->env_phase < 0)
+   {
+      chan->env_phase += chan->env_delay;
+
+      if (chan->holdnote)
+         chan->env_vol = (chan->env_vol + 1) & 0x0F;
+      else if (chan->env_vol < 0x0F)
+         chan->env_vol++;
+   }
+
+   /* TODO: find true relation of freq_limit to register values */
+   if (chan->freq < 8 || (false == chan->sweep_inc && chan->freq > chan->freq_limit))
+      return (chan->output_vol = 0);
+
+   /* frequency sweeping at a rate of (sweep_delay + 1) / 120 secs */
+   if (chan->sweep_on && chan->sweep_shifts)
+   {
+      chan->sweep_phase -= 2; /* 120/60 */
+      while (chan->sweep_phase < 0)
+      {
+         chan->sweep_phase += chan->sweep_delay;
+
+         if (chan->sweep_inc) /* ramp up */
+         {
+            if (0 == ch)
+               chan->freq += ~(chan->freq >> chan->sweep_shifts);
+            else
+               chan->freq -= (chan->freq >> chan->sweep_shifts);
+         }
+         else /* ramp down */
+         {
+            chan->freq += (chan->freq >> chan->sweep_shifts);
+         }
+      }
+   }
+
+   chan->accum -= apu.cycle_rate;
+   if (chan->accum >= 0)
+      return chan->output_vol;
+
+   if (chan->fixed_envelope)
+      volume = chan->volume; /* fixed volume */
+   else
+      volume = chan->env_vol ^ 0x0F;
+
+   num_times = total = 0;
+
+   while (chan->accum < 0)
+   {
+      chan->accum += (chan->freq + 1) << APU_FIX_SHIFT;
+      chan->adder = (chan->adder + 1) & 0x0F;
+
+      if (chan->adder < chan->duty_flip)
+         total += volume;
+
+      num_times++;
+   }
+
+   chan->output_vol = APU_LEVEL(total) / num_times;
+   return chan->output_vol;
+}
 
 
 /* TRIANGLE WAVE
@@ -351,42 +311,49 @@ APU_MAKE_RECTANGLE(1)
 ** reg2: low 8 bits of frequency
 ** reg3: 7-3=length counter, 2-0=high 3 bits of frequency
 */
-static int32 apu_triangle(void)
+ALWAYS_INLINE int32 apu_triangle(triangle_t *chan)
 {
-   APU_VOLUME_DECAY(apu.triangle.output_vol);
+   int32 total;
+   int num_times;
 
-   if (false == apu.triangle.enabled || 0 == apu.triangle.vbl_length)
-      return APU_TRIANGLE_OUTPUT;
+   /* a halted triangle holds its level rather than dropping to zero */
+   if (false == chan->enabled || 0 == chan->vbl_length)
+      return chan->output_vol;
 
-   if (apu.triangle.counter_started)
+   if (chan->counter_started)
    {
-      if (apu.triangle.linear_length > 0)
-         apu.triangle.linear_length--;
-      if (apu.triangle.vbl_length && false == apu.triangle.holdnote)
-         apu.triangle.vbl_length--;
+      if (chan->linear_length > 0)
+         chan->linear_length--;
+      if (chan->vbl_length && false == chan->holdnote)
+         chan->vbl_length--;
    }
-   else if (false == apu.triangle.holdnote && apu.triangle.write_latency)
+   else if (false == chan->holdnote && chan->write_latency)
    {
-      if (--apu.triangle.write_latency == 0)
-         apu.triangle.counter_started = true;
+      if (--chan->write_latency == 0)
+         chan->counter_started = true;
    }
 
-   if (0 == apu.triangle.linear_length || apu.triangle.freq < 4) /* inaudible */
-      return APU_TRIANGLE_OUTPUT;
+   if (0 == chan->linear_length || chan->freq < 4) /* inaudible */
+      return chan->output_vol;
+
+   chan->accum -= apu.cycle_rate;
+   if (chan->accum >= 0)
+      return chan->output_vol;
 
-   apu.triangle.accum -= apu.cycle_rate; \
-   while (apu.triangle.accum < 0)
+   num_times = total = 0;
+
+   while (chan->accum < 0)
    {
-      apu.triangle.accum += apu.triangle.freq;
-      apu.triangle.adder = (apu.triangle.adder + 1) & 0x1F;
+      chan->accum += chan->freq << APU_FIX_SHIFT;
+      chan->adder = (chan->adder + 1) & 0x1F;
 
-      if (apu.triangle.adder & 0x10)
-         apu.triangle.output_vol -= (2 << 8);
-      else
-         apu.triangle.output_vol += (2 << 8);
+      /* 15 down to 0, then back up */
+      total += (chan->adder & 0x10) ? (chan->adder & 0x0F) : (chan->adder ^ 0x0F);
+      num_times++;
    }
 
-   return APU_TRIANGLE_OUTPUT;
+   chan->output_vol = APU_LEVEL(total) / num_times;
+   return chan->output_vol;
 }
 
 
@@ -396,123 +363,53 @@ static int32 apu_triangle(void)
 ** reg2: 7=small(93 byte) sample,3-0=freq lookup
 ** reg3: 7-4=vbl length counter
 */
-/* TODO: AAAAAAAAAAAAAAAAAAAAAAAA!  #ifdef MADNESS! */
-static int32 apu_noise(void)
+ALWAYS_INLINE int32 apu_noise(noise_t *chan)
 {
-   int32 outvol;
-
-#if defined(APU_OVERSAMPLE) && defined(REALTIME_NOISE)
-#else /* !(APU_OVERSAMPLE && REALTIME_NOISE) */
-   int32 noise_bit;
-#endif /* !(APU_OVERSAMPLE && REALTIME_NOISE) */
-#ifdef APU_OVERSAMPLE
+   int32 volume, total;
    int num_times;
-   int32 total;
-#endif /* APU_OVERSAMPLE */
-
-   APU_VOLUME_DECAY(apu.noise.output_vol);
 
-   if (false == apu.noise.enabled || 0 == apu.noise.vbl_length)
-      return APU_NOISE_OUTPUT;
+   if (false == chan->enabled || 0 == chan->vbl_length)
+      return (chan->output_vol = 0);
 
    /* vbl length counter */
-   if (false == apu.noise.holdnote)
-      apu.noise.vbl_length--;
+   if (false == chan->holdnote)
+      chan->vbl_length--;
 
    /* envelope decay at a rate of (env_delay + 1) / 240 secs */
-   apu.noise.env_phase -= 4; /* 240/60 */
-   while (apu.noise.env_phase < 0)
+   chan->env_phase -= 4; /* 240/60 */
+   while (chan->env_phase < 0)
    {
-      apu.noise.env_phase += apu.noise.env_delay;
+      chan->env_phase += chan->env_delay;
 
-      if (apu.noise.holdnote)
-         apu.noise.env_vol = (apu.noise.env_vol + 1) & 0x0F;
-      else if (apu.noise.env_vol < 0x0F)
-         apu.noise.env_vol++;
+      if (chan->holdnote)
+         chan->env_vol = (chan->env_vol + 1) & 0x0F;
+      else if (chan->env_vol < 0x0F)
+         chan->env_vol++;
    }
 
-   apu.noise.accum -= apu.cycle_rate;
-   if (apu.noise.accum >= 0)
-      return APU_NOISE_OUTPUT;
-   
-#ifdef APU_OVERSAMPLE
-   if (apu.noise.fixed_envelope)
-      outvol = apu.noise.volume << 8; /* fixed volume */
+   chan->accum -= apu.cycle_rate;
+   if (chan->accum >= 0)
+      return chan->output_vol;
+
+   if (chan->fixed_envelope)
+      volume = chan->volume; /* fixed volume */
    else
-      outvol = (apu.noise.env_vol ^ 0x0F) << 8;
+      volume = chan->env_vol ^ 0x0F;
 
    num_times = total = 0;
-#endif /* APU_OVERSAMPLE */
 
-   while (apu.noise.accum < 0)
+   while (chan->accum < 0)
    {
-      apu.noise.accum += apu.noise.freq;
+      chan->accum += chan->freq << APU_FIX_SHIFT;
 
-#ifdef REALTIME_NOISE
-
-#ifdef APU_OVERSAMPLE
-      if (shift_register15(apu.noise.xor_tap))
-         total += outvol;
-      else
-         total -= outvol;
+      if (shift_register15(chan->xor_tap))
+         total += volume;
 
       num_times++;
-#else /* !APU_OVERSAMPLE */
-      noise_bit = shift_register15(apu.noise.xor_tap);
-#endif /* !APU_OVERSAMPLE */
-
-#else /* !REALTIME_NOISE */
-      apu.noise.cur_pos++;
-
-      if (apu.noise.short_sample)
-      {
-         if (APU_NOISE_93 == apu.noise.cur_pos)
-            apu.noise.cur_pos = 0;
-      }
-      else
-      {
-         if (APU_NOISE_32K == apu.noise.cur_pos)
-            apu.noise.cur_pos = 0;
-      }
-
-#ifdef APU_OVERSAMPLE
-      if (apu.noise.short_sample)
-         noise_bit = noise_short_lut[apu.noise.cur_pos];
-      else
-         noise_bit = noise_long_lut[apu.noise.cur_pos];
-
-      if (noise_bit)
-         total += outvol;
-      else
-         total -= outvol;
-
-      num_times++;
-#endif /* APU_OVERSAMPLE */
-#endif /* !REALTIME_NOISE */
    }
 
-#ifdef APU_OVERSAMPLE
-   apu.noise.output_vol = total / num_times;
-#else /* !APU_OVERSAMPLE */
-   if (apu.noise.fixed_envelope)
-      outvol = apu.noise.volume << 8; /* fixed volume */
-   else
-      outvol = (apu.noise.env_vol ^ 0x0F) << 8;
-
-#ifndef REALTIME_NOISE
-   if (apu.noise.short_sample)
-      noise_bit = noise_short_lut[apu.noise.cur_pos];
-   else
-      noise_bit = noise_long_lut[apu.noise.cur_pos];
-#endif /* !REALTIME_NOISE */
-
-   if (noise_bit)
-      apu.noise.output_vol = outvol;
-   else
-      apu.noise.output_vol = -outvol;
-#endif /* !APU_OVERSAMPLE */
-
-   return APU_NOISE_OUTPUT;
+   chan->output_vol = APU_LEVEL(total) / num_times;
+   return chan->output_vol;
 }
 
 
@@ -523,89 +420,216 @@ INLINE void apu_dmcreload(void)
    apu.dmc.irq_occurred = false;
 }
 
+/* throw away whatever the mixer hasn't played, and have it pick up from
+** the dac as it stands
+*/
+static void apu_dmcflush(void)
+{
+   dmc_read = dmc_write;
+   dmc_frames = 0;
+   dmc_clock = 0;
+   dmc_level = apu.dmc.regs[1];
+}
+
+/* queue a dac change, or a frame end, for the mixer */
+static void apu_dmcpush(uint32 cycle, int32 level)
+{
+   dmcdelta_t *delta;
+
+   /* nobody has been mixing (no sound, or it's paused) */
+   if (dmc_write - dmc_read == APU_DMC_DELTAS)
+      apu_dmcflush();
+
+   delta = &dmc_deltas[dmc_write & (APU_DMC_DELTAS - 1)];
+   delta->time = (int32) (cycle - dmc_start);
+   delta->level = level;
+   dmc_write++;
+}
+
 /* DELTA MODULATION CHANNEL
 ** =========================
 ** reg0: 7=irq gen, 6=looping, 3-0=pointer to clock table
 ** reg1: output dc level, 6 bits unsigned
 ** reg2: 8 bits of 64-byte aligned address offset : $C000 + (value * 64)
 ** reg3: length, (value * 16) + 1
+**
+** this half runs on the cpu's timeline: the cpu is stopped whenever the
+** dmc is due to fetch a byte or finish a sample (see apu_dmcnext), so
+** fetches steal their cycles and irqs are raised on the cycle they should
+** be.  every change of the dac is queued for the mixer, which only plays
+** them back (see apu_dmc)
 */
-static int32 apu_dmc(void)
+void apu_dmcclock(void)
 {
+   dmc_t *chan = &apu.dmc;
+   uint32 now, cycle;
+   int32 elapsed;
    int delta_bit;
 
-   APU_VOLUME_DECAY(apu.dmc.output_vol);
+   now = nes6502_getcycles(false);
+   elapsed = (int32) (now - dmc_now);
+   dmc_now = now;
+
+   /* out of step with the cpu, after a context switch */
+   if (elapsed < 0 || elapsed > APU_DMC_IDLE)
+      elapsed = 0;
+
+   chan->timer -= elapsed;
 
-   /* only process when channel is alive */
-   if (apu.dmc.dma_length)
+   while (chan->timer <= 0)
    {
-      apu.dmc.accum -= apu.cycle_rate;
-      
-      while (apu.dmc.accum < 0)
+      /* the cycle this clock fell on */
+      cycle = now + chan->timer;
+      chan->timer += chan->freq;
+
+      /* the timer runs on with nothing to play */
+      if (0 == chan->dma_length)
+         continue;
+
+      delta_bit = (chan->dma_length & 7) ^ 7;
+
+      if (7 == delta_bit)
+      {
+         chan->cur_byte = nes6502_getbyte(chan->address);
+
+         /* the fetch holds the cpu off the bus for four cycles */
+         nes6502_burn(4);
+
+         /* prevent wraparound */
+         if (0xFFFF == chan->address)
+            chan->address = 0x8000;
+         else
+            chan->address++;
+      }
+
+      if (--chan->dma_length == 0)
       {
-         apu.dmc.accum += apu.dmc.freq;
-         
-         delta_bit = (apu.dmc.dma_length & 7) ^ 7;
-         
-         if (7 == delta_bit)
+         /* if loop bit set, we're cool to retrigger sample */
+         if (chan->looping)
          {
-            apu.dmc.cur_byte = nes6502_getbyte(apu.dmc.address);
-            
-            /* steal a cycle from CPU*/
-            nes6502_burn(1);
-
-            /* prevent wraparound */
-            if (0xFFFF == apu.dmc.address)
-               apu.dmc.address = 0x8000;
-            else
-               apu.dmc.address++;
+            apu_dmcreload();
          }
-
-         if (--apu.dmc.dma_length == 0)
+         else
          {
-            /* if loop bit set, we're cool to retrigger sample */
-            if (apu.dmc.looping)
+            /* check to see if we should generate an irq */
+            if (chan->irq_gen)
             {
-               apu_dmcreload();
-            }
-            else
-            {
-               /* check to see if we should generate an irq */
-               if (apu.dmc.irq_gen)
-               {
-                  apu.dmc.irq_occurred = true;
-                  if (apu.irq_callback)
-                     apu.irq_callback();
-               }
-
-               /* bodge for timestamp queue */
-               apu.dmc.enabled = false;
-               break;
+               chan->irq_occurred = true;
+               if (apu.irq_callback)
+                  apu.irq_callback();
             }
+
+            continue;
          }
+      }
 
-         /* positive delta */
-         if (apu.dmc.cur_byte & (1 << delta_bit))
+      /* positive delta */
+      if (chan->cur_byte & (1 << delta_bit))
+      {
+         if (chan->regs[1] < 0x7D)
          {
-            if (apu.dmc.regs[1] < 0x7D)
-            {
-               apu.dmc.regs[1] += 2;
-               apu.dmc.output_vol += (2 << 8);
-            }
+            chan->regs[1] += 2;
+            apu_dmcpush(cycle, chan->regs[1]);
          }
-         /* negative delta */
-         else            
+      }
+      /* negative delta */
+      else            
+      {
+         if (chan->regs[1] > 1)
          {
-            if (apu.dmc.regs[1] > 1)
-            {
-               apu.dmc.regs[1] -= 2;
-               apu.dmc.output_vol -= (2 << 8);
-            }
+            chan->regs[1] -= 2;
+            apu_dmcpush(cycle, chan->regs[1]);
          }
       }
    }
+}
+
+/* cpu cycles until the dmc next needs the cpu, to fetch a byte or to
+** finish a sample
+*/
+int apu_dmcnext(void)
+{
+   dmc_t *chan = &apu.dmc;
+   int clocks, cycles;
+
+   if (0 == chan->dma_length)
+      return APU_DMC_IDLE;
+
+   /* fetches come every eight clocks, and the end on the last */
+   clocks = chan->dma_length & 7;
+   if (clocks >= chan->dma_length)
+      clocks = chan->dma_length - 1;
+
+   cycles = chan->timer - (int32) (nes6502_getcycles(false) - dmc_now)
+            + clocks * chan->freq;
+
+   return (cycles < 1) ? 1 : cycles;
+}
+
+static void apu_mixframe(void);
+
+/* the cpu has finished a frame: hand its dmc output to the mixer, and
+** run the channels through it
+*/
+void apu_endframe(void)
+{
+   apu_dmcclock();
+
+   /* the mixer fell behind by more than it ever should; catch it up */
+   if (dmc_frames > 2)
+   {
+      apu_dmcflush();
+   }
+   else
+   {
+      apu_dmcpush(dmc_now, -1);
+      dmc_frames++;
+   }
+
+   dmc_start = dmc_now;
+
+   apu_mixframe();
+}
+
+/* the cpu has been put somewhere else in time (a state was loaded); start
+** the dmc's timeline over from there, and drop what the mixer had queued
+*/
+void apu_resync(void)
+{
+   dmc_now = dmc_start = nes6502_getcycles(false);
+   apu_dmcflush();
+}
+
+/* the mixer's half of the dmc: play back the dac changes queued from the
+** cpu's timeline, pacing through each frame by its length in cycles
+*/
+ALWAYS_INLINE int32 apu_dmc(void)
+{
+   dmcdelta_t *delta;
+
+   dmc_clock += dmc_step;
+
+   while (dmc_read != dmc_write)
+   {
+      delta = &dmc_deltas[dmc_read & (APU_DMC_DELTAS - 1)];
+      if ((delta->time << APU_DMC_SHIFT) > dmc_clock)
+         break;
+
+      if (delta->level < 0)
+      {
+         dmc_clock -= delta->time << APU_DMC_SHIFT;
+         dmc_step = (delta->time << APU_DMC_SHIFT) / apu.mix_samples;
+         dmc_frames--;
+      }
+      else
+      {
+         dmc_level = delta->level;
+      }
+
+      dmc_read++;
+   }
 
-   return APU_DMC_OUTPUT;
+   return APU_LEVEL(dmc_level);
 }
 
 
@@ -613,6 +637,10 @@ void apu_write(uint32 address, uint8 value)
 {  
    int chan;
 
+   /* the dmc has to be run up to now before any of its registers change */
+   if (address >= APU_WRE0)
+      apu_dmcclock();
+
    switch (address)
    {
    /* rectangles */
@@ -685,7 +713,7 @@ void apu_write(uint32 address, uint8 value)
       ** for the 6502 code to do a couple of table dereferences and load up 
       ** the other triregs
       */
-      apu.triangle.write_latency = (int) (228 / apu.cycle_rate);
+      apu.triangle.write_latency = (228 << APU_FIX_SHIFT) / apu.cycle_rate;
       apu.triangle.freq = (((value & 7) << 8) + apu.triangle.regs[1]) + 1;
       apu.triangle.vbl_length = vbl_lut[value >> 3];
       apu.triangle.counter_started = false;
@@ -705,18 +733,7 @@ void apu_write(uint32 address, uint8 value)
       apu.noise.regs[1] = value;
       apu.noise.freq = noise_freq[value & 0x0F];
 
-#ifdef REALTIME_NOISE
       apu.noise.xor_tap = (value & 0x80) ? 0x40: 0x02;
-#else /* !REALTIME_NOISE */
-      /* detect transition from long->short sample */
-      if ((value & 0x80) && false == apu.noise.short_sample)
-      {
-         /* recalculate short noise buffer */
-         shift_register15(noise_short_lut, APU_NOISE_93);
-         apu.noise.cur_pos = 0;
-      }
-      apu.noise.short_sample = (value & 0x80) ? true : false;
-#endif /* !REALTIME_NOISE */
       break;
 
    case APU_WRD3:
@@ -740,15 +757,17 @@ void apu_write(uint32 address, uint8 value)
          apu.dmc.irq_gen = false;
          apu.dmc.irq_occurred = false;
       }
+
+      /* the dmc's next fetch has moved; have the cpu come back for it */
+      nes6502_release();
       break;
 
    case APU_WRE1: /* 7-bit DAC */
-      /* add the _delta_ between written value and
-      ** current output level of the volume reg
-      */
-      value &= 0x7F; /* bit 7 ignored */
-      apu.dmc.output_vol += ((value - apu.dmc.regs[1]) << 8);
-      apu.dmc.regs[1] = value;
+      if (apu.dmc.regs[1] != (value & 0x7F))
+      {
+         apu.dmc.regs[1] = value & 0x7F; /* bit 7 ignored */
+         apu_dmcpush(dmc_now, apu.dmc.regs[1]);
+      }
       break;
 
    case APU_WRE2:
@@ -762,8 +781,6 @@ void apu_write(uint32 address, uint8 value)
       break;
 
    case APU_SMASK:
-      /* bodge for timestamp queue */
-      apu.dmc.enabled = (value & 0x10) ? true : false;
       apu.enable_reg = value;
 
       for (chan = 0; chan < 2; chan++)
@@ -805,7 +822,10 @@ void apu_write(uint32 address, uint8 value)
       if (value & 0x10)
       {
          if (0 == apu.dmc.dma_length)
+         {
             apu_dmcreload();
+            nes6502_release();
+         }
       }
       else
       {
@@ -833,6 +853,8 @@ uint8 apu_read(uint32 address)
    switch (address)
    {
    case APU_SMASK:
+      apu_dmcclock();
+
       value = 0;
       /* Return 1 in 0-5 bit pos if a channel is playing */
       if (apu.rectangle[0].enabled && apu.rectangle[0].vbl_length)
@@ -844,8 +866,7 @@ uint8 apu_read(uint32 address)
       if (apu.noise.enabled && apu.noise.vbl_length)
          value |= 0x08;
 
-      /* bodge for timestamp queue */
-      if (apu.dmc.enabled)
+      if (apu.dmc.dma_length)
          value |= 0x10;
 
       if (apu.dmc.irq_occurred)
@@ -873,12 +894,165 @@ uint8 apu_read(uint32 address)
       out = -0x8000; \
 }
 
-void apu_process(void *buffer, int num_samples)
+/* run every channel across a block, then mix it down into dest */
+static void apu_mixblock(int16 *dest, int num_samples)
+{
+   int32 *pulse = mix_pulse, *tnd = mix_tnd, *ext = mix_ext;
+   int i;
+
+   /* one loop per channel, each adding its weight into the mixer inputs */
+   memset(pulse, 0, num_samples * sizeof(int32));
+   memset(tnd, 0, num_samples * sizeof(int32));
+
+   if (apu.mix_enable & 0x01)
+   {
+      for (i = 0; i < num_samples; i++)
+         pulse[i] += apu_rectangle(&apu.rectangle[0], 0);
+   }
+
+   if (apu.mix_enable & 0x02)
+   {
+      for (i = 0; i < num_samples; i++)
+         pulse[i] += apu_rectangle(&apu.rectangle[1], 1);
+   }
+
+   if (apu.mix_enable & 0x04)
+   {
+      for (i = 0; i < num_samples; i++)
+         tnd[i] += 3 * apu_triangle(&apu.triangle);
+   }
+
+   if (apu.mix_enable & 0x08)
+   {
+      for (i = 0; i < num_samples; i++)
+         tnd[i] += 2 * apu_noise(&apu.noise);
+   }
+
+   /* the dmc's queue drains whether or not it's heard */
+   if (apu.mix_enable & 0x10)
+   {
+      for (i = 0; i < num_samples; i++)
+         tnd[i] += apu_dmc();
+   }
+   else
+   {
+      for (i = 0; i < num_samples; i++)
+         apu_dmc();
+   }
+
+   memset(ext, 0, num_samples * sizeof(int32));
+   if (apu.ext && (apu.mix_enable & 0x20))
+      apu.ext->process_block(ext, num_samples);
+
+   /* the nonlinear mix is two table lookups per sample, with no
+   ** dependency between samples
+   */
+   for (i = 0; i < num_samples; i++)
+      pulse[i] = pulse_lut[pulse[i]] + tnd_lut[tnd[i]];
+
+   /* filters carry state from sample to sample, so they go last */
+   for (i = 0; i < num_samples; i++)
+   {
+      int32 next_sample, accum;
+
+      /* the mixer output never goes negative; take out the dc */
+      dc_out += pulse[i] - dc_in - ((dc_out + (1 << (APU_DC_SHIFT - 1))) >> APU_DC_SHIFT);
+      dc_in = pulse[i];
+
+      accum = dc_out + ext[i];
+
+      /* do any filtering */
+      if (APU_FILTER_NONE != apu.filter_type)
+      {
+         next_sample = accum;
+
+         if (APU_FILTER_LOWPASS == apu.filter_type)
+         {
+            accum += prev_sample;
+            accum >>= 1;
+         }
+         else
+            accum = (accum + accum + accum + prev_sample) >> 2;
+
+         prev_sample = next_sample;
+      }
+
+      /* do clipping */
+      CLIP_OUTPUT16(accum);
+
+      dest[i] = (int16) accum;
+   }
+}
+
+/* one output sample: taps input samples against one phase of the filter */
+INLINE int32 apu_rsdot(const int16 *input, const int16 *coefs, int taps)
 {
-   static int32 prev_sample = 0;
+#ifdef __SSE2__
+   __m128i sum = _mm_setzero_si128();
 
+   for (; taps; taps -= 8, input += 8, coefs += 8)
+   {
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_loadu_si128((const __m128i *) input),
+                                              _mm_loadu_si128((const __m128i *) coefs)));
+   }
+
+   sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+   sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+   return _mm_cvtsi128_si32(sum);
+#else /* !__SSE2__ */
+   int32 sum = 0;
+
+   while (taps--)
+      sum += *input++ * *coefs++;
+
+   return sum;
+#endif /* !__SSE2__ */
+}
+
+/* Every frame is mixed as the cpu finishes it, exactly mix_samples of it,
+** whether or not anyone asks for the sound.  The length counters,
+** envelopes and sweeps are stepped by the mixer, so this keeps them on
+** the cpu's timeline: what the game reads from $4015, and what a snapshot
+** holds, come out the same however the frame was run and however fast
+** the sound device is being fed.
+*/
+static void apu_mixframe(void)
+{
+   int index, used, count, block;
+
+   /* drop what the filter has moved past, and anything a frame nobody
+   ** listened to left past what the filter still needs
+   */
+   index = (int) (rs_pos >> 32);
+   used = index;
+   if (rs_count - used > rs_taps + 2 * APU_RS_SLACK)
+      used = rs_count - rs_taps - 2 * APU_RS_SLACK;
+
+   rs_count -= used;
+   memmove(rs_input, rs_input + used, rs_count * sizeof(int16));
+   if (used > index)
+      rs_pos &= 0xFFFFFFFF;
+   else
+      rs_pos -= (uint64_t) used << 32;
+
+   count = apu.mix_samples;
+   if (count > APU_RS_QUEUE - rs_count)
+      count = APU_RS_QUEUE - rs_count;
+
+   for (; count; count -= block)
+   {
+      block = (count > APU_MIXBLOCK) ? APU_MIXBLOCK : count;
+      apu_mixblock(rs_input + rs_count, block);
+      rs_count += block;
+   }
+}
+
+void apu_process(void *buffer, int num_samples)
+{
    int16 *buf16;
    uint8 *buf8;
+   int32 accum;
+   int index;
 
    if (NULL != buffer)
    {
@@ -888,41 +1062,25 @@ void apu_process(void *buffer, int num_samples)
       buf16 = (int16 *) buffer;
       buf8 = (uint8 *) buffer;
 
-      while (num_samples--)
+      for (; num_samples; num_samples--)
       {
-         int32 next_sample, accum = 0;
-
-         if (apu.mix_enable & 0x01)
-            accum += apu_rectangle_0();
-         if (apu.mix_enable & 0x02)
-            accum += apu_rectangle_1();
-         if (apu.mix_enable & 0x04)
-            accum += apu_triangle();
-         if (apu.mix_enable & 0x08)
-            accum += apu_noise();
-         if (apu.mix_enable & 0x10)
-            accum += apu_dmc();
-         if (apu.ext && (apu.mix_enable & 0x20))
-            accum += apu.ext->process();
-
-         /* do any filtering */
-         if (APU_FILTER_NONE != apu.filter_type)
+         index = (int) (rs_pos >> 32);
+         if (index + rs_taps > rs_count)
          {
-            next_sample = accum;
-
-            if (APU_FILTER_LOWPASS == apu.filter_type)
-            {
-               accum += prev_sample;
-               accum >>= 1;
-            }
-            else
-               accum = (accum + accum + accum + prev_sample) >> 2;
-
-            prev_sample = next_sample;
+            accum = rs_hold;
+         }
+         else
+         {
+            accum = apu_rsdot(rs_input + index,
+                              rs_coefs + ((uint32) rs_pos >> (32 - APU_RS_PHASEBITS)) * rs_taps,
+                              rs_taps);
+            accum = (accum + (1 << 13)) >> 14;
+            rs_pos += rs_step;
+
+            /* do clipping */
+            CLIP_OUTPUT16(accum);
+            rs_hold = accum;
          }
-
-         /* do clipping */
-         CLIP_OUTPUT16(accum);
 
          /* signed 16-bit output, unsigned 8-bit */
          if (16 == apu.sample_bits)
@@ -933,6 +1091,30 @@ void apu_process(void *buffer, int num_samples)
    }
 }
 
+/* speed the output up or slow it down by ratio (1.0 being nominal), so
+** the sound card can be kept fed at just the right rate
+*/
+void apu_setratio(double ratio)
+{
+   rs_step = (uint64_t) (rs_nominal * ratio);
+}
+
+/* the mixer forgets what it has heard and starts over cold, as it does
+** when first set up; the sound has jumped elsewhere in time
+*/
+void apu_resetmixer(void)
+{
+   prev_sample = 0;
+   dc_in = dc_out = 0;
+
+   rs_pos = 0;
+   rs_hold = 0;
+
+   /* the filter looks ahead, so the output starts that far behind */
+   rs_count = rs_taps + APU_RS_SLACK;
+   memset(rs_input, 0, rs_count * sizeof(int16));
+}
+
 /* set the filter type */
 void apu_setfilter(int filter_type)
 {
@@ -943,6 +1125,11 @@ void apu_reset(void)
 {
    uint32 address;
 
+   /* the dmc starts over from here */
+   dmc_now = dmc_start = nes6502_getcycles(false);
+   apu.dmc.freq = apu.dmc.timer = dmc_clocks[0];
+   apu_dmcflush();
+
    /* initialize all channel members */
    for (address = 0x4000; address <= 0x4013; address++)
       apu_write(address, 0);
@@ -968,28 +1155,107 @@ void apu_build_luts(int num_samples)
    /* triangle wave channel's linear length table */
    for (i = 0; i < 128; i++)
       trilength_lut[i] = (int) (0.25 * i * num_samples);
+}
+
+/* the usual approximations of the 2A03 mixer, scaled so a lone pulse
+** channel at full volume swings as far as it did when channels were
+** mixed linearly (and as far as the expansion chips, which still are)
+*/
+static void apu_build_mixer(void)
+{
+   double scale;
+   int i;
+
+   scale = (15 << 9) / (95.52 / (8128.0 / 15 + 100));
+
+   pulse_lut[0] = tnd_lut[0] = 0;
 
-#ifndef REALTIME_NOISE
-   /* generate noise samples */
-   shift_register15(noise_long_lut, APU_NOISE_32K);
-   shift_register15(noise_short_lut, APU_NOISE_93);
-#endif /* !REALTIME_NOISE */
+   for (i = 1; i < APU_PULSE_LUTSIZE; i++)
+      pulse_lut[i] = (int32) (scale * 95.52 / (8128.0 * APU_LEVEL(1) / i + 100));
+
+   for (i = 1; i < APU_TND_LUTSIZE; i++)
+      tnd_lut[i] = (int32) (scale * 163.67 / (24329.0 * APU_LEVEL(1) / i + 100));
+}
+
+/* windowed sinc lowpass, cut off below the lower of the two nyquists
+** (with a little room for apu_setratio), in APU_RS_PHASES phases
+*/
+static void apu_build_resampler(int sample_rate)
+{
+   double cutoff, t, x, h, sum, coefs[APU_RS_MAXTAPS];
+   int phase, i, error;
+   int16 *dest;
+
+   cutoff = 0.46;
+   if (sample_rate < APU_MIXRATE)
+      cutoff *= (double) sample_rate / APU_MIXRATE;
+
+   /* taps come in multiples of 8 for the dot product */
+   rs_taps = ((int) (APU_RS_ZEROS / cutoff) + 8) & ~7;
+   if (rs_taps > APU_RS_MAXTAPS)
+      rs_taps = APU_RS_MAXTAPS;
+
+   for (phase = 0; phase < APU_RS_PHASES; phase++)
+   {
+      sum = 0;
+
+      for (i = 0; i < rs_taps; i++)
+      {
+         /* distance from the output point, and where that is in the window */
+         t = i - (rs_taps / 2 - 1) - (double) phase / APU_RS_PHASES;
+         x = t / (rs_taps / 2);
+
+         if (0 == t)
+            h = 2 * cutoff;
+         else
+            h = sin(2 * PI * cutoff * t) / (PI * t);
+
+         h *= 0.42 + 0.5 * cos(PI * x) + 0.08 * cos(2 * PI * x);
+         coefs[i] = h;
+         sum += h;
+      }
+
+      /* unity gain in every phase, down to the last bit */
+      dest = rs_coefs + phase * rs_taps;
+      error = 1 << 14;
+      for (i = 0; i < rs_taps; i++)
+      {
+         dest[i] = (int16) floor(coefs[i] * (1 << 14) / sum + 0.5);
+         error -= dest[i];
+      }
+      dest[rs_taps / 2 - 1] += error;
+   }
+
+   rs_nominal = (uint64_t) ((double) APU_MIXRATE / sample_rate * 4294967296.0);
+   rs_step = rs_nominal;
+   apu_resetmixer();
 }
 
 void apu_setparams(double base_freq, int sample_rate, int refresh_rate, int sample_bits)
 {
+   if (0 == base_freq)
+      base_freq = APU_BASEFREQ;
+
    apu.sample_rate = sample_rate;
-   apu.refresh_rate = refresh_rate;
    apu.sample_bits = sample_bits;
    apu.num_samples = sample_rate / refresh_rate;
-   if (0 == base_freq)
-      apu.base_freq = APU_BASEFREQ;
-   else
-      apu.base_freq = base_freq;
-   apu.cycle_rate = (float) (apu.base_freq / sample_rate);
+
+   /* the device rate only matters to the resampler */
+   apu_build_resampler(sample_rate);
+
+   if (base_freq == apu.base_freq && refresh_rate == apu.refresh_rate)
+      return;
+
+   /* channels always run at the mix rate */
+   apu.base_freq = base_freq;
+   apu.refresh_rate = refresh_rate;
+   apu.mix_rate = APU_MIXRATE;
+   apu.mix_samples = APU_MIXRATE / refresh_rate;
+   apu.cycle_rate = (int32) (apu.base_freq * (1 << APU_FIX_SHIFT) / APU_MIXRATE);
+   dmc_step = apu.cycle_rate >> (APU_FIX_SHIFT - APU_DMC_SHIFT);
 
    /* build various lookup tables for apu */
-   apu_build_luts(apu.num_samples);
+   apu_build_luts(apu.mix_samples);
 
    apu_reset();
 }
@@ -1016,6 +1282,7 @@ apu_t *apu_create(double base_freq, int sample_rate, int refresh_rate, int sampl
 
    apu_setcontext(temp_apu);
 
+   apu_build_mixer();
    apu_setparams(base_freq, sample_rate, refresh_rate, sample_bits);
 
    for (channel = 0; channel < 6; channel++)
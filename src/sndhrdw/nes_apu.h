@@ -27,9 +27,6 @@
 #define _NES_APU_H_
 
 
-/* define this for realtime generated noise */
-#define  REALTIME_NOISE
-
 #define  APU_WRA0       0x4000
 #define  APU_WRA1       0x4001
 #define  APU_WRA2       0x4002
@@ -51,12 +48,14 @@
 
 #define  APU_SMASK      0x4015
 
-/* length of generated noise */
-#define  APU_NOISE_32K  0x7FFF
-#define  APU_NOISE_93   93
-
 #define  APU_BASEFREQ   1789772.7272727272727272
 
+/* channel timers count cpu cycles in 16.16 fixed point */
+#define  APU_FIX_SHIFT  16
+
+/* channels are run and mixed at this rate, whatever the device's */
+#define  APU_MIXRATE    96000
+
 
 /* channel structures */
 /* As much data as possible is precalculated,
@@ -69,7 +68,7 @@ typedef struct rectangle_s
 
    bool enabled;
    
-   float accum;
+   int32 accum;
    int32 freq;
    int32 output_vol;
    bool fixed_envelope;
@@ -100,7 +99,7 @@ typedef struct triangle_s
 
    bool enabled;
 
-   float accum;
+   int32 accum;
    int32 freq;
    int32 output_vol;
 
@@ -122,7 +121,7 @@ typedef struct noise_s
 
    bool enabled;
 
-   float accum;
+   int32 accum;
    int32 freq;
    int32 output_vol;
 
@@ -136,24 +135,15 @@ typedef struct noise_s
 
    int vbl_length;
 
-#ifdef REALTIME_NOISE
    uint8 xor_tap;
-#else
-   bool short_sample;
-   int cur_pos;
-#endif /* REALTIME_NOISE */
 } noise_t;
 
 typedef struct dmc_s
 {
    uint8 regs[4];
 
-   /* bodge for timestamp queue */
-   bool enabled;
-   
-   float accum;
+   int32 timer; /* cpu cycles to the next output clock */
    int32 freq;
-   int32 output_vol;
 
    uint32 address;
    uint32 cached_addr;
@@ -186,13 +176,15 @@ typedef struct
    void (*write_func)(uint32 address, uint8 value);
 } apu_memwrite;
 
-/* external sound chip stuff */
+/* external sound chip stuff: process_block adds num_samples of the
+** chip's output at the mix rate into buffer
+*/
 typedef struct apuext_s
 {
    int   (*init)(void);
    void  (*shutdown)(void);
    void  (*reset)(void);
-   int32 (*process)(void);
+   void  (*process_block)(int32 *buffer, int num_samples);
    apu_memread *mem_read;
    apu_memwrite *mem_write;
 } apuext_t;
@@ -213,12 +205,15 @@ typedef struct apu_s
    int filter_type;
 
    double base_freq;
-   float cycle_rate;
+   int32 cycle_rate; /* cpu cycles per mix sample, fixed point */
 
    int sample_rate;
    int sample_bits;
    int refresh_rate;
 
+   int mix_rate;
+   int mix_samples; /* per frame, at mix_rate */
+
    void (*process)(void *buffer, int num_samples);
    void (*irq_callback)(void);
    uint8 (*irqclear_callback)(void);
@@ -242,14 +237,22 @@ extern void apu_destroy(apu_t **apu);
 
 extern void apu_process(void *buffer, int num_samples);
 extern void apu_reset(void);
+extern void apu_resetmixer(void);
 
 extern void apu_setext(apu_t *apu, apuext_t *ext);
 extern void apu_setfilter(int filter_type);
+extern void apu_setratio(double ratio);
 extern void apu_setchan(int chan, bool enabled);
 
 extern uint8 apu_read(uint32 address);
 extern void apu_write(uint32 address, uint8 value);
 
+/* the dmc runs on the cpu's clock, not the mixer's */
+extern int apu_dmcnext(void);
+extern void apu_dmcclock(void);
+extern void apu_endframe(void);
+extern void apu_resync(void);
+
 
 #ifdef __cplusplus
 }
@@ -33,7 +33,7 @@ typedef struct vrcvirectangle_s
 
    uint8 reg[3];
    
-   float accum;
+   int32 accum;
    uint8 adder;
 
    int32 freq;
@@ -47,7 +47,7 @@ typedef struct vrcvisawtooth_s
    
    uint8 reg[3];
    
-   float accum;
+   int32 accum;
    uint8 adder;
    uint8 output_acc;
 
@@ -59,14 +59,30 @@ typedef struct vrcvisnd_s
 {
    vrcvirectangle_t rectangle[2];
    vrcvisawtooth_t saw;
-   float incsize;
+   int32 incsize; /* cpu cycles per sample, fixed point */
 } vrcvisnd_t;
 
 
 static vrcvisnd_t vrcvi;
 
+/* clock a silent channel's timer across a whole block at once, and
+** return how many times it went off
+*/
+INLINE int vrcvi_skip(int32 *accum, int32 freq, int num_samples)
+{
+   int steps;
+
+   *accum -= vrcvi.incsize * num_samples;
+   if (*accum >= 0)
+      return 0;
+
+   steps = (-*accum + freq - 1) / freq;
+   *accum += steps * freq;
+   return steps;
+}
+
 /* VRCVI rectangle wave generation */
-static int32 vrcvi_rectangle(vrcvirectangle_t *chan)
+ALWAYS_INLINE int32 vrcvi_rectangle(vrcvirectangle_t *chan)
 {
    /* reg0: 0-3=volume, 4-6=duty cycle
    ** reg1: 8 bits of freq
@@ -80,10 +96,6 @@ static int32 vrcvi_rectangle(vrcvirectangle_t *chan)
       chan->adder = (chan->adder + 1) & 0x0F;
    }
 
-   /* return if not enabled */
-   if (false == chan->enabled)
-      return 0;
-
    if (chan->adder < chan->duty_flip)
       return -(chan->volume);
    else
@@ -91,7 +103,7 @@ static int32 vrcvi_rectangle(vrcvirectangle_t *chan)
 }
 
 /* VRCVI sawtooth wave generation */
-static int32 vrcvi_sawtooth(vrcvisawtooth_t *chan)
+ALWAYS_INLINE int32 vrcvi_sawtooth(vrcvisawtooth_t *chan)
 {
    /* reg0: 0-5=phase accumulator bits
    ** reg1: 8 bits of freq
@@ -112,23 +124,52 @@ static int32 vrcvi_sawtooth(vrcvisawtooth_t *chan)
       }
    }
 
-   /* return if not enabled */
-   if (false == chan->enabled)
-      return 0;
-
    return (chan->output_acc >> 3) << 9;
 }
 
-/* mix vrcvi sound channels together */
-static int32 vrcvi_process(void)
+/* mix vrcvi sound channels into a block, one channel at a time */
+static void vrcvi_process(int32 *buffer, int num_samples)
 {
-   int32 output;
+   vrcvisawtooth_t *saw = &vrcvi.saw;
+   int chan, i, steps;
+
+   for (chan = 0; chan < 2; chan++)
+   {
+      vrcvirectangle_t *rect = &vrcvi.rectangle[chan];
+
+      /* the duty counter runs on even when the channel is off */
+      if (false == rect->enabled)
+      {
+         steps = vrcvi_skip(&rect->accum, rect->freq, num_samples);
+         rect->adder = (rect->adder + steps) & 0x0F;
+         continue;
+      }
+
+      for (i = 0; i < num_samples; i++)
+         buffer[i] += vrcvi_rectangle(rect);
+   }
 
-   output = vrcvi_rectangle(&vrcvi.rectangle[0]);
-   output += vrcvi_rectangle(&vrcvi.rectangle[1]);
-   output += vrcvi_sawtooth(&vrcvi.saw);
+   if (false == saw->enabled)
+   {
+      /* the accumulator starts over every seventh step, so once it has
+      ** it only depends on where in the cycle the block ended
+      */
+      steps = vrcvi_skip(&saw->accum, saw->freq, num_samples);
+      if (saw->adder + steps >= 7)
+      {
+         saw->adder = (saw->adder + steps) % 7;
+         saw->output_acc = saw->adder * saw->volume;
+      }
+      else
+      {
+         saw->adder += steps;
+         saw->output_acc += steps * saw->volume;
+      }
+      return;
+   }
 
-   return output;
+   for (i = 0; i < num_samples; i++)
+      buffer[i] += vrcvi_sawtooth(saw);
 }
 
 /* write to registers */
@@ -148,13 +189,13 @@ static void vrcvi_write(uint32 address, uint8 value)
    case 0x9001:
    case 0xA001:
       vrcvi.rectangle[chan].reg[1] = value;
-      vrcvi.rectangle[chan].freq = ((vrcvi.rectangle[chan].reg[2] & 0x0F) << 8) + value + 1;
+      vrcvi.rectangle[chan].freq = (((vrcvi.rectangle[chan].reg[2] & 0x0F) << 8) + value + 1) << APU_FIX_SHIFT;
       break;
 
    case 0x9002:
    case 0xA002:
       vrcvi.rectangle[chan].reg[2] = value;
-      vrcvi.rectangle[chan].freq = ((value & 0x0F) << 8) + vrcvi.rectangle[chan].reg[1] + 1;
+      vrcvi.rectangle[chan].freq = (((value & 0x0F) << 8) + vrcvi.rectangle[chan].reg[1] + 1) << APU_FIX_SHIFT;
       vrcvi.rectangle[chan].enabled = (value & 0x80) ? true : false;
       break;
 
@@ -165,12 +206,12 @@ static void vrcvi_write(uint32 address, uint8 value)
 
    case 0xB001:
       vrcvi.saw.reg[1] = value;
-      vrcvi.saw.freq = (((vrcvi.saw.reg[2] & 0x0F) << 8) + value + 1) << 1;
+      vrcvi.saw.freq = (((vrcvi.saw.reg[2] & 0x0F) << 8) + value + 1) << (APU_FIX_SHIFT + 1);
       break;
 
    case 0xB002:
       vrcvi.saw.reg[2] = value;
-      vrcvi.saw.freq = (((value & 0x0F) << 8) + vrcvi.saw.reg[1] + 1) << 1;
+      vrcvi.saw.freq = (((value & 0x0F) << 8) + vrcvi.saw.reg[1] + 1) << (APU_FIX_SHIFT + 1);
       vrcvi.saw.enabled = (value & 0x80) ? true : false;
       break;
 
@@ -0,0 +1,199 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** thread.c
+**
+** Worker threads, for the core's own background jobs
+** $Id$
+*/
+
+#include <stdlib.h>
+#ifdef WIN32
+#include <windows.h>
+#else /* !WIN32 */
+#include <pthread.h>
+#endif /* !WIN32 */
+#include <noftypes.h>
+#include <thread.h>
+
+struct thread_s
+{
+#ifdef WIN32
+   HANDLE handle;
+#else /* !WIN32 */
+   pthread_t handle;
+#endif /* !WIN32 */
+   int (*func)(void *arg);
+   void *arg;
+   int retval;
+};
+
+struct monitor_s
+{
+#ifdef WIN32
+   CRITICAL_SECTION lock;
+   CONDITION_VARIABLE cond;
+#else /* !WIN32 */
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+#endif /* !WIN32 */
+};
+
+#ifdef WIN32
+static DWORD WINAPI thread_start(LPVOID param)
+{
+   thread_t *thread = param;
+
+   thread->retval = thread->func(thread->arg);
+   return 0;
+}
+#else /* !WIN32 */
+static void *thread_start(void *param)
+{
+   thread_t *thread = param;
+
+   thread->retval = thread->func(thread->arg);
+   return NULL;
+}
+#endif /* !WIN32 */
+
+thread_t *thread_create(int (*func)(void *arg), void *arg)
+{
+   thread_t *thread;
+
+   thread = malloc(sizeof(thread_t));
+   if (NULL == thread)
+      return NULL;
+
+   thread->func = func;
+   thread->arg = arg;
+   thread->retval = 0;
+
+#ifdef WIN32
+   thread->handle = CreateThread(NULL, 0, thread_start, thread, 0, NULL);
+   if (NULL == thread->handle)
+   {
+      free(thread);
+      return NULL;
+   }
+#else /* !WIN32 */
+   if (pthread_create(&thread->handle, NULL, thread_start, thread))
+   {
+      free(thread);
+      return NULL;
+   }
+#endif /* !WIN32 */
+
+   return thread;
+}
+
+/* wait for a thread to finish, and have what it returned */
+int thread_join(thread_t **thread)
+{
+   int retval;
+
+   if (NULL == *thread)
+      return -1;
+
+#ifdef WIN32
+   WaitForSingleObject((*thread)->handle, INFINITE);
+   CloseHandle((*thread)->handle);
+#else /* !WIN32 */
+   pthread_join((*thread)->handle, NULL);
+#endif /* !WIN32 */
+
+   retval = (*thread)->retval;
+   free(*thread);
+
+   return retval;
+}
+
+monitor_t *monitor_create(void)
+{
+   monitor_t *monitor;
+
+   monitor = malloc(sizeof(monitor_t));
+   if (NULL == monitor)
+      return NULL;
+
+#ifdef WIN32
+   InitializeCriticalSection(&monitor->lock);
+   InitializeConditionVariable(&monitor->cond);
+#else /* !WIN32 */
+   pthread_mutex_init(&monitor->lock, NULL);
+   pthread_cond_init(&monitor->cond, NULL);
+#endif /* !WIN32 */
+
+   return monitor;
+}
+
+void monitor_destroy(monitor_t **monitor)
+{
+   if (NULL == *monitor)
+      return;
+
+#ifdef WIN32
+   DeleteCriticalSection(&(*monitor)->lock);
+#else /* !WIN32 */
+   pthread_cond_destroy(&(*monitor)->cond);
+   pthread_mutex_destroy(&(*monitor)->lock);
+#endif /* !WIN32 */
+
+   free(*monitor);
+}
+
+void monitor_enter(monitor_t *monitor)
+{
+#ifdef WIN32
+   EnterCriticalSection(&monitor->lock);
+#else /* !WIN32 */
+   pthread_mutex_lock(&monitor->lock);
+#endif /* !WIN32 */
+}
+
+void monitor_leave(monitor_t *monitor)
+{
+#ifdef WIN32
+   LeaveCriticalSection(&monitor->lock);
+#else /* !WIN32 */
+   pthread_mutex_unlock(&monitor->lock);
+#endif /* !WIN32 */
+}
+
+/* let go of the lock until notified; wake ups can be spurious, so check
+** whatever was being waited for again
+*/
+void monitor_wait(monitor_t *monitor)
+{
+#ifdef WIN32
+   SleepConditionVariableCS(&monitor->cond, &monitor->lock, INFINITE);
+#else /* !WIN32 */
+   pthread_cond_wait(&monitor->cond, &monitor->lock);
+#endif /* !WIN32 */
+}
+
+/* wake everyone waiting */
+void monitor_notify(monitor_t *monitor)
+{
+#ifdef WIN32
+   WakeAllConditionVariable(&monitor->cond);
+#else /* !WIN32 */
+   pthread_cond_broadcast(&monitor->cond);
+#endif /* !WIN32 */
+}
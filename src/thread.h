@@ -0,0 +1,46 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** thread.h
+**
+** Worker threads, for the core's own background jobs
+** $Id$
+*/
+
+#ifndef _THREAD_H_
+#define _THREAD_H_
+
+#include <noftypes.h>
+
+typedef struct thread_s thread_t;
+
+/* a lock and a condition to wait on under it */
+typedef struct monitor_s monitor_t;
+
+extern thread_t *thread_create(int (*func)(void *arg), void *arg);
+extern int thread_join(thread_t **thread);
+
+extern monitor_t *monitor_create(void);
+extern void monitor_destroy(monitor_t **monitor);
+extern void monitor_enter(monitor_t *monitor);
+extern void monitor_leave(monitor_t *monitor);
+extern void monitor_wait(monitor_t *monitor);
+extern void monitor_notify(monitor_t *monitor);
+
+#endif /* _THREAD_H_ */
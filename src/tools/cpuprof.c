@@ -0,0 +1,176 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** cpuprof.c
+**
+** Headless cycle profile of a game's code, for kcachegrind
+** $Id$
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <noftypes.h>
+#include <log.h>
+#include <osd.h>
+#include <vid_drv.h>
+#include <nes.h>
+#include <nes_ppu.h>
+#include <nes_apu.h>
+#include <nes_rom.h>
+#include <replay.h>
+#include <prof6502.h>
+
+#define  PROF_FRAMES          600   /* with no replay to say how many */
+
+static void usage(void)
+{
+   fprintf(stderr,
+      "usage: cpuprof [options] file.nes [file.rpl]\n"
+      "  -f frames   frames to run (all of the replay, or %d)\n"
+      "  -n count    functions to list (20)\n"
+      "  -o file     the profile (callgrind.out.<game>), and file.asm\n",
+      PROF_FRAMES);
+   exit(1);
+}
+
+/* the file's name, minus directories and extension */
+static void prof_basename(char *buf, int length, const char *filename)
+{
+   const char *start, *p;
+   char *dot;
+
+   start = filename;
+   for (p = filename; *p; p++)
+   {
+      if ('/' == *p || '\\' == *p)
+         start = p + 1;
+   }
+
+   snprintf(buf, length, "%s", start);
+
+   dot = strrchr(buf, '.');
+   if (NULL != dot && dot != buf)
+      *dot = 0;
+}
+
+int main(int argc, char *argv[])
+{
+   char outname[PATH_MAX + 16], base[PATH_MAX];
+   const char *output = NULL, *replay = NULL;
+   vidinfo_t video;
+   nes_t *machine = NULL;
+   int opt, frames = -1, count = 20, frame, retval = 1;
+
+   for (opt = 1; opt < argc && '-' == argv[opt][0] && argv[opt][1]; opt++)
+   {
+      if (argv[opt][2] || opt + 1 >= argc)
+         usage();
+
+      switch (argv[opt][1])
+      {
+      case 'f': frames = atoi(argv[++opt]); break;
+      case 'n': count = atoi(argv[++opt]); break;
+      case 'o': output = argv[++opt]; break;
+      default:  usage(); break;
+      }
+   }
+
+   if (opt + 2 == argc)
+      replay = argv[opt + 1];
+   else if (opt + 1 != argc)
+      usage();
+
+   if (NULL == output)
+   {
+      prof_basename(base, sizeof(base), argv[opt]);
+      snprintf(outname, sizeof(outname), "callgrind.out.%s", base);
+      output = outname;
+   }
+
+   log_init();
+
+   osd_getvideoinfo(&video);
+   if (vid_init(video.default_width, video.default_height, video.driver))
+      goto _fail;
+
+   machine = nes_create();
+   if (NULL == machine || nes_insertcart(argv[opt], machine))
+   {
+      fprintf(stderr, "cpuprof: could not load %s\n", argv[opt]);
+      goto _fail;
+   }
+
+   if (replay && replay_play(replay))
+   {
+      fprintf(stderr, "cpuprof: could not play %s\n", replay);
+      goto _fail;
+   }
+
+   if (frames < 0)
+      frames = replay ? (int) (replay_numframes() - replay_keyframe(0)) : PROF_FRAMES;
+
+   prof6502_namehandler((const void *) ppu_read, "ppu_read");
+   prof6502_namehandler((const void *) ppu_write, "ppu_write");
+   prof6502_namehandler((const void *) ppu_readhigh, "ppu_readhigh");
+   prof6502_namehandler((const void *) ppu_writehigh, "ppu_writehigh");
+   prof6502_namehandler((const void *) apu_read, "apu_read");
+   prof6502_namehandler((const void *) apu_write, "apu_write");
+
+   if (prof6502_start(machine->rominfo->rom, machine->rominfo->rom_banks * 0x4000))
+   {
+      fprintf(stderr, "cpuprof: could not profile; build with NES6502_PROFILE\n");
+      goto _fail;
+   }
+
+   for (frame = 0; frame < frames; frame++)
+   {
+      if (replay)
+      {
+         if (false == replay_frame(false))
+            break;
+      }
+      else
+      {
+         nes_runframe(false, false);
+      }
+   }
+
+   prof6502_stop();
+   prof6502_report(stdout, count);
+
+   if (prof6502_write(output))
+   {
+      fprintf(stderr, "cpuprof: could not write %s\n", output);
+      goto _fail;
+   }
+
+   fprintf(stderr, "%s: %d frames profiled, written to %s\n", argv[opt], frame, output);
+   retval = 0;
+
+_fail:
+   prof6502_free();
+   replay_stop();
+   if (machine)
+      nes_destroy(&machine);
+   vid_shutdown();
+   log_shutdown();
+
+   return retval;
+}
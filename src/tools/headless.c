@@ -0,0 +1,207 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** headless.c
+**
+** An OSD with no screen, sound or keyboard, for tools that run the
+** whole machine
+** $Id$
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef WIN32
+#include <windows.h>
+#else /* !WIN32 */
+#include <unistd.h>
+#endif /* !WIN32 */
+#include <noftypes.h>
+#include <bitmap.h>
+#include <vid_drv.h>
+#include <osd.h>
+#include <nofrendo.h>
+
+#define  HEADLESS_WIDTH       256
+#define  HEADLESS_HEIGHT      240
+
+volatile int nofrendo_ticks = 0;
+
+static bitmap_t *screen = NULL;
+static uint8 screen_pixels[HEADLESS_WIDTH * HEADLESS_HEIGHT];
+
+/* the frame is drawn into here, and goes no further */
+static int headless_init(int width, int height)
+{
+   UNUSED(width);
+   UNUSED(height);
+
+   return 0;
+}
+
+static void headless_shutdown(void)
+{
+   bmp_destroy(&screen);
+}
+
+static int headless_setmode(int width, int height)
+{
+   UNUSED(width);
+   UNUSED(height);
+
+   return 0;
+}
+
+static void headless_setpalette(rgb_t *palette)
+{
+   UNUSED(palette);
+}
+
+static bitmap_t *headless_lock(void)
+{
+   if (NULL == screen)
+      screen = bmp_createhw(screen_pixels, HEADLESS_WIDTH, HEADLESS_HEIGHT, HEADLESS_WIDTH);
+
+   return screen;
+}
+
+viddriver_t headlessDriver =
+{
+   "headless",             /* name */
+   headless_init,          /* init */
+   headless_shutdown,      /* shutdown */
+   headless_setmode,       /* set_mode */
+   headless_setpalette,    /* set_palette */
+   NULL,                   /* clear */
+   headless_lock,          /* lock_write */
+   NULL,                   /* free_write */
+   NULL,                   /* custom_blit */
+   false                   /* invalidate flag */
+};
+
+void osd_getvideoinfo(vidinfo_t *info)
+{
+   info->default_width = HEADLESS_WIDTH;
+   info->default_height = HEADLESS_HEIGHT;
+   info->driver = &headlessDriver;
+}
+
+void osd_getsoundinfo(sndinfo_t *info)
+{
+   info->sample_rate = 44100;
+   info->bps = 16;
+}
+
+void osd_getsoundstats(sndstats_t *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+}
+
+void osd_setsound(void (*playfunc)(void *buffer, int size))
+{
+   UNUSED(playfunc);
+}
+
+void osd_soundframe(void)
+{
+}
+
+int osd_init(void)
+{
+   return 0;
+}
+
+void osd_shutdown(void)
+{
+}
+
+int osd_installtimer(int frequency, void *func, int funcsize,
+                     void *counter, int countersize)
+{
+   UNUSED(frequency);
+   UNUSED(func);
+   UNUSED(funcsize);
+   UNUSED(counter);
+   UNUSED(countersize);
+
+   return 0;
+}
+
+void osd_getinput(void)
+{
+}
+
+void osd_getmouse(int *x, int *y, int *button)
+{
+   *x = *y = *button = 0;
+}
+
+uint32 osd_get_usecs(void)
+{
+#ifdef WIN32
+   LARGE_INTEGER count, freq;
+
+   QueryPerformanceCounter(&count);
+   QueryPerformanceFrequency(&freq);
+   return (uint32) (count.QuadPart * 1000000 / freq.QuadPart);
+#else /* !WIN32 */
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint32) (now.tv_sec * 1000000 + now.tv_nsec / 1000);
+#endif /* !WIN32 */
+}
+
+uint32 osd_get_ticks(void)
+{
+   return osd_get_usecs() / 1000;
+}
+
+void osd_delay(uint32 ms)
+{
+#ifdef WIN32
+   Sleep(ms);
+#else /* !WIN32 */
+   usleep(ms * 1000);
+#endif /* !WIN32 */
+}
+
+/* nothing to go back to */
+void main_insert(const char *filename, system_t type)
+{
+   UNUSED(filename);
+   UNUSED(type);
+}
+
+void main_eject(void)
+{
+}
+
+void main_quit(void)
+{
+}
+
+int main_loop(const char *filename, system_t type)
+{
+   UNUSED(filename);
+   UNUSED(type);
+
+   return 0;
+}
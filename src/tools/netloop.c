@@ -0,0 +1,267 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** netloop.c
+**
+** Netplay over the loopback interface, with a link as bad as asked for
+** $Id$
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif /* !WIN32 */
+#include <noftypes.h>
+#include <log.h>
+#include <osd.h>
+#include <vid_drv.h>
+#include <nes.h>
+#include <nesinput.h>
+#include <netplay.h>
+
+typedef struct loop_s
+{
+   int latency;         /* ms, each way */
+   int loss;            /* percent */
+   int delay, rollback;
+   int seconds;
+   int changes;         /* times a second the pad changes */
+   int port;
+   const char *filename;
+} loop_t;
+
+typedef struct loopresult_s
+{
+   netstats_t stats;
+   uint32 usecs;        /* how long it ran for */
+   double cpu;          /* seconds of cpu it used */
+} loopresult_t;
+
+static void usage(void)
+{
+   fprintf(stderr,
+      "usage: netloop [options] [file.nes]\n"
+      "  -l ms       latency each way (50)\n"
+      "  -p percent  packets lost (5)\n"
+      "  -d frames   input delay (%d)\n"
+      "  -r frames   frames that may be rolled back (%d)\n"
+      "  -t seconds  how long to play for (10)\n"
+      "  -c count    pad changes a second (6)\n"
+      "  -P port     the first of two ports to use (%d)\n",
+      NETPLAY_DELAY, NETPLAY_ROLLBACK, NETPLAY_PORT);
+   exit(1);
+}
+
+#ifndef WIN32
+/* one side: play along at the real frame rate, mashing buttons */
+static int loop_player(loop_t *loop, int player, int result_fd)
+{
+   static nesinput_t pad = { INP_JOYPAD0, 0 };
+   loopresult_t result;
+   uint32 start, next, now, frame_usecs, frames;
+   uint32 seed = (uint32) (player + 1) * 69069;
+   clock_t cpu_start;
+
+   if (netplay_open(player, loop->port + player, "127.0.0.1", loop->port + (player ^ 1),
+                    loop->delay, loop->rollback))
+   {
+      fprintf(stderr, "netloop: player %d couldn't start netplay\n", player + 1);
+      return -1;
+   }
+
+   netplay_setlink(loop->latency, loop->loss);
+   input_register(&pad);
+
+   frames = loop->seconds * NES_REFRESH_RATE;
+   frame_usecs = 1000000 / NES_REFRESH_RATE;
+   start = next = osd_get_usecs();
+   cpu_start = clock();
+
+   do
+   {
+      seed = seed * 1103515245 + 12345;
+      if ((int) ((seed >> 16) % NES_REFRESH_RATE) < loop->changes)
+      {
+         seed = seed * 1103515245 + 12345;
+         pad.data = (seed >> 16) & 0xFF;
+      }
+
+      netplay_frame(true);
+      netplay_getstats(&result.stats);
+
+      /* on to the next frame, unless we've fallen behind */
+      next += frame_usecs;
+      now = osd_get_usecs();
+      if ((int32) (next - now) > 0)
+         osd_delay((next - now) / 1000);
+      else if ((int32) (now - next) > (int32) frame_usecs)
+         next = now;
+   }
+   while (result.stats.frames < frames
+          && osd_get_usecs() - start < (loop->seconds + 5) * 1000000u);
+
+   result.usecs = osd_get_usecs() - start;
+   result.cpu = (double) (clock() - cpu_start) / CLOCKS_PER_SEC;
+   netplay_close();
+
+   if (write(result_fd, &result, sizeof(result)) != sizeof(result))
+      return -1;
+
+   return 0;
+}
+
+static void loop_report(int player, loopresult_t *result)
+{
+   netstats_t *stats = &result->stats;
+   double seconds = result->usecs / 1000000.0;
+
+   printf("player %d: %u frames in %.1f s, %u stalls\n", player + 1,
+          stats->frames, seconds, stats->stalls);
+   printf("  rollbacks      %.1f/s, %.1f frames/s resimulated\n",
+          stats->rollbacks / seconds, stats->resim_frames / seconds);
+   printf("  cpu            %.1f ms/s resimulating, %.1f ms/s in netplay, %.1f ms/s in all\n",
+          stats->resim_usecs / seconds / 1000, stats->frame_usecs / seconds / 1000,
+          result->cpu * 1000 / seconds);
+   printf("  packets        %u sent, %u lost, %u received\n",
+          stats->packets_sent, stats->packets_lost, stats->packets_received);
+
+   if (0xFFFFFFFF == stats->checked_frame)
+      printf("  sync           no checkpoints compared");
+   else
+      printf("  sync           agreed through frame %u", stats->checked_frame);
+   printf(", %u desyncs, %u resyncs\n", stats->desyncs, stats->resyncs);
+}
+#endif /* !WIN32 */
+
+int main(int argc, char *argv[])
+{
+   loop_t loop;
+   vidinfo_t video;
+   nes_t *machine;
+#ifndef WIN32
+   loopresult_t results[2];
+   int fds[2][2], player, status, retval = 0;
+   pid_t pids[2];
+#endif /* !WIN32 */
+   int opt;
+
+   loop.latency = 50;
+   loop.loss = 5;
+   loop.delay = NETPLAY_DELAY;
+   loop.rollback = NETPLAY_ROLLBACK;
+   loop.seconds = 10;
+   loop.changes = 6;
+   loop.port = NETPLAY_PORT;
+   loop.filename = "";
+
+   for (opt = 1; opt < argc && '-' == argv[opt][0] && argv[opt][1]; opt++)
+   {
+      if (opt + 1 >= argc || argv[opt][2])
+         usage();
+
+      switch (argv[opt][1])
+      {
+      case 'l': loop.latency = atoi(argv[++opt]); break;
+      case 'p': loop.loss = atoi(argv[++opt]); break;
+      case 'd': loop.delay = atoi(argv[++opt]); break;
+      case 'r': loop.rollback = atoi(argv[++opt]); break;
+      case 't': loop.seconds = atoi(argv[++opt]); break;
+      case 'c': loop.changes = atoi(argv[++opt]); break;
+      case 'P': loop.port = atoi(argv[++opt]); break;
+      default:  usage(); break;
+      }
+   }
+
+   if (opt < argc)
+      loop.filename = argv[opt++];
+
+   if (opt < argc || loop.seconds <= 0 || loop.latency < 0 || loop.loss < 0
+       || loop.loss > 100 || loop.delay < 0 || loop.rollback < 1
+       || loop.rollback > NETPLAY_MAXROLLBACK || loop.port <= 0)
+      usage();
+
+#ifdef WIN32
+   fprintf(stderr, "netloop: needs fork(), which this system hasn't got\n");
+   return 1;
+#else /* !WIN32 */
+   log_init();
+
+   /* both sides start from the very same machine */
+   osd_getvideoinfo(&video);
+   if (vid_init(video.default_width, video.default_height, video.driver))
+      return 1;
+
+   machine = nes_create();
+   if (NULL == machine || nes_insertcart(loop.filename, machine))
+   {
+      fprintf(stderr, "netloop: could not start the machine\n");
+      return 1;
+   }
+
+   printf("netloop: %d ms each way, %d%% lost, %d frame delay, %d frame rollback\n",
+          loop.latency, loop.loss, loop.delay, loop.rollback);
+
+   /* the cores are one to a process, so each side gets a process, and
+   ** sends back how it went down a pipe of its own
+   */
+   fflush(stdout);
+   for (player = 0; player < 2; player++)
+   {
+      if (pipe(fds[player]))
+         return 1;
+
+      pids[player] = fork();
+      if (0 == pids[player])
+      {
+         close(fds[player][0]);
+         exit(loop_player(&loop, player, fds[player][1]) ? 1 : 0);
+      }
+
+      if (pids[player] < 0)
+         return 1;
+
+      close(fds[player][1]);
+   }
+
+   for (player = 0; player < 2; player++)
+   {
+      if (read(fds[player][0], &results[player], sizeof(loopresult_t)) != sizeof(loopresult_t))
+         retval = 1;
+      close(fds[player][0]);
+
+      if (waitpid(pids[player], &status, 0) < 0 || false == WIFEXITED(status)
+          || 0 != WEXITSTATUS(status))
+         retval = 1;
+   }
+
+   for (player = 0; player < 2 && 0 == retval; player++)
+      loop_report(player, &results[player]);
+
+   nes_destroy(&machine);
+   vid_shutdown();
+   log_shutdown();
+
+   return retval;
+#endif /* !WIN32 */
+}
@@ -0,0 +1,309 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** nsfrender.c
+**
+** Headless NSF to WAV renderer
+** $Id$
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <noftypes.h>
+#include <log.h>
+#include <nsf.h>
+#include <wav.h>
+#include "toolutil.h"
+
+/* a little either side of the centre still counts as silence */
+#define  SILENCE_THRESHOLD    8
+
+typedef struct render_s
+{
+   int sample_rate;
+   int sample_bits;
+   int length;          /* seconds, at most */
+   int silence;         /* seconds of quiet that end a song, 0 for never */
+   int jobs;
+   const char *outdir;
+   const char *basename;
+} render_t;
+
+static void usage(void)
+{
+   fprintf(stderr,
+      "usage: nsfrender [options] file.nsf [track ...]\n"
+      "  -r rate     sample rate (44100)\n"
+      "  -b bits     8 or 16 bit samples (16)\n"
+      "  -t seconds  longest a song may run (150)\n"
+      "  -s seconds  stop after this much silence, 0 to never (3)\n"
+      "  -j jobs     songs to render at once (one per cpu)\n"
+      "  -o dir      where the WAVs go (.)\n");
+   exit(1);
+}
+
+static bool render_isquiet(const void *buffer, int num_samples, int sample_bits)
+{
+   int i;
+
+   if (16 == sample_bits)
+   {
+      const int16 *src = buffer;
+
+      for (i = 0; i < num_samples; i++)
+      {
+         if (src[i] > (SILENCE_THRESHOLD << 8) || src[i] < -(SILENCE_THRESHOLD << 8))
+            return false;
+      }
+   }
+   else
+   {
+      const uint8 *src = buffer;
+
+      for (i = 0; i < num_samples; i++)
+      {
+         if (src[i] > 0x80 + SILENCE_THRESHOLD || src[i] < 0x80 - SILENCE_THRESHOLD)
+            return false;
+      }
+   }
+
+   return true;
+}
+
+/* play one song into its own WAV, as fast as the cpu will go */
+static int render_track(nsf_t *nsf, render_t *render, int track)
+{
+   char filename[1024];
+   void *buffer;
+   wav_t *wav = NULL;
+   int frames, max_frames, quiet_frames, silence_frames, num_samples;
+   clock_t start;
+   double elapsed;
+
+   snprintf(filename, sizeof(filename), "%s/%s-%02d.wav",
+            render->outdir, render->basename, track);
+
+   buffer = malloc((render->sample_rate / NSF_REFRESH_RATE + 1) * (render->sample_bits / 8));
+   if (NULL == buffer)
+      goto _fail;
+
+   if (nsf_playtrack(nsf, track, render->sample_rate, render->sample_bits))
+   {
+      fprintf(stderr, "nsfrender: could not start track %d\n", track);
+      goto _fail;
+   }
+
+   wav = wav_open(filename, render->sample_rate, render->sample_bits);
+   if (NULL == wav)
+   {
+      fprintf(stderr, "nsfrender: could not create %s\n", filename);
+      goto _fail;
+   }
+
+   max_frames = render->length * NSF_REFRESH_RATE;
+   silence_frames = render->silence * NSF_REFRESH_RATE;
+   quiet_frames = 0;
+   start = clock();
+
+   for (frames = 0; frames < max_frames; frames++)
+   {
+      num_samples = nsf_frame(nsf, buffer);
+      if (wav_write(wav, buffer, num_samples))
+      {
+         fprintf(stderr, "nsfrender: error writing %s\n", filename);
+         goto _fail;
+      }
+
+      if (0 == silence_frames)
+         continue;
+
+      if (render_isquiet(buffer, num_samples, render->sample_bits))
+         quiet_frames++;
+      else
+         quiet_frames = 0;
+
+      if (quiet_frames >= silence_frames)
+      {
+         frames++;
+         break;
+      }
+   }
+
+   elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+   if (wav_close(&wav))
+   {
+      fprintf(stderr, "nsfrender: error writing %s\n", filename);
+      goto _fail;
+   }
+
+   free(buffer);
+
+   fprintf(stderr, "%s: %.1f seconds, %.0fx realtime\n", filename,
+           (double) frames / NSF_REFRESH_RATE,
+           elapsed > 0 ? frames / (elapsed * NSF_REFRESH_RATE) : 0.0);
+
+   return 0;
+
+_fail:
+   wav_close(&wav);
+   if (buffer)
+      free(buffer);
+   return -1;
+}
+
+/* what a worker's for */
+typedef struct renderjob_s
+{
+   nsf_t *nsf;
+   render_t *render;
+   int *tracks;
+   int retval;
+} renderjob_t;
+
+static int render_job(int index, void *arg)
+{
+   renderjob_t *job = arg;
+
+   return render_track(job->nsf, job->render, job->tracks[index]);
+}
+
+static int render_done(int index, bool ok, void *arg)
+{
+   renderjob_t *job = arg;
+
+   UNUSED(index);
+   if (false == ok)
+      job->retval = -1;
+   return 0;
+}
+
+/* the cpu and apu cores are single instances, so songs are rendered in
+** parallel by forking a worker process apiece off the loaded tune
+*/
+static int render_tracks(nsf_t *nsf, render_t *render, int *tracks, int num_tracks)
+{
+   renderjob_t job;
+   int i;
+
+   job.nsf = nsf;
+   job.render = render;
+   job.tracks = tracks;
+   job.retval = 0;
+
+   /* whatever didn't get a worker is done here */
+   i = tool_runworkers(render->jobs, num_tracks, render_job, render_done, &job);
+   if (i < 0)
+      return -1;
+
+   for (; i < num_tracks; i++)
+   {
+      if (render_track(nsf, render, tracks[i]))
+         job.retval = -1;
+   }
+
+   return job.retval;
+}
+
+int main(int argc, char *argv[])
+{
+   render_t render;
+   nsf_t *nsf = NULL;
+   char *basename = NULL;
+   int *tracks = NULL;
+   int num_tracks, i, opt, retval = 1;
+
+   render.sample_rate = 44100;
+   render.sample_bits = 16;
+   render.length = 150;
+   render.silence = 3;
+   render.jobs = tool_jobs();
+   render.outdir = ".";
+
+   for (opt = 1; opt < argc && '-' == argv[opt][0] && argv[opt][1]; opt++)
+   {
+      if (opt + 1 >= argc || argv[opt][2])
+         usage();
+
+      switch (argv[opt][1])
+      {
+      case 'r': render.sample_rate = atoi(argv[++opt]); break;
+      case 'b': render.sample_bits = atoi(argv[++opt]); break;
+      case 't': render.length = atoi(argv[++opt]); break;
+      case 's': render.silence = atoi(argv[++opt]); break;
+      case 'j': render.jobs = atoi(argv[++opt]); break;
+      case 'o': render.outdir = argv[++opt]; break;
+      default:  usage(); break;
+      }
+   }
+
+   if (opt >= argc || render.sample_rate < 8000
+       || (8 != render.sample_bits && 16 != render.sample_bits)
+       || render.length <= 0 || render.silence < 0)
+      usage();
+
+   if (render.jobs < 1)
+      render.jobs = 1;
+
+   log_init();
+
+   nsf = nsf_load(argv[opt]);
+   if (NULL == nsf)
+   {
+      fprintf(stderr, "nsfrender: could not load %s\n", argv[opt]);
+      goto _fail;
+   }
+
+   basename = tool_basename(argv[opt]);
+   if (NULL == basename)
+      goto _fail;
+   render.basename = basename;
+   opt++;
+
+   /* the songs asked for, or all of them */
+   num_tracks = (opt < argc) ? argc - opt : nsf->num_songs;
+   tracks = malloc(num_tracks * sizeof(int));
+   if (NULL == tracks)
+      goto _fail;
+
+   for (i = 0; i < num_tracks; i++)
+   {
+      tracks[i] = (opt < argc) ? atoi(argv[opt + i]) : i + 1;
+      if (tracks[i] < 1 || tracks[i] > nsf->num_songs)
+      {
+         fprintf(stderr, "nsfrender: no track %d; there are %d\n", tracks[i], nsf->num_songs);
+         goto _fail;
+      }
+   }
+
+   if (0 == render_tracks(nsf, &render, tracks, num_tracks))
+      retval = 0;
+
+_fail:
+   if (tracks)
+      free(tracks);
+   if (basename)
+      free(basename);
+   nsf_free(&nsf);
+   log_shutdown();
+
+   return retval;
+}
@@ -0,0 +1,650 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** replayrender.c
+**
+** Headless replay to video and WAV renderer, a segment per cpu
+** $Id$
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <noftypes.h>
+#include <log.h>
+#include <osd.h>
+#include <vid_drv.h>
+#include <pcx.h>
+#include <wav.h>
+#include <y4m.h>
+#include <nes.h>
+#include <nes_apu.h>
+#include <replay.h>
+#include "toolutil.h"
+
+#define  RENDER_CHUNK         32768 /* samples */
+
+/* a worker's mixer starts out cold, and clicks; so each renders a little
+** sound past the end of its segment, to be played over the start of the
+** next while that one's mixer settles
+*/
+#define  RENDER_OVERLAP       2     /* frames */
+
+enum
+{
+   SEG_WAITING,
+   SEG_DONE,
+   SEG_FAILED
+};
+
+typedef struct render_s
+{
+   int sample_rate;
+   int sample_bits;
+   int jobs;
+   int thumbs;          /* frames between thumbnails, 0 for none */
+   bool video, audio;
+   const char *outdir;
+   const char *basename;
+} render_t;
+
+/* the finished files, built up a segment at a time */
+typedef struct output_s
+{
+   FILE *video;
+   wav_t *audio;
+   uint8 *buffer;       /* RENDER_CHUNK samples, as read or written */
+   int16 *samples;
+   int16 *tail;         /* the last segment's sound past its end */
+   int tail_samples;
+} output_t;
+
+static void usage(void)
+{
+   fprintf(stderr,
+      "usage: replayrender [options] file.nes file.rpl\n"
+      "  -r rate     sample rate (44100)\n"
+      "  -b bits     8 or 16 bit samples (16)\n"
+      "  -t seconds  a PCX thumbnail this often, 0 for none (0)\n"
+      "  -V          no video, just the sound and any thumbnails\n"
+      "  -A          no sound\n"
+      "  -j jobs     segments to render at once (one per cpu)\n"
+      "  -o dir      where the output goes (.)\n");
+   exit(1);
+}
+
+static void render_partname(char *filename, int length, render_t *render,
+                            int segment, const char *ext)
+{
+   snprintf(filename, length, "%s/%s-part%04d.%s", render->outdir,
+            render->basename, segment, ext);
+}
+
+/* samples before a frame, counted from the very first, so every frame
+** gets the same number however the replay was cut up
+*/
+static uint32 render_sampleat(render_t *render, uint32 frame)
+{
+   return (uint32) (((uint64_t) frame * render->sample_rate) / NES_REFRESH_RATE);
+}
+
+static uint32 render_segend(int segment)
+{
+   if (segment + 1 < replay_numkeyframes())
+      return replay_keyframe(segment + 1);
+
+   return replay_numframes();
+}
+
+/* frames of sound a segment renders past its end; never more than the
+** next segment has
+*/
+static uint32 render_overlap(int segment)
+{
+   uint32 length;
+
+   if (segment + 1 >= replay_numkeyframes())
+      return 0;
+
+   length = render_segend(segment + 1) - replay_keyframe(segment + 1);
+   return MIN(RENDER_OVERLAP, length);
+}
+
+/* play one segment, from its keyframe up to the next, into files of its
+** own; each is a whole Y4M or WAV, the WAV running on into the overlap
+*/
+static int render_segment(render_t *render, int segment)
+{
+   char filename[1024];
+   nes_t *machine = nes_getcontextptr();
+   y4m_t *y4m = NULL;
+   wav_t *wav = NULL;
+   void *buffer = NULL;
+   uint32 frame, end, sound_end;
+   bool thumb;
+   int num_samples;
+
+   frame = replay_keyframe(segment);
+   end = render_segend(segment);
+   sound_end = render->audio ? end + render_overlap(segment) : end;
+
+   if (replay_seek(frame))
+   {
+      fprintf(stderr, "replayrender: could not seek to frame %u\n", frame);
+      goto _fail;
+   }
+
+   if (render->video)
+   {
+      render_partname(filename, sizeof(filename), render, segment, "y4m");
+      y4m = y4m_open(filename, NES_SCREEN_WIDTH, NES_SCREEN_HEIGHT, NES_REFRESH_RATE);
+      if (NULL == y4m)
+      {
+         fprintf(stderr, "replayrender: could not create %s\n", filename);
+         goto _fail;
+      }
+   }
+
+   if (render->audio)
+   {
+      buffer = malloc((render->sample_rate / NES_REFRESH_RATE + 1) * (render->sample_bits / 8));
+      if (NULL == buffer)
+         goto _fail;
+
+      render_partname(filename, sizeof(filename), render, segment, "wav");
+      wav = wav_open(filename, render->sample_rate, render->sample_bits);
+      if (NULL == wav)
+      {
+         fprintf(stderr, "replayrender: could not create %s\n", filename);
+         goto _fail;
+      }
+   }
+
+   for (; frame < sound_end; frame++)
+   {
+      thumb = render->thumbs && 0 == frame % render->thumbs && frame < end;
+
+      /* frames nobody will see needn't be drawn */
+      if (false == replay_frame(thumb || (y4m && frame < end)))
+      {
+         fprintf(stderr, "replayrender: the replay ran out at frame %u\n", frame);
+         goto _fail;
+      }
+
+      if (y4m && frame < end && y4m_write(y4m, machine->vidbuf, machine->ppu->curpal))
+         goto _fail;
+
+      if (thumb)
+      {
+         snprintf(filename, sizeof(filename), "%s/%s-%07u.pcx",
+                  render->outdir, render->basename, frame);
+         if (pcx_write(filename, machine->vidbuf, machine->ppu->curpal))
+         {
+            fprintf(stderr, "replayrender: could not create %s\n", filename);
+            goto _fail;
+         }
+      }
+
+      if (wav)
+      {
+         num_samples = render_sampleat(render, frame + 1) - render_sampleat(render, frame);
+         apu_process(buffer, num_samples);
+         if (wav_write(wav, buffer, num_samples))
+            goto _fail;
+      }
+   }
+
+   if (y4m_close(&y4m) || wav_close(&wav))
+   {
+      fprintf(stderr, "replayrender: error writing segment %d\n", segment);
+      goto _fail;
+   }
+
+   if (buffer)
+      free(buffer);
+
+   return 0;
+
+_fail:
+   y4m_close(&y4m);
+   wav_close(&wav);
+   if (buffer)
+      free(buffer);
+   return -1;
+}
+
+/* tack a segment's video on the end, minus its stream header unless it
+** is the first
+*/
+static int render_stitchvideo(output_t *output, const char *filename, bool header)
+{
+   FILE *fp;
+   size_t length;
+   int c;
+
+   fp = fopen(filename, "rb");
+   if (NULL == fp)
+      return -1;
+
+   if (false == header)
+   {
+      do
+         c = fgetc(fp);
+      while (EOF != c && '\n' != c);
+   }
+
+   while ((length = fread(output->buffer, 1, RENDER_CHUNK * 2, fp)) > 0)
+   {
+      if (length != fwrite(output->buffer, 1, length, output->video))
+         break;
+   }
+
+   if (ferror(fp) || ferror(output->video))
+   {
+      fclose(fp);
+      return -1;
+   }
+
+   fclose(fp);
+   return 0;
+}
+
+/* samples from a part, little-endian in the file, into signed 16-bit */
+static int render_getsamples(output_t *output, FILE *fp, int16 *dest, int num_samples)
+{
+   const uint8 *src = output->buffer;
+   int i;
+
+   if (16 == output->audio->sample_bits)
+   {
+      if (num_samples != (int) fread(output->buffer, 2, num_samples, fp))
+         return -1;
+
+      for (i = 0; i < num_samples; i++, src += 2)
+         dest[i] = (int16) (src[0] | (src[1] << 8));
+   }
+   else
+   {
+      if (num_samples != (int) fread(output->buffer, 1, num_samples, fp))
+         return -1;
+
+      for (i = 0; i < num_samples; i++)
+         dest[i] = (int16) ((src[i] ^ 0x80) << 8);
+   }
+
+   return 0;
+}
+
+/* and back again, to be written as wav_write wants them */
+static int render_putsamples(output_t *output, const int16 *src, int num_samples)
+{
+   int i;
+
+   if (16 == output->audio->sample_bits)
+      return wav_write(output->audio, src, num_samples);
+
+   for (i = 0; i < num_samples; i++)
+      output->buffer[i] = (uint8) ((src[i] >> 8) ^ 0x80);
+
+   return wav_write(output->audio, output->buffer, num_samples);
+}
+
+/* a segment's sound goes on the end, except the start of it, which the
+** last segment already rendered with its mixer warm; the last frame of
+** that is faded across to this one's
+*/
+static int render_stitchaudio(render_t *render, output_t *output, int segment,
+                              const char *filename)
+{
+   FILE *fp;
+   uint32 start, end, overlap;
+   int i, head, fade, length, num_samples;
+
+   fp = fopen(filename, "rb");
+   if (NULL == fp)
+      return -1;
+
+   if (fseek(fp, WAV_HEADER_LENGTH, SEEK_SET))
+      goto _fail;
+
+   start = replay_keyframe(segment);
+   end = render_segend(segment);
+   length = (int) (render_sampleat(render, end) - render_sampleat(render, start));
+
+   head = (segment > 0) ? output->tail_samples : 0;
+   if (head)
+   {
+      overlap = render_overlap(segment - 1);
+      fade = (int) (render_sampleat(render, start + overlap)
+                    - render_sampleat(render, start + overlap - 1));
+
+      if (render_getsamples(output, fp, output->samples, head))
+         goto _fail;
+
+      for (i = 0; i < head - fade; i++)
+         output->samples[i] = output->tail[i];
+
+      for (; i < head; i++)
+      {
+         output->samples[i] = (int16) ((output->tail[i] * (head - i)
+                                        + output->samples[i] * (i - head + fade)) / fade);
+      }
+
+      if (render_putsamples(output, output->samples, head))
+         goto _fail;
+   }
+
+   for (length -= head; length > 0; length -= num_samples)
+   {
+      num_samples = MIN(length, RENDER_CHUNK);
+      if (render_getsamples(output, fp, output->samples, num_samples)
+          || render_putsamples(output, output->samples, num_samples))
+         goto _fail;
+   }
+
+   /* what's past the end is for the start of the next */
+   overlap = render_overlap(segment);
+   output->tail_samples = (int) (render_sampleat(render, end + overlap)
+                                 - render_sampleat(render, end));
+   if (render_getsamples(output, fp, output->tail, output->tail_samples))
+      goto _fail;
+
+   fclose(fp);
+   return 0;
+
+_fail:
+   fclose(fp);
+   return -1;
+}
+
+static int render_stitch(render_t *render, output_t *output, int segment)
+{
+   char filename[1024];
+
+   if (output->video)
+   {
+      render_partname(filename, sizeof(filename), render, segment, "y4m");
+      if (render_stitchvideo(output, filename, 0 == segment))
+         return -1;
+      remove(filename);
+   }
+
+   if (output->audio)
+   {
+      render_partname(filename, sizeof(filename), render, segment, "wav");
+      if (render_stitchaudio(render, output, segment, filename))
+         return -1;
+      remove(filename);
+   }
+
+   return 0;
+}
+
+static void render_removeparts(render_t *render, int segment)
+{
+   char filename[1024];
+
+   render_partname(filename, sizeof(filename), render, segment, "y4m");
+   remove(filename);
+   render_partname(filename, sizeof(filename), render, segment, "wav");
+   remove(filename);
+}
+
+static int render_open(render_t *render, output_t *output)
+{
+   char filename[1024];
+
+   memset(output, 0, sizeof(output_t));
+
+   output->buffer = malloc(RENDER_CHUNK * 2);
+   output->samples = malloc(RENDER_CHUNK * sizeof(int16));
+   output->tail = malloc(RENDER_OVERLAP * (render->sample_rate / NES_REFRESH_RATE + 1)
+                         * sizeof(int16));
+   if (NULL == output->buffer || NULL == output->samples || NULL == output->tail)
+      return -1;
+
+   if (render->video)
+   {
+      snprintf(filename, sizeof(filename), "%s/%s.y4m", render->outdir, render->basename);
+      output->video = fopen(filename, "wb");
+      if (NULL == output->video)
+      {
+         fprintf(stderr, "replayrender: could not create %s\n", filename);
+         return -1;
+      }
+   }
+
+   if (render->audio)
+   {
+      snprintf(filename, sizeof(filename), "%s/%s.wav", render->outdir, render->basename);
+      output->audio = wav_open(filename, render->sample_rate, render->sample_bits);
+      if (NULL == output->audio)
+      {
+         fprintf(stderr, "replayrender: could not create %s\n", filename);
+         return -1;
+      }
+   }
+
+   return 0;
+}
+
+static int render_close(output_t *output)
+{
+   int retval = 0;
+
+   if (output->video && fclose(output->video))
+      retval = -1;
+   if (wav_close(&output->audio))
+      retval = -1;
+   if (output->buffer)
+      free(output->buffer);
+   if (output->samples)
+      free(output->samples);
+   if (output->tail)
+      free(output->tail);
+
+   return retval;
+}
+
+/* what the workers are for, and how far the output's got */
+typedef struct renderjob_s
+{
+   render_t *render;
+   output_t *output;
+   uint8 *state;
+   int num_segments;
+   int stitched;
+} renderjob_t;
+
+static int render_job(int index, void *arg)
+{
+   renderjob_t *job = arg;
+
+   return render_segment(job->render, index);
+}
+
+/* as the earliest unstitched segment finishes, it goes on the end of the
+** output; stop if that one failed
+*/
+static int render_done(int index, bool ok, void *arg)
+{
+   renderjob_t *job = arg;
+
+   job->state[index] = ok ? SEG_DONE : SEG_FAILED;
+
+   while (job->stitched < job->num_segments && SEG_DONE == job->state[job->stitched])
+   {
+      if (render_stitch(job->render, job->output, job->stitched))
+         job->state[job->stitched] = SEG_FAILED;
+      else
+         job->stitched++;
+   }
+
+   if (job->stitched < job->num_segments && SEG_FAILED == job->state[job->stitched])
+      return -1;
+
+   return 0;
+}
+
+/* the cores are single instances, so segments are rendered in parallel
+** by forking a worker apiece off the machine with the replay loaded,
+** each starting from its keyframe
+*/
+static int render_segments(render_t *render, output_t *output)
+{
+   renderjob_t job;
+   int segment, retval = 0;
+
+   job.render = render;
+   job.output = output;
+   job.num_segments = replay_numkeyframes();
+   job.stitched = 0;
+
+   job.state = malloc(job.num_segments);
+   if (NULL == job.state)
+      return -1;
+   memset(job.state, SEG_WAITING, job.num_segments);
+
+   if (tool_runworkers(render->jobs, job.num_segments, render_job, render_done, &job) < 0)
+      retval = -1;
+
+   /* whatever didn't get a worker is done here */
+   for (segment = job.stitched; segment < job.num_segments && 0 == retval; segment++)
+   {
+      if (render_segment(render, segment) || render_stitch(render, output, segment))
+         retval = -1;
+   }
+
+   /* don't leave the pieces of a failed render lying about */
+   for (segment = job.stitched; segment < job.num_segments && retval; segment++)
+      render_removeparts(render, segment);
+
+   free(job.state);
+   return retval;
+}
+
+int main(int argc, char *argv[])
+{
+   render_t render;
+   output_t output;
+   vidinfo_t video;
+   nes_t *machine = NULL;
+   char *basename = NULL;
+   uint32 start, frames;
+   double seconds, elapsed;
+   int opt, thumb_seconds = 0, retval = 1;
+
+   render.sample_rate = 44100;
+   render.sample_bits = 16;
+   render.jobs = tool_jobs();
+   render.video = true;
+   render.audio = true;
+   render.outdir = ".";
+
+   for (opt = 1; opt < argc && '-' == argv[opt][0] && argv[opt][1]; opt++)
+   {
+      if (argv[opt][2])
+         usage();
+
+      switch (argv[opt][1])
+      {
+      case 'V': render.video = false; continue;
+      case 'A': render.audio = false; continue;
+      default: break;
+      }
+
+      if (opt + 1 >= argc)
+         usage();
+
+      switch (argv[opt][1])
+      {
+      case 'r': render.sample_rate = atoi(argv[++opt]); break;
+      case 'b': render.sample_bits = atoi(argv[++opt]); break;
+      case 't': thumb_seconds = atoi(argv[++opt]); break;
+      case 'j': render.jobs = atoi(argv[++opt]); break;
+      case 'o': render.outdir = argv[++opt]; break;
+      default:  usage(); break;
+      }
+   }
+
+   if (opt + 2 != argc || render.sample_rate < 8000
+       || (8 != render.sample_bits && 16 != render.sample_bits) || thumb_seconds < 0)
+      usage();
+
+   render.thumbs = thumb_seconds * NES_REFRESH_RATE;
+   if (render.jobs < 1)
+      render.jobs = 1;
+
+   memset(&output, 0, sizeof(output));
+   log_init();
+
+   osd_getvideoinfo(&video);
+   if (vid_init(video.default_width, video.default_height, video.driver))
+      goto _fail;
+
+   machine = nes_create();
+   if (NULL == machine || nes_insertcart(argv[opt], machine))
+   {
+      fprintf(stderr, "replayrender: could not load %s\n", argv[opt]);
+      goto _fail;
+   }
+
+   apu_setparams(0, render.sample_rate, NES_REFRESH_RATE, render.sample_bits);
+
+   if (replay_play(argv[opt + 1]))
+   {
+      fprintf(stderr, "replayrender: could not play %s\n", argv[opt + 1]);
+      goto _fail;
+   }
+
+   basename = tool_basename(argv[opt + 1]);
+   if (NULL == basename)
+      goto _fail;
+   render.basename = basename;
+
+   if (render_open(&render, &output))
+      goto _fail;
+
+   start = osd_get_usecs();
+   if (render_segments(&render, &output))
+      goto _fail;
+   elapsed = (osd_get_usecs() - start) / 1000000.0;
+
+   frames = replay_numframes() - replay_keyframe(0);
+   seconds = (double) frames / NES_REFRESH_RATE;
+   fprintf(stderr, "%s: %u frames, %.1f seconds in %d segments, %.0fx realtime\n",
+           render.basename, frames, seconds, replay_numkeyframes(),
+           elapsed > 0 ? seconds / elapsed : 0.0);
+
+   retval = 0;
+
+_fail:
+   if (render_close(&output))
+      retval = 1;
+   replay_stop();
+   if (machine)
+      nes_destroy(&machine);
+   vid_shutdown();
+   if (basename)
+      free(basename);
+   log_shutdown();
+
+   return retval;
+}
@@ -0,0 +1,147 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** toolutil.c
+**
+** Bits the offline renderers share: cpu count, output names, workers
+** $Id$
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif /* !WIN32 */
+#include <noftypes.h>
+#include "toolutil.h"
+
+/* how many jobs to run at once, one per cpu */
+int tool_jobs(void)
+{
+#if !defined(WIN32) && defined(_SC_NPROCESSORS_ONLN)
+   long procs = sysconf(_SC_NPROCESSORS_ONLN);
+
+   if (procs > 0)
+      return (int) procs;
+#endif /* !WIN32 && _SC_NPROCESSORS_ONLN */
+   return 1;
+}
+
+/* the file's name, minus directories and extension */
+char *tool_basename(const char *filename)
+{
+   const char *start, *p;
+   char *name, *dot;
+
+   start = filename;
+   for (p = filename; *p; p++)
+   {
+      if ('/' == *p || '\\' == *p)
+         start = p + 1;
+   }
+
+   name = strdup(start);
+   if (NULL == name)
+      return NULL;
+
+   dot = strrchr(name, '.');
+   if (NULL != dot && dot != name)
+      *dot = 0;
+
+   return name;
+}
+
+/* the cores are single instances, so jobs run in parallel by forking a
+** worker apiece, up to jobs of them at once, in index order.  done hears
+** about each as it exits.  returns how many were started, all of them
+** finished, for the caller to do the rest itself (all of them, if there's
+** no forking to be had); -1 if done asked to stop, or waiting failed
+*/
+int tool_runworkers(int jobs, int count, tooljob_t job, tooldone_t done, void *arg)
+{
+#ifndef WIN32
+   pid_t *pids, pid;
+   int next = 0, running = 0, retval = 0, status, i;
+
+   if (jobs < 2 || count < 2)
+      return 0;
+
+   pids = malloc(count * sizeof(pid_t));
+   if (NULL == pids)
+      return 0;
+
+   while (0 == retval && (next < count || running))
+   {
+      while (running < jobs && next < count)
+      {
+         /* nothing buffered for a worker to write out again */
+         fflush(NULL);
+         pid = fork();
+         if (0 == pid)
+            exit(job(next, arg) ? 1 : 0);
+
+         if (pid < 0)
+            break;
+
+         pids[next++] = pid;
+         running++;
+      }
+
+      /* no more workers to be had, or no more wanted */
+      if (0 == running)
+         break;
+
+      pid = wait(&status);
+      if (pid < 0)
+      {
+         retval = -1;
+         break;
+      }
+
+      for (i = 0; i < next; i++)
+      {
+         if (pids[i] == pid)
+         {
+            pids[i] = 0;
+            running--;
+            if (done(i, WIFEXITED(status) && 0 == WEXITSTATUS(status), arg))
+               retval = -1;
+            break;
+         }
+      }
+   }
+
+   /* let any still going finish after a failure */
+   while (running-- > 0)
+      wait(&status);
+
+   free(pids);
+   return retval ? -1 : next;
+#else /* WIN32 */
+   UNUSED(jobs);
+   UNUSED(count);
+   UNUSED(job);
+   UNUSED(done);
+   UNUSED(arg);
+   return 0;
+#endif /* WIN32 */
+}
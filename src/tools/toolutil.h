@@ -0,0 +1,49 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** toolutil.h
+**
+** Bits the offline renderers share: cpu count, output names, workers
+** $Id$
+*/
+
+#ifndef _TOOLUTIL_H_
+#define _TOOLUTIL_H_
+
+#include <noftypes.h>
+
+/* runs job number index, in a worker; 0 if it went fine */
+typedef int (*tooljob_t)(int index, void *arg);
+
+/* told, in the parent, how a worker's job went; nonzero starts no more */
+typedef int (*tooldone_t)(int index, bool ok, void *arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern int tool_jobs(void);
+extern char *tool_basename(const char *filename);
+extern int tool_runworkers(int jobs, int count, tooljob_t job, tooldone_t done, void *arg);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _TOOLUTIL_H_ */
@@ -0,0 +1,153 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** tracedump.c
+**
+** Disassembles a binary trace of the 6502 core, oldest instruction first
+** $Id$
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <noftypes.h>
+#include <nes6502.h>
+#include <dis6502.h>
+#include <trace6502.h>
+
+#define  DUMP_CHUNK           4096     /* records read at a time */
+
+static void usage(void)
+{
+   fprintf(stderr,
+      "usage: tracedump [options] file.ntr\n"
+      "  -n count    only the last count instructions (all of them)\n");
+   exit(1);
+}
+
+static void dump_record(FILE *fp, const tracerec_t *rec)
+{
+   char line[8];
+   uint8 p = rec->p;
+
+   if (0xFFFF == rec->scanline)
+      strcpy(line, "-");
+   else
+      snprintf(line, sizeof(line), "%d", (int16) rec->scanline);
+
+   fprintf(fp, "%10u %4s  %-28s %c%c1%c%c%c%c%c %02X %02X %02X %02X\n",
+           rec->cycles, line, nes6502_disasm_code(rec->pc, rec->code),
+           (p & N_FLAG) ? 'N' : '.',
+           (p & V_FLAG) ? 'V' : '.',
+           (p & B_FLAG) ? 'B' : '.',
+           (p & D_FLAG) ? 'D' : '.',
+           (p & I_FLAG) ? 'I' : '.',
+           (p & Z_FLAG) ? 'Z' : '.',
+           (p & C_FLAG) ? 'C' : '.',
+           rec->a, rec->x, rec->y, rec->s);
+}
+
+int main(int argc, char *argv[])
+{
+   tracehdr_t header;
+   tracerec_t *chunk = NULL;
+   FILE *fp = NULL;
+   uint64_t count, first, index;
+   long long last = -1;
+   uint32 slot, run, i;
+   int opt, retval = 1;
+
+   for (opt = 1; opt < argc && '-' == argv[opt][0] && argv[opt][1]; opt++)
+   {
+      if (argv[opt][2] || opt + 1 >= argc)
+         usage();
+
+      switch (argv[opt][1])
+      {
+      case 'n': last = atoll(argv[++opt]); break;
+      default:  usage(); break;
+      }
+   }
+
+   if (opt + 1 != argc)
+      usage();
+
+   fp = fopen(argv[opt], "rb");
+   if (NULL == fp)
+   {
+      fprintf(stderr, "tracedump: could not open %s\n", argv[opt]);
+      goto _fail;
+   }
+
+   if (1 != fread(&header, sizeof(header), 1, fp)
+       || memcmp(header.magic, TRACE6502_MAGIC, sizeof(header.magic))
+       || sizeof(tracerec_t) != header.record_size
+       || 0 == header.num_records
+       || (header.num_records & (header.num_records - 1)))
+   {
+      fprintf(stderr, "tracedump: %s is not a trace\n", argv[opt]);
+      goto _fail;
+   }
+
+   /* what's left of the ring, from its oldest */
+   count = header.written;
+   if (count > header.num_records)
+      count = header.num_records;
+   if (last >= 0 && (uint64_t) last < count)
+      count = (uint64_t) last;
+   first = header.written - count;
+
+   chunk = malloc(DUMP_CHUNK * sizeof(tracerec_t));
+   if (NULL == chunk)
+      goto _fail;
+
+   for (index = first; index < header.written; index += run)
+   {
+      /* as far as the chunk, the end, or the ring wrapping round */
+      slot = (uint32) index & (header.num_records - 1);
+      run = header.num_records - slot;
+      if (run > DUMP_CHUNK)
+         run = DUMP_CHUNK;
+      if ((uint64_t) run > header.written - index)
+         run = (uint32) (header.written - index);
+
+      if (fseek(fp, TRACE6502_OFFSET + (long) slot * sizeof(tracerec_t), SEEK_SET)
+          || run != fread(chunk, sizeof(tracerec_t), run, fp))
+      {
+         fprintf(stderr, "tracedump: %s is cut short\n", argv[opt]);
+         goto _fail;
+      }
+
+      for (i = 0; i < run; i++)
+         dump_record(stdout, &chunk[i]);
+   }
+
+   fprintf(stderr, "%s: %llu of %llu instructions\n", argv[opt],
+           (unsigned long long) count, (unsigned long long) header.written);
+   retval = 0;
+
+_fail:
+   if (chunk)
+      free(chunk);
+   if (fp)
+      fclose(fp);
+
+   return retval;
+}
@@ -24,6 +24,7 @@
 */
 
 #include <string.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <noftypes.h>
 #include <log.h>
@@ -31,28 +32,62 @@
 #include <vid_drv.h>
 #include <gui.h>
 #include <osd.h>
+#include <nofconfig.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define  VID_X86
+#include <immintrin.h>
+#define  VID_TARGET(isa)   __attribute__ ((target(isa)))
+#endif /* __GNUC__ && x86 */
 
 /* hardware surface */
 static bitmap_t *screen = NULL;
+static int screen_width, screen_height;
 
-/* primary / backbuffer surfaces */
-static bitmap_t *primary_buffer = NULL, *back_buffer = NULL;
+/* the emulated machine renders straight into frame_buffer.  primary_buffer
+** is the part of it that fits on screen, and the GUI draws on overlay,
+** which is laid over the primary buffer as it goes out to the driver
+*/
+static bitmap_t *frame_buffer = NULL, *primary_buffer = NULL, *overlay = NULL;
+static bool *overlay_used = NULL;
 
 static viddriver_t *driver = NULL;
 
+/* dirty rectangle state */
+#define  CHUNK_WIDTH    64
+#define  CHUNK_HEIGHT   16
+
+static int chunk_width = CHUNK_WIDTH, chunk_height = CHUNK_HEIGHT;
+static int chunk_cols;
+static uint64_t *chunk_hash = NULL;
+static rect_t *dirty_rects = NULL;
+static int dirty_cutoff = 0;
+static bool full_refresh = true;
+
+/* bytes handed to the driver */
+static struct
+{
+   uint32 frames, full_blits;
+   uint64_t bytes;
+} vid_stats;
+
 /* fast automagic loop unrolling */
 #define  DUFFS_DEVICE(transfer, count) \
 { \
    register int n = (count + 7) / 8; \
    switch (count % 8) \
    { \
-   case 0:  do {  { transfer; } \
-   case 7:        { transfer; } \
-   case 6:        { transfer; } \
-   case 5:        { transfer; } \
-   case 4:        { transfer; } \
-   case 3:        { transfer; } \
-   case 2:        { transfer; } \
+   case 0:  do {  { transfer; } FALLTHROUGH; \
+   case 7:        { transfer; } FALLTHROUGH; \
+   case 6:        { transfer; } FALLTHROUGH; \
+   case 5:        { transfer; } FALLTHROUGH; \
+   case 4:        { transfer; } FALLTHROUGH; \
+   case 3:        { transfer; } FALLTHROUGH; \
+   case 2:        { transfer; } FALLTHROUGH; \
    case 1:        { transfer; } \
             } while (--n > 0); \
    } \
@@ -83,6 +118,195 @@ INLINE int vid_memcmp(const void *p1, const void *p2, int len)
    return 0;
 }
 
+#define  HASH_PRIME1     0x9E3779B185EBCA87ULL
+#define  HASH_PRIME2     0xC2B2AE3D27D4EB4FULL
+
+INLINE uint64_t vid_hashstep(uint64_t acc, uint64_t data, uint64_t key)
+{
+   uint64_t mixed = data ^ key;
+
+   return acc + ((data >> 32) | (data << 32)) + (mixed & 0xFFFFFFFF) * (mixed >> 32);
+}
+
+INLINE uint64_t vid_hashmix(uint64_t hash)
+{
+   hash ^= hash >> 33;
+   hash *= HASH_PRIME2;
+   hash ^= hash >> 29;
+   hash *= HASH_PRIME1;
+   return hash ^ (hash >> 32);
+}
+
+/* hash an area of a bitmap, skipping lines that are not wanted.  every
+** 8 bytes are mixed with their own key, so pixels moving around change
+** the hash as well
+*/
+static uint64_t vid_hasharea(const bitmap_t *bmp, int x, int y, int width,
+                             int height, const bool *wanted, uint64_t seed)
+{
+   uint64_t acc[2] = { 0, 0 }, data, key = seed;
+   const uint8 *p;
+   int len, i;
+#ifdef __SSE2__
+   __m128i vacc = _mm_setzero_si128();
+   __m128i vkey = _mm_set_epi64x(seed + HASH_PRIME1, seed);
+   const __m128i step = _mm_set1_epi64x(HASH_PRIME1 * 2);
+#endif /* __SSE2__ */
+
+   for (; height; height--, y++)
+   {
+      if (wanted && false == wanted[y])
+         continue;
+
+      p = bmp->line[y] + x;
+      len = width;
+
+#ifdef __SSE2__
+      for (; len >= 16; len -= 16, p += 16)
+      {
+         __m128i vdata = _mm_loadu_si128((const __m128i *) p);
+         __m128i mixed = _mm_xor_si128(vdata, vkey);
+
+         vacc = _mm_add_epi64(vacc, _mm_shuffle_epi32(vdata, 0xB1));
+         vacc = _mm_add_epi64(vacc, _mm_mul_epu32(mixed, _mm_srli_epi64(mixed, 32)));
+         vkey = _mm_add_epi64(vkey, step);
+      }
+#endif /* __SSE2__ */
+
+      for (i = 0; len > 0; len -= 8, p += 8, i ^= 1)
+      {
+         data = 0;
+         memcpy(&data, p, MIN(len, 8));
+         acc[i] = vid_hashstep(acc[i], data, key);
+         key += HASH_PRIME1;
+      }
+
+      key += HASH_PRIME2;
+   }
+
+#ifdef __SSE2__
+   {
+      uint64_t lanes[2];
+
+      _mm_storeu_si128((__m128i *) lanes, vacc);
+      acc[0] += lanes[0];
+      acc[1] += lanes[1];
+   }
+#endif /* __SSE2__ */
+
+   return vid_hashmix(vid_hashmix(seed ^ acc[0]) ^ acc[1]);
+}
+
+/* true if nothing has been drawn on this line of the overlay */
+INLINE bool vid_blankline(const uint8 *p, int len)
+{
+#ifdef __SSE2__
+   const __m128i blank = _mm_set1_epi8((char) VID_TRANSPARENT);
+   __m128i diff = _mm_setzero_si128();
+
+   for (; len >= 16; len -= 16, p += 16)
+      diff = _mm_or_si128(diff, _mm_xor_si128(_mm_loadu_si128((const __m128i *) p), blank));
+
+   if (0xFFFF != _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())))
+      return false;
+#endif /* __SSE2__ */
+
+   while (len--)
+   {
+      if (VID_TRANSPARENT != *p++)
+         return false;
+   }
+
+   return true;
+}
+
+/* copy a line of the primary buffer with the overlay laid on top */
+INLINE void vid_overlayline(uint8 *dest, const uint8 *src, const uint8 *over,
+                            int len)
+{
+#ifdef __SSE2__
+   const __m128i blank = _mm_set1_epi8((char) VID_TRANSPARENT);
+   __m128i pixels, mask;
+
+   for (; len >= 16; len -= 16, dest += 16, src += 16, over += 16)
+   {
+      pixels = _mm_loadu_si128((const __m128i *) over);
+      mask = _mm_cmpeq_epi8(pixels, blank);
+      pixels = _mm_or_si128(_mm_and_si128(mask, _mm_loadu_si128((const __m128i *) src)),
+                            _mm_andnot_si128(mask, pixels));
+      _mm_storeu_si128((__m128i *) dest, pixels);
+   }
+#endif /* __SSE2__ */
+
+   for (; len; len--, src++, over++)
+      *dest++ = (VID_TRANSPARENT == *over) ? *src : *over;
+}
+
+/* 8-bit to 32-bit conversion for drivers with truecolor surfaces.
+** overlay may be NULL; where it isn't transparent, it wins
+*/
+static void convert32_scalar(uint32 *dest, const uint8 *src, const uint8 *over,
+                             const uint32 *palette, int length)
+{
+   if (NULL != over)
+   {
+      for (; length; length--, src++, over++)
+         *dest++ = palette[(VID_TRANSPARENT == *over) ? *src : *over];
+      return;
+   }
+
+   for (; length >= 4; length -= 4, src += 4, dest += 4)
+   {
+      dest[0] = palette[src[0]];
+      dest[1] = palette[src[1]];
+      dest[2] = palette[src[2]];
+      dest[3] = palette[src[3]];
+   }
+
+   while (length--)
+      *dest++ = palette[*src++];
+}
+
+#ifdef VID_X86
+
+/* 8 palette gathers at a time, with the overlay merged in beforehand */
+VID_TARGET("avx2")
+static void convert32_avx2(uint32 *dest, const uint8 *src, const uint8 *over,
+                           const uint32 *palette, int length)
+{
+   const __m128i blank = _mm_set1_epi8((char) VID_TRANSPARENT);
+   __m128i pixels, mask;
+   __m256i lo, hi;
+
+   for (; length >= 16; length -= 16, src += 16, dest += 16)
+   {
+      pixels = _mm_loadu_si128((const __m128i *) src);
+
+      if (NULL != over)
+      {
+         __m128i top = _mm_loadu_si128((const __m128i *) over);
+
+         mask = _mm_cmpeq_epi8(top, blank);
+         pixels = _mm_blendv_epi8(top, pixels, mask);
+         over += 16;
+      }
+
+      lo = _mm256_i32gather_epi32((const int *) palette, _mm256_cvtepu8_epi32(pixels), 4);
+      hi = _mm256_i32gather_epi32((const int *) palette,
+                                  _mm256_cvtepu8_epi32(_mm_srli_si128(pixels, 8)), 4);
+
+      _mm256_storeu_si256((__m256i *) dest, lo);
+      _mm256_storeu_si256((__m256i *) (dest + 8), hi);
+   }
+
+   if (length)
+      convert32_scalar(dest, src, over, palette, length);
+}
+
+#endif /* VID_X86 */
+
+vidconvert_t vid_convert32 = convert32_scalar;
+
 /* super-dooper assembly memcpy (thanks, SDL!) */
 #if defined(__GNUC__) && defined(i386)
 #define vid_memcpy(dest, src, len) \
@@ -121,7 +345,13 @@ INLINE void vid_memcpy(void *dest, const void *src, int len)
 /* TODO: any way to remove this filth (GUI needs it)? */
 bitmap_t *vid_getbuffer(void)
 {
-   return primary_buffer;
+   return overlay;
+}
+
+/* the bitmap the emulated machine renders into */
+bitmap_t *vid_getframe(void)
+{
+   return frame_buffer;
 }
 
 void vid_setpalette(rgb_t *p)
@@ -201,79 +431,57 @@ void vid_blit(bitmap_t *bitmap, int src_x, int src_y, int dest_x, int dest_y,
    }
 }
 
-static void vid_blitscreen(int num_dirties, rect_t *dirty_rects)
+/* copy one area of the primary buffer, and whatever the GUI drew over
+** it, to the screen
+*/
+static void vid_blitrect(int x, int y, int width, int height,
+                         int dest_x, int dest_y)
 {
-   int src_x, src_y, dest_x, dest_y;
-   int blit_width, blit_height;
+   uint8 *dest = screen->line[y + dest_y] + x + dest_x;
 
-   screen = driver->lock_write();
-
-   /* center in y direction */
-   if (primary_buffer->height <= screen->height)
-   {
-      src_y = 0;
-      blit_height = primary_buffer->height;
-      dest_y = (screen->height - blit_height) >> 1;
-   }
-   else
+   for (; height; height--, y++)
    {
-      src_y = (primary_buffer->height - screen->height) >> 1;
-      blit_height = screen->height;
-      dest_y = 0;
-   }
+      if (overlay_used[y])
+         vid_overlayline(dest, primary_buffer->line[y] + x, overlay->line[y] + x, width);
+      else
+         memcpy(dest, primary_buffer->line[y] + x, width);
 
-   /* and in x */
-   if (primary_buffer->width <= screen->width)
-   {
-      src_x = 0;
-      blit_width = primary_buffer->width;
-      dest_x = (screen->width - blit_width) >> 1;
-   }
-   else
-   {
-      src_x = (primary_buffer->width - screen->width) >> 1;
-      blit_width = screen->width;
-      dest_x = 0;
+      dest += screen->pitch;
    }
+}
+
+static void vid_blitscreen(int num_dirties, rect_t *dirty_rects)
+{
+   int i, dest_x, dest_y;
+   rect_t *rect;
+
+   screen = driver->lock_write();
+
+   /* the primary buffer was cut to fit, center it */
+   dest_x = (screen->width - primary_buffer->width) >> 1;
+   dest_y = (screen->height - primary_buffer->height) >> 1;
    
    /* should we just copy the entire screen? */
    if (-1 == num_dirties)
    {
-      uint8 *dest, *src;
-
-      src = primary_buffer->line[src_y] + src_x;
-      dest = screen->line[dest_y] + dest_x;
+      vid_stats.full_blits++;
+      vid_stats.bytes += primary_buffer->width * primary_buffer->height;
 
-      while (blit_height--)
-      {
-         vid_memcpy(dest, src, primary_buffer->width);
-         src += primary_buffer->pitch;
-         dest += screen->pitch;
-      }
+      vid_blitrect(0, 0, primary_buffer->width, primary_buffer->height,
+                   dest_x, dest_y);
    }
    else
    {
-      /* we need to blit just a bunch of dirties */
-      int i, j, height;
-      rect_t *rects = dirty_rects;
-
-      for (i = 0; i < num_dirties && blit_height; i++)
+      /* we need to blit just a bunch of dirties, and hand them on to the
+      ** driver in screen coordinates
+      */
+      for (i = 0, rect = dirty_rects; i < num_dirties; i++, rect++)
       {
-         height = rects->h;
-         if (blit_height < height)
-            height = blit_height;
+         vid_stats.bytes += rect->w * rect->h;
 
-         j = 0;
-         DUFFS_DEVICE(  
-         {
-            vid_memcpy(screen->line[dest_y + rects->y + j] + rects->x + dest_x,
-                       primary_buffer->line[src_y + rects->y + j] + rects->x + src_x,
-                       rects->w);
-            j++;
-            blit_height--;
-         }, height);
-
-         rects++;
+         vid_blitrect(rect->x, rect->y, rect->w, rect->h, dest_x, dest_y);
+         rect->x += dest_x;
+         rect->y += dest_y;
       }
    }
 
@@ -281,112 +489,221 @@ static void vid_blitscreen(int num_dirties, rect_t *dirty_rects)
       driver->free_write(num_dirties, dirty_rects);
 }
 
-/* TODO: this code is sickly */
-
-#define  CHUNK_WIDTH    256
-#define  CHUNK_HEIGHT   16
-#define  MAX_DIRTIES    ((256 / CHUNK_WIDTH) * (240 / CHUNK_HEIGHT))
-#define  DIRTY_CUTOFF   ((3 * MAX_DIRTIES) / 4)
-
-#if 0
-INLINE int calc_dirties(rect_t *list)
+/* hash the new frame chunk by chunk, and compare against the hashes of
+** the last one.  dirty chunks next to each other on a row are merged into
+** one rectangle.  returns -1 if so much changed that a full blit is
+** cheaper
+*/
+static int calc_dirties(rect_t *list)
 {
-   bool dirty;
-   int num_dirties = 0;
-   int i = 0, j, line_offset = 0;
-   int iterations = primary_buffer->height / CHUNK_HEIGHT;
+   int num_dirties = 0, area = 0;
+   int x, y, j, width, height;
+   uint64_t hash, *last = chunk_hash;
+   rect_t *rect;
 
-   for (i = 0; i < iterations; i++)
+   for (y = 0; y < primary_buffer->height; y += chunk_height)
    {
-      dirty = false;
-
-      j = line_offset;
-      DUFFS_DEVICE(
-      { 
-         if (vid_memcmp(back_buffer->line[j], primary_buffer->line[j], 
-                        CHUNK_WIDTH))
-         { 
-            dirty = true; 
-            break; 
-         } 
-
-         j++; 
-      }, CHUNK_HEIGHT);
-
-      if (true == dirty)
+      height = MIN(chunk_height, primary_buffer->height - y);
+      rect = NULL;
+
+      for (j = y; j < y + height; j++)
+         overlay_used[j] = (false == vid_blankline(overlay->line[j], overlay->width));
+
+      for (x = 0; x < primary_buffer->width; x += chunk_width, last++)
       {
-         list->h = CHUNK_HEIGHT;
-         list->w = CHUNK_WIDTH;
-         list->x = 0;
-         list->y = line_offset;
-         list++;
-
-         /* totally arbitrary at this point */
-         if (++num_dirties > DIRTY_CUTOFF)
-            return -1;
-      }
+         width = MIN(chunk_width, primary_buffer->width - x);
+
+         hash = vid_hasharea(primary_buffer, x, y, width, height, NULL, HASH_PRIME1)
+                ^ vid_hasharea(overlay, x, y, width, height, overlay_used, HASH_PRIME2);
+
+         if (hash == *last)
+         {
+            rect = NULL;
+            continue;
+         }
+
+         *last = hash;
 
-      line_offset += CHUNK_HEIGHT;
+         if (NULL != rect)
+         {
+            rect->w += width;
+         }
+         else
+         {
+            rect = &list[num_dirties++];
+            rect->x = x;
+            rect->y = y;
+            rect->w = width;
+            rect->h = height;
+         }
+
+         area += width * height;
+      }
    }
 
+   if (area > dirty_cutoff)
+      return -1;
+
    return num_dirties;
 }
-#endif
+
+/* room for the worst case of one rectangle per chunk */
+static int vid_allocdirties(void)
+{
+   int rows;
+
+   if (NULL != dirty_rects)
+      free(dirty_rects);
+   if (NULL != chunk_hash)
+      free(chunk_hash);
+
+   chunk_cols = (primary_buffer->width + chunk_width - 1) / chunk_width;
+   rows = (primary_buffer->height + chunk_height - 1) / chunk_height;
+
+   dirty_rects = malloc(chunk_cols * rows * sizeof(rect_t));
+   chunk_hash = malloc(chunk_cols * rows * sizeof(uint64_t));
+   if (NULL == dirty_rects || NULL == chunk_hash)
+      return -1;
+
+   memset(chunk_hash, 0, chunk_cols * rows * sizeof(uint64_t));
+
+   /* totally arbitrary at this point */
+   dirty_cutoff = (3 * primary_buffer->width * primary_buffer->height) / 4;
+   full_refresh = true;
+
+   return 0;
+}
+
+/* set the size of the blocks compared for dirty rectangles */
+int vid_setchunks(int width, int height)
+{
+   if (width < 8 || (width & 7) || height < 1)
+   {
+      log_printf("invalid dirty chunk size %dx%d\n", width, height);
+      return -1;
+   }
+
+   chunk_width = width;
+   chunk_height = height;
+
+   if (NULL != primary_buffer)
+      return vid_allocdirties();
+
+   return 0;
+}
 
 void vid_flush(void)
 {
-   bitmap_t *temp;
-   int num_dirties;
-   rect_t dirty_rects[MAX_DIRTIES];
+   int num_dirties, i;
 
    ASSERT(driver);
 
-   if (true == driver->invalidate)
+   /* hashes need to stay current even if everything is going out */
+   num_dirties = calc_dirties(dirty_rects);
+
+   if (true == driver->invalidate || true == full_refresh)
    {
       driver->invalidate = false;
+      full_refresh = false;
       num_dirties = -1;
    }
-   else
-   {
-      //num_dirties = calc_dirties(dirty_rects);
-      num_dirties = -1;
-   }
+
+   vid_stats.frames++;
 
    if (driver->custom_blit)
-      driver->custom_blit(primary_buffer, num_dirties, dirty_rects);
+   {
+      bitmap_t *over = NULL;
+
+      for (i = 0; i < overlay->height; i++)
+      {
+         if (overlay_used[i])
+            over = overlay;
+      }
+
+      driver->custom_blit(primary_buffer, over, num_dirties, dirty_rects);
+   }
    else
+   {
       vid_blitscreen(num_dirties, dirty_rects);
+   }
 
-   /* Swap pointers to the main/back buffers */
-   temp = back_buffer;
-   back_buffer = primary_buffer;
-   primary_buffer = temp;
+   /* the GUI draws a fresh overlay every frame */
+   for (i = 0; i < overlay->height; i++)
+   {
+      if (overlay_used[i])
+         memset(overlay->line[i], VID_TRANSPARENT, overlay->width);
+   }
 }
 
-/* emulated machine tells us which resolution it wants */
-int vid_setmode(int width, int height)
+static void vid_freebuffers(void)
 {
    if (NULL != primary_buffer)
       bmp_destroy(&primary_buffer);
-   if (NULL != back_buffer)
-      bmp_destroy(&back_buffer);
+   if (NULL != frame_buffer)
+      bmp_destroy(&frame_buffer);
+   if (NULL != overlay)
+      bmp_destroy(&overlay);
 
-   primary_buffer = bmp_create(width, height, 0); /* no overdraw */
-   if (NULL == primary_buffer)
-      return -1;
+   if (NULL != overlay_used)
+   {
+      free(overlay_used);
+      overlay_used = NULL;
+   }
 
-   /* Create our backbuffer */
-   back_buffer = bmp_create(width, height, 0); /* no overdraw */
-   if (NULL == back_buffer)
+   if (NULL != chunk_hash)
    {
-      bmp_destroy(&primary_buffer);
-      return -1;
+      free(chunk_hash);
+      chunk_hash = NULL;
    }
 
-   bmp_clear(primary_buffer, GUI_BLACK);
-   bmp_clear(back_buffer, GUI_BLACK);
+   if (NULL != dirty_rects)
+   {
+      free(dirty_rects);
+      dirty_rects = NULL;
+   }
+}
+
+/* emulated machine tells us which resolution it renders at, and how far
+** it may draw past either side of a line.  it gets a frame of that size
+** to draw into, and as much of it as fits is shown
+*/
+int vid_setmode(int width, int height, int overdraw)
+{
+   int view_width, view_height;
+
+   vid_freebuffers();
+
+   frame_buffer = bmp_create(width, height, overdraw);
+   if (NULL == frame_buffer)
+      goto _fail;
+
+   view_width = MIN(width, screen_width);
+   view_height = MIN(height, screen_height);
+
+   primary_buffer = bmp_createhw(frame_buffer->line[(height - view_height) >> 1]
+                                 + ((width - view_width) >> 1),
+                                 view_width, view_height, frame_buffer->pitch);
+   if (NULL == primary_buffer)
+      goto _fail;
+
+   /* the GUI gets a layer of its own, the same size as what is shown */
+   overlay = bmp_create(view_width, view_height, 0); /* no overdraw */
+   overlay_used = malloc(view_height * sizeof(bool));
+   if (NULL == overlay || NULL == overlay_used)
+      goto _fail;
+
+   bmp_clear(frame_buffer, GUI_BLACK);
+   bmp_clear(overlay, VID_TRANSPARENT);
+   memset(overlay_used, 0, view_height * sizeof(bool));
+
+   if (vid_allocdirties())
+      goto _fail;
 
    return 0;
+
+_fail:
+   vid_freebuffers();
+   return -1;
 }
 
 static int vid_findmode(int width, int height, viddriver_t *osd_driver)
@@ -413,6 +730,9 @@ static int vid_findmode(int width, int height, viddriver_t *osd_driver)
    if (driver->free_write)
       driver->free_write(-1, NULL);
 
+   screen_width = screen->width;
+   screen_height = screen->height;
+
    log_printf("video driver: %s at %dx%d\n", driver->name,
               screen->width, screen->height);
 
@@ -422,6 +742,14 @@ static int vid_findmode(int width, int height, viddriver_t *osd_driver)
 /* This is the interface to the drivers, used in nofrendo.c */
 int vid_init(int width, int height, viddriver_t *osd_driver)
 {
+#ifdef VID_X86
+   if (__builtin_cpu_supports("avx2"))
+      vid_convert32 = convert32_avx2;
+#endif /* VID_X86 */
+
+   vid_setchunks(config.read_int("video", "chunk_width", CHUNK_WIDTH),
+                 config.read_int("video", "chunk_height", CHUNK_HEIGHT));
+
    if (vid_findmode(width, height, osd_driver))
    {
       log_printf("video initialization failed for %s at %dx%d\n",
@@ -437,10 +765,14 @@ void vid_shutdown(void)
    if (NULL == driver)
       return;
 
-   if (NULL != primary_buffer)
-      bmp_destroy(&primary_buffer);
-   if (NULL != back_buffer)
-      bmp_destroy(&back_buffer);
+   if (vid_stats.frames)
+   {
+      log_printf("video: %d frames, %d full blits, %d bytes blitted per frame\n",
+                 vid_stats.frames, vid_stats.full_blits,
+                 (int) (vid_stats.bytes / vid_stats.frames));
+   }
+
+   vid_freebuffers();
 
    if (driver && driver->shutdown)
       driver->shutdown();
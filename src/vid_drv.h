@@ -28,6 +28,9 @@
 
 #include <bitmap.h>
 
+/* overlay pixels of this color let the frame underneath show through */
+#define  VID_TRANSPARENT   0xFF
+
 typedef struct viddriver_s
 {
    /* name of driver */
@@ -44,22 +47,36 @@ typedef struct viddriver_s
    void      (*clear)(uint8 color);
    /* lock surface for writing (required) */
    bitmap_t *(*lock_write)(void);
-   /* free a locked surface (can be NULL) */
+   /* free a locked surface (can be NULL) - num_dirties == -1 if the
+   ** whole surface was written, otherwise dirty_rects lists the areas
+   ** that changed, in surface coordinates
+   */
    void      (*free_write)(int num_dirties, rect_t *dirty_rects);
-   /* custom blitter - num_dirties == -1 if full blit required */
-   void      (*custom_blit)(bitmap_t *primary, int num_dirties, 
-                            rect_t *dirty_rects);
+   /* custom blitter - num_dirties == -1 if full blit required,
+   ** dirty_rects are in primary buffer coordinates.  overlay is the
+   ** same size as primary, and goes on top of it (NULL if empty)
+   */
+   void      (*custom_blit)(bitmap_t *primary, bitmap_t *overlay,
+                            int num_dirties, rect_t *dirty_rects);
    /* immediately invalidate the buffer, i.e. full redraw */
    bool      invalidate;
 } viddriver_t;
 
+/* palette lookup of length 8-bit pixels, with an optional overlay */
+typedef void (*vidconvert_t)(uint32 *dest, const uint8 *src, const uint8 *overlay,
+                             const uint32 *palette, int length);
+
+extern vidconvert_t vid_convert32;
+
 /* TODO: filth */
 extern bitmap_t *vid_getbuffer(void);
+extern bitmap_t *vid_getframe(void);
 
 extern int  vid_init(int width, int height, viddriver_t *osd_driver);
 extern void vid_shutdown(void);
 
-extern int  vid_setmode(int width, int height);
+extern int  vid_setmode(int width, int height, int overdraw);
+extern int  vid_setchunks(int width, int height);
 extern void vid_setpalette(rgb_t *pal);
 
 extern void vid_blit(bitmap_t *bitmap, int src_x, int src_y, int dest_x, 
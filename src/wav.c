@@ -0,0 +1,152 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** wav.c
+**
+** WAV format sound-saving routines
+** $Id$
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <noftypes.h>
+#include <wav.h>
+
+static void wav_put16(uint8 *dest, uint32 value)
+{
+   dest[0] = (uint8) value;
+   dest[1] = (uint8) (value >> 8);
+}
+
+static void wav_put32(uint8 *dest, uint32 value)
+{
+   wav_put16(dest, value);
+   wav_put16(dest + 2, value >> 16);
+}
+
+/* mono PCM: a RIFF chunk holding a format chunk and the data chunk */
+static int wav_putheader(wav_t *wav)
+{
+   uint8 header[WAV_HEADER_LENGTH];
+   uint32 data_length, block_align;
+
+   block_align = wav->sample_bits / 8;
+   data_length = wav->num_samples * block_align;
+
+   memcpy(header, "RIFF", 4);
+   wav_put32(header + 4, WAV_HEADER_LENGTH - 8 + data_length);
+   memcpy(header + 8, "WAVEfmt ", 8);
+   wav_put32(header + 16, 16);
+   wav_put16(header + 20, 1); /* PCM */
+   wav_put16(header + 22, 1); /* mono */
+   wav_put32(header + 24, wav->sample_rate);
+   wav_put32(header + 28, wav->sample_rate * block_align);
+   wav_put16(header + 32, block_align);
+   wav_put16(header + 34, wav->sample_bits);
+   memcpy(header + 36, "data", 4);
+   wav_put32(header + 40, data_length);
+
+   if (fseek(wav->fp, 0, SEEK_SET)
+       || 1 != fwrite(header, WAV_HEADER_LENGTH, 1, wav->fp))
+      return -1;
+
+   return 0;
+}
+
+/* start a WAV file; the header is filled in for real on close */
+wav_t *wav_open(const char *filename, int sample_rate, int sample_bits)
+{
+   wav_t *wav;
+
+   ASSERT(8 == sample_bits || 16 == sample_bits);
+
+   wav = malloc(sizeof(wav_t));
+   if (NULL == wav)
+      return NULL;
+
+   wav->sample_rate = sample_rate;
+   wav->sample_bits = sample_bits;
+   wav->num_samples = 0;
+
+   wav->fp = fopen(filename, "wb");
+   if (NULL == wav->fp)
+      goto _fail;
+
+   if (wav_putheader(wav))
+      goto _fail;
+
+   return wav;
+
+_fail:
+   if (NULL != wav->fp)
+      fclose(wav->fp);
+   free(wav);
+   return NULL;
+}
+
+/* samples are unsigned 8-bit or signed 16-bit, as the apu makes them */
+int wav_write(wav_t *wav, const void *data, int num_samples)
+{
+   ASSERT(wav);
+
+#ifdef HOST_LITTLE_ENDIAN
+   if (num_samples != (int) fwrite(data, wav->sample_bits / 8, num_samples, wav->fp))
+      return -1;
+#else /* !HOST_LITTLE_ENDIAN */
+   if (16 == wav->sample_bits)
+   {
+      const uint16 *src = data;
+      uint8 bytes[2];
+      int i;
+
+      for (i = 0; i < num_samples; i++)
+      {
+         wav_put16(bytes, src[i]);
+         if (1 != fwrite(bytes, 2, 1, wav->fp))
+            return -1;
+      }
+   }
+   else if (num_samples != (int) fwrite(data, 1, num_samples, wav->fp))
+   {
+      return -1;
+   }
+#endif /* !HOST_LITTLE_ENDIAN */
+
+   wav->num_samples += num_samples;
+   return 0;
+}
+
+/* fix up the header's lengths and close */
+int wav_close(wav_t **wav)
+{
+   int retval;
+
+   if (NULL == *wav)
+      return 0;
+
+   retval = wav_putheader(*wav);
+   if (fclose((*wav)->fp))
+      retval = -1;
+
+   free(*wav);
+   *wav = NULL;
+
+   return retval;
+}
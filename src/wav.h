@@ -0,0 +1,46 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** wav.h
+**
+** WAV format sound-saving routines
+** $Id$
+*/
+
+#ifndef _WAV_H_
+#define _WAV_H_
+
+#include <stdio.h>
+#include <noftypes.h>
+
+#define  WAV_HEADER_LENGTH    44
+
+typedef struct wav_s
+{
+   FILE *fp;
+   int sample_rate;
+   int sample_bits;
+   uint32 num_samples;
+} wav_t;
+
+extern wav_t *wav_open(const char *filename, int sample_rate, int sample_bits);
+extern int wav_write(wav_t *wav, const void *data, int num_samples);
+extern int wav_close(wav_t **wav);
+
+#endif /* _WAV_H_ */
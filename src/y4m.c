@@ -0,0 +1,165 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** y4m.c
+**
+** YUV4MPEG2 video-saving routines
+** $Id$
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <noftypes.h>
+#include <bitmap.h>
+#include <y4m.h>
+
+/* start a stream of 4:2:0 frames, rate a second; width and height must
+** be even
+*/
+y4m_t *y4m_open(const char *filename, int width, int height, int rate)
+{
+   y4m_t *y4m;
+
+   ASSERT(0 == (width & 1) && 0 == (height & 1));
+
+   y4m = malloc(sizeof(y4m_t));
+   if (NULL == y4m)
+      return NULL;
+
+   y4m->width = width;
+   y4m->height = height;
+   y4m->num_frames = 0;
+   y4m->fp = NULL;
+
+   y4m->planes = malloc(width * height * 3 / 2);
+   if (NULL == y4m->planes)
+      goto _fail;
+
+   /* black, until there's a frame to repeat */
+   memset(y4m->planes, 16, width * height);
+   memset(y4m->planes + width * height, 128, width * height / 2);
+
+   y4m->fp = fopen(filename, "wb");
+   if (NULL == y4m->fp)
+      goto _fail;
+
+   if (fprintf(y4m->fp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+               width, height, rate) < 0)
+      goto _fail;
+
+   return y4m;
+
+_fail:
+   if (NULL != y4m->fp)
+      fclose(y4m->fp);
+   if (y4m->planes)
+      free(y4m->planes);
+   free(y4m);
+   return NULL;
+}
+
+/* the top left of an 8-bit bitmap, in the colors pal gives it; chroma
+** is the average of each 2x2 block
+*/
+int y4m_write(y4m_t *y4m, const bitmap_t *bmp, const rgb_t *pal)
+{
+   uint8 lut_y[256];
+   int16 lut_u[256], lut_v[256];
+   uint8 *dest_y, *dest_u, *dest_v;
+   const uint8 *src0, *src1;
+   int x, y, i, r, g, b;
+   int chroma_length = (y4m->width / 2) * (y4m->height / 2);
+
+   ASSERT(y4m);
+   ASSERT(bmp->width >= y4m->width && bmp->height >= y4m->height);
+
+   /* BT.601, studio range */
+   for (i = 0; i < 256; i++)
+   {
+      r = pal[i].r;
+      g = pal[i].g;
+      b = pal[i].b;
+      lut_y[i] = (uint8) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+      lut_u[i] = (int16) ((-38 * r - 74 * g + 112 * b + 128) >> 8);
+      lut_v[i] = (int16) ((112 * r - 94 * g - 18 * b + 128) >> 8);
+   }
+
+   dest_y = y4m->planes;
+   dest_u = dest_y + y4m->width * y4m->height;
+   dest_v = dest_u + chroma_length;
+
+   for (y = 0; y < y4m->height; y += 2)
+   {
+      src0 = bmp->line[y];
+      src1 = bmp->line[y + 1];
+
+      for (x = 0; x < y4m->width; x += 2)
+      {
+         dest_y[x] = lut_y[src0[x]];
+         dest_y[x + 1] = lut_y[src0[x + 1]];
+         dest_y[y4m->width + x] = lut_y[src1[x]];
+         dest_y[y4m->width + x + 1] = lut_y[src1[x + 1]];
+
+         *dest_u++ = (uint8) (128 + ((lut_u[src0[x]] + lut_u[src0[x + 1]]
+                                     + lut_u[src1[x]] + lut_u[src1[x + 1]] + 2) >> 2));
+         *dest_v++ = (uint8) (128 + ((lut_v[src0[x]] + lut_v[src0[x + 1]]
+                                     + lut_v[src1[x]] + lut_v[src1[x + 1]] + 2) >> 2));
+      }
+
+      dest_y += y4m->width * 2;
+   }
+
+   if (6 != fwrite("FRAME\n", 1, 6, y4m->fp)
+       || 1 != fwrite(y4m->planes, y4m->width * y4m->height + chroma_length * 2, 1, y4m->fp))
+      return -1;
+
+   y4m->num_frames++;
+   return 0;
+}
+
+/* the last frame again, for one there was no picture for */
+int y4m_repeat(y4m_t *y4m)
+{
+   ASSERT(y4m);
+
+   if (6 != fwrite("FRAME\n", 1, 6, y4m->fp)
+       || 1 != fwrite(y4m->planes, y4m->width * y4m->height * 3 / 2, 1, y4m->fp))
+      return -1;
+
+   y4m->num_frames++;
+   return 0;
+}
+
+int y4m_close(y4m_t **y4m)
+{
+   int retval = 0;
+
+   if (NULL == *y4m)
+      return 0;
+
+   if (fclose((*y4m)->fp))
+      retval = -1;
+
+   free((*y4m)->planes);
+   free(*y4m);
+   *y4m = NULL;
+
+   return retval;
+}
@@ -0,0 +1,46 @@
+/*
+** Nofrendo (c) 1998-2000 Matthew Conte (matt@conte.com)
+**
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of version 2 of the GNU Library General
+** Public License as published by the Free Software Foundation.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Library General Public License for more details.  To obtain a
+** copy of the GNU Library General Public License, write to the Free
+** Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+** Any permitted reproduction of these routines, in whole or in part,
+** must bear this legend.
+**
+**
+** y4m.h
+**
+** YUV4MPEG2 video-saving routines
+** $Id$
+*/
+
+#ifndef _Y4M_H_
+#define _Y4M_H_
+
+#include <stdio.h>
+#include <noftypes.h>
+#include <bitmap.h>
+
+typedef struct y4m_s
+{
+   FILE *fp;
+   int width, height;
+   uint32 num_frames;
+   uint8 *planes;       /* a frame's worth of Y, then U, then V */
+} y4m_t;
+
+extern y4m_t *y4m_open(const char *filename, int width, int height, int rate);
+extern int y4m_write(y4m_t *y4m, const bitmap_t *bmp, const rgb_t *pal);
+extern int y4m_repeat(y4m_t *y4m);
+extern int y4m_close(y4m_t **y4m);
+
+#endif /* _Y4M_H_ */